@@ -0,0 +1,153 @@
+/* Minimal benchmark harness shared by the bench/ programs (header only: every bench is its own binary).
+ *
+ * A BenchCase collects one latency sample per timed call. bench_report_* print a table
+ * and a JSON document with p50/p99 latencies and throughput, e.g.
+ *   {"suite":"provision","version":"v1.2-3-gabc","timestamp":1760000000,"results":[
+ *     {"name":"keygen/p256","iterations":200,"p50_us":41.2,"p99_us":77.0,...}]}
+ * so results can be compared across versions. Includers define _DEFAULT_SOURCE first.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+#define BENCH_MAX_CASES 64
+
+typedef struct {
+    char name[64];
+    double *samples;        /* seconds per call */
+    size_t n, cap;
+    double bytes_per_call;  /* for MB/s, 0 if not meaningful */
+    double items_per_call;  /* work items per call (e.g. rules), 1 by default */
+} BenchCase;
+
+typedef struct {
+    const char *suite;
+    BenchCase cases[BENCH_MAX_CASES];
+    size_t ncases;
+} BenchReport;
+
+typedef int (*BenchFn)(void *ctx);
+
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline BenchCase *bench_case(BenchReport *r, const char *name) {
+    if (r->ncases == BENCH_MAX_CASES) return NULL;
+    BenchCase *c = &r->cases[r->ncases++];
+    memset(c, 0, sizeof(*c));
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->items_per_call = 1;
+    return c;
+}
+
+static inline void bench_sample(BenchCase *c, double seconds) {
+    if (c->n == c->cap) {
+        size_t cap = c->cap ? c->cap * 2 : 64;
+        double *s = realloc(c->samples, cap * sizeof(double));
+        if (!s) return;
+        c->samples = s;
+        c->cap = cap;
+    }
+    c->samples[c->n++] = seconds;
+}
+
+/* Time `iters` calls of fn after `warmup` untimed ones. Returns 0 or fn's first error. */
+static inline int bench_run(BenchReport *r, const char *name, int warmup, int iters, BenchFn fn, void *ctx) {
+    BenchCase *c = bench_case(r, name);
+    if (!c) return -1;
+    for (int i = 0; i < warmup; i++) {
+        int rc = fn(ctx);
+        if (rc) return rc;
+    }
+    for (int i = 0; i < iters; i++) {
+        double t0 = bench_now();
+        int rc = fn(ctx);
+        bench_sample(c, bench_now() - t0);
+        if (rc) {
+            fprintf(stderr, "bench %s failed: %d\n", name, rc);
+            return rc;
+        }
+    }
+    return 0;
+}
+
+/* Attach throughput information to the most recent case */
+static inline void bench_set_work(BenchReport *r, double bytes_per_call, double items_per_call) {
+    if (!r->ncases) return;
+    r->cases[r->ncases - 1].bytes_per_call = bytes_per_call;
+    r->cases[r->ncases - 1].items_per_call = items_per_call > 0 ? items_per_call : 1;
+}
+
+static int bench_cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+typedef struct {
+    double mean, p50, p99, min, max, ops, mbps;
+} BenchStats;
+
+static inline BenchStats bench_stats(BenchCase *c) {
+    BenchStats s = { 0 };
+    if (!c->n) return s;
+    qsort(c->samples, c->n, sizeof(double), bench_cmp_double);
+    double total = 0;
+    for (size_t i = 0; i < c->n; i++) total += c->samples[i];
+    s.mean = total / c->n;
+    s.p50 = c->samples[(c->n - 1) / 2];
+    s.p99 = c->samples[(size_t)((c->n - 1) * 0.99)];
+    s.min = c->samples[0];
+    s.max = c->samples[c->n - 1];
+    s.ops = total > 0 ? c->n * c->items_per_call / total : 0;
+    s.mbps = total > 0 && c->bytes_per_call > 0 ? c->n * c->bytes_per_call / total / 1e6 : 0;
+    return s;
+}
+
+static inline void bench_report_table(BenchReport *r, FILE *out) {
+    fprintf(out, "%-26s %7s %11s %11s %11s %12s %9s\n", "CASE", "N", "p50 us", "p99 us", "mean us", "items/s", "MB/s");
+    for (size_t i = 0; i < r->ncases; i++) {
+        BenchCase *c = &r->cases[i];
+        BenchStats s = bench_stats(c);
+        fprintf(out, "%-26s %7zu %11.1f %11.1f %11.1f %12.1f", c->name, c->n, s.p50 * 1e6, s.p99 * 1e6,
+                s.mean * 1e6, s.ops);
+        if (s.mbps > 0) fprintf(out, " %9.1f\n", s.mbps);
+        else fprintf(out, " %9s\n", "-");
+    }
+}
+
+static inline void bench_report_json(BenchReport *r, FILE *out) {
+    char host[128] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    fprintf(out, "{\"suite\":\"%s\",\"version\":\"%s\",\"host\":\"%s\",\"timestamp\":%ld,\"results\":[",
+            r->suite, BENCH_VERSION, host, (long)time(NULL));
+    for (size_t i = 0; i < r->ncases; i++) {
+        BenchCase *c = &r->cases[i];
+        BenchStats s = bench_stats(c);
+        fprintf(out, "%s\n  {\"name\":\"%s\",\"iterations\":%zu,\"p50_us\":%.3f,\"p99_us\":%.3f,"
+                     "\"mean_us\":%.3f,\"min_us\":%.3f,\"max_us\":%.3f,\"items_per_sec\":%.3f",
+                i ? "," : "", c->name, c->n, s.p50 * 1e6, s.p99 * 1e6, s.mean * 1e6, s.min * 1e6,
+                s.max * 1e6, s.ops);
+        if (s.mbps > 0) fprintf(out, ",\"mb_per_sec\":%.3f", s.mbps);
+        fprintf(out, "}");
+    }
+    fprintf(out, "\n]}\n");
+}
+
+static inline void bench_report_free(BenchReport *r) {
+    for (size_t i = 0; i < r->ncases; i++) free(r->cases[i].samples);
+    r->ncases = 0;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,186 @@
+/* Fleet audit: devices/s for a rack of image files at several I/O and verifier pool sizes.
+ *
+ *   build/bench/bench_audit [devices]
+ *
+ * Provisions n disk-image files with a throw-away P-256 CA: most with a valid certificate
+ * for their own identity, and a known share expired, issued for another device, signed
+ * by a foreign CA, or without USB_SIG at all. Each configuration audits the whole rack
+ * and must report exactly the expected status for every image. A USBGuard entry of the
+ * same model must not stand in for a stick whose serial USBGuard does not list.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "audit.h"
+#include "ca_signer.h"
+#include "cert_gen.h"
+#include "embed_cert.h"
+
+#include <fcntl.h>
+
+#define IMAGE_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+    AuditConfig cfg;
+    const char *const *devices;
+    const VerifyStatus *expected;
+    size_t n;
+    AuditDevice *results;
+} Ctx;
+
+static int do_audit(void *p) {
+    Ctx *c = p;
+    AuditSummary sum;
+    if (audit_run(&c->cfg, c->devices, c->n, c->results, &sum) != 0) return -1;
+    for (size_t i = 0; i < c->n; i++) {
+        if (c->results[i].verify.status != c->expected[i]) {
+            fprintf(stderr, "%s: %s, expected %s\n", c->devices[i], cert_verify_status_name(c->results[i].verify.status),
+                    cert_verify_status_name(c->expected[i]));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Sign a certificate for the identity of `for_path` and embed it into `path`. With
+ * ca_key the validity is moved into the past and the certificate re-signed with that
+ * key (the signer refuses to issue expired certificates). */
+static int provision(const char *path, const char *for_path, CaSigner *signer, EVP_PKEY *ca_key) {
+    UsbDeviceInfo *info = usb_info_from_block_device(for_path);
+    EVP_PKEY *key = certgen_generate_key_alg(KEY_ALG_EC_P256);
+    X509_REQ *req = key && info ? certgen_build_csr(key, info) : NULL;
+    X509 *cert = req ? ca_signer_sign(signer, req, 365) : NULL;
+    if (cert && ca_key) {
+        X509_gmtime_adj(X509_getm_notBefore(cert), -2L * 86400);
+        X509_gmtime_adj(X509_getm_notAfter(cert), -1L * 86400);
+        if (X509_sign(cert, ca_key, EVP_sha256()) <= 0) {
+            X509_free(cert);
+            cert = NULL;
+        }
+    }
+    int rc = cert ? embed_cert_x509(path, cert, NULL, 0) : -1;
+    X509_free(cert);
+    X509_REQ_free(req);
+    EVP_PKEY_free(key);
+    usb_info_free(info);
+    return rc;
+}
+
+static UsbDeviceInfo *guard_entry(const char *serial) {
+    UsbDeviceInfo *d = usb_info_create();
+    if (!d) return NULL;
+    usb_info_set_id(d, "0781", "5581");
+    if (serial) usb_info_set_serial(d, serial);
+    return d;
+}
+
+/* serial match, no VID:PID fallback for a listed model with another serial, VID:PID for a
+ * serial-less stick only while it is unambiguous */
+static int check_guard_match(void) {
+    UsbDeviceList *list = usbguard_device_list_create(0);
+    UsbDeviceInfo *listed = guard_entry("LISTED"), *other = guard_entry("OTHER"), *bare = guard_entry(NULL);
+    int rc = list && listed && other && bare && usbguard_device_list_append(list, listed) == 0 ? 0 : -1;
+    if (rc != 0) {
+        usb_info_free(listed);
+        listed = NULL;
+    }
+    if (rc == 0 && (cert_verify_match_usbguard(list, listed) != listed ||
+                    cert_verify_match_usbguard(list, other) != NULL ||
+                    cert_verify_match_usbguard(list, bare) != listed)) rc = -1;
+    UsbDeviceInfo *twin = rc == 0 ? guard_entry("TWIN") : NULL;
+    if (rc == 0 && (!twin || usbguard_device_list_append(list, twin) != 0)) {
+        usb_info_free(twin);
+        rc = -1;
+    }
+    if (rc == 0 && cert_verify_match_usbguard(list, bare) != NULL) rc = -1;
+    if (rc != 0) fprintf(stderr, "USBGuard entry matching failed\n");
+    usb_info_free(other);
+    usb_info_free(bare);
+    usbguard_free_device_list(list);
+    return rc;
+}
+
+static CaSigner *make_ca(const char *dir, const char *name, int keep_crt, char *crt, size_t crtsz,
+                         EVP_PKEY **ca_key) {
+    char key[256];
+    snprintf(crt, crtsz, "%s/%s.crt", dir, name);
+    snprintf(key, sizeof(key), "%s/%s.key", dir, name);
+    CaSigner *s = certgen_generate_ca(KEY_ALG_EC_P256, name, 1, crt, key) == 0 ? ca_signer_create(crt, key) : NULL;
+    X509 *ca_cert = NULL;
+    if (s && ca_key && certgen_load_ca(crt, key, &ca_cert, ca_key) != 0) *ca_key = NULL;
+    X509_free(ca_cert);
+    unlink(key);
+    if (!keep_crt) unlink(crt);
+    return s;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 128;
+    if (n < 8) n = 8;
+    char dir[] = "/tmp/bench_audit.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char ca_crt[256], other_crt[256];
+    EVP_PKEY *ca_key = NULL;
+    CaSigner *ca = make_ca(dir, "ca", 1, ca_crt, sizeof(ca_crt), &ca_key);
+    CaSigner *other = make_ca(dir, "other", 0, other_crt, sizeof(other_crt), NULL);
+
+    char **paths = calloc(n, sizeof(*paths));
+    VerifyStatus *expected = calloc(n, sizeof(*expected));
+    AuditDevice *results = calloc(n, sizeof(*results));
+    int rc = ca && ca_key && other && paths && expected && results ? 0 : -1;
+    for (size_t i = 0; i < n && rc == 0; i++) {
+        paths[i] = malloc(64);
+        if (!paths[i]) { rc = -1; break; }
+        snprintf(paths[i], 64, "%s/stick%04zu.img", dir, i);
+        int fd = open(paths[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, IMAGE_BYTES) != 0) rc = -1;
+        if (fd >= 0) close(fd);
+    }
+    /* 1 in 8 of each failure kind, the rest valid */
+    for (size_t i = 0; i < n && rc == 0; i++) {
+        switch (i % 8) {
+        case 1: expected[i] = VERIFY_EXPIRED;   rc = provision(paths[i], paths[i], ca, ca_key); break;
+        case 3: expected[i] = VERIFY_MISBOUND;  rc = provision(paths[i], paths[(i + 1) % n], ca, NULL); break;
+        case 5: expected[i] = VERIFY_BAD_CHAIN; rc = provision(paths[i], paths[i], other, NULL); break;
+        case 7: expected[i] = VERIFY_NO_CERT;   break;
+        default: expected[i] = VERIFY_OK;       rc = provision(paths[i], paths[i], ca, NULL); break;
+        }
+    }
+    if (rc != 0) fprintf(stderr, "cannot provision the image rack in %s\n", dir);
+
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    static const struct { const char *name; int io, verify; } RUNS[] = {
+        { "audit/io1-verify1", 1, 1 },
+        { "audit/io4-verify1", 4, 1 },
+        { "audit/io4-verifyN", 4, 0 },
+        { "audit/io16-verifyN", 16, 0 },
+    };
+    BenchReport r = { .suite = "audit" };
+    Ctx c = { .devices = (const char *const *)paths, .expected = expected, .n = n, .results = results };
+    printf("%zu images, %d CPU(s)\n", n, cpus);
+    for (size_t i = 0; i < sizeof(RUNS) / sizeof(RUNS[0]) && rc == 0; i++) {
+        audit_config_init(&c.cfg);
+        c.cfg.ca_cert_path = ca_crt;
+        c.cfg.io_workers = RUNS[i].io;
+        c.cfg.verify_workers = RUNS[i].verify;
+        rc = bench_run(&r, RUNS[i].name, 1, 5, do_audit, &c);
+        bench_set_work(&r, 0, (double)n);
+    }
+    if (rc == 0) bench_report_table(&r, stdout);
+    bench_report_free(&r);
+    if (rc == 0) rc = check_guard_match();
+
+    for (size_t i = 0; paths && i < n; i++) {
+        if (paths[i]) unlink(paths[i]);
+        free(paths[i]);
+    }
+    unlink(ca_crt);
+    rmdir(dir);
+    free(paths);
+    free(expected);
+    free(results);
+    ca_signer_free(ca);
+    ca_signer_free(other);
+    EVP_PKEY_free(ca_key);
+    printf("%s\n", rc == 0 ? "OK" : "FAIL");
+    return rc != 0;
+}
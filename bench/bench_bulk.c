@@ -0,0 +1,107 @@
+/* Offline bulk issuance: throughput and memory for growing manifests.
+ *
+ *   build/bench/bench_bulk [devices] [workers]
+ *
+ * Issues P-256 device certificates (fresh P-256 CA) for a synthetic manifest of n and
+ * 4n devices and reports certificates/s and the peak RSS growth of each run: with the
+ * bounded in-flight window the 4n run must not need noticeably more memory than the n
+ * run. The bundle is read back to check every device came out once, in manifest order.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "bulk_issue.h"
+#include "cert_gen.h"
+
+#include <sys/resource.h>
+
+static long peak_rss_kb(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+static int write_manifest(const char *path, size_t n) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "id,name,serial\n");
+    for (size_t i = 0; i < n; i++) {
+        if (i % 2) fprintf(f, "0781:%04zx,SanDisk Ultra,4C5300%014zu\n", 0x5500 + i % 256, i);
+        else fprintf(f, "{\"id\":\"0951:1666\",\"name\":\"DataTraveler\",\"serial\":\"E0D5%016zu\"}\n", i);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* Every line must be a success for manifest line i + 2, in order */
+static int check_bundle(const char *path, size_t n) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    char *line = NULL;
+    size_t cap = 0, seen = 0;
+    int bad = 0;
+    while (getline(&line, &cap, f) >= 0) {
+        unsigned long long ln = 0;
+        if (sscanf(line, "{\"line\":%llu", &ln) != 1 || ln != seen + 2 || strstr(line, "\"error\"") ||
+            !strstr(line, "\"cert\":")) bad = 1;
+        seen++;
+    }
+    free(line);
+    fclose(f);
+    return bad || seen != n ? -1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000;
+    int workers = argc > 2 ? atoi(argv[2]) : 0;
+    if (n < 1) n = 1;
+    char dir[] = "/tmp/bench_bulk.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char crt[128], key[128], manifest[128], bundle[128];
+    snprintf(crt, sizeof(crt), "%s/ca.crt", dir);
+    snprintf(key, sizeof(key), "%s/ca.key", dir);
+    snprintf(manifest, sizeof(manifest), "%s/manifest.csv", dir);
+    snprintf(bundle, sizeof(bundle), "%s/bundle.jsonl", dir);
+    int fail = certgen_generate_ca(KEY_ALG_EC_P256, "bench CA", 1, crt, key) != 0;
+
+    BulkConfig cfg;
+    bulk_config_init(&cfg);
+    cfg.ca_cert_path = crt;
+    cfg.ca_key_path = key;
+    cfg.key_alg = KEY_ALG_EC_P256;
+    cfg.workers = workers;
+
+    long rss_before = peak_rss_kb(), growth[2] = { 0, 0 };
+    for (int run = 0; run < 2 && !fail; run++) {
+        size_t count = run ? 4 * n : n;
+        FILE *in = NULL, *out = NULL;
+        fail = write_manifest(manifest, count) != 0 || !(in = fopen(manifest, "r")) || !(out = fopen(bundle, "w"));
+        BulkStats st;
+        int rc = fail ? -1 : bulk_issue(&cfg, in, out, &st);
+        if (in) fclose(in);
+        if (out && fclose(out) != 0) rc = -1;
+        if (rc != 0 || st.issued != count) {
+            fprintf(stderr, "bulk_issue: %d\n", rc);
+            fail = 1;
+            break;
+        }
+        fail = check_bundle(bundle, count) != 0;
+        long rss = peak_rss_kb();
+        growth[run] = rss - rss_before;
+        rss_before = rss;
+        printf("bulk     %7zu devices: %8.1f certificates/s, %llu in flight max, peak RSS +%ld KB%s\n",
+               count, st.issued / st.seconds, (unsigned long long)st.max_in_flight, growth[run],
+               fail ? "  (bundle check FAILED)" : "");
+    }
+    /* the second, 4x larger run may not raise the peak by more than a few MB */
+    if (!fail && growth[1] > 8 * 1024) {
+        fprintf(stderr, "memory grows with the manifest size\n");
+        fail = 1;
+    }
+
+    unlink(crt);
+    unlink(key);
+    unlink(manifest);
+    unlink(bundle);
+    rmdir(dir);
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
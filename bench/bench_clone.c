@@ -0,0 +1,113 @@
+/* Golden-image cloner: MB/s for a sparse image, sparse-aware vs dense, and content check.
+ *
+ *   build/bench/bench_clone [image MiB] [data %]
+ *
+ * Builds a sparse golden image (random data extents, some explicit zero runs, holes
+ * elsewhere) and clones it into the USB_DATA partition of a disk-image file: sparse-aware
+ * into a fresh target, sparse-aware over a target full of old data (holes must be zeroed),
+ * and dense (every byte read and written) for comparison, at two chunk sizes. After each
+ * run the partition is compared with the image.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "image_clone.h"
+
+#include <fcntl.h>
+
+#define MIB (1024ull * 1024)
+#define DATA_OFFSET (2 * MIB)   /* USB_DATA starts at 2 MiB */
+
+static int fill_random(int fd, uint64_t off, uint64_t len, uint64_t *rng) {
+    static unsigned char buf[MIB];
+    while (len > 0) {
+        for (size_t i = 0; i < sizeof(buf); i += 8) {
+            *rng ^= *rng << 13; *rng ^= *rng >> 7; *rng ^= *rng << 17;
+            memcpy(buf + i, rng, 8);
+        }
+        size_t n = len < sizeof(buf) ? (size_t)len : sizeof(buf);
+        if (pwrite(fd, buf, n, (off_t)off) != (ssize_t)n) return -1;
+        off += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* size MiB, every 8 MiB: pct% random data, one MiB of explicit zeros, the rest a hole */
+static int make_golden(const char *path, uint64_t size_mib, int pct) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)(size_mib * MIB)) != 0) return -1;
+    uint64_t rng = 88172645463325252ull;
+    static const unsigned char zeros[MIB];
+    int rc = 0;
+    for (uint64_t off = 0; off < size_mib * MIB && rc == 0; off += 8 * MIB) {
+        uint64_t data = 8 * MIB * (uint64_t)pct / 100;
+        rc = fill_random(fd, off, data, &rng);
+        if (rc == 0 && off + data + MIB <= size_mib * MIB &&
+            pwrite(fd, zeros, MIB, (off_t)(off + data)) != (ssize_t)MIB) rc = -1;
+    }
+    if (close(fd) != 0) rc = -1;
+    return rc;
+}
+
+static int make_target(const char *path, uint64_t size_mib, int dirty) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)(size_mib * MIB)) != 0) return -1;
+    uint64_t rng = 0x9e3779b97f4a7c15ull;
+    int rc = dirty ? fill_random(fd, 0, size_mib * MIB, &rng) : 0;
+    if (close(fd) != 0) rc = -1;
+    return rc;
+}
+
+static int same_content(const char *target, const char *image, uint64_t len) {
+    int a = open(target, O_RDONLY), b = open(image, O_RDONLY);
+    unsigned char *x = malloc(MIB), *y = malloc(MIB);
+    int rc = a >= 0 && b >= 0 && x && y ? 0 : -1;
+    for (uint64_t off = 0; off < len && rc == 0; off += MIB) {
+        if (pread(a, x, MIB, (off_t)(DATA_OFFSET + off)) != (ssize_t)MIB ||
+            pread(b, y, MIB, (off_t)off) != (ssize_t)MIB || memcmp(x, y, MIB) != 0) rc = -1;
+    }
+    free(x);
+    free(y);
+    if (a >= 0) close(a);
+    if (b >= 0) close(b);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t mib = argc > 1 ? strtoull(argv[1], NULL, 10) : 256;
+    int pct = argc > 2 ? atoi(argv[2]) : 25;
+    if (mib < 8) mib = 8;
+    if (pct < 0 || pct > 87) pct = 25;
+    char dir[] = "/tmp/bench_clone.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char golden[64], target[64];
+    snprintf(golden, sizeof(golden), "%s/golden.img", dir);
+    snprintf(target, sizeof(target), "%s/stick.img", dir);
+    int fail = make_golden(golden, mib, pct) != 0;
+    if (fail) fprintf(stderr, "cannot create %s\n", golden);
+
+    static const struct { const char *name; int dirty; int flags; size_t chunk; } RUNS[] = {
+        { "sparse, fresh target",  0, IMAGE_CLONE_PARTITION | IMAGE_CLONE_NO_ZERO, 0 },
+        { "sparse, used target",   1, IMAGE_CLONE_PARTITION, 0 },
+        { "dense, used target",    1, IMAGE_CLONE_PARTITION | IMAGE_CLONE_DENSE, 0 },
+        { "sparse, 1 MiB chunks",  1, IMAGE_CLONE_PARTITION, MIB },
+        { "dense, 1 MiB chunks",   1, IMAGE_CLONE_PARTITION | IMAGE_CLONE_DENSE, MIB },
+    };
+    printf("golden image %llu MiB, %d%% data\n", (unsigned long long)mib, pct);
+    for (size_t i = 0; i < sizeof(RUNS) / sizeof(RUNS[0]) && !fail; i++) {
+        CloneStats st;
+        fail = make_target(target, mib + 8, RUNS[i].dirty) != 0 ||
+               image_clone_to_device(target, golden, RUNS[i].flags, RUNS[i].chunk, &st) != 0;
+        int ok = !fail && same_content(target, golden, mib * MIB) == 0;
+        printf("  %-22s %8.1f MB/s  %6.2f s  %7.1f MiB written  %7.1f MiB zeroed  %7.1f MiB skipped  %s\n",
+               RUNS[i].name, st.mbps, st.seconds, st.bytes_written / (double)MIB, st.bytes_zeroed / (double)MIB,
+               st.bytes_skipped / (double)MIB, ok ? "content ok" : "CONTENT MISMATCH");
+        if (!ok) fail = 1;
+    }
+
+    unlink(golden);
+    unlink(target);
+    rmdir(dir);
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
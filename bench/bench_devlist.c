@@ -0,0 +1,140 @@
+/* UsbDeviceList construction: heap allocation per object vs one arena per list.
+ *
+ * Counts malloc/calloc/realloc/free calls (by wrapping the glibc allocator) and peak RSS
+ * for building and releasing a synthetic list. Each mode runs in its own child process
+ * so ru_maxrss is not shared. A second part times property lookups of "usbguard_id" and
+ * "raw_info" on every device: linear key scan vs string API vs atom accessors.
+ *
+ *   build/bench/bench_devlist [devices]
+ */
+#define _DEFAULT_SOURCE
+#include "usbguard_interface.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+static size_t g_allocs, g_frees;
+
+void *malloc(size_t n) { g_allocs++; return __libc_malloc(n); }
+void *calloc(size_t a, size_t b) { g_allocs++; return __libc_calloc(a, b); }
+void *realloc(void *p, size_t n) { g_allocs++; return __libc_realloc(p, n); }
+void free(void *p) { if (p) g_frees++; __libc_free(p); }
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char *label, int use_arena, size_t ndev) {
+    /* rules prepared up front so only list construction is counted */
+    char **rules = __libc_malloc(ndev * sizeof(char *));
+    for (size_t i = 0; i < ndev; i++) {
+        char r[512];
+        int len = snprintf(r, sizeof(r),
+                           "block id %04zx:%04zx serial \"SN%08zu\" name \"Flash Drive %zu\" "
+                           "hash \"Ik0pA8dY0gVqH9sQ3lN0Tq+%06zu=\" parent-hash \"jEP/6WzviqdJ5VSeTUY8PatCNBKeaREvo2OqdplND/o=\" "
+                           "via-port \"%zu-%zu\" with-interface { 08:06:50 08:06:62 } with-connect-type \"hotplug\"",
+                           0x0781 + i % 16, 0x5567 + i % 64, i, i, i, i % 4 + 1, i % 8 + 1);
+        rules[i] = __libc_malloc((size_t)len + 1);
+        memcpy(rules[i], r, (size_t)len + 1);
+    }
+    struct rusage ru0;
+    getrusage(RUSAGE_SELF, &ru0);
+
+    g_allocs = g_frees = 0;
+    double t0 = now_seconds();
+    UsbDeviceList *list = usbguard_device_list_create(use_arena);
+    for (size_t i = 0; i < ndev; i++) {
+        UsbDeviceInfo *d = usbguard_device_from_rule_in(list->arena, (unsigned)i, rules[i]);
+        if (!d || usbguard_device_list_append(list, d) != 0) { fprintf(stderr, "out of memory\n"); exit(1); }
+    }
+    double build = now_seconds() - t0;
+    size_t allocs = g_allocs;
+    size_t props = list->devices[ndev - 1]->property_count;
+
+    t0 = now_seconds();
+    usbguard_free_device_list(list);
+    double release = now_seconds() - t0;
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%-6s %8.1f allocs/device  %7.1f ms build  %6.2f ms free  %7ld KiB peak RSS (+%ld)  (%zu props/device, %zu frees)\n",
+           label, (double)allocs / ndev, build * 1e3, release * 1e3, ru.ru_maxrss, ru.ru_maxrss - ru0.ru_maxrss,
+           props, g_frees);
+}
+
+/* the former usb_info_get_property(): strcmp over properties[] */
+static const char *scan_property(const UsbDeviceInfo *d, const char *key) {
+    for (size_t i = 0; i < d->property_count; i++)
+        if (strcmp(d->properties[i].key, key) == 0) return d->properties[i].value;
+    return NULL;
+}
+
+static void lookups(size_t ndev) {
+    UsbDeviceList *list = usbguard_device_list_create(1);
+    for (size_t i = 0; i < ndev; i++) {
+        char r[256];
+        snprintf(r, sizeof(r), "block id 0781:5567 serial \"SN%08zu\" name \"Flash\" hash \"h%zu\" "
+                 "parent-hash \"p\" via-port \"1-1\" with-interface 08:06:50 with-connect-type \"hotplug\"", i, i);
+        usbguard_device_list_append(list, usbguard_device_from_rule_in(list->arena, (unsigned)i, r));
+    }
+    int rounds = 20;
+    volatile size_t sink = 0;
+    double t0 = now_seconds();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < ndev; i++)
+            sink += strlen(scan_property(list->devices[i], "usbguard_id")) +
+                    (size_t)scan_property(list->devices[i], "raw_info")[0];
+    double scan = now_seconds() - t0;
+    t0 = now_seconds();
+    for (int r = 0; r < rounds; r++)
+        for (size_t i = 0; i < ndev; i++)
+            sink += strlen(usb_info_get_property(list->devices[i], "usbguard_id")) +
+                    (size_t)usb_info_get_property(list->devices[i], "raw_info")[0];
+    double str = now_seconds() - t0;
+    t0 = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < ndev; i++) {
+            uint32_t id = 0;
+            usb_info_usbguard_id(list->devices[i], &id);
+            sink += id + (size_t)usb_info_raw_info(list->devices[i])[0];
+        }
+    }
+    double atom = now_seconds() - t0;
+    double n = (double)ndev * rounds;
+    printf("lookup usbguard_id + raw_info: scan %.1f ns  string API %.1f ns  atoms %.1f ns  (per device)\n",
+           scan * 1e9 / n, str * 1e9 / n, atom * 1e9 / n);
+    usbguard_free_device_list(list);
+}
+
+int main(int argc, char *argv[]) {
+    size_t ndev = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    if (ndev < 1) ndev = 1;
+    printf("%zu devices\n", ndev);
+    fflush(stdout);
+
+    const char *labels[] = { "heap", "arena" };
+    for (int mode = 0; mode < 2; mode++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            run(labels[mode], mode, ndev);
+            fflush(stdout);
+            _exit(0);
+        }
+        int status = 0;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return 1;
+    }
+    lookups(ndev);
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* Native GPT + signature writer vs usbPartition.sh.
+ *
+ * The native path is timed on a disk-image file. The script path needs root and a
+ * real block device (e.g. a loop device); it only runs when BENCH_SCRIPT_DEVICE is set:
+ *   sudo BENCH_SCRIPT_DEVICE=/dev/loop0 build/bench/bench_embed [iterations]
+ */
+#define _DEFAULT_SOURCE
+#include "embed_cert.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IMAGE_BYTES (64LL * 1024 * 1024)
+#define SIG_PATH "output/usb_cert.pem"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int iters = argc > 1 ? atoi(argv[1]) : 20;
+    if (iters < 1) iters = 1;
+
+    FILE *f = fopen(SIG_PATH, "rb");
+    if (!f) { perror(SIG_PATH); return 1; }
+    unsigned char sig[8192];
+    size_t sig_len = fread(sig, 1, sizeof(sig), f);
+    fclose(f);
+
+    char image[] = "/tmp/bench_embed.XXXXXX";
+    int fd = mkstemp(image);
+    if (fd < 0 || ftruncate(fd, IMAGE_BYTES) != 0) { perror("image"); return 1; }
+    close(fd);
+
+    double t0 = now_seconds();
+    for (int i = 0; i < iters; i++) {
+        int rc = embed_cert_native(image, sig, sig_len, 0);
+        if (rc != 0) { fprintf(stderr, "native embed failed: %d\n", rc); unlink(image); return 1; }
+    }
+    double native_ms = (now_seconds() - t0) * 1e3 / iters;
+    unlink(image);
+    printf("native  (image file)      %8.2f ms/stick  (%d runs, %zu byte signature)\n", native_ms, iters, sig_len);
+
+    const char *dev = getenv("BENCH_SCRIPT_DEVICE");
+    if (!dev) {
+        printf("script  (usbPartition.sh) skipped, set BENCH_SCRIPT_DEVICE=/dev/loopN to compare\n");
+        return 0;
+    }
+    int script_iters = iters < 3 ? iters : 3;   /* seconds per run */
+    t0 = now_seconds();
+    for (int i = 0; i < script_iters; i++) {
+        int rc = embed_cert_ex("usbPartition.sh", dev, SIG_PATH, EMBED_FLAG_ASSUME_YES);
+        if (rc != 0) { fprintf(stderr, "script embed failed: %d\n", rc); return 1; }
+    }
+    double script_ms = (now_seconds() - t0) * 1e3 / script_iters;
+    printf("script  (%s) %8.2f ms/stick  (%d runs)\n", dev, script_ms, script_iters);
+    printf("speedup %.1fx\n", script_ms / native_ms);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/* Native FAT32 formatter: time and bytes written per volume size, plus a structure check.
+ *
+ *   build/bench/bench_format [repeats]
+ *
+ * Partitions sparse disk-image files of several sizes (USB_SIG + USB_DATA), formats
+ * USB_DATA with fat32_format and then re-reads the volume the way fsck.fat looks at it:
+ * boot sector fields and signature, backup boot sector, both FSInfo copies, the two FATs
+ * (identical, media / end-of-chain entries, free count matching FSInfo), the root
+ * directory's label entry, and the data region starting on a cluster boundary. A volume
+ * too small for FAT32 must be refused with -ENOSPC.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "blockdev.h"
+#include "fat32.h"
+#include "gpt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+
+#define MIB (1024ull * 1024)
+
+static uint32_t le16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t le32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+
+static int make_image(const char *path, uint64_t mib) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    int rc = ftruncate(fd, (off_t)(mib * MIB));
+    close(fd);
+    return rc;
+}
+
+#define CHECK(cond, what) do { if (!(cond)) { fprintf(stderr, "  check failed: %s\n", what); goto out; } } while (0)
+
+/* Independent reading of the volume; returns 0 when it is a consistent, empty FAT32 */
+static int check_volume(BlockDev *bd, uint64_t off, uint64_t len, const Fat32Info *fi, const char *label) {
+    int rc = -1;
+    uint32_t bps = bd->sector_size;
+    uint8_t *bs = blockdev_alloc(bd, 8 * bps), *fat = NULL, *fat2 = NULL, *root = NULL;
+    if (!bs || blockdev_pread(bd, bs, 8 * bps, off) != 0) goto out;
+    const uint8_t *fsinfo = bs + bps, *bkboot = bs + 6 * bps, *bkfsinfo = bs + 7 * bps;
+
+    CHECK(bs[0] == 0xEB && bs[2] == 0x90, "jump instruction");
+    CHECK(bs[510] == 0x55 && bs[511] == 0xAA, "boot signature");
+    CHECK(le16(bs + 11) == bps, "bytes per sector");
+    uint32_t spc = bs[13], reserved = le16(bs + 14), fat_sz = le32(bs + 36), total = le32(bs + 32);
+    CHECK(spc && (spc & (spc - 1)) == 0 && spc * bps <= 32768, "sectors per cluster");
+    CHECK(bs[16] == 2 && le16(bs + 17) == 0 && le16(bs + 19) == 0 && le16(bs + 22) == 0, "FAT32 BPB");
+    CHECK(bs[21] == 0xF8, "media byte");
+    CHECK(le32(bs + 28) == off / bps, "hidden sectors");
+    CHECK(total == len / bps && total == fi->total_sectors, "total sectors");
+    CHECK(le32(bs + 44) == 2 && le16(bs + 48) == 1 && le16(bs + 50) == 6, "root / FSInfo / backup");
+    CHECK(bs[66] == 0x29 && memcmp(bs + 82, "FAT32   ", 8) == 0, "extended BPB");
+    CHECK(le32(bs + 67) == fi->volume_id, "volume id");
+    CHECK(memcmp(bs, bkboot, bps) == 0, "backup boot sector");
+
+    uint64_t data_sec = reserved + 2ull * fat_sz;
+    uint64_t clusters = (total - data_sec) / spc;
+    CHECK(clusters >= FAT32_MIN_CLUSTERS && clusters == fi->clusters, "cluster count");
+    CHECK((clusters + 2) * 4 <= (uint64_t)fat_sz * bps, "FAT covers every cluster");
+    CHECK(data_sec % spc == 0, "data region cluster aligned");
+
+    CHECK(le32(fsinfo) == 0x41615252 && le32(fsinfo + 484) == 0x61417272 && le32(fsinfo + 508) == 0xAA550000,
+          "FSInfo signatures");
+    CHECK(memcmp(fsinfo, bkfsinfo, bps) == 0, "backup FSInfo");
+
+    size_t fat_len = (size_t)fat_sz * bps;
+    fat = malloc(fat_len);
+    fat2 = malloc(fat_len);
+    if (!fat || !fat2 || blockdev_pread(bd, fat, fat_len, off + (uint64_t)reserved * bps) != 0 ||
+        blockdev_pread(bd, fat2, fat_len, off + (uint64_t)(reserved + fat_sz) * bps) != 0) goto out;
+    CHECK(memcmp(fat, fat2, fat_len) == 0, "FAT copies identical");
+    CHECK((le32(fat) & 0x0FFFFFFF) == 0x0FFFFFF8, "FAT[0] media");
+    CHECK((le32(fat + 4) & 0x0FFFFFFF) == 0x0FFFFFFF, "FAT[1]");
+    CHECK((le32(fat + 8) & 0x0FFFFFFF) >= 0x0FFFFFF8, "root directory end of chain");
+    uint64_t free_clusters = 0;
+    for (uint64_t c = 2; c < clusters + 2; c++) free_clusters += (le32(fat + 4 * c) & 0x0FFFFFFF) == 0;
+    CHECK(free_clusters == le32(fsinfo + 488), "FSInfo free count");
+    for (size_t i = (size_t)(clusters + 2) * 4; i < fat_len; i++) CHECK(fat[i] == 0, "FAT tail zero");
+
+    size_t cl = (size_t)spc * bps;
+    root = blockdev_alloc(bd, cl);
+    if (!root || blockdev_pread(bd, root, cl, off + data_sec * bps) != 0) goto out;
+    if (label) {
+        CHECK(root[11] == 0x08 && memcmp(root, bs + 71, 11) == 0, "volume label entry");
+        for (size_t i = 32; i < cl; i++) CHECK(root[i] == 0, "root directory otherwise empty");
+    } else {
+        CHECK(memcmp(bs + 71, "NO NAME    ", 11) == 0, "default label");
+        for (size_t i = 0; i < cl; i++) CHECK(root[i] == 0, "root directory empty");
+    }
+    rc = 0;
+out:
+    free(bs);
+    free(fat);
+    free(fat2);
+    free(root);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    int repeats = argc > 1 ? atoi(argv[1]) : 5;
+    if (repeats < 1) repeats = 1;
+    char dir[] = "/tmp/bench_format.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char path[64];
+    snprintf(path, sizeof(path), "%s/stick.img", dir);
+
+    static const uint64_t SIZES_MIB[] = { 64, 1024, 16 * 1024, 64 * 1024 };
+    int fail = 0;
+    printf("%-10s %10s %8s %10s %8s %12s %12s %10s  %s\n", "volume", "clusters", "cluster", "FAT", "reserved",
+           "written", "zeroed", "format", "check");
+    for (size_t i = 0; i < sizeof(SIZES_MIB) / sizeof(SIZES_MIB[0]) && !fail; i++) {
+        BlockDev bd;
+        GptPartition data;
+        Fat32Info fi;
+        const char *label = i % 2 ? "usb data" : NULL;
+        if (make_image(path, SIZES_MIB[i]) != 0 || blockdev_open(&bd, path, 1) != 0) {
+            fprintf(stderr, "cannot create %s\n", path);
+            fail = 1;
+            break;
+        }
+        int rc = gpt_write_usb_layout(&bd, NULL, &data);
+        double best = 0;
+        for (int r = 0; r < repeats && rc == 0; r++) {
+            double t0 = bench_now();
+            rc = fat32_format(&bd, gpt_part_offset(&data), gpt_part_size(&data), label, 0, &fi);
+            double dt = bench_now() - t0;
+            if (r == 0 || dt < best) best = dt;
+        }
+        int ok = rc == 0 && check_volume(&bd, gpt_part_offset(&data), gpt_part_size(&data), &fi, label) == 0;
+        if (rc == 0) {
+            printf("%6llu MiB %10u %6u B %7.1f KiB %8u %8.1f KiB %8.1f KiB %8.2f ms  %s\n",
+                   (unsigned long long)SIZES_MIB[i], fi.clusters, fi.sectors_per_cluster * fi.bytes_per_sector,
+                   fi.fat_sectors * (double)fi.bytes_per_sector / 1024, fi.reserved_sectors,
+                   fi.bytes_written / 1024.0, fi.bytes_zeroed / 1024.0, best * 1e3, ok ? "ok" : "FAILED");
+        } else {
+            fprintf(stderr, "format of %llu MiB failed: %s\n", (unsigned long long)SIZES_MIB[i], strerror(-rc));
+        }
+        if (!ok) fail = 1;
+        blockdev_close(&bd);
+    }
+
+    /* 16 MiB leaves too few clusters for FAT32 */
+    if (!fail) {
+        BlockDev bd;
+        GptPartition data;
+        int rc = make_image(path, 16) == 0 ? blockdev_open(&bd, path, 1) : -EIO;
+        if (rc == 0) {
+            rc = gpt_write_usb_layout(&bd, NULL, &data);
+            if (rc == 0) rc = fat32_format(&bd, gpt_part_offset(&data), gpt_part_size(&data), NULL, 0, NULL);
+            blockdev_close(&bd);
+        }
+        printf("%6d MiB refused: %s\n", 16, rc == -ENOSPC ? "ok" : "FAILED");
+        if (rc != -ENOSPC) fail = 1;
+    }
+
+    unlink(path);
+    rmdir(dir);
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
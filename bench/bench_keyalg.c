@@ -0,0 +1,112 @@
+/* Key algorithm comparison: keygen, sign and verify per KeyAlg, plus the size of a
+ * leaf certificate (DER, signed by a CA of the same algorithm) that ends up in USB_SIG.
+ *
+ * Usage: build/bench/bench_keyalg [iterations]
+ */
+#define _DEFAULT_SOURCE
+#include "cert_gen.h"
+#include "ca_signer.h"
+#include "key_alg.h"
+
+#include <openssl/crypto.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int sign_once(EVP_PKEY *pkey, const unsigned char *msg, size_t msglen, unsigned char *sig, size_t *siglen) {
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    int ok = ctx && EVP_DigestSignInit(ctx, NULL, key_alg_digest_for_key(pkey), NULL, pkey) == 1 &&
+             EVP_DigestSign(ctx, sig, siglen, msg, msglen) == 1;
+    EVP_MD_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+static int verify_once(EVP_PKEY *pkey, const unsigned char *msg, size_t msglen, const unsigned char *sig, size_t siglen) {
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    int ok = ctx && EVP_DigestVerifyInit(ctx, NULL, key_alg_digest_for_key(pkey), NULL, pkey) == 1 &&
+             EVP_DigestVerify(ctx, sig, siglen, msg, msglen) == 1;
+    EVP_MD_CTX_free(ctx);
+    return ok ? 0 : -1;
+}
+
+/* DER size of a leaf issued by a throw-away CA of the same algorithm */
+static long leaf_der_size(KeyAlg alg, EVP_PKEY *leaf_key, const char *tmpdir) {
+    char crt[512], key[512];
+    snprintf(crt, sizeof(crt), "%s/%s.crt", tmpdir, key_alg_name(alg));
+    snprintf(key, sizeof(key), "%s/%s.key", tmpdir, key_alg_name(alg));
+    if (certgen_generate_ca(alg, "bench CA", 1, crt, key) != 0) return -1;
+    CaSigner *signer = ca_signer_create(crt, key);
+    unlink(crt);
+    unlink(key);
+    if (!signer) return -1;
+
+    UsbDeviceInfo *info = usb_info_create();
+    usb_info_set_id(info, "0781", "5581");
+    usb_info_set_name(info, "Ultra");
+    usb_info_set_serial(info, "4C530001230512114135");
+    X509_REQ *req = certgen_build_csr(leaf_key, info);
+    X509 *cert = req ? ca_signer_sign(signer, req, 365) : NULL;
+    long len = cert ? i2d_X509(cert, NULL) : -1;
+
+    X509_free(cert);
+    X509_REQ_free(req);
+    usb_info_free(info);
+    ca_signer_free(signer);
+    return len;
+}
+
+int main(int argc, char *argv[]) {
+    int iters = argc > 1 ? atoi(argv[1]) : 5;
+    if (iters < 1) iters = 1;
+
+    char tmpdir[] = "/tmp/bench_keyalg.XXXXXX";
+    if (!mkdtemp(tmpdir)) { perror("mkdtemp"); return 1; }
+
+    static const unsigned char msg[32] = "usb-digital-signing benchmark!!";
+    unsigned char sig[1024];
+
+    printf("%-8s %12s %12s %12s %10s %10s\n", "ALG", "keygen ms", "sign ops/s", "verify ops/s", "sig bytes", "cert DER");
+    for (int a = 0; a < KEY_ALG_COUNT; a++) {
+        KeyAlg alg = (KeyAlg)a;
+        /* RSA-4096 keygen takes seconds; fewer rounds keep the run bounded */
+        int kg_iters = alg == KEY_ALG_RSA4096 ? (iters + 3) / 4 : iters;
+
+        EVP_PKEY *pkey = NULL;
+        double t0 = now_seconds();
+        for (int i = 0; i < kg_iters; i++) {
+            EVP_PKEY_free(pkey);
+            pkey = key_alg_generate(alg);
+            if (!pkey) { fprintf(stderr, "%s keygen failed\n", key_alg_name(alg)); return 1; }
+        }
+        double keygen_ms = (now_seconds() - t0) * 1e3 / kg_iters;
+
+        size_t siglen = sizeof(sig);
+        int sign_iters = iters * 10;
+        t0 = now_seconds();
+        for (int i = 0; i < sign_iters; i++) {
+            siglen = sizeof(sig);
+            if (sign_once(pkey, msg, sizeof(msg), sig, &siglen) != 0) { fprintf(stderr, "sign failed\n"); return 1; }
+        }
+        double sign_ops = sign_iters / (now_seconds() - t0);
+
+        t0 = now_seconds();
+        for (int i = 0; i < sign_iters; i++) {
+            if (verify_once(pkey, msg, sizeof(msg), sig, siglen) != 0) { fprintf(stderr, "verify failed\n"); return 1; }
+        }
+        double verify_ops = sign_iters / (now_seconds() - t0);
+
+        long der = leaf_der_size(alg, pkey, tmpdir);
+        printf("%-8s %12.2f %12.0f %12.0f %10zu %10ld\n", key_alg_name(alg), keygen_ms, sign_ops, verify_ops, siglen, der);
+        EVP_PKEY_free(pkey);
+    }
+    rmdir(tmpdir);
+    return 0;
+}
@@ -0,0 +1,184 @@
+/* Issued-certificate ledger: append throughput, indexed lookups, reopen and recovery.
+ *
+ *   build/bench/bench_ledger [records]
+ *
+ * Fills a ledger with synthetic records (LEDGER_OPEN_NOSYNC, one sync at the end, as a
+ * bulk run would), then times lookups by serial and by device serial, reopening with the
+ * indexes (tail replay only), rebuilding without them, and cutting a torn final record.
+ * A child that appends without ledger_sync and exits without closing leaves slots past
+ * the covered length; reopening must replay them and find all of one stick's records.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "ledger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#define RENEWALS 4      /* every device gets a certificate and RENEWALS-1 renewals */
+#define CRASH_RECORDS 300   /* one stick, more than a lookup keeps on the stack */
+
+typedef struct {
+    Ledger *l;
+    size_t n;
+    uint64_t rng;
+} Ctx;
+
+static void make_entry(size_t i, LedgerEntry *e) {
+    memset(e, 0, sizeof(*e));
+    uint64_t s = 0x100000000ull + i;
+    e->serial_len = 5;
+    for (int k = 4; k >= 0; k--, s >>= 8) e->serial[k] = (unsigned char)s;
+    snprintf(e->device_id, sizeof(e->device_id), "0781:%04zx", 0x5500 + i % 256);
+    snprintf(e->device_serial, sizeof(e->device_serial), "4C5300%014zu", i / RENEWALS);
+    snprintf(e->subject, sizeof(e->subject), "/CN=4C5300%014zu/O=SanDisk/OU=usb", i / RENEWALS);
+    e->issued_at = 1760000000 + (int64_t)i;
+    e->not_before = e->issued_at;
+    e->not_after = e->issued_at + 365 * 86400;
+    memset(e->sha256, (int)(i & 0xff), sizeof(e->sha256));
+}
+
+static size_t next_index(Ctx *c) {
+    c->rng = c->rng * 6364136223846793005ull + 1442695040888963407ull;
+    return (size_t)(c->rng >> 33) % c->n;
+}
+
+static int find_serial(void *p) {
+    Ctx *c = p;
+    LedgerEntry want, got;
+    make_entry(next_index(c), &want);
+    if (ledger_find_serial(c->l, want.serial, want.serial_len, &got) != 0) return -1;
+    return memcmp(got.sha256, want.sha256, 32) == 0 ? 0 : -1;
+}
+
+static int find_device(void *p) {
+    Ctx *c = p;
+    LedgerEntry want, got[RENEWALS];
+    make_entry(next_index(c), &want);
+    return ledger_find_device_serial(c->l, want.device_serial, got, RENEWALS) >= 1 ? 0 : -1;
+}
+
+static int find_missing(void *p) {
+    Ctx *c = p;
+    unsigned char serial[8] = { 0x7f, 1, 2, 3, 4, 5, 6, (unsigned char)next_index(c) };
+    LedgerEntry got;
+    return ledger_find_serial(c->l, serial, sizeof(serial), &got) == -ENOENT ? 0 : -1;
+}
+
+static double reopen(const char *dir, Ctx *c, LedgerStats *st) {
+    double t0 = bench_now();
+    int rc = ledger_open(dir, LEDGER_OPEN_NOSYNC, &c->l);
+    double dt = bench_now() - t0;
+    if (rc != 0) {
+        fprintf(stderr, "ledger_open: %d\n", rc);
+        return -1;
+    }
+    ledger_get_stats(c->l, st);
+    return dt;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 300000;
+    if (n < RENEWALS) n = RENEWALS;
+    char dir[] = "/tmp/bench_ledger.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char path[128];
+    Ctx c = { .n = n, .rng = 42 };
+    LedgerStats st;
+    int fail = 0;
+
+    if (reopen(dir, &c, &st) < 0) return 1;
+    double t0 = bench_now();
+    for (size_t i = 0; i < n && !fail; i++) {
+        LedgerEntry e;
+        make_entry(i, &e);
+        if (ledger_append(c.l, &e) != 0) fail = 1;
+    }
+    if (!fail && ledger_sync(c.l) != 0) fail = 1;
+    double dt = bench_now() - t0;
+    ledger_get_stats(c.l, &st);
+    printf("append   %zu records: %.0f records/s, %.1f MB log\n", n, n / dt, st.log_bytes / 1e6);
+
+    BenchReport r = { .suite = "ledger" };
+    if (!fail) fail = bench_run(&r, "find/serial", 100, 20000, find_serial, &c) != 0;
+    if (!fail) fail = bench_run(&r, "find/device-serial", 100, 20000, find_device, &c) != 0;
+    if (!fail) fail = bench_run(&r, "find/missing", 100, 20000, find_missing, &c) != 0;
+    if (!fail) bench_report_table(&r, stdout);
+    bench_report_free(&r);
+    ledger_close(c.l);
+
+    /* reopen with intact indexes: nothing to replay */
+    if (!fail) {
+        dt = reopen(dir, &c, &st);
+        fail = dt < 0 || st.records != n || st.replayed != 0;
+        printf("reopen   %.2f ms, %llu records, %llu replayed\n", dt * 1e3,
+               (unsigned long long)st.records, (unsigned long long)st.replayed);
+        if (c.l) ledger_close(c.l);
+    }
+
+    /* without indexes: full rebuild from the log */
+    snprintf(path, sizeof(path), "%s/serial.idx", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/device.idx", dir);
+    unlink(path);
+    if (!fail) {
+        dt = reopen(dir, &c, &st);
+        fail = dt < 0 || st.records != n || st.replayed != n || !st.rebuilt;
+        printf("rebuild  %.2f ms, %llu records replayed\n", dt * 1e3, (unsigned long long)st.replayed);
+        if (!fail) fail = find_serial(&c) != 0;
+        if (c.l) ledger_close(c.l);
+    }
+
+    /* torn append: half a record at the end of the log is cut off on open */
+    snprintf(path, sizeof(path), "%s/ledger.log", dir);
+    if (!fail) {
+        int fd = open(path, O_WRONLY | O_APPEND);
+        static const unsigned char torn[40] = { 'L', 'G', 'R', '1', 200 };
+        fail = fd < 0 || write(fd, torn, sizeof(torn)) != (ssize_t)sizeof(torn);
+        if (fd >= 0) close(fd);
+        if (!fail) {
+            dt = reopen(dir, &c, &st);
+            fail = dt < 0 || !st.truncated || st.records != n;
+            printf("torn     tail cut: %s, %llu records intact\n", st.truncated ? "yes" : "no",
+                   (unsigned long long)st.records);
+            if (c.l) ledger_close(c.l);
+        }
+    }
+
+    /* unsynced appends of a process that dies without ledger_close */
+    if (!fail) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            Ledger *l;
+            if (ledger_open(dir, LEDGER_OPEN_NOSYNC, &l) != 0) _exit(1);
+            for (size_t i = 0; i < CRASH_RECORDS; i++) {
+                LedgerEntry e;
+                make_entry(n + i, &e);
+                snprintf(e.device_serial, sizeof(e.device_serial), "CRASHED");
+                if (ledger_append(l, &e) != 0) _exit(1);
+            }
+            _exit(0);
+        }
+        int status = 0;
+        fail = pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+        if (!fail) {
+            dt = reopen(dir, &c, &st);
+            fail = dt < 0 || st.records != n + CRASH_RECORDS || st.replayed != CRASH_RECORDS;
+            int found = fail ? -1 : ledger_find_device_serial(c.l, "CRASHED", NULL, 0);
+            printf("crash    %llu records replayed, %d found for one stick\n",
+                   (unsigned long long)st.replayed, found);
+            if (found != CRASH_RECORDS) fail = 1;
+            if (c.l) ledger_close(c.l);
+        }
+    }
+
+    const char *files[] = { "ledger.log", "serial.idx", "device.idx" };
+    for (size_t i = 0; i < 3; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
@@ -0,0 +1,118 @@
+/* Device discovery: polling usbguard_list_devices() vs DevicePresenceChanged events.
+ *
+ * Needs the USBGuard stand-in on a private bus, e.g.
+ *   make tools && tools/usbguard_stub_session.sh --devices 500 -- build/bench/bench_monitor [inserts]
+ * Without USBGUARD_DBUS_ADDRESS the benchmark is skipped.
+ */
+#define _DEFAULT_SOURCE
+#include "usbguard_interface.h"
+#include "usbguard_monitor.h"
+
+#include <dbus/dbus.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t g_last_insert;
+static double g_last_at;
+
+static void on_event(const UsbGuardEvent *ev, void *user) {
+    (void)user;
+    if (ev->type != USBGUARD_EVENT_INSERT) return;
+    pthread_mutex_lock(&g_lock);
+    g_last_insert = ev->id;
+    g_last_at = now_seconds();
+    pthread_cond_signal(&g_cond);
+    pthread_mutex_unlock(&g_lock);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* org.usbguard.Stub1.insert / remove on the stand-in service, under whichever bus name it owns */
+static uint32_t stub_call(DBusConnection *conn, const char *method, int type, const void *arg) {
+    DBusMessage *reply = NULL;
+    for (const char *const *name = usbguard_bus_names; *name && !reply; name++) {
+        DBusMessage *msg = dbus_message_new_method_call(*name, USBGUARD_DEVICES_PATH, "org.usbguard.Stub1", method);
+        dbus_message_append_args(msg, type, arg, DBUS_TYPE_INVALID);
+        reply = dbus_connection_send_with_reply_and_block(conn, msg, 5000, NULL);
+        dbus_message_unref(msg);
+    }
+    dbus_uint32_t id = 0;
+    if (reply) {
+        dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &id, DBUS_TYPE_INVALID);
+        dbus_message_unref(reply);
+    }
+    return id;
+}
+
+int main(int argc, char *argv[]) {
+    int inserts = argc > 1 ? atoi(argv[1]) : 200;
+    if (inserts < 1) inserts = 1;
+    const char *addr = usbguard_bus_address();
+    if (!addr) {
+        printf("monitor skipped, run under tools/usbguard_stub_session.sh (needs USBGUARD_DBUS_ADDRESS)\n");
+        return 0;
+    }
+
+    /* polling baseline: one full listDevices + parse */
+    int polls = 20;
+    size_t ndev = 0;
+    double t0 = now_seconds();
+    for (int i = 0; i < polls; i++) {
+        UsbDeviceList *l = usbguard_list_devices("match");
+        if (!l) { fprintf(stderr, "listDevices failed\n"); return 1; }
+        ndev = l->count;
+        usbguard_free_device_list(l);
+    }
+    double poll_ms = (now_seconds() - t0) * 1e3 / polls;
+
+    UsbGuardMonitor *mon = usbguard_monitor_start(on_event, NULL);
+    if (!mon) return 1;
+    size_t seeded = usbguard_monitor_count(mon);
+    printf("table seeded with %zu device(s)\n", seeded);
+
+    DBusConnection *ctl = dbus_connection_open_private(addr, NULL);
+    if (!ctl || !dbus_bus_register(ctl, NULL)) { fprintf(stderr, "control connection failed\n"); return 1; }
+
+    double *lat = calloc((size_t)inserts, sizeof(double));
+    const char *rule = "id 0781:5567 serial \"BENCH\" name \"Bench Flash\"";
+    for (int i = 0; i < inserts; i++) {
+        double sent = now_seconds();
+        uint32_t id = stub_call(ctl, "insert", DBUS_TYPE_STRING, &rule);
+        pthread_mutex_lock(&g_lock);
+        while (g_last_insert != id) pthread_cond_wait(&g_cond, &g_lock);
+        lat[i] = (g_last_at - sent) * 1e6;
+        pthread_mutex_unlock(&g_lock);
+        stub_call(ctl, "remove", DBUS_TYPE_UINT32, &id);
+    }
+    qsort(lat, (size_t)inserts, sizeof(double), cmp_double);
+
+    printf("poll    listDevices         %8.2f ms/poll  (%zu devices)\n", poll_ms, ndev);
+    printf("events  insert -> callback  %8.1f us p50  %8.1f us p99  (%d inserts, incl. stub round trip)\n",
+           lat[inserts / 2], lat[(inserts * 99) / 100], inserts);
+    /* the last Remove signal may still be in flight */
+    for (int i = 0; i < 100 && usbguard_monitor_count(mon) != seeded; i++) {
+        struct timespec ts = { 0, 10 * 1000 * 1000 };
+        nanosleep(&ts, NULL);
+    }
+    printf("table after insert/remove: %zu device(s)\n", usbguard_monitor_count(mon));
+
+    free(lat);
+    dbus_connection_close(ctl);
+    dbus_connection_unref(ctl);
+    usbguard_monitor_stop(mon);
+    return 0;
+}
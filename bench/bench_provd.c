@@ -0,0 +1,260 @@
+/* Provisioning daemon: per-request overhead over the Unix socket against the work a fresh
+ * process repeats for every job, batching of a provisioning burst, and backpressure.
+ *
+ *   build/bench/bench_provd [images]
+ *
+ * Runs the daemon in-process on a socket in a temporary directory with a throw-away P-256
+ * CA and disk-image files (no USBGuard, image files allowed). Cold cases redo what each `main` run pays besides
+ * exec: loading the CA for a station run, creating a verifier for one check.
+ */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#include "bench.h"
+#include "provd.h"
+#include "cert_gen.h"
+#include "cert_verify.h"
+#include "embed_cert.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+
+#define IMAGE_BYTES (8 * 1024 * 1024)
+#define PINGS 1000
+#define FLOOD 512
+
+typedef struct {
+    int fd;
+    const char *socket_path;
+    char **images;
+    size_t n;
+    const char *ca_crt;
+    const char *ca_key;
+    const char *out_dir;
+    StationResult *results;
+} Ctx;
+
+static int do_ping(void *p) {
+    Ctx *c = p;
+    ProvdReply r;
+    for (int i = 0; i < PINGS; i++) {
+        if (provd_call(c->fd, PROVD_OP_PING, NULL, &r) != 0 || r.rc != 0) return -1;
+    }
+    return 0;
+}
+
+static int do_verify_daemon(void *p) {
+    Ctx *c = p;
+    ProvdReply r;
+    for (size_t i = 0; i < c->n; i++) {
+        if (provd_call(c->fd, PROVD_OP_VERIFY, c->images[i], &r) != 0 || r.rc != 0 || r.detail != VERIFY_OK)
+            return -1;
+    }
+    return 0;
+}
+
+/* a fresh `main verify`: load the CA into a new verifier for every stick */
+static int do_verify_cold(void *p) {
+    Ctx *c = p;
+    for (size_t i = 0; i < c->n; i++) {
+        CertVerifier *v = cert_verifier_create(c->ca_crt, 256);
+        UsbDeviceInfo *block = usb_info_from_block_device(c->images[i]);
+        VerifyResult res;
+        VerifyStatus st = v ? cert_verify_device(v, c->images[i], block, &res) : VERIFY_IO_ERROR;
+        usb_info_free(block);
+        cert_verifier_free(v);
+        if (st != VERIFY_OK) return -1;
+    }
+    return 0;
+}
+
+/* the whole burst pipelined on one connection */
+static int do_provision_daemon(void *p) {
+    Ctx *c = p;
+    for (size_t i = 0; i < c->n; i++) {
+        if (provd_send(c->fd, (uint32_t)i, PROVD_OP_PROVISION, c->images[i]) != 0) return -1;
+    }
+    for (size_t i = 0; i < c->n; i++) {
+        ProvdReply r;
+        if (provd_recv(c->fd, &r) != 0 || r.rc != 0) return -1;
+    }
+    return 0;
+}
+
+/* one station run per stick, each loading the CA */
+static int do_provision_cold(void *p) {
+    Ctx *c = p;
+    StationConfig cfg;
+    station_config_init(&cfg);
+    cfg.ca_cert_path = c->ca_crt;
+    cfg.ca_key_path = c->ca_key;
+    cfg.output_dir = c->out_dir;
+    cfg.key_alg = KEY_ALG_EC_P256;
+    for (size_t i = 0; i < c->n; i++) {
+        if (station_run(&cfg, (const char *const *)&c->images[i], 1, c->results) != 0) return -1;
+    }
+    return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static ProvdServer *start(ProvdConfig *cfg, Ctx *c, size_t queue, size_t inflight) {
+    provd_config_init(cfg);
+    cfg->socket_path = c->socket_path;
+    cfg->station.ca_cert_path = c->ca_crt;
+    cfg->station.ca_key_path = c->ca_key;
+    cfg->station.output_dir = c->out_dir;
+    cfg->station.key_alg = KEY_ALG_EC_P256;
+    cfg->use_usbguard = 0;
+    cfg->allow_image_files = 1;
+    if (queue) cfg->queue_depth = queue;
+    if (inflight) cfg->conn_inflight = inflight;
+    int err;
+    ProvdServer *s = provd_start(cfg, &err);
+    if (!s) fprintf(stderr, "provd_start: %s\n", strerror(-err));
+    return s;
+}
+
+/* paths that are neither a USB disk nor (here) an image file never reach a lane */
+static int check_refused(Ctx *c) {
+    static const char *const paths[] = { "/dev/null", "/tmp", "/nonexistent/stick.img" };
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+        ProvdReply r;
+        if (provd_call(c->fd, PROVD_OP_PROVISION, paths[i], &r) != 0 || r.rc != -ENODEV) {
+            fprintf(stderr, "%s: not refused\n", paths[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* a golden image would be wiped by formatting USB_DATA, so station_run refuses the pair up front */
+static int check_clone_format(Ctx *c) {
+    StationConfig cfg;
+    station_config_init(&cfg);
+    cfg.data_image = "/nonexistent/golden.img";
+    cfg.embed_flags |= EMBED_FLAG_FORMAT_DATA;
+    StationResult res;
+    if (station_run(&cfg, (const char *const *)&c->images[0], 1, &res) != -EINVAL) {
+        fprintf(stderr, "data_image with format-data not refused\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* two images named alike in different directories, provisioned in one batch: each gets
+ * its own artifact directory */
+static int check_same_name(Ctx *c, const char *dir) {
+    char paths[2][96];
+    int rc = 0;
+    for (int i = 0; i < 2 && rc == 0; i++) {
+        snprintf(paths[i], sizeof(paths[i]), "%s/rack%d", dir, i);
+        if (mkdir(paths[i], 0755) != 0) rc = -1;
+        strcat(paths[i], "/stick.img");
+        int fd = rc == 0 ? open(paths[i], O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+        if (fd < 0 || ftruncate(fd, IMAGE_BYTES) != 0) rc = -1;
+        if (fd >= 0) close(fd);
+    }
+    for (uint32_t i = 0; i < 2 && rc == 0; i++) rc = provd_send(c->fd, i, PROVD_OP_PROVISION, paths[i]);
+    ProvdReply r[2];
+    for (int i = 0; i < 2 && rc == 0; i++) rc = provd_recv(c->fd, &r[i]) == 0 && r[i].rc == 0 ? 0 : -1;
+    if (rc == 0 && strcmp(r[0].text, r[1].text) == 0) {
+        fprintf(stderr, "%s and %s share %s\n", paths[0], paths[1], r[0].text);
+        rc = -1;
+    }
+    return rc;
+}
+
+/* FLOOD verify requests on one connection against a 4-deep queue: every one must be
+ * answered, and the daemon must have paused reading instead of queueing them all */
+static int check_backpressure(Ctx *c) {
+    ProvdConfig cfg;
+    ProvdServer *s = start(&cfg, c, 4, 8);
+    int fd = s ? provd_connect(c->socket_path) : -1;
+    int rc = fd >= 0 ? 0 : -1;
+    double t0 = bench_now();
+    for (uint32_t i = 0; i < FLOOD && rc == 0; i++) rc = provd_send(fd, i, PROVD_OP_VERIFY, c->images[i % c->n]);
+    static unsigned char seen[FLOOD];
+    for (size_t i = 0; i < FLOOD && rc == 0; i++) {
+        ProvdReply r;
+        rc = provd_recv(fd, &r) == 0 && r.rc == 0 && r.detail == VERIFY_OK && r.id < FLOOD && !seen[r.id]++ ? 0 : -1;
+    }
+    double secs = bench_now() - t0;
+    ProvdStats st;
+    if (s) provd_get_stats(s, &st);
+    if (fd >= 0) close(fd);
+    provd_stop(s);
+    if (rc == 0) {
+        printf("backpressure: %d pipelined verifies, queue 4: peak %zu, %llu stall(s), %llu batch(es), %.1f ms\n",
+               FLOOD, st.queue_peak, (unsigned long long)st.stalls, (unsigned long long)st.batches, secs * 1e3);
+        if (st.queue_peak > 4 || st.stalls == 0) rc = -1;
+    }
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 16;
+    if (n < 1) n = 1;
+    char dir[] = "/tmp/bench_provd.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char ca_crt[256], ca_key[256], out_dir[256], sock[256];
+    snprintf(ca_crt, sizeof(ca_crt), "%s/ca.crt", dir);
+    snprintf(ca_key, sizeof(ca_key), "%s/ca.key", dir);
+    snprintf(out_dir, sizeof(out_dir), "%s/out", dir);
+    snprintf(sock, sizeof(sock), "%s/provd.sock", dir);
+    Ctx c = { .fd = -1, .socket_path = sock, .n = n, .ca_crt = ca_crt, .ca_key = ca_key, .out_dir = out_dir };
+    c.images = calloc(n, sizeof(*c.images));
+    c.results = calloc(1, sizeof(*c.results));
+    int rc = c.images && c.results && certgen_generate_ca(KEY_ALG_EC_P256, "bench provd CA", 1, ca_crt, ca_key) == 0
+                 ? 0 : -1;
+    for (size_t i = 0; i < n && rc == 0; i++) {
+        c.images[i] = malloc(64);
+        if (!c.images[i]) { rc = -1; break; }
+        snprintf(c.images[i], 64, "%s/stick%04zu.img", dir, i);
+        int fd = open(c.images[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ftruncate(fd, IMAGE_BYTES) != 0) rc = -1;
+        if (fd >= 0) close(fd);
+    }
+
+    BenchReport r = { .suite = "provd" };
+    ProvdConfig cfg;
+    ProvdServer *srv = rc == 0 ? start(&cfg, &c, 0, 0) : NULL;
+    if (!srv || (c.fd = provd_connect(sock)) < 0) rc = -1;
+    if (rc == 0) rc = bench_run(&r, "cold/provision", 0, 3, do_provision_cold, &c);
+    bench_set_work(&r, 0, (double)n);
+    if (rc == 0) rc = bench_run(&r, "provd/provision-burst", 0, 3, do_provision_daemon, &c);
+    bench_set_work(&r, 0, (double)n);
+    if (rc == 0) rc = bench_run(&r, "cold/verify", 1, 5, do_verify_cold, &c);
+    bench_set_work(&r, 0, (double)n);
+    if (rc == 0) rc = bench_run(&r, "provd/verify", 1, 5, do_verify_daemon, &c);
+    bench_set_work(&r, 0, (double)n);
+    if (rc == 0) rc = bench_run(&r, "provd/ping", 1, 5, do_ping, &c);
+    bench_set_work(&r, 0, PINGS);
+    if (rc == 0) rc = check_refused(&c);
+    if (rc == 0) rc = check_same_name(&c, dir);
+    if (rc == 0) rc = check_clone_format(&c);
+    ProvdStats st;
+    if (srv) provd_get_stats(srv, &st);
+    if (c.fd >= 0) close(c.fd);
+    provd_stop(srv);
+    if (rc == 0) {
+        bench_report_table(&r, stdout);
+        printf("%llu request(s) in %llu batch(es), largest %zu\n", (unsigned long long)st.requests,
+               (unsigned long long)st.batches, st.max_batch);
+        rc = check_backpressure(&c);
+    }
+    bench_report_free(&r);
+
+    for (size_t i = 0; c.images && i < n; i++) free(c.images[i]);
+    free(c.images);
+    free(c.results);
+    /* images, CA and the per-device output directories */
+    if (nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0) fprintf(stderr, "cannot remove %s\n", dir);
+    printf("%s\n", rc == 0 ? "OK" : "FAIL");
+    return rc != 0;
+}
@@ -0,0 +1,331 @@
+/* Provisioning micro-benchmarks: keygen, CSR, CA signing, encoding, verification,
+ * USBGuard rule parsing and embedding into a disk image, with p50/p99 latencies.
+ *
+ *   build/bench/bench_provision [--quick] [--json FILE|-]
+ *
+ * `make bench` writes the JSON to build/bench/provision.json (BENCH_JSON=... to change).
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "ca_signer.h"
+#include "cert_gen.h"
+#include "cert_verify.h"
+#include "embed_cert.h"
+#include "key_alg.h"
+#include "metrics.h"
+#include "sig_container.h"
+#include "usbguard_interface.h"
+#include "usbguard_rule.h"
+
+#include <openssl/pem.h>
+
+#define RULES_PER_CALL 1000
+#define IMAGE_BYTES (64LL * 1024 * 1024)
+#define SPANS_PER_CALL 100000
+
+typedef struct {
+    KeyAlg alg;
+    EVP_PKEY *leaf_key;
+    UsbDeviceInfo *info;
+    X509_REQ *req;
+    CaSigner *signer;
+    X509 *cert;
+    CertVerifier *verifier;
+    char **rules;
+    size_t rules_bytes;
+    char image[64];
+    unsigned char buf[16384];
+} Ctx;
+
+static int do_keygen(void *p) {
+    Ctx *c = p;
+    EVP_PKEY *k = key_alg_generate(c->alg);
+    EVP_PKEY_free(k);
+    return k ? 0 : -1;
+}
+
+static int do_csr(void *p) {
+    Ctx *c = p;
+    X509_REQ *req = certgen_build_csr(c->leaf_key, c->info);
+    X509_REQ_free(req);
+    return req ? 0 : -1;
+}
+
+static int do_sign(void *p) {
+    Ctx *c = p;
+    X509 *cert = ca_signer_sign(c->signer, c->req, 365);
+    X509_free(cert);
+    return cert ? 0 : -1;
+}
+
+static int do_der(void *p) {
+    Ctx *c = p;
+    unsigned char *out = c->buf;
+    return i2d_X509(c->cert, &out) > 0 ? 0 : -1;
+}
+
+static int do_pem(void *p) {
+    Ctx *c = p;
+    BIO *bio = BIO_new(BIO_s_mem());
+    int ok = bio && PEM_write_bio_X509(bio, c->cert) == 1;
+    BIO_free(bio);
+    return ok ? 0 : -1;
+}
+
+static int do_verify(void *p) {
+    Ctx *c = p;
+    VerifyResult res;
+    /* expected == NULL: chain only, no cache */
+    return cert_verify_x509(c->verifier, c->cert, NULL, NULL, &res) == VERIFY_OK ? 0 : -1;
+}
+
+static int do_rules_parse(void *p) {
+    Ctx *c = p;
+    for (size_t i = 0; i < RULES_PER_CALL; i++) {
+        UsbGuardRule rule;
+        if (usbguard_rule_parse(c->rules[i], (size_t)-1, &rule) != 0) return -1;
+    }
+    return 0;
+}
+
+static int do_rules_list(void *p) {
+    Ctx *c = p;
+    UsbDeviceList *list = usbguard_device_list_create(1);
+    if (!list) return -1;
+    for (size_t i = 0; i < RULES_PER_CALL; i++)
+        usbguard_device_list_append(list, usbguard_device_from_rule_in(list->arena, (unsigned)i, c->rules[i]));
+    int ok = list->count == RULES_PER_CALL;
+    usbguard_free_device_list(list);
+    return ok ? 0 : -1;
+}
+
+static int do_embed(void *p) {
+    Ctx *c = p;
+    return embed_cert_x509(c->image, c->cert, NULL, 0);
+}
+
+static int do_renew(void *p) {
+    Ctx *c = p;
+    return embed_renew_x509(c->image, c->cert, NULL, NULL, NULL);
+}
+
+/* A container from before A/B slots (generation 0) in slot A with B empty: renewal must
+ * write B with generation 1 and leave A readable as the fallback, and keep writing B
+ * while B's payload does not read back */
+static int check_gen0_renew(Ctx *c, const char *dir) {
+    char path[96];
+    snprintf(path, sizeof(path), "%s/slots.img", dir);
+    unsigned char *der = NULL, *cont = NULL, *cert = NULL;
+    size_t cont_len = 0, cert_len = 0;
+    int der_len = i2d_X509(c->cert, &der);
+    BlockDev bd = { .fd = -1 };
+    int rc = der_len > 0 ? sig_container_encode(der, (size_t)der_len, NULL, 0, 0, &cont, &cont_len) : -1;
+    FILE *f = rc == 0 ? fopen(path, "wb") : NULL;
+    if (rc == 0 && (!f || ftruncate(fileno(f), SIG_SLOT_COUNT * SIG_SLOT_BYTES) != 0)) rc = -1;
+    if (f) fclose(f);
+    if (rc == 0) rc = blockdev_open(&bd, path, 1);
+    if (rc == 0) {
+        sig_container_set_generation(cont, 0);
+        rc = blockdev_pwrite(&bd, cont, cont_len, 0);
+    }
+
+    int slot = -1;
+    uint64_t gen = 0;
+    SigContainerInfo info;
+    if (rc == 0) rc = sig_slots_write_next(&bd, 0, SIG_SLOT_COUNT * SIG_SLOT_BYTES, cont, cont_len, &slot, &gen);
+    if (rc == 0 && (slot != 1 || gen != 1)) rc = -1;
+    if (rc == 0) rc = sig_slots_read(&bd, 0, SIG_SLOT_COUNT * SIG_SLOT_BYTES, &info, &cert, &cert_len, NULL, NULL, &slot);
+    if (rc == 0 && (slot != 1 || info.generation != 1)) rc = -1;
+    free(cert);
+    cert = NULL;
+    /* B's payload damaged under a valid header: A is what reads back, so the next renewal
+     * must replace B again, not A */
+    static const unsigned char torn[SIG_CONTAINER_SECTOR];
+    if (rc == 0) rc = blockdev_pwrite(&bd, torn, sizeof(torn), SIG_SLOT_BYTES + SIG_CONTAINER_SECTOR);
+    if (rc == 0) rc = sig_slots_read(&bd, 0, SIG_SLOT_COUNT * SIG_SLOT_BYTES, &info, &cert, &cert_len, NULL, NULL, &slot);
+    if (rc == 0 && slot != 0) rc = -1;
+    free(cert);
+    cert = NULL;
+    if (rc == 0) rc = sig_slots_write_next(&bd, 0, SIG_SLOT_COUNT * SIG_SLOT_BYTES, cont, cont_len, &slot, &gen);
+    if (rc == 0 && (slot != 1 || gen != 2)) rc = -1;
+    /* a torn B header: the generation-0 certificate in A is still current */
+    if (rc == 0) rc = blockdev_pwrite(&bd, torn, sizeof(torn), SIG_SLOT_BYTES);
+    if (rc == 0) rc = sig_slots_read(&bd, 0, SIG_SLOT_COUNT * SIG_SLOT_BYTES, &info, &cert, &cert_len, NULL, NULL, &slot);
+    if (rc == 0 && (slot != 0 || info.generation != 0 || cert_len != (size_t)der_len)) rc = -1;
+
+    if (bd.fd >= 0) blockdev_close(&bd);
+    unlink(path);
+    free(cert);
+    free(cont);
+    OPENSSL_free(der);
+    printf("renew over a generation-0 container: %s\n", rc == 0 ? "slot B written, slot A kept" : "FAIL");
+    return rc;
+}
+
+/* Instrumentation cost: a span plus a counter, as in the provisioning pipeline */
+static int do_metrics(void *p) {
+    (void)p;
+    for (int i = 0; i < SPANS_PER_CALL; i++) {
+        uint64_t t = metrics_span_begin();
+        metrics_add(METRIC_BYTES_WRITTEN, 512);
+        metrics_span_end(METRIC_STAGE_SIG_WRITE, t);
+    }
+    return 0;
+}
+
+/* Throw-away CA of `alg` plus a signer and a verifier for it */
+static int setup_ca(Ctx *c, KeyAlg alg, const char *dir) {
+    char crt[256], key[256];
+    snprintf(crt, sizeof(crt), "%s/ca.crt", dir);
+    snprintf(key, sizeof(key), "%s/ca.key", dir);
+    int rc = certgen_generate_ca(alg, "bench CA", 1, crt, key);
+    if (rc == 0) {
+        c->signer = ca_signer_create(crt, key);
+        c->verifier = cert_verifier_create(crt, 0);
+    }
+    unlink(crt);
+    unlink(key);
+    return c->signer && c->verifier ? 0 : -1;
+}
+
+static void teardown_ca(Ctx *c) {
+    ca_signer_free(c->signer);
+    cert_verifier_free(c->verifier);
+    c->signer = NULL;
+    c->verifier = NULL;
+}
+
+int main(int argc, char *argv[]) {
+    int quick = 0;
+    const char *json = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) quick = 1;
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) json = argv[++i];
+        else {
+            fprintf(stderr, "Usage: %s [--quick] [--json FILE|-]\n", argv[0]);
+            return 1;
+        }
+    }
+    int scale = quick ? 1 : 5;
+
+    Ctx c;
+    memset(&c, 0, sizeof(c));
+    BenchReport r = { .suite = "provision" };
+    char dir[] = "/tmp/bench_provision.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    int rc = 0;
+
+    /* keygen */
+    static const struct { KeyAlg alg; const char *name; int iters; } kg[] = {
+        { KEY_ALG_RSA2048, "keygen/rsa2048", 4 },
+        { KEY_ALG_EC_P256, "keygen/p256", 100 },
+        { KEY_ALG_ED25519, "keygen/ed25519", 100 },
+    };
+    for (size_t i = 0; i < sizeof(kg) / sizeof(kg[0]) && !rc; i++) {
+        c.alg = kg[i].alg;
+        rc = bench_run(&r, kg[i].name, 1, kg[i].iters * scale, do_keygen, &c);
+    }
+
+    /* CSR, signing, encoding and verification of a P-256 leaf */
+    c.leaf_key = key_alg_generate(KEY_ALG_EC_P256);
+    c.info = usb_info_create();
+    usb_info_set_id(c.info, "0781", "5581");
+    usb_info_set_name(c.info, "Ultra");
+    usb_info_set_serial(c.info, "4C530001230512114135");
+    c.req = certgen_build_csr(c.leaf_key, c.info);
+    if (!rc && !c.req) rc = -1;
+    if (!rc) rc = bench_run(&r, "csr/p256", 5, 200 * scale, do_csr, &c);
+
+    static const struct { KeyAlg alg; const char *sign, *verify; } cas[] = {
+        { KEY_ALG_RSA2048, "sign/ca-rsa2048", "verify/ca-rsa2048" },
+        { KEY_ALG_EC_P256, "sign/ca-p256", "verify/ca-p256" },
+    };
+    for (size_t i = 0; i < sizeof(cas) / sizeof(cas[0]) && !rc; i++) {
+        rc = setup_ca(&c, cas[i].alg, dir);
+        if (!rc) rc = bench_run(&r, cas[i].sign, 5, 100 * scale, do_sign, &c);
+        if (!rc) {
+            X509_free(c.cert);
+            c.cert = ca_signer_sign(c.signer, c.req, 365);
+            rc = c.cert ? bench_run(&r, cas[i].verify, 5, 100 * scale, do_verify, &c) : -1;
+        }
+        teardown_ca(&c);
+    }
+    if (!rc) {
+        int der_len = i2d_X509(c.cert, NULL);
+        rc = bench_run(&r, "encode/der", 10, 1000 * scale, do_der, &c);
+        bench_set_work(&r, der_len, 1);
+        if (!rc) rc = bench_run(&r, "encode/pem", 10, 1000 * scale, do_pem, &c);
+        bench_set_work(&r, der_len, 1);
+    }
+
+    /* listDevices-style rule parsing */
+    c.rules = calloc(RULES_PER_CALL, sizeof(char *));
+    for (size_t i = 0; i < RULES_PER_CALL && c.rules; i++) {
+        char rule[512];
+        snprintf(rule, sizeof(rule),
+                 "%s id %04zx:%04zx serial \"SN%08zu\" name \"Flash Drive %zu\" "
+                 "hash \"Ik0pA8dY0gVqH9sQ3lN0Tq+%06zu=\" parent-hash \"jEP/6WzviqdJ5VSeTUY8PatCNBKeaREvo2OqdplND/o=\" "
+                 "via-port \"%zu-%zu\" with-interface { 08:06:50 08:06:62 } with-connect-type \"hotplug\"",
+                 i % 3 ? "block" : "allow", 0x0781 + i % 16, 0x5567 + i % 64, i, i, i, i % 4 + 1, i % 8 + 1);
+        c.rules[i] = strdup(rule);
+        c.rules_bytes += strlen(rule);
+    }
+    if (!rc) {
+        rc = bench_run(&r, "rules/parse", 2, 50 * scale, do_rules_parse, &c);
+        bench_set_work(&r, c.rules_bytes, RULES_PER_CALL);
+    }
+    if (!rc) {
+        rc = bench_run(&r, "rules/device-list", 2, 20 * scale, do_rules_list, &c);
+        bench_set_work(&r, c.rules_bytes, RULES_PER_CALL);
+    }
+
+    /* native embed into a disk image, then in-place renewal */
+    snprintf(c.image, sizeof(c.image), "%s/disk.img", dir);
+    FILE *img = fopen(c.image, "wb");
+    if (!img || ftruncate(fileno(img), IMAGE_BYTES) != 0) rc = -1;
+    if (img) fclose(img);
+    if (!rc) rc = bench_run(&r, "embed/image", 1, 4 * scale, do_embed, &c);
+    if (!rc) rc = bench_run(&r, "embed/renew", 1, 20 * scale, do_renew, &c);
+    if (!rc) rc = check_gen0_renew(&c, dir);
+    unlink(c.image);
+    rmdir(dir);
+
+    /* metrics off (the default) vs on */
+    if (!rc) {
+        rc = bench_run(&r, "metrics/span-off", 2, 20 * scale, do_metrics, &c);
+        bench_set_work(&r, 0, SPANS_PER_CALL);
+    }
+    if (!rc) {
+        metrics_enable(1);
+        rc = bench_run(&r, "metrics/span-on", 2, 20 * scale, do_metrics, &c);
+        bench_set_work(&r, 0, SPANS_PER_CALL);
+        metrics_enable(0);
+        metrics_reset();
+    }
+
+    if (!rc) {
+        bench_report_table(&r, stdout);
+        if (json) {
+            FILE *out = strcmp(json, "-") == 0 ? stdout : fopen(json, "w");
+            if (!out) {
+                perror(json);
+                rc = 1;
+            } else {
+                bench_report_json(&r, out);
+                if (out != stdout) {
+                    fclose(out);
+                    printf("JSON: %s\n", json);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; c.rules && i < RULES_PER_CALL; i++) free(c.rules[i]);
+    free(c.rules);
+    X509_free(c.cert);
+    X509_REQ_free(c.req);
+    usb_info_free(c.info);
+    EVP_PKEY_free(c.leaf_key);
+    bench_report_free(&r);
+    return rc ? 1 : 0;
+}
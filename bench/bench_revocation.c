@@ -0,0 +1,231 @@
+/* Revocation list: load time, membership lookups, lookups during reloads, CRL round trip.
+ *
+ *   build/bench/bench_revocation [revoked serials] [reader threads]
+ *
+ * Builds a revocation store with n serials (every other counter value, so the odd ones
+ * are misses next to hits), loads it, times lookups, then keeps reader threads checking
+ * serials while the main thread reloads the list over and over: no lookup may give a
+ * wrong answer and none should wait for a reload. Finally a CRL is generated from a small
+ * store, signed with a fresh CA, loaded back, and rejected against a different CA.
+ */
+#define _DEFAULT_SOURCE
+#include "bench.h"
+#include "cert_gen.h"
+#include "revocation.h"
+
+#include <errno.h>
+#include <pthread.h>
+
+#define BATCH 100       /* lookups per timed call: one lookup is close to the timer's resolution */
+#define RELOADS 5
+
+typedef struct {
+    RevocationList *list;
+    size_t n;
+    uint64_t rng;
+} Ctx;
+
+static void make_serial(uint64_t v, unsigned char out[8]) {
+    for (int k = 7; k >= 0; k--, v >>= 8) out[k] = (unsigned char)v;
+}
+
+/* Revoked serials are FIRST + 2i, i < n */
+#define FIRST 0x100000000ull
+
+static uint64_t pick(Ctx *c, int revoked) {
+    c->rng = c->rng * 6364136223846793005ull + 1442695040888963407ull;
+    return FIRST + 2 * ((c->rng >> 33) % c->n) + (revoked ? 0 : 1);
+}
+
+static int lookup(Ctx *c, int revoked) {
+    for (int i = 0; i < BATCH; i++) {
+        unsigned char s[8];
+        make_serial(pick(c, revoked), s);
+        if (revocation_list_is_revoked(c->list, s, sizeof(s)) != revoked) return -1;
+    }
+    return 0;
+}
+
+static int lookup_hit(void *p) { return lookup(p, 1); }
+static int lookup_miss(void *p) { return lookup(p, 0); }
+
+typedef struct {
+    Ctx c;
+    volatile int *stop;
+    uint64_t lookups;
+    double max_latency;
+    int wrong;
+} Reader;
+
+static void *reader(void *arg) {
+    Reader *r = arg;
+    while (!*r->stop) {
+        for (int i = 0; i < 1000; i++) {
+            int revoked = (int)(r->lookups & 1);
+            unsigned char s[8];
+            make_serial(pick(&r->c, revoked), s);
+            double t0 = bench_now();
+            int got = revocation_list_is_revoked(r->c.list, s, sizeof(s));
+            double dt = bench_now() - t0;
+            if (dt > r->max_latency) r->max_latency = dt;
+            if (got != revoked) r->wrong++;
+            r->lookups++;
+        }
+    }
+    return NULL;
+}
+
+static int write_store(const char *path, size_t n) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    for (size_t i = 0; i < n; i++)
+        fprintf(f, "%llX %lld %d\n", (unsigned long long)(FIRST + 2 * i), 1760000000LL + (long long)i,
+                REVOCATION_REASON_KEY_COMPROMISE);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* CRL generate / load / reject with a small store and two fresh CAs */
+static int crl_round_trip(const char *dir) {
+    char store[128], crt[128], key[128], crt2[128], key2[128], crl[128];
+    snprintf(store, sizeof(store), "%s/crl-store.txt", dir);
+    snprintf(crt, sizeof(crt), "%s/ca.crt", dir);
+    snprintf(key, sizeof(key), "%s/ca.key", dir);
+    snprintf(crt2, sizeof(crt2), "%s/other.crt", dir);
+    snprintf(key2, sizeof(key2), "%s/other.key", dir);
+    snprintf(crl, sizeof(crl), "%s/ca.crl", dir);
+    int fail = 0;
+    if (certgen_generate_ca(KEY_ALG_EC_P256, "bench CA", 1, crt, key) != 0 ||
+        certgen_generate_ca(KEY_ALG_EC_P256, "bench CA", 1, crt2, key2) != 0) {
+        fprintf(stderr, "CA generation failed\n");
+        fail = 1;
+    }
+
+    const size_t n = 1000;
+    unsigned char s[8];
+    for (size_t i = 0; i < n && !fail; i++) {
+        make_serial(FIRST + 2 * i, s);
+        fail = revocation_store_add(store, s, sizeof(s), REVOCATION_REASON_SUPERSEDED) != 0;
+    }
+    make_serial(FIRST, s);
+    if (!fail && revocation_store_add(store, s, sizeof(s), 0) != 1) {
+        fprintf(stderr, "duplicate revocation not detected\n");
+        fail = 1;
+    }
+
+    RevocationList *l = revocation_list_create();
+    if (!fail) {
+        double t0 = bench_now();
+        int rc = revocation_crl_generate(store, crt, key, 7, crl);
+        double gen = bench_now() - t0;
+        t0 = bench_now();
+        int lrc = revocation_list_load_crl(l, crl, crt);
+        double load = bench_now() - t0;
+        RevocationStats st;
+        revocation_list_stats(l, &st);
+        unsigned char miss[8];
+        make_serial(FIRST + 1, miss);
+        fail = rc != (int)n || lrc != 0 || st.entries != n || st.next_update <= st.this_update ||
+               !revocation_list_is_revoked(l, s, sizeof(s)) || revocation_list_is_revoked(l, miss, sizeof(miss));
+        printf("crl      %zu entries: generate %.2f ms, verify+load %.2f ms\n", n, gen * 1e3, load * 1e3);
+    }
+    /* regenerated within the same second: the CRL number still moves forward */
+    if (!fail) {
+        RevocationStats a, b;
+        revocation_list_stats(l, &a);
+        if (revocation_crl_generate(store, crt, key, 7, crl) != (int)n || revocation_list_load_crl(l, crl, crt) != 0) {
+            fail = 1;
+        } else {
+            revocation_list_stats(l, &b);
+            if (a.number <= 0 || b.number <= a.number) {
+                fprintf(stderr, "CRL number did not increase (%lld -> %lld)\n", (long long)a.number, (long long)b.number);
+                fail = 1;
+            }
+        }
+    }
+    /* same issuer name, different key: the signature check must refuse it */
+    if (!fail && revocation_list_load_crl(l, crl, crt2) != -EBADMSG) {
+        fprintf(stderr, "CRL accepted against the wrong CA\n");
+        fail = 1;
+    }
+    revocation_list_free(l);
+    const char *files[] = { store, crt, key, crt2, key2, crl };
+    for (size_t i = 0; i < 6; i++) unlink(files[i]);
+    return fail;
+}
+
+int main(int argc, char *argv[]) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : 2;
+    if (n < 1) n = 1;
+    if (threads < 1) threads = 1;
+    char dir[] = "/tmp/bench_revocation.XXXXXX";
+    if (!mkdtemp(dir)) { perror("mkdtemp"); return 1; }
+    char store[128];
+    snprintf(store, sizeof(store), "%s/revoked.txt", dir);
+    int fail = write_store(store, n) != 0;
+
+    Ctx c = { .list = revocation_list_create(), .n = n, .rng = 7 };
+    RevocationStats st;
+    if (!fail) {
+        double t0 = bench_now();
+        fail = revocation_list_load_store(c.list, store) != 0;
+        double dt = bench_now() - t0;
+        revocation_list_stats(c.list, &st);
+        fail = fail || st.entries != n;
+        printf("load     %zu serials: %.1f ms, Bloom filter %.1f KB\n", st.entries, dt * 1e3, st.bloom_bytes / 1024.0);
+    }
+
+    BenchReport r = { .suite = "revocation" };
+    if (!fail) fail = bench_run(&r, "lookup/revoked", 100, 20000, lookup_hit, &c) != 0;
+    bench_set_work(&r, 0, BATCH);
+    if (!fail) fail = bench_run(&r, "lookup/not-revoked", 100, 20000, lookup_miss, &c) != 0;
+    bench_set_work(&r, 0, BATCH);
+    if (!fail) bench_report_table(&r, stdout);
+    bench_report_free(&r);
+
+    /* readers keep going while the list is reloaded */
+    if (!fail) {
+        volatile int stop = 0;
+        Reader *rd = calloc((size_t)threads, sizeof(Reader));
+        pthread_t *tid = calloc((size_t)threads, sizeof(pthread_t));
+        if (!rd || !tid) return 1;
+        for (int i = 0; i < threads; i++) {
+            rd[i].c = (Ctx){ .list = c.list, .n = n, .rng = 100 + (uint64_t)i };
+            rd[i].stop = &stop;
+            pthread_create(&tid[i], NULL, reader, &rd[i]);
+        }
+        double t0 = bench_now(), reload_max = 0;
+        for (int k = 0; k < RELOADS && !fail; k++) {
+            double t1 = bench_now();
+            fail = revocation_list_load_store(c.list, store) != 0;
+            double dt = bench_now() - t1;
+            if (dt > reload_max) reload_max = dt;
+        }
+        double dt = bench_now() - t0;
+        stop = 1;
+        uint64_t total = 0;
+        double max_latency = 0;
+        int wrong = 0;
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tid[i], NULL);
+            total += rd[i].lookups;
+            wrong += rd[i].wrong;
+            if (rd[i].max_latency > max_latency) max_latency = rd[i].max_latency;
+        }
+        revocation_list_stats(c.list, &st);
+        printf("reload   %d reloads (max %.1f ms) under %d readers: %.1f M lookups/s, "
+               "max lookup %.1f us, %d wrong answers, generation %llu\n",
+               RELOADS, reload_max * 1e3, threads, total / dt / 1e6, max_latency * 1e6, wrong,
+               (unsigned long long)st.generation);
+        if (wrong) fail = 1;
+        free(rd);
+        free(tid);
+    }
+    revocation_list_free(c.list);
+    unlink(store);
+
+    if (!fail) fail = crl_round_trip(dir);
+    rmdir(dir);
+    printf("%s\n", fail ? "FAIL" : "OK");
+    return fail;
+}
@@ -0,0 +1,123 @@
+/* USBGuard rule parsing throughput on a synthetic 10k-device list.
+ *
+ *   legacy     the former strstr()-per-attribute scan (id / name / serial only)
+ *   tokenizer  usbguard_rule_parse(): one pass, every attribute, views only
+ *   devices    usbguard_device_from_rule(): tokenizer + UsbDeviceInfo construction
+ *
+ *   build/bench/bench_rules [devices] [rounds]
+ */
+#define _DEFAULT_SOURCE
+#include "usbguard_interface.h"
+#include "usbguard_rule.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* what usbguard_list_devices() used to do per rule */
+static void legacy_parse(const char *rule, char *id, char *name, char *serial) {
+    const char *p = strstr(rule, "id ");
+    if (p) sscanf(p + 3, "%31s", id);
+    p = strstr(rule, "name \"");
+    if (p) {
+        p += 6;
+        const char *q = strchr(p, '"');
+        if (q) { size_t l = (size_t)(q - p) < 255 ? (size_t)(q - p) : 255; memcpy(name, p, l); name[l] = 0; }
+    }
+    p = strstr(rule, "serial \"");
+    if (p) {
+        p += 8;
+        const char *q = strchr(p, '"');
+        if (q) { size_t l = (size_t)(q - p) < 255 ? (size_t)(q - p) : 255; memcpy(serial, p, l); serial[l] = 0; }
+    }
+}
+
+static int check(const char *rule, UsbGuardRuleAttr attr, const char *expect) {
+    UsbGuardRule r;
+    char buf[256] = "";
+    if (usbguard_rule_parse(rule, (size_t)-1, &r) == 0 && r.attrs[attr].present)
+        strview_unescape(r.attrs[attr].raw, buf, sizeof(buf));
+    if (strcmp(buf, expect) != 0) {
+        fprintf(stderr, "parse mismatch for %s: got '%s', want '%s'\n", usbguard_rule_attr_name(attr), buf, expect);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t ndev = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    if (ndev < 1) ndev = 1;
+    if (rounds < 1) rounds = 1;
+
+    /* cases the strstr scan got wrong */
+    const char *tricky = "block id 0781:5567 serial \"A\\\"B id 9\" name \"Flash \\\"X\\\"\" "
+                         "hash \"h\" parent-hash \"via-port id 1\" via-port \"1-2\" "
+                         "with-interface { 08:06:50 08:06:62 } with-connect-type \"hotplug\"";
+    int bad = check(tricky, RULE_ATTR_ID, "0781:5567") + check(tricky, RULE_ATTR_SERIAL, "A\"B id 9") +
+              check(tricky, RULE_ATTR_NAME, "Flash \"X\"") + check(tricky, RULE_ATTR_PARENT_HASH, "via-port id 1") +
+              check(tricky, RULE_ATTR_WITH_INTERFACE, " 08:06:50 08:06:62 ") +
+              check(tricky, RULE_ATTR_WITH_CONNECT_TYPE, "hotplug");
+    if (bad) return 1;
+
+    char **rules = malloc(ndev * sizeof(char *));
+    size_t bytes = 0;
+    for (size_t i = 0; i < ndev; i++) {
+        char r[512];
+        snprintf(r, sizeof(r),
+                 "%s id %04zx:%04zx serial \"SN%08zu\" name \"Flash Drive %zu\" "
+                 "hash \"Ik0pA8dY0gVqH9sQ3lN0Tq+%06zu=\" parent-hash \"jEP/6WzviqdJ5VSeTUY8PatCNBKeaREvo2OqdplND/o=\" "
+                 "via-port \"%zu-%zu\" with-interface { 08:06:50 08:06:62 } with-connect-type \"hotplug\"",
+                 i % 3 ? "block" : "allow", 0x0781 + i % 16, 0x5567 + i % 64, i, i, i, i % 4 + 1, i % 8 + 1);
+        rules[i] = strdup(r);
+        bytes += strlen(r);
+    }
+
+    volatile size_t sink = 0;
+    double t0 = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < ndev; i++) {
+            char id[32] = "", name[256] = "", serial[256] = "";
+            legacy_parse(rules[i], id, name, serial);
+            sink += id[0] + name[0] + serial[0];
+        }
+    }
+    double legacy = now_seconds() - t0;
+
+    t0 = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < ndev; i++) {
+            UsbGuardRule rule;
+            if (usbguard_rule_parse(rules[i], (size_t)-1, &rule) != 0) { fprintf(stderr, "parse error\n"); return 1; }
+            sink += rule.attrs[RULE_ATTR_SERIAL].raw.len;
+        }
+    }
+    double tok = now_seconds() - t0;
+
+    t0 = now_seconds();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < ndev; i++) {
+            UsbDeviceInfo *d = usbguard_device_from_rule((unsigned)i, rules[i]);
+            sink += d->property_count;
+            usb_info_free(d);
+        }
+    }
+    double dev = now_seconds() - t0;
+
+    double total = (double)ndev * rounds, mb = (double)bytes * rounds / 1e6;
+    printf("%zu devices x %d rounds, %.0f bytes/rule\n", ndev, rounds, (double)bytes / ndev);
+    printf("legacy     %8.0f ns/rule  %8.1f MB/s  (id, name, serial)\n", legacy * 1e9 / total, mb / legacy);
+    printf("tokenizer  %8.0f ns/rule  %8.1f MB/s  (all attributes)\n", tok * 1e9 / total, mb / tok);
+    printf("devices    %8.0f ns/rule  %8.1f MB/s  (UsbDeviceInfo incl. properties)\n", dev * 1e9 / total, mb / dev);
+
+    for (size_t i = 0; i < ndev; i++) free(rules[i]);
+    free(rules);
+    return sink == 0;
+}
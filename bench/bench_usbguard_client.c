@@ -0,0 +1,77 @@
+/* USBGuard request latency: new connection per call vs persistent client vs pipelined.
+ *
+ * Needs the USBGuard stand-in on a private bus, e.g.
+ *   make tools && tools/usbguard_stub_session.sh --devices 50 -- build/bench/bench_usbguard_client [calls]
+ * Without USBGUARD_DBUS_ADDRESS the benchmark is skipped.
+ */
+#define _DEFAULT_SOURCE
+#include "usbguard_client.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PIPELINE_DEPTH 8
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int list_once(UsbGuardClient *c, const char *query) {
+    UsbDeviceList *l = NULL;
+    int rc = usbguard_client_list_devices(c, query, &l);
+    usbguard_free_device_list(l);
+    return rc;
+}
+
+int main(int argc, char *argv[]) {
+    int calls = argc > 1 ? atoi(argv[1]) : 500;
+    if (calls < PIPELINE_DEPTH) calls = PIPELINE_DEPTH;
+    if (!usbguard_bus_address()) {
+        printf("usbguard_client skipped, run under tools/usbguard_stub_session.sh (needs USBGUARD_DBUS_ADDRESS)\n");
+        return 0;
+    }
+    /* a narrow query, as issued per device in loops */
+    const char *query = "block";
+
+    /* connect + resolve + call each time (what every usbguard_list_devices() used to do) */
+    int fresh_calls = calls / 10 ? calls / 10 : 1;
+    double t0 = now_seconds();
+    for (int i = 0; i < fresh_calls; i++) {
+        UsbGuardClient *c = usbguard_client_open(0);
+        if (!c || list_once(c, query) != 0) { fprintf(stderr, "request failed\n"); return 1; }
+        usbguard_client_close(c);
+    }
+    double fresh_us = (now_seconds() - t0) * 1e6 / fresh_calls;
+
+    UsbGuardClient *c = usbguard_client_open(0);
+    if (!c) return 1;
+    printf("service: %s\n", usbguard_client_service(c));
+
+    t0 = now_seconds();
+    for (int i = 0; i < calls; i++) {
+        if (list_once(c, query) != 0) { fprintf(stderr, "request failed\n"); return 1; }
+    }
+    double seq_us = (now_seconds() - t0) * 1e6 / calls;
+
+    /* keep PIPELINE_DEPTH requests in flight */
+    UsbGuardCall *ring[PIPELINE_DEPTH];
+    t0 = now_seconds();
+    for (int i = 0; i < PIPELINE_DEPTH; i++) ring[i] = usbguard_client_list_devices_async(c, query);
+    for (int i = 0; i < calls; i++) {
+        UsbDeviceList *l = NULL;
+        int slot = i % PIPELINE_DEPTH;
+        if (usbguard_call_wait_devices(ring[slot], &l) != 0) { fprintf(stderr, "request failed\n"); return 1; }
+        usbguard_free_device_list(l);
+        ring[slot] = i + PIPELINE_DEPTH < calls ? usbguard_client_list_devices_async(c, query) : NULL;
+    }
+    double pipe_us = (now_seconds() - t0) * 1e6 / calls;
+    usbguard_client_close(c);
+
+    printf("connect per call    %8.1f us/call  (%d calls)\n", fresh_us, fresh_calls);
+    printf("persistent client   %8.1f us/call  (%d calls)\n", seq_us, calls);
+    printf("pipelined (%d deep)  %8.1f us/call  (%d calls)\n", PIPELINE_DEPTH, pipe_us, calls);
+    return 0;
+}
@@ -0,0 +1,124 @@
+/* USBGuard policy bursts: one decision per round trip vs a pipelined batch, and the rule
+ * cache keeping repeated permanent decisions from growing the policy.
+ *
+ * Needs the USBGuard stand-in on a private bus, e.g.
+ *   make tools && tools/usbguard_stub_session.sh --devices 50 -- build/bench/bench_usbguard_policy
+ * Without USBGUARD_DBUS_ADDRESS the benchmark is skipped.
+ */
+#define _DEFAULT_SOURCE
+#include "usbguard_policy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PREAUTH_RULE "allow id 0781:5567 serial \"PRE%06zu\" hash \"pre%06zu\""
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long rule_count(UsbGuardClient *c) {
+    UsbDeviceList *l = NULL;
+    if (usbguard_call_wait_devices(usbguard_client_list_rules_async(c, ""), &l) != 0) return -1;
+    long n = (long)l->count;
+    usbguard_free_device_list(l);
+    return n;
+}
+
+static int run_batch(const char *name, UsbGuardClient *c, UsbGuardRuleCache *cache, const UsbGuardDecision *d,
+                     size_t n, UsbGuardDecisionResult *res, long expect_new_rules, double rtt_us) {
+    UsbGuardBatchStats st;
+    long before = rule_count(c);
+    int failed = usbguard_apply_batch(c, cache, d, n, res, &st);
+    long added = rule_count(c) - before;
+    printf("%-22s %8.1f us  %5.1f RTT  calls %3zu  cached %3zu  skipped %3zu  rules +%ld\n", name,
+           st.seconds * 1e6, st.seconds * 1e6 / rtt_us, st.calls, st.cached, st.skipped, added);
+    if (failed != 0 || before < 0 || added != expect_new_rules) {
+        fprintf(stderr, "%s: %d failed, %ld rule(s) appended, expected %ld\n", name, failed, added, expect_new_rules);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t burst = argc > 1 ? strtoul(argv[1], NULL, 10) : 50;
+    if (!usbguard_bus_address()) {
+        printf("usbguard_policy skipped, run under tools/usbguard_stub_session.sh (needs USBGUARD_DBUS_ADDRESS)\n");
+        return 0;
+    }
+    UsbGuardClient *c = usbguard_client_open(0);
+    UsbDeviceList *devs = NULL;
+    if (!c || usbguard_client_list_devices(c, "", &devs) != 0) {
+        fprintf(stderr, "cannot list devices\n");
+        return 1;
+    }
+    if (devs->count < burst) burst = devs->count;
+    if (burst == 0) {
+        fprintf(stderr, "no devices (start the stub with --devices N)\n");
+        return 1;
+    }
+
+    UsbGuardDecision *d = calloc(burst, sizeof(*d)), *pre = calloc(burst, sizeof(*pre));
+    UsbGuardDecisionResult *res = calloc(burst, sizeof(*res));
+    char (*pre_rules)[96] = calloc(burst, sizeof(*pre_rules));
+    UsbGuardRuleCache *cache = usbguard_rule_cache_create();
+    int rc = d && pre && res && pre_rules && cache ? 0 : 1;
+    for (size_t i = 0; i < burst && rc == 0; i++) {
+        if (usb_info_usbguard_id(devs->devices[i], &d[i].device_id) != 0) rc = 1;
+        d[i].target = USBGUARD_TARGET_BLOCK;
+        d[i].device_rule = usb_info_raw_info(devs->devices[i]);
+        snprintf(pre_rules[i], sizeof(pre_rules[i]), PREAUTH_RULE, i, i);
+        pre[i].target = USBGUARD_TARGET_ALLOW;
+        pre[i].permanent = 1;
+        pre[i].rule = pre_rules[i];
+    }
+
+    /* one decision per round trip, as a loop over usbguard_client_apply_policy would do. Every
+     * run below changes the target, so each decision also costs a DevicePolicyChanged signal. */
+    double t0 = now_seconds();
+    for (size_t i = 0; i < burst && rc == 0; i++) {
+        uint32_t rule_id;
+        if (usbguard_call_wait_u32(usbguard_client_apply_policy_async(c, d[i].device_id, USBGUARD_TARGET_ALLOW, 0),
+                                   &rule_id) != 0)
+            rc = 1;
+    }
+    double seq_us = (now_seconds() - t0) * 1e6;
+    double rtt_us = seq_us / burst;
+    if (rc == 0) {
+        printf("%zu devices, service %s, round trip %.1f us\n", burst, usbguard_client_service(c), rtt_us);
+        printf("%-22s %8.1f us  %5.1f RTT\n", "sequential/temporary", seq_us, seq_us / rtt_us);
+    }
+
+    if (rc == 0) rc = run_batch("batch/temporary", c, NULL, d, burst, res, 0, rtt_us);
+    for (size_t i = 0; i < burst; i++) {
+        d[i].target = USBGUARD_TARGET_ALLOW;
+        d[i].permanent = 1;
+    }
+    if (rc == 0) rc = usbguard_rule_cache_load(cache, c) != 0;
+    /* the first permanent burst appends one rule per device, the second none */
+    if (rc == 0) rc = run_batch("batch/permanent", c, cache, d, burst, res, (long)burst, rtt_us);
+    if (rc == 0) rc = run_batch("batch/permanent-cached", c, cache, d, burst, res, 0, rtt_us);
+    for (size_t i = 0; i < burst && rc == 0; i++) rc = res[i].cached ? 0 : 1;
+    /* pre-authorisation rules for sticks not plugged in yet */
+    if (rc == 0) rc = run_batch("append/new", c, cache, pre, burst, res, (long)burst, rtt_us);
+    if (rc == 0) rc = run_batch("append/cached", c, cache, pre, burst, res, 0, rtt_us);
+    /* a fresh cache seeded from listRules must know all of them */
+    if (rc == 0) rc = usbguard_rule_cache_load(cache, c) != 0;
+    for (size_t i = 0; i < burst && rc == 0; i++)
+        rc = usbguard_rule_cache_contains(cache, USBGUARD_TARGET_ALLOW, d[i].device_rule) &&
+             usbguard_rule_cache_contains(cache, USBGUARD_TARGET_ALLOW, pre_rules[i]) ? 0 : 1;
+    if (rc == 0) printf("rule cache after reload: %zu rule(s)\n", usbguard_rule_cache_size(cache));
+
+    usbguard_rule_cache_free(cache);
+    free(pre_rules);
+    free(res);
+    free(pre);
+    free(d);
+    usbguard_free_device_list(devs);
+    usbguard_client_close(c);
+    printf("%s\n", rc == 0 ? "OK" : "FAIL");
+    return rc;
+}
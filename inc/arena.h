@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator: memory comes from a chain of chunks that double in size, and is
+// released all at once by arena_destroy. Individual allocations are never freed.
+// Not thread-safe; one arena belongs to one object graph (e.g. a UsbDeviceList).
+
+typedef struct Arena Arena;
+
+// first_chunk 0 selects 4 KiB
+Arena *arena_create(size_t first_chunk);
+void arena_destroy(Arena *arena);
+
+// 16-byte aligned; arena_zalloc returns zeroed memory. Strings are packed unaligned.
+void *arena_alloc(Arena *arena, size_t size);
+void *arena_zalloc(Arena *arena, size_t size);
+
+// Grow an allocation; extended in place when it is the most recent one
+void *arena_realloc(Arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+char *arena_strdup(Arena *arena, const char *s);
+char *arena_strndup(Arena *arena, const char *s, size_t len);
+
+// Bytes handed out / reserved from malloc, and number of chunks
+void arena_stats(const Arena *arena, size_t *used, size_t *reserved, size_t *chunks);
+
+#endif // ARENA_H
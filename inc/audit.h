@@ -0,0 +1,88 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include "cert_verify.h"
+#include "revocation.h"
+#include "usbguard_interface.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+
+// Fleet audit: check the certificates on many attached sticks at once.
+//
+// Two thread pools form a pipeline. io_workers threads take the next device, resolve its
+// sysfs identity and read its USB_SIG payload (cert_verify_read: GPT plus a few sectors),
+// so at most io_workers devices are being read at any time - hubs and their controllers
+// slow down badly under many concurrent readers. Each finished read is queued for
+// verify_workers threads that check chain, validity, revocation and device binding
+// (cert_verify_payload) on the CPU. Wall time is then roughly the larger of total I/O /
+// io_workers and total verification / verify_workers, not the per-device sum.
+//
+// The expected CN comes from the USBGuard entry matching the block device (its serial, or
+// an unambiguous VID:PID for sticks without one), or from sysfs when USBGuard does not
+// list the stick.
+
+// audit_find_devices flags
+#define AUDIT_FIND_LOOP     0x1     // also attached loop devices (test racks of image files)
+
+// Number of VerifyStatus values, for the per-status counters
+#define AUDIT_STATUS_COUNT  (VERIFY_REVOKED + 1)
+
+typedef struct {
+    const char *ca_cert_path;       // default "cert/ca.crt"
+    RevocationList *revocation;     // borrowed; NULL = revocation not checked
+    const UsbDeviceList *guard;     // USBGuard's device list (borrowed); NULL = sysfs identity only
+    int io_workers;                 // concurrent USB_SIG readers, default 4
+    int verify_workers;             // 0 = online CPUs
+    int expiry_warn_days;           // valid certificates expiring within this many days are
+                                    // flagged (default 30, 0 = never)
+} AuditConfig;
+
+typedef enum {
+    AUDIT_IDENTITY_SYSFS = 0,       // expected CN from the block device's sysfs ancestry
+    AUDIT_IDENTITY_USBGUARD         // expected CN from the matching USBGuard device
+} AuditIdentity;
+
+typedef struct {
+    const char *device;             // borrowed from the caller's device array
+    AuditIdentity identity;
+    const UsbDeviceInfo *guard_device;  // matching entry of cfg->guard (borrowed), or NULL
+    char expected_cn[256];
+    VerifyResult verify;
+    int expiring;                   // VERIFY_OK, but notAfter within expiry_warn_days
+    double read_ms;                 // identity + USB_SIG read
+    double verify_ms;
+} AuditDevice;
+
+typedef struct {
+    size_t devices;
+    size_t by_status[AUDIT_STATUS_COUNT];
+    size_t expiring;
+    double seconds;                 // wall time of audit_run
+    double read_seconds;            // sums over all devices
+    double verify_seconds;
+} AuditSummary;
+
+void audit_config_init(AuditConfig *cfg);
+
+// Audit count devices (block devices or disk-image files); results[i] belongs to
+// devices[i]. Returns 0 (findings are in the results, not the return code) or a negative
+// errno: -EINVAL, -ENOENT if the CA certificate cannot be loaded, -EAGAIN for threads.
+int audit_run(const AuditConfig *cfg, const char *const *devices, size_t count,
+              AuditDevice *results, AuditSummary *summary);
+
+// Candidate sticks: whole block devices under /sys/block that sit on a USB bus and have
+// a medium, as "/dev/<name>" sorted by name. Free with audit_free_devices.
+int audit_find_devices(int flags, char ***devices, size_t *count);
+void audit_free_devices(char **devices, size_t count);
+
+// 1 if device is a block special file for one of the sticks audit_find_devices would list
+// with the same flags (a whole disk, not a partition), 0 otherwise.
+int audit_is_usb_disk(const char *device, int flags);
+
+// One JSON document: run summary plus one object per device, in device order
+int audit_write_json(FILE *out, const AuditConfig *cfg, const AuditDevice *results, size_t count,
+                     const AuditSummary *summary);
+
+#endif // AUDIT_H
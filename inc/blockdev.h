@@ -0,0 +1,44 @@
+#ifndef BLOCKDEV_H
+#define BLOCKDEV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw access to a whole USB stick: a block device (/dev/sdX, /dev/loopN) or a plain
+// disk-image file, addressed by byte offset. All functions return 0 or a negative errno.
+
+typedef struct {
+    int fd;
+    int is_block;               // 1 for block devices, 0 for image files
+    uint32_t sector_size;       // logical sector size (512 for image files)
+    uint64_t size_bytes;        // device / image size
+} BlockDev;
+
+// Open for reading (writable = 0) or read-write. Block devices opened for writing are
+// opened O_EXCL, which fails with -EBUSY while any partition is mounted.
+int blockdev_open(BlockDev *bd, const char *path, int writable);
+void blockdev_close(BlockDev *bd);
+
+// Full-length positional I/O (retries short transfers and EINTR)
+int blockdev_pread(BlockDev *bd, void *buf, size_t len, uint64_t off);
+int blockdev_pwrite(BlockDev *bd, const void *buf, size_t len, uint64_t off);
+
+// Make [off, off+len) read as zeros: BLKZEROOUT / fallocate where possible, zero writes otherwise
+int blockdev_zero(BlockDev *bd, uint64_t off, uint64_t len);
+
+// fdatasync
+int blockdev_sync(BlockDev *bd);
+
+// Drop cached pages for a range so the next read comes from the medium (best-effort)
+void blockdev_drop_cache(BlockDev *bd, uint64_t off, uint64_t len);
+
+// Ask the kernel to re-read the partition table (block devices only; best-effort)
+int blockdev_reread_partitions(BlockDev *bd);
+
+// Zeroed buffer aligned for direct sector I/O; free with free()
+void *blockdev_alloc(const BlockDev *bd, size_t len);
+
+// Round len up to a whole number of sectors
+size_t blockdev_round_up(const BlockDev *bd, size_t len);
+
+#endif // BLOCKDEV_H
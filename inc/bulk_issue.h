@@ -0,0 +1,56 @@
+#ifndef BULK_ISSUE_H
+#define BULK_ISSUE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "key_alg.h"
+#include "ledger.h"
+#include "serial_alloc.h"
+
+// Offline bulk issuance: certificates for a shipment of sticks known only from a manifest,
+// before any of them is plugged in.
+//
+// Manifest: one device per line, either CSV
+//     0781:5581,SanDisk Ultra,4C530001230512114135
+// (first field VID:PID, last field serial, anything between is the name; an "id,..."
+// header, blank lines and '#' comments are skipped) or a JSON object per line
+//     {"id":"0781:5581","name":"SanDisk Ultra","serial":"4C530001230512114135"}
+//
+// Bundle: one JSON object per manifest device, in manifest order:
+//     {"line":3,"id":"0781:5581","name":"SanDisk Ultra","serial":"4C53...","cn":"4C53...",
+//      "cert_serial":"0100000007","not_after":1792000000,"cert":"<base64 DER>",
+//      "key":"<base64 PKCS#8 DER>"}
+// or, for a device that failed, {"line":4,"serial":"...","error":"csr","rc":-3}.
+//
+// The manifest is read by the calling thread while workers issue certificates; at most
+// `window` devices are in flight or waiting to be written in order, so memory use does
+// not depend on the manifest size.
+
+typedef struct {
+    const char *ca_cert_path;   // default "cert/ca.crt"
+    const char *ca_key_path;    // default "cert/ca.key"
+    KeyAlg key_alg;             // default KEY_ALG_RSA2048
+    int days;                   // default 365
+    int workers;                // 0 -> online CPUs
+    size_t window;              // devices in flight, 0 -> 8 per worker
+    int include_keys;           // 1 (default): the bundle carries each device's private key
+    SerialAlloc *serials;       // borrowed, NULL = random 127-bit serials
+    Ledger *ledger;             // borrowed, NULL = not recorded
+} BulkConfig;
+
+typedef struct {
+    uint64_t devices;           // manifest entries (comments and blank lines excluded)
+    uint64_t issued;
+    uint64_t failed;            // unparsable entries included
+    uint64_t max_in_flight;     // high-water mark of the window
+    double seconds;
+} BulkStats;
+
+void bulk_config_init(BulkConfig *cfg);
+
+// Issue a certificate for every device in manifest and stream the results to bundle.
+// Returns the number of failed devices or a negative errno (CA not loadable, write error,
+// -EAGAIN if no worker thread could be started).
+int bulk_issue(const BulkConfig *cfg, FILE *manifest, FILE *bundle, BulkStats *stats);
+
+#endif // BULK_ISSUE_H
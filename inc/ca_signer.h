@@ -0,0 +1,34 @@
+#ifndef CA_SIGNER_H
+#define CA_SIGNER_H
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include "serial_alloc.h"
+
+// Long-lived CA signer: parses the CA certificate and key once and caches the issuer
+// name, the fixed leaf extensions and a digest-sign context already initialised with
+// the CA key. Each signing only builds the leaf and runs the signature itself.
+// A signer is immutable after creation and may be shared by concurrent threads.
+
+typedef struct CaSigner CaSigner;
+
+// Load CA certificate + key from PEM files. Returns NULL on error.
+CaSigner *ca_signer_create(const char *ca_cert_path, const char *ca_key_path);
+
+// Build a signer from already loaded objects (the signer takes its own references)
+CaSigner *ca_signer_from_objects(X509 *ca, EVP_PKEY *ca_pkey);
+
+// Serial numbers for issued certificates. Default (NULL): random 127-bit serials.
+// The allocator is borrowed and must outlive the signer; set it before sharing the signer.
+void ca_signer_set_serials(CaSigner *signer, SerialAlloc *serials);
+
+// Issue a certificate for req valid for `days` days (<= 0 -> 365). Free with X509_free.
+X509 *ca_signer_sign(CaSigner *signer, X509_REQ *req, int days);
+
+// Borrowed CA certificate / key (valid for the signer's lifetime)
+X509 *ca_signer_cert(const CaSigner *signer);
+EVP_PKEY *ca_signer_key(const CaSigner *signer);
+
+void ca_signer_free(CaSigner *signer);
+
+#endif // CA_SIGNER_H
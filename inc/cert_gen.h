@@ -1,9 +1,65 @@
 #ifndef CERT_GEN_H
 #define CERT_GEN_H
 #include "usb_info.h"
+#include "keypool.h"
+#include "key_alg.h"
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#include <stddef.h>
 
 char *test_sanitize_component(const char *input);
 
+// Install a key pool: keys of the pool's algorithm are then taken from it instead of
+// being generated inline (NULL restores inline keygen). Set it before starting workers.
+void certgen_set_keypool(KeyPool *pool);
+
+// ---- In-memory pipeline: objects stay in memory between stages ----
+
+// Result codes of a pipeline stage whose OpenSSL call failed. They are reported in station
+// results and bulk bundles, so the values stay as they are.
+#define CERTGEN_ERR_KEY     (-2)    // certgen_generate_key_alg returned NULL
+#define CERTGEN_ERR_CSR     (-8)    // certgen_build_csr returned NULL
+#define CERTGEN_ERR_SIGN    (-12)   // signing returned NULL
+#define CERTGEN_ERR_CA      (-5)    // CA certificate or key could not be loaded
+
+// Generate a device key (from the key pool when one of this algorithm is installed).
+// Free with EVP_PKEY_free.
+EVP_PKEY *certgen_generate_key_alg(KeyAlg alg);
+
+// RSA shorthand for certgen_generate_key_alg
+EVP_PKEY *certgen_generate_key(int bits);
+
+// Subject CN the device's certificate carries: sanitized serial, else id, else name
+void certgen_subject_cn(const UsbDeviceInfo *usbInfo, char *cn, size_t cnsz);
+
+// Build and self-sign a CSR for the device (digest follows the key type). Free with X509_REQ_free.
+X509_REQ *certgen_build_csr(EVP_PKEY *pkey, const UsbDeviceInfo *usbInfo);
+
+// Issue a certificate for the CSR, signed by ca/ca_pkey. Free with X509_free.
+// One-shot; for repeated signing keep a CaSigner (ca_signer.h) instead.
+X509 *certgen_sign_csr(X509_REQ *req, X509 *ca, EVP_PKEY *ca_pkey, int days);
+
+// Load CA certificate and key once; caller frees both
+int certgen_load_ca(const char *ca_cert_path, const char *ca_key_path, X509 **ca_out, EVP_PKEY **ca_key_out);
+
+// Serialize final artifacts (PEM files, key written 0600)
+int certgen_write_key_pem(const char *key_path, EVP_PKEY *pkey);
+int certgen_write_csr_pem(const char *csr_path, X509_REQ *req);
+int certgen_write_cert_pem(const char *cert_path, X509 *cert);
+
+// DER-encode a certificate into a new buffer (free with OPENSSL_free)
+int certgen_cert_to_der(X509 *cert, unsigned char **der, size_t *der_len);
+
+// Create a self-signed CA (key + certificate PEM) using the given algorithm
+int certgen_generate_ca(KeyAlg alg, const char *common_name, int days,
+                        const char *ca_cert_path, const char *ca_key_path);
+
+// ---- File-based API (thin wrappers over the in-memory pipeline) ----
+
+// Generate a device key of any supported algorithm and save it as PEM
+int certgen_generate_key_pem_alg(const char *usb_key_path, KeyAlg alg);
+
 // Function tạo private key và lưu vào file PEM
 int certgen_generate_key_pem(const char *usb_key_path, int bits);
 
@@ -0,0 +1,98 @@
+#ifndef CERT_VERIFY_H
+#define CERT_VERIFY_H
+
+#include "usb_info.h"
+#include "usbguard_interface.h"
+#include "revocation.h"
+#include "sig_container.h"
+
+#include <openssl/x509.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Plug-in time verification: read the certificate from a stick's USB_SIG, validate the
+// chain against the CA certificate and check that the subject CN is the one issued for
+// the device USBGuard reports. Successful results are cached in an LRU keyed by
+// (device CN, payload SHA-256) until the certificate's notAfter, so a re-plugged stick
+// costs one or two sector reads and a hash instead of a signature verification.
+// A verifier may be shared by concurrent threads.
+
+typedef enum {
+    VERIFY_OK = 0,
+    VERIFY_NO_CERT,             // no USB_SIG partition or no valid container in it
+    VERIFY_BAD_CHAIN,           // signature / chain does not lead to the CA
+    VERIFY_EXPIRED,             // outside notBefore..notAfter
+    VERIFY_MISBOUND,            // valid certificate, but issued for another device
+    VERIFY_IO_ERROR,            // device could not be opened / read
+    VERIFY_REVOKED              // valid chain, but the serial is on the revocation list
+} VerifyStatus;
+
+typedef struct {
+    VerifyStatus status;
+    int from_cache;             // 1 if answered by the identity cache
+    int x509_error;             // X509_V_ERR_* for VERIFY_BAD_CHAIN / VERIFY_EXPIRED
+    int io_error;               // negative errno for VERIFY_IO_ERROR / VERIFY_NO_CERT
+    char subject_cn[256];
+    char serial_hex[80];        // certificate serial number (hex)
+    time_t not_after;
+    unsigned char sha256[32];   // of the container payload (certificate + chain)
+} VerifyResult;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+} VerifyCacheStats;
+
+typedef struct CertVerifier CertVerifier;
+
+// Load the trusted CA certificate(s) from a PEM file. cache_capacity 0 disables the cache.
+CertVerifier *cert_verifier_create(const char *ca_cert_path, size_t cache_capacity);
+void cert_verifier_free(CertVerifier *verifier);
+
+// Verify the certificate on a block device / image. expected is the device as USBGuard
+// (or sysfs) describes it; its CN (see certgen_subject_cn) must match the certificate.
+// With expected == NULL only the chain is checked and the cache is bypassed.
+VerifyStatus cert_verify_device(CertVerifier *verifier, const char *dev_path,
+                                const UsbDeviceInfo *expected, VerifyResult *result);
+
+// The two halves of cert_verify_device, so the USB_SIG sector reads and the signature
+// checks can run on different threads (see audit.h). cert_verify_read only does I/O and
+// never needs a verifier; its status is VERIFY_OK, VERIFY_NO_CERT or VERIFY_IO_ERROR
+// (errno in rc). cert_verify_payload passes a failed read through as the result.
+typedef struct {
+    VerifyStatus status;
+    int rc;
+    SigContainerInfo info;
+    unsigned char *der, *chain_der;     // certificate / concatenated chain DER
+    size_t der_len, chain_len;
+} VerifyPayload;
+
+VerifyStatus cert_verify_read(const char *dev_path, VerifyPayload *payload);
+VerifyStatus cert_verify_payload(CertVerifier *verifier, const VerifyPayload *payload,
+                                 const UsbDeviceInfo *expected, VerifyResult *result);
+void cert_verify_payload_free(VerifyPayload *payload);
+
+// Verify an already parsed certificate (chain may be NULL); the cache key uses the
+// SHA-256 of the certificate DER.
+VerifyStatus cert_verify_x509(CertVerifier *verifier, X509 *cert, STACK_OF(X509) *chain,
+                              const UsbDeviceInfo *expected, VerifyResult *result);
+
+// Check certificates against a revocation list (borrowed; NULL to stop checking). Cached
+// identities are re-checked on every hit, so reloading the list takes effect immediately.
+void cert_verifier_set_revocation(CertVerifier *verifier, RevocationList *list);
+
+// Find the USBGuard entry for a block device: by serial, or by VID:PID (unambiguous only)
+// if the block device has no serial. NULL if there is no such entry.
+const UsbDeviceInfo *cert_verify_match_usbguard(const UsbDeviceList *list, const UsbDeviceInfo *block_info);
+
+// Drop every cached identity (e.g. after the CA or revocation list changed)
+void cert_verifier_flush(CertVerifier *verifier);
+
+void cert_verifier_cache_stats(CertVerifier *verifier, VerifyCacheStats *stats);
+
+const char *cert_verify_status_name(VerifyStatus status);
+
+#endif // CERT_VERIFY_H
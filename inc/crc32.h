@@ -0,0 +1,14 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE 802.3, reflected, as used by GPT headers and partition arrays).
+// Pass crc = 0 for a fresh checksum, or a previous result to continue.
+uint32_t crc32_ieee(uint32_t crc, const void *data, size_t len);
+
+// CRC-32C (Castagnoli), same calling convention; used by the USB_SIG container.
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+#endif // CRC32_H
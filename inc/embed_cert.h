@@ -1,7 +1,44 @@
 #ifndef EMBED_CERT_H
 #define EMBED_CERT_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <openssl/x509.h>
+#include "sig_container.h"
+
+// Flags for embed_cert_ex
+#define EMBED_FLAG_ASSUME_YES   0x1   // skip the interactive device confirmation (--yes)
+#define EMBED_FLAG_FORMAT_DATA  0x2   // also make a FAT32 file system on the data partition
+                                      // (--format-data; native: fat32.h, script: mkfs.vfat)
+#define EMBED_FLAG_RENEW        0x4   // native only: renew into the inactive A/B slot, no repartitioning
+
 // Function to embed a certificate into USB
 void embed_cert(const char *usb_script, const char *usb_device, const char *signature_path);
 
-#endif
\ No newline at end of file
+// Same as embed_cert but with flags; returns 0 on success, the script exit status otherwise
+int embed_cert_ex(const char *usb_script, const char *usb_device, const char *signature_path, int flags);
+
+// Native path (no script, no sudo, no external tools): write protective MBR + GPT
+// (USB_SIG 1-2 MiB, USB_DATA rest), then the signature at USB_SIG's offset, and
+// verify by reading back only the written sectors; EMBED_FLAG_FORMAT_DATA then formats
+// USB_DATA in place (fat32.h). Works on block devices and on plain disk-image files.
+// Returns 0 or a negative errno (-EBADMSG on verify mismatch).
+int embed_cert_native(const char *usb_device, const unsigned char *sig, size_t sig_len, int flags);
+
+// Natively embed a certificate (and optional chain) as a USB_SIG container (sig_container.h):
+// one header sector plus the DER payload instead of a PEM padded to 1 MiB.
+int embed_cert_x509(const char *usb_device, X509 *cert, STACK_OF(X509) *chain, int flags);
+
+// Renew in place: keep the partition table and the data partition, write the certificate
+// into the inactive A/B slot of the existing USB_SIG and flip the generation (two syncs,
+// a few sectors). -ENOENT if the stick has no USB_SIG partition. slot/generation optional.
+int embed_renew_x509(const char *usb_device, X509 *cert, STACK_OF(X509) *chain, int *slot, uint64_t *generation);
+
+// Same, with the certificate read from a PEM file; further PEM certificates become the chain.
+// EMBED_FLAG_RENEW selects embed_renew_x509 instead of a full re-provision.
+int embed_cert_native_file(const char *usb_device, const char *signature_path, int flags);
+
+// Read the certificate back from USB_SIG (header + payload sectors only). info is optional.
+int embed_read_cert(const char *usb_device, X509 **cert_out, SigContainerInfo *info);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef FAT32_H
+#define FAT32_H
+
+#include <stdint.h>
+#include "blockdev.h"
+
+// In-process FAT32 formatter for the USB_DATA partition (what `mkfs.vfat -F 32` did in
+// usbPartition.sh --format-data). Works on the partition's byte range of the whole
+// device, so no partition device node, partprobe or udevadm settle is needed.
+//
+// Layout inside the partition (offsets in sectors, fatgen103 / dosfstools conventions):
+//    0  boot sector (BPB, "FAT32   ", 0x55AA)
+//    1  FSInfo (free cluster count and next-free hint)
+//    6  backup boot sector, 7 backup FSInfo
+//    R  FAT #1, R + F  FAT #2           R = reserved sectors (>= 32, data cluster aligned)
+//    R + 2F  data region; cluster 2 is the root directory (volume label entry only)
+// Cluster size follows the Microsoft table (512 B up to 260 MiB, 4 KiB to 8 GiB, 8 KiB to
+// 16 GiB, 16 KiB to 32 GiB, 32 KiB above). Only the reserved area, both FATs and the root
+// cluster are written; the data region is left as it is. The boot sector is written last,
+// so an interrupted format never looks like a valid file system.
+
+#define FAT32_MIN_CLUSTERS  65525u          // fewer clusters would make it FAT16 by definition
+#define FAT32_MAX_CLUSTERS  0x0FFFFFF5u
+
+typedef struct {
+    uint32_t bytes_per_sector;
+    uint32_t sectors_per_cluster;
+    uint32_t reserved_sectors;
+    uint32_t fat_sectors;               // per FAT
+    uint32_t clusters;                  // data clusters
+    uint64_t total_sectors;
+    uint32_t volume_id;
+    uint64_t bytes_written;             // reserved area, FAT heads and root cluster written
+    uint64_t bytes_zeroed;              // FAT areas cleared with zero-range requests
+} Fat32Info;
+
+// Format the byte range [part_offset, part_offset + part_bytes) of bd. label may be NULL
+// ("NO NAME"); it is upper-cased and cut to 11 characters. volume_id 0 = random.
+// Returns 0 or a negative errno (-ENOSPC: too small for FAT32, needs about 33 MiB;
+// -EFBIG: more than 2^32 sectors).
+int fat32_format(BlockDev *bd, uint64_t part_offset, uint64_t part_bytes, const char *label,
+                 uint32_t volume_id, Fat32Info *info);
+
+// Format the USB_DATA partition of a stick or disk-image file (-ENOENT without one)
+int fat32_format_device(const char *device, const char *label, Fat32Info *info);
+
+#endif // FAT32_H
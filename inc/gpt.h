@@ -0,0 +1,36 @@
+#ifndef GPT_H
+#define GPT_H
+
+#include "blockdev.h"
+#include <stdint.h>
+
+// Native GPT writer/reader for the stick layout usbPartition.sh used to create with
+// sgdisk/parted: protective MBR + GPT, "USB_SIG" at 1-2 MiB, "USB_DATA" from 2 MiB
+// to the end (MiB aligned). Primary and backup headers carry proper CRC32s.
+
+#define GPT_SIG_PART_NAME   "USB_SIG"
+#define GPT_DATA_PART_NAME  "USB_DATA"
+#define GPT_MIN_DEVICE_BYTES (4ULL * 1024 * 1024)
+
+typedef struct {
+    uint64_t first_lba;
+    uint64_t last_lba;          // inclusive
+    uint32_t sector_size;
+    char name[37];              // ASCII rendering of the UTF-16LE partition name
+} GptPartition;
+
+// Byte offset / length of a partition on the device
+uint64_t gpt_part_offset(const GptPartition *part);
+uint64_t gpt_part_size(const GptPartition *part);
+
+// Wipe any previous table and write protective MBR, primary + backup GPT with the
+// USB_SIG / USB_DATA layout. sig/data (optional) receive the created partitions.
+// Returns 0 or a negative errno (-ENOSPC if the device is smaller than 4 MiB).
+int gpt_write_usb_layout(BlockDev *bd, GptPartition *sig, GptPartition *data);
+
+// Look up a partition by name in the primary GPT (falling back to the backup header
+// when the primary fails its CRC checks). Returns 0, -ENOENT if absent, -EBADMSG
+// if there is no valid GPT, or another negative errno.
+int gpt_find_partition(BlockDev *bd, const char *name, GptPartition *out);
+
+#endif // GPT_H
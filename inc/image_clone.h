@@ -0,0 +1,40 @@
+#ifndef IMAGE_CLONE_H
+#define IMAGE_CLONE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Golden-image cloner: streams a payload image (typically a FAT filesystem image) into the
+// USB_DATA partition of a stick or disk-image file.
+//
+// The source is walked by extents (lseek SEEK_DATA / SEEK_HOLE), so holes in a sparse
+// image are never read; all-zero chunks inside data extents are detected as well. Both
+// become zero-range requests on the target (BLKZEROOUT / fallocate) instead of writes.
+// Data is read by a reader thread into one of two large aligned buffers while the caller
+// writes the other, so reading the image and writing the stick overlap.
+
+// image_clone_to_device flags
+#define IMAGE_CLONE_PARTITION   0x1     // write the USB_SIG / USB_DATA layout first if the
+                                        // target has no USB_DATA partition
+#define IMAGE_CLONE_NO_ZERO     0x2     // target is known to read as zeros (fresh image file):
+                                        // leave holes alone instead of zeroing them
+#define IMAGE_CLONE_DENSE       0x4     // read and write every byte (no hole / zero detection)
+
+#define IMAGE_CLONE_CHUNK_DEFAULT (4u * 1024 * 1024)
+
+typedef struct {
+    uint64_t image_bytes;       // size of the source image
+    uint64_t bytes_written;     // data written to the target
+    uint64_t bytes_zeroed;      // holes and zero chunks turned into zero-range requests
+    uint64_t bytes_skipped;     // holes left alone (IMAGE_CLONE_NO_ZERO)
+    double seconds;             // including the final sync
+    double mbps;                // image_bytes / seconds, in MB/s
+} CloneStats;
+
+// Copy image_path to the start of USB_DATA on device and sync. chunk_size 0 = default.
+// Returns 0 or a negative errno: -ENOENT without a USB_DATA partition (and no
+// IMAGE_CLONE_PARTITION), -EFBIG if the image is larger than the partition.
+int image_clone_to_device(const char *device, const char *image_path, int flags, size_t chunk_size,
+                          CloneStats *stats);
+
+#endif // IMAGE_CLONE_H
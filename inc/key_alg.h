@@ -0,0 +1,36 @@
+#ifndef KEY_ALG_H
+#define KEY_ALG_H
+
+#include <openssl/evp.h>
+
+// Key algorithms usable for device keys and for the CA
+typedef enum {
+    KEY_ALG_RSA2048 = 0,
+    KEY_ALG_RSA3072,
+    KEY_ALG_RSA4096,
+    KEY_ALG_EC_P256,
+    KEY_ALG_EC_P384,
+    KEY_ALG_ED25519,
+    KEY_ALG_COUNT
+} KeyAlg;
+
+// Short name ("rsa2048", "p256", "ed25519", ...)
+const char *key_alg_name(KeyAlg alg);
+
+// Parse a short name; returns -1 if unknown
+int key_alg_from_name(const char *name, KeyAlg *alg);
+
+// Map an RSA size to its KeyAlg; returns -1 if not one of 2048/3072/4096
+int key_alg_from_rsa_bits(int bits, KeyAlg *alg);
+
+// Which algorithm an existing key uses; returns -1 if unsupported
+int key_alg_of_key(const EVP_PKEY *pkey, KeyAlg *alg);
+
+// Generate a fresh key (no key pool involved). Free with EVP_PKEY_free.
+EVP_PKEY *key_alg_generate(KeyAlg alg);
+
+// Digest to sign with for this key: SHA-256 (RSA, P-256), SHA-384 (P-384),
+// NULL for Ed25519 which hashes internally (pass NULL to X509_sign / DigestSignInit)
+const EVP_MD *key_alg_digest_for_key(const EVP_PKEY *pkey);
+
+#endif // KEY_ALG_H
@@ -0,0 +1,56 @@
+#ifndef KEYPOOL_H
+#define KEYPOOL_H
+
+#include "key_alg.h"
+
+#include <openssl/evp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Background key pre-generation pool (any KeyAlg; it matters most for RSA).
+// Worker threads keep a bounded in-memory queue of ready keys between the low and
+// high watermarks, so provisioning takes a key in O(1) instead of running keygen.
+// Optionally, keys left at shutdown are spilled to an encrypted on-disk spool
+// (AES-256-CBC PEM, 0600 files) and loaded back on the next start.
+
+typedef struct KeyPool KeyPool;
+
+typedef struct {
+    KeyAlg alg;                 // algorithm of the pooled keys (default KEY_ALG_RSA2048)
+    size_t high_watermark;      // producers stop when this many keys are ready (default 8)
+    size_t low_watermark;       // producers restart when the queue drops to this (default 2)
+    int threads;                // producer threads (default 1)
+    const char *spool_dir;      // optional encrypted spool directory (NULL = memory only)
+    const char *spool_pass;     // passphrase for the spool, required when spool_dir is set
+} KeyPoolConfig;
+
+typedef struct {
+    size_t available;           // keys ready right now
+    uint64_t generated;         // keys produced by the worker threads
+    uint64_t loaded;            // keys recovered from the spool
+    uint64_t taken;             // keys handed out
+    uint64_t waits;             // keypool_take calls that found the queue empty
+    double wait_seconds;        // total time callers spent blocked in keypool_take
+} KeyPoolStats;
+
+// Fill config with defaults
+void keypool_config_init(KeyPoolConfig *cfg);
+
+// Create the pool and start its producers. Returns NULL on error.
+KeyPool *keypool_create(const KeyPoolConfig *cfg);
+
+// Take a ready key (caller owns it, free with EVP_PKEY_free). Blocks while the pool is empty.
+// Returns NULL only if the pool is shutting down.
+EVP_PKEY *keypool_take(KeyPool *pool);
+
+// Algorithm the pool produces
+KeyAlg keypool_alg(const KeyPool *pool);
+
+// Snapshot of the pool counters
+void keypool_get_stats(KeyPool *pool, KeyPoolStats *stats);
+
+// Stop producers, spill unused keys to the spool (if configured) and free the rest.
+// Private key material is cleared from memory before it is released.
+void keypool_destroy(KeyPool *pool);
+
+#endif // KEYPOOL_H
@@ -0,0 +1,103 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <openssl/x509.h>
+#include "usb_info.h"
+
+// Issued-certificate ledger: an append-only log of every certificate the CA signs, with
+// memory-mapped hash indexes by certificate serial and by device serial.
+//
+// <dir>/ledger.log     records, appended with one write() each, all integers little-endian:
+//    0  magic "LGR1"              4
+//    4  record length             u32   header + strings, padded to 8
+//    8  CRC32C                    u32   of the record with this field zeroed
+//   12  version (1)               u16
+//   14  serial length             u8    DER INTEGER content bytes, <= 20
+//   15  device id length          u8
+//   16  issued at                 i64   unix seconds
+//   24  notBefore                 i64
+//   32  notAfter                  i64
+//   40  certificate SHA-256       32    of the DER certificate
+//   72  device serial length      u16
+//   74  subject length            u16
+//   76  reserved (zero)           4
+//   80  serial, device id, device serial, subject (no terminators)
+//
+// <dir>/serial.idx, <dir>/device.idx   open-addressing tables of (key hash, log offset),
+// grown by doubling. They are derived data: each remembers how much of the log it covers,
+// so opening replays only the log tail, and a missing or damaged index is rebuilt from
+// the log. The covered length only advances after the slots it describes are msync'ed
+// (on every append, or at ledger_sync / ledger_close with LEDGER_OPEN_NOSYNC). A torn record at the end of the log (crash during append) is cut off on open.
+// Lookups probe the mapped table and read the candidate records with pread.
+//
+// The log is flock()ed: one writer process at a time. Within a process all calls are
+// thread-safe (lookups share a read lock, appends take the write lock).
+
+#define LEDGER_SERIAL_MAX           20
+#define LEDGER_DEVICE_ID_MAX        64
+#define LEDGER_DEVICE_SERIAL_MAX    128
+#define LEDGER_SUBJECT_MAX          256
+
+// ledger_open flags
+#define LEDGER_OPEN_NOSYNC  0x1     // appends are not fdatasync'ed one by one (bulk use:
+                                    // call ledger_sync at checkpoints)
+
+typedef struct Ledger Ledger;
+
+typedef struct {
+    unsigned char serial[LEDGER_SERIAL_MAX];
+    size_t serial_len;
+    char device_id[LEDGER_DEVICE_ID_MAX];           // "vvvv:pppp" or empty
+    char device_serial[LEDGER_DEVICE_SERIAL_MAX];   // USB iSerial or empty
+    char subject[LEDGER_SUBJECT_MAX];               // X509_NAME_oneline form, "/CN=..."
+    int64_t issued_at;
+    int64_t not_before;
+    int64_t not_after;
+    unsigned char sha256[32];
+    uint64_t offset;                                // log offset, set by the ledger
+} LedgerEntry;
+
+typedef struct {
+    uint64_t records;
+    uint64_t log_bytes;
+    uint64_t replayed;          // records indexed from the log tail at open
+    int rebuilt;                // 1 if an index was rebuilt from scratch at open
+    int truncated;              // 1 if a torn tail record was cut off at open
+} LedgerStats;
+
+// Open or create the ledger in dir (created if missing). Returns 0 and *out or a negative
+// errno: -EBUSY if another process has it open, -EBADMSG on a corrupt record mid-log.
+int ledger_open(const char *dir, int flags, Ledger **out);
+
+// ledger_sync, then release the lock
+void ledger_close(Ledger *l);
+
+// Fill an entry from an issued certificate and the device it was issued for (info optional)
+int ledger_entry_from_cert(X509 *cert, const UsbDeviceInfo *info, LedgerEntry *e);
+
+// Append (durable on return unless LEDGER_OPEN_NOSYNC). Sets e->offset. Returns 0 or -errno.
+int ledger_append(Ledger *l, LedgerEntry *e);
+
+// Make all appends so far durable and covered by the indexes
+int ledger_sync(Ledger *l);
+
+// Certificate by serial (content bytes of the DER INTEGER). 0, -ENOENT or -errno.
+int ledger_find_serial(Ledger *l, const unsigned char *serial, size_t serial_len, LedgerEntry *out);
+
+// Certificates issued for a device serial, newest first. Fills up to max entries and
+// returns how many exist in total (may exceed max), or a negative errno.
+int ledger_find_device_serial(Ledger *l, const char *device_serial, LedgerEntry *out, size_t max);
+
+// Visit all records in log order; stop early when cb returns non-zero (returned as is)
+int ledger_foreach(Ledger *l, int (*cb)(const LedgerEntry *e, void *user), void *user);
+
+void ledger_get_stats(Ledger *l, LedgerStats *st);
+
+// Serial bytes as upper-case hex (buf >= 2 * LEDGER_SERIAL_MAX + 1), and back
+void ledger_serial_hex(const LedgerEntry *e, char *buf, size_t len);
+int ledger_serial_from_hex(const char *hex, unsigned char *out, size_t *out_len);
+
+#endif // LEDGER_H
@@ -0,0 +1,101 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Process-wide provisioning metrics: monotonic-clock spans around each pipeline stage
+// (kept as latency histograms) plus counters for devices, failures by (stage, code) and
+// bytes written. Disabled by default; while disabled every call is one predicted-not-taken
+// branch on a global flag, no clock read and no atomic.
+//
+//   uint64_t t = metrics_span_begin();
+//   rc = do_stage();
+//   metrics_span_end(METRIC_STAGE_SIGN, t);
+//
+// Export as Prometheus text format (node_exporter textfile collector) or as JSON lines.
+// All recording functions are thread-safe.
+
+typedef enum {
+    METRIC_STAGE_INFO = 0,      // device identification (sysfs / USBGuard)
+    METRIC_STAGE_KEY,           // key generation or key pool take
+    METRIC_STAGE_CSR,
+    METRIC_STAGE_SIGN,          // CA signing
+    METRIC_STAGE_WRITE,         // key / certificate PEM files
+    METRIC_STAGE_EMBED,         // whole embed step (the rows below are parts of it)
+    METRIC_STAGE_PARTITION,     // protective MBR + GPT
+    METRIC_STAGE_SIG_WRITE,     // USB_SIG payload write + sync
+    METRIC_STAGE_VERIFY,        // read-back of the written sectors
+    METRIC_STAGE_SETTLE,        // partition table re-read (udevadm settle equivalent)
+    METRIC_STAGE_SCRIPT,        // usbPartition.sh (partition, dd, verify in one system())
+    METRIC_STAGE_DBUS,          // USBGuard D-Bus call, send to reply
+    METRIC_STAGE_CLONE,         // golden image into USB_DATA (image_clone.h)
+    METRIC_STAGE_CLONE_WAIT,    // station: time spent waiting for the clone after signing
+    METRIC_STAGE_FORMAT,        // FAT32 on USB_DATA (fat32.h)
+    METRIC_STAGE_COUNT
+} MetricStage;
+
+typedef enum {
+    METRIC_DEVICES_PROVISIONED = 0,
+    METRIC_DEVICES_FAILED,
+    METRIC_BYTES_WRITTEN,       // bytes written or zeroed on the target devices
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+extern int metrics_on;
+
+// Turn collection on or off (off by default). Recorded values are kept.
+void metrics_enable(int on);
+static inline int metrics_enabled(void) { return __builtin_expect(metrics_on, 0); }
+
+// Monotonic clock in nanoseconds
+uint64_t metrics_now_ns(void);
+
+void metrics_record_span(MetricStage stage, uint64_t ns);
+void metrics_record_add(MetricCounter counter, uint64_t n);
+void metrics_record_failure(MetricStage stage, int code);
+
+// Span start: 0 when disabled, so the matching end is a no-op
+static inline uint64_t metrics_span_begin(void) {
+    return metrics_enabled() ? metrics_now_ns() : 0;
+}
+
+static inline void metrics_span_end(MetricStage stage, uint64_t start) {
+    if (start) metrics_record_span(stage, metrics_now_ns() - start);
+}
+
+static inline void metrics_add(MetricCounter counter, uint64_t n) {
+    if (metrics_enabled()) metrics_record_add(counter, n);
+}
+
+// Count a failed stage with its return code (negative errno or the stage's own code)
+static inline void metrics_failure(MetricStage stage, int code) {
+    if (metrics_enabled()) metrics_record_failure(stage, code);
+}
+
+// Snapshot of one stage
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} MetricSpanStats;
+
+void metrics_span_stats(MetricStage stage, MetricSpanStats *out);
+uint64_t metrics_counter(MetricCounter counter);
+
+// Forget everything recorded so far
+void metrics_reset(void);
+
+const char *metrics_stage_name(MetricStage stage);
+
+// Prometheus text exposition format (counters, per-stage histograms in seconds)
+int metrics_write_prometheus(FILE *out);
+
+// One JSON object on one line: {"ts":...,"counters":{...},"stages":{...},"failures":[...]}
+int metrics_write_json(FILE *out);
+
+// Write to path: "*.prom" is replaced atomically (tmp + rename) with the Prometheus
+// text, anything else gets one JSON line appended. Returns 0 or a negative errno.
+int metrics_export(const char *path);
+
+#endif // METRICS_H
@@ -0,0 +1,127 @@
+#ifndef PROVD_H
+#define PROVD_H
+
+#include "station.h"
+#include "revocation.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Provisioning daemon: one long-running process that keeps the CA signer, the certificate
+// verifier (and its identity cache), the USBGuard connection and OpenSSL warm, and takes
+// provisioning, renewal and verification requests over a Unix domain socket.
+//
+// Wire format, all integers little-endian. Every frame is a 12-byte header and a payload:
+//   u32 payload length (<= PROVD_MAX_PAYLOAD)
+//   u32 request id     (chosen by the client, echoed in the reply)
+//   u8  op             (ProvdOp; replies carry op | PROVD_OP_REPLY)
+//   u8  flags, u16 reserved (0)
+// Request payload: the absolute device path (no NUL), empty for ping / stats. Only USB
+// whole-disk block devices are accepted (audit_is_usb_disk), others are answered -ENODEV.
+// Reply payload:
+//   i32 rc             (0 or a negative errno)
+//   u8  detail         (StationStage for provision / renew, VerifyStatus for verify)
+//   u8  from_cache     (verify answered by the identity cache)
+//   u16 reserved
+//   u32 service_us     (queue + processing time inside the daemon)
+//   text               (certificate path, subject CN, or the stats JSON)
+// A client may pipeline any number of requests on one connection; replies can arrive out
+// of order and are matched by request id.
+//
+// Requests are queued per lane (provision / renew, and verify) and a lane thread takes up
+// to batch_max of them at a time. A provisioning batch is one station_run on the warm
+// signer; its lane waits up to batch_window_ms for a burst to fill the batch. A verify
+// batch is whatever queued while the previous one ran, sharing one USBGuard device listing.
+// With queue_depth requests queued (or conn_inflight on one connection) the daemon stops
+// reading the sockets concerned, so clients block in write() instead of the daemon
+// buffering without bound. Ping and stats are answered by the socket thread directly.
+//
+// The socket is mode 0660; on top of that a connection is closed unless its peer
+// (SO_PEERCRED) is root, has uid peer_uid or has primary gid peer_gid.
+
+#define PROVD_SOCKET_PATH   "output/provd.sock"
+#define PROVD_HEADER_SIZE   12
+#define PROVD_REPLY_FIXED   12      // reply payload bytes before the text
+#define PROVD_MAX_PAYLOAD   4096
+
+typedef enum {
+    PROVD_OP_PING = 0,
+    PROVD_OP_PROVISION,
+    PROVD_OP_RENEW,
+    PROVD_OP_VERIFY,
+    PROVD_OP_STATS,
+    PROVD_OP_COUNT
+} ProvdOp;
+
+#define PROVD_OP_REPLY      0x80
+
+typedef struct {
+    const char *socket_path;        // default PROVD_SOCKET_PATH
+    StationConfig station;          // provision / renew template; renew and signer are set per
+                                    // lane, use_script and data_image are not supported
+    RevocationList *revocation;     // borrowed; NULL = revocation not checked
+    int use_usbguard;               // 1 (default): verify against USBGuard's device entry
+    size_t verify_cache;            // identity cache entries, default 256
+    size_t queue_depth;             // queued requests before reading pauses, default 256
+    size_t conn_inflight;           // per connection, default 64
+    size_t batch_max;               // default 16
+    int batch_window_ms;            // provisioning lane, default 2
+    int device_flags;               // audit_is_usb_disk flags (AUDIT_FIND_LOOP: loop devices too)
+    int allow_image_files;          // also accept regular files (disk images); tests only
+    uid_t peer_uid;                 // default the daemon's effective uid
+    gid_t peer_gid;                 // default its effective gid; (gid_t)-1 = uid only
+} ProvdConfig;
+
+typedef struct {
+    uint64_t connections;
+    uint64_t requests;              // provision / renew / verify received
+    uint64_t completed;
+    uint64_t batches;
+    size_t max_batch;
+    size_t queue_peak;
+    uint64_t stalls;                // times reading paused for backpressure
+    uint64_t refused;               // connections from peers that are not allowed
+} ProvdStats;
+
+typedef struct ProvdServer ProvdServer;
+
+void provd_config_init(ProvdConfig *cfg);
+
+// Load the CA, bind the socket (a stale socket file is replaced; -EADDRINUSE if a daemon
+// answers on it) and start serving. Returns NULL with *error set to a negative errno.
+ProvdServer *provd_start(const ProvdConfig *cfg, int *error);
+
+// Stop accepting, let running batches finish, drop queued requests and close all
+// connections, then free the server and remove the socket file.
+void provd_stop(ProvdServer *server);
+
+void provd_get_stats(ProvdServer *server, ProvdStats *stats);
+
+const char *provd_op_name(ProvdOp op);
+
+// ---------- client ----------
+
+typedef struct {
+    uint32_t id;
+    ProvdOp op;
+    int rc;
+    uint8_t detail;
+    uint8_t from_cache;
+    uint32_t service_us;
+    char text[PROVD_MAX_PAYLOAD - PROVD_REPLY_FIXED + 1];
+} ProvdReply;
+
+// Blocking connection to a daemon. Returns the socket fd or a negative errno.
+int provd_connect(const char *socket_path);
+
+// Send one request (device may be NULL for ping / stats) / receive the next reply.
+// Return 0 or a negative errno (-EPIPE: the daemon closed the connection).
+int provd_send(int fd, uint32_t id, ProvdOp op, const char *device);
+int provd_recv(int fd, ProvdReply *reply);
+
+// provd_send + provd_recv, for one request at a time
+int provd_call(int fd, ProvdOp op, const char *device, ProvdReply *reply);
+
+#endif // PROVD_H
@@ -0,0 +1,68 @@
+#ifndef REVOCATION_H
+#define REVOCATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Certificate revocation for lost or compromised sticks.
+//
+// The revocation store is a local append-only text file, one revoked certificate per line:
+//   <serial hex> <revocation time, unix seconds> <CRL reason code>
+// revocation_crl_generate() turns it into a CRL signed with the CA key (the same CA files
+// the signer uses), for distribution to verifying hosts.
+//
+// A RevocationList holds an immutable set of revoked serials loaded from a CRL or directly
+// from the store: a sorted array of fixed-width serials behind a Bloom filter, so the
+// common "not revoked" answer costs a few bit tests and a hit a binary search. Reloading
+// builds the new set off to the side and publishes it with one pointer swap; lookups never
+// wait for a reload (the reloading thread waits for readers of the old set to drain).
+
+#define REVOCATION_SERIAL_MAX 20
+
+// CRL reason codes (RFC 5280)
+#define REVOCATION_REASON_UNSPECIFIED       0
+#define REVOCATION_REASON_KEY_COMPROMISE    1
+#define REVOCATION_REASON_SUPERSEDED        4
+#define REVOCATION_REASON_CESSATION         5
+
+typedef struct RevocationList RevocationList;
+
+typedef struct {
+    size_t entries;             // revoked serials in the current set
+    uint64_t generation;        // number of successful loads
+    time_t this_update;         // CRL lastUpdate (0 when loaded from the store)
+    time_t next_update;         // CRL nextUpdate, 0 if none
+    int64_t number;             // CRL number, 0 if none or loaded from the store
+    size_t bloom_bytes;
+} RevocationStats;
+
+// Append a serial (big-endian content bytes) to the store; already revoked serials are
+// left alone. Returns 0, 1 if it was already revoked, or a negative errno.
+int revocation_store_add(const char *store_path, const unsigned char *serial, size_t serial_len, int reason);
+
+// Build a CRL from the store (missing store = empty CRL), valid for `days` days, signed
+// with the CA key, and write it as PEM. Its CRL number is the larger of the current time and
+// the number of the CRL it replaces plus one, so it strictly increases at crl_path.
+// Returns the number of entries or a negative errno.
+int revocation_crl_generate(const char *store_path, const char *ca_cert_path, const char *ca_key_path,
+                            int days, const char *crl_path);
+
+RevocationList *revocation_list_create(void);
+void revocation_list_free(RevocationList *list);
+
+// Replace the set with the CRL at crl_path after checking its signature against the CA
+// certificate. On error the previous set stays in place. Returns 0 or a negative errno
+// (-EBADMSG: unparsable or wrongly signed CRL). An expired CRL still loads: nextUpdate is
+// only reported in RevocationStats, and the caller decides whether to warn or refuse.
+int revocation_list_load_crl(RevocationList *list, const char *crl_path, const char *ca_cert_path);
+
+// Replace the set with the serials of a revocation store
+int revocation_list_load_store(RevocationList *list, const char *store_path);
+
+// 1 if revoked, 0 otherwise. Safe to call concurrently with loads.
+int revocation_list_is_revoked(RevocationList *list, const unsigned char *serial, size_t serial_len);
+
+void revocation_list_stats(RevocationList *list, RevocationStats *stats);
+
+#endif // REVOCATION_H
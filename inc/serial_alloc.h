@@ -0,0 +1,56 @@
+#ifndef SERIAL_ALLOC_H
+#define SERIAL_ALLOC_H
+
+#include <stdint.h>
+#include <openssl/asn1.h>
+
+// Certificate serial numbers that are unique across threads and process restarts.
+//
+// Counter mode: a persistent 64-bit counter in a small state file. Serials are reserved
+// in blocks: the file records the end of the current block (one pwrite + fdatasync per
+// block, not per certificate) and serials inside the block are handed out with a single
+// atomic add. After a crash or restart the unused rest of a block is skipped, never
+// reissued. The state file is flock()ed, so two processes cannot share it.
+//
+// Random mode (no state file): 16-byte positive serials from the OpenSSL DRBG. The top
+// bit is cleared to keep the DER INTEGER positive, so each carries 127 random bits (the
+// CA/Browser Forum baseline requirements ask for at least 64).
+//
+// An allocator may be shared by any number of threads.
+
+typedef struct SerialAlloc SerialAlloc;
+
+typedef struct {
+    const char *state_path;     // counter state file; NULL selects random 127-bit serials
+    uint64_t block_size;        // serials reserved per fsync (default 4096)
+    uint64_t first_serial;      // first serial of a new state file (default 2^32, above
+                                // the time()-based serials older releases issued)
+} SerialAllocConfig;
+
+typedef struct {
+    int random;                 // 1 in random mode
+    uint64_t next;              // next counter serial (counter mode)
+    uint64_t reserved;          // end of the reserved block (exclusive)
+    uint64_t issued;            // serials handed out by this allocator
+    uint64_t blocks;            // blocks reserved (= fsyncs) by this allocator
+} SerialAllocStats;
+
+// Fill config with defaults
+void serial_alloc_config_init(SerialAllocConfig *cfg);
+
+// Open (or create) the allocator. Returns 0 and *out, or a negative errno:
+// -EBUSY if another process holds the state file, -EBADMSG if it is corrupt.
+int serial_alloc_create(const SerialAllocConfig *cfg, SerialAlloc **out);
+
+// Next counter serial. -EINVAL in random mode, -EIO if a block cannot be persisted.
+int serial_alloc_next_u64(SerialAlloc *a, uint64_t *out);
+
+// Store the next serial (either mode) into serial
+int serial_alloc_assign(SerialAlloc *a, ASN1_INTEGER *serial);
+
+void serial_alloc_get_stats(SerialAlloc *a, SerialAllocStats *st);
+
+// Release the state file lock; the rest of the current block is abandoned
+void serial_alloc_free(SerialAlloc *a);
+
+#endif // SERIAL_ALLOC_H
@@ -0,0 +1,89 @@
+#ifndef SIG_CONTAINER_H
+#define SIG_CONTAINER_H
+
+#include "blockdev.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// On-device signature container stored at the start of USB_SIG.
+//
+// Sector 0 (512 bytes) is the header, all integers little-endian:
+//   0  magic "USB-SIG\0"          8
+//   8  version (1)                u16
+//  10  header bytes used (128)    u16
+//  12  key algorithm (KeyAlg)     u16   0xFFFF = unknown
+//  14  flags                      u16   SIG_CONTAINER_FLAG_*
+//  16  certificate length         u32
+//  20  chain length               u32   concatenated DER certificates, 0 if none
+//  24  payload offset             u32   from container start, sector aligned (512)
+//  28  payload CRC32C             u32
+//  32  payload SHA-256            32
+//  64  generation                 u64   slot sequence number (see below)
+//  72  reserved (zero)            52
+// 124  header CRC32C of [0,124)   u32
+// The payload (DER certificate followed by the optional chain) starts at sector 1, so a
+// reader touches the header sector plus ceil(payload / 512) sectors.
+//
+// A/B slots: USB_SIG holds two containers, slot A at offset 0 and slot B at 512 KiB.
+// The valid slot with the highest generation is current (A on a tie; a container from
+// before A/B slots is valid with generation 0). Renewal writes the other
+// slot (payload first, header sector last, each followed by a sync) with generation + 1,
+// so a power loss at any point leaves the previous certificate readable.
+
+#define SIG_CONTAINER_MAGIC         "USB-SIG"
+#define SIG_CONTAINER_VERSION       1
+#define SIG_CONTAINER_SECTOR        512
+#define SIG_CONTAINER_ALG_UNKNOWN   0xFFFF
+#define SIG_CONTAINER_FLAG_CHAIN    0x0001
+
+#define SIG_SLOT_COUNT              2
+#define SIG_SLOT_BYTES              (512u * 1024u)
+
+typedef struct {
+    uint16_t version;
+    uint16_t alg;
+    uint16_t flags;
+    uint32_t cert_len;
+    uint32_t chain_len;
+    uint32_t payload_offset;
+    uint32_t payload_crc;
+    uint8_t sha256[32];
+    uint64_t generation;
+} SigContainerInfo;
+
+// Build a container (generation 1): header sector + payload padded to whole 512-byte sectors.
+// *out is malloc'd (free with free()). chain may be NULL. Returns 0 or a negative errno.
+int sig_container_encode(const unsigned char *cert_der, size_t cert_len,
+                         const unsigned char *chain_der, size_t chain_len,
+                         int alg, unsigned char **out, size_t *out_len);
+
+// Validate a header sector (magic, version, CRC32C, sane lengths). Returns 0 or -EBADMSG.
+int sig_container_parse_header(const unsigned char *hdr, size_t hdr_len, SigContainerInfo *info);
+
+// Validate the payload against a parsed header (CRC32C and SHA-256). Returns 0 or -EBADMSG.
+int sig_container_check_payload(const SigContainerInfo *info, const unsigned char *payload, size_t len);
+
+// Read the container stored at byte offset `off` (at most max_len bytes) of a device.
+// On success *cert_der (and *chain_der when non-NULL and present) are malloc'd.
+int sig_container_read(BlockDev *bd, uint64_t off, uint64_t max_len, SigContainerInfo *info,
+                       unsigned char **cert_der, size_t *cert_len,
+                       unsigned char **chain_der, size_t *chain_len);
+
+// Change the generation of an encoded container (re-computes the header CRC)
+void sig_container_set_generation(unsigned char *container, uint64_t generation);
+
+// Read the current certificate from the A/B slots of a USB_SIG partition at part_off.
+// Falls back to the other slot if the newest one fails its checks. slot (optional)
+// receives the slot index read. Output buffers as for sig_container_read.
+int sig_slots_read(BlockDev *bd, uint64_t part_off, uint64_t part_len, SigContainerInfo *info,
+                   unsigned char **cert_der, size_t *cert_len,
+                   unsigned char **chain_der, size_t *chain_len, int *slot);
+
+// Write container into the slot sig_slots_read would not return (chosen by header if
+// neither slot reads back, B on a tie) with generation = highest valid generation + 1
+// (1 if none), payload before header, and verify the written sectors. slot / generation
+// (optional) receive where and as what it was written. Returns 0 or a negative errno.
+int sig_slots_write_next(BlockDev *bd, uint64_t part_off, uint64_t part_len,
+                         unsigned char *container, size_t len, int *slot, uint64_t *generation);
+
+#endif // SIG_CONTAINER_H
@@ -0,0 +1,77 @@
+#ifndef STATION_H
+#define STATION_H
+
+#include <stddef.h>
+#include <limits.h>
+#include "key_alg.h"
+#include "serial_alloc.h"
+#include "ledger.h"
+#include "ca_signer.h"
+
+// Station mode: provision many USB sticks in parallel on a worker pool.
+// Each device runs the full pipeline (key -> CSR -> CA sign -> partition + embed)
+// on a block device or a disk-image file
+// with its own output directory, so concurrent jobs never share files.
+// Key, CSR and certificate stay in memory; the CA is loaded once per batch.
+
+// Pipeline stage a device stopped at (STATION_STAGE_DONE on success)
+typedef enum {
+    STATION_STAGE_INFO = 0,
+    STATION_STAGE_KEY,
+    STATION_STAGE_CSR,
+    STATION_STAGE_SIGN,
+    STATION_STAGE_WRITE,
+    STATION_STAGE_CLONE,        // waiting for / failed in the golden-image copy
+    STATION_STAGE_EMBED,
+    STATION_STAGE_DONE
+} StationStage;
+
+typedef struct {
+    const char *ca_cert_path;   // default "cert/ca.crt"
+    const char *ca_key_path;    // default "cert/ca.key"
+    const char *script_path;    // default "usbPartition.sh"
+    const char *output_dir;     // per-device artifacts go to <output_dir>/<escaped device path>/
+                                // ("/dev/sdb" -> dev-sdb, "/img/a_1.img" -> img-a_5f1.img)
+    KeyAlg key_alg;             // device key algorithm, default KEY_ALG_RSA2048
+    int days;                   // default 365
+    int workers;                // 0 -> min(device count, online CPUs)
+    int embed_flags;            // EMBED_FLAG_*; station always adds EMBED_FLAG_ASSUME_YES
+    int use_script;             // 1: partition/embed via script_path instead of the native writer
+    int renew;                  // 1: renew into the inactive A/B slot of an already provisioned
+                                // stick instead of repartitioning it
+    SerialAlloc *serials;       // certificate serials (borrowed); NULL = random 127-bit
+    CaSigner *signer;           // CA already loaded (borrowed, serials set by the owner), e.g. by
+                                // a long-running daemon; NULL = load ca_*_path for this batch
+    Ledger *ledger;             // every issued certificate is recorded here (borrowed), NULL = none
+    const char *data_image;     // golden image streamed into USB_DATA (image_clone.h), NULL = none.
+                                // The copy runs while the key is generated and signed; native
+                                // embed only (not with use_script or renew) and never with
+                                // EMBED_FLAG_FORMAT_DATA, which would wipe the clone
+} StationConfig;
+
+// Per-device result
+typedef struct {
+    const char *device;
+    StationStage stage;         // STATION_STAGE_DONE on success, else the failing stage
+    int rc;                     // return code of the failing stage (0 on success)
+    double seconds;             // wall time spent on this device
+    double clone_mbps;          // golden-image copy throughput, 0 without data_image
+    char key_path[PATH_MAX];
+    char cert_path[PATH_MAX];
+} StationResult;
+
+// Fill config with defaults
+void station_config_init(StationConfig *cfg);
+
+// Provision devices[0..count) in parallel. results must hold count entries.
+// A failing device never stops the others. Returns the number of failed devices, -EINVAL on bad
+// args (including data_image together with EMBED_FLAG_FORMAT_DATA).
+int station_run(const StationConfig *cfg, const char *const *devices, size_t count, StationResult *results);
+
+// Print a per-device result table
+void station_print_report(const StationResult *results, size_t count);
+
+// Human-readable stage name
+const char *station_stage_name(StationStage stage);
+
+#endif // STATION_H
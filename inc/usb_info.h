@@ -1,7 +1,28 @@
 #ifndef USB_INFO_H
 #define USB_INFO_H
 
+#include "arena.h"
 #include <stddef.h>
+#include <stdint.h>
+
+// Well-known property keys, interned to integer atoms. Their values are also kept in a
+// fixed slot per device, so lookups by atom (and by these names) are O(1).
+typedef enum {
+    USB_PROP_USBGUARD_ID = 0,   // "usbguard_id"
+    USB_PROP_RAW_INFO,          // "raw_info"
+    USB_PROP_HASH,              // "hash"
+    USB_PROP_PARENT_HASH,       // "parent-hash"
+    USB_PROP_VIA_PORT,          // "via-port"
+    USB_PROP_WITH_INTERFACE,    // "with-interface"
+    USB_PROP_WITH_CONNECT_TYPE, // "with-connect-type"
+    USB_PROP_LABEL,             // "label"
+    USB_PROP_TARGET,            // "target"
+    USB_PROP_BLOCK_DEVICE,      // "block_device"
+    USB_PROP_ATOM_COUNT
+} UsbPropAtom;
+
+// Other keys get a hashed index once a device has more than this many properties
+#define USB_PROP_INDEX_MIN 8
 
 // Struct chứa thông tin thuộc tính của USB
 typedef struct {
@@ -16,22 +37,65 @@ typedef struct {
     char *serial;         // Serial number
     size_t property_count;
     UsbProperty *properties;
+    size_t property_capacity;
+    Arena *arena;         // non-NULL: all strings live in this arena (see usb_info_create_in)
+    const char *atoms[USB_PROP_ATOM_COUNT];  // first value of each well-known key, or NULL
+    uint32_t usbguard_id;                    // parsed USB_PROP_USBGUARD_ID (has_usbguard_id)
+    int has_usbguard_id;
+    uint16_t *prop_index;                    // open addressing: property index + 1, 0 = empty
+    size_t prop_index_size;                  // power of two, 0 = no index yet
 } UsbDeviceInfo;
 
 // Hàm khởi tạo / giải phóng
 UsbDeviceInfo *usb_info_create(void);
 void usb_info_free(UsbDeviceInfo *info);
 
+// Arena-backed device: the struct and every string are allocated from arena and released
+// with it; usb_info_free() on such a device does nothing.
+UsbDeviceInfo *usb_info_create_in(Arena *arena);
+
+// Copy len bytes of s (NUL-terminated) into the device's storage (arena or heap), for
+// filling id/name/serial directly
+char *usb_info_strndup(UsbDeviceInfo *info, const char *s, size_t len);
+
+// Deep copy of src (into arena, or on the heap when arena is NULL)
+UsbDeviceInfo *usb_info_clone(Arena *arena, const UsbDeviceInfo *src);
+
 // Hàm cập nhật thông tin
 void usb_info_set_id(UsbDeviceInfo *info, const char *vendor_id, const char *product_id);
 void usb_info_set_name(UsbDeviceInfo *info, const char *name);
 void usb_info_set_serial(UsbDeviceInfo *info, const char *serial);
 void usb_info_add_property(UsbDeviceInfo *info, const char *key, const char *value);
+// Same, for a value that is not NUL-terminated (value_len bytes are copied)
+void usb_info_add_property_n(UsbDeviceInfo *info, const char *key, const char *value, size_t value_len);
+
+// Fast path for a well-known key: no key copy, no interning lookup
+void usb_info_add_atom(UsbDeviceInfo *info, UsbPropAtom atom, const char *value, size_t value_len);
 
 // Hàm debug / in thông tin
 void usb_info_print(const UsbDeviceInfo *info);
 
 // Helper: lấy property theo key (trả NULL nếu không tồn tại)
+// Compatibility layer: well-known keys resolve to their atom slot, others go through
+// the hashed index (or a scan for small devices). The first value of a key wins.
 const char *usb_info_get_property(const UsbDeviceInfo *info, const char *key);
 
+// Typed accessors
+const char *usb_info_get_atom(const UsbDeviceInfo *info, UsbPropAtom atom);
+// USBGuard device id; returns 0 and sets *id, or -1 if the device has none
+int usb_info_usbguard_id(const UsbDeviceInfo *info, uint32_t *id);
+static inline const char *usb_info_raw_info(const UsbDeviceInfo *info) {
+    return usb_info_get_atom(info, USB_PROP_RAW_INFO);
+}
+
+// Atom for a key name, or -1 if it is not a well-known key
+int usb_prop_atom(const char *key, size_t len);
+const char *usb_prop_atom_name(UsbPropAtom atom);
+
+// Build device info for a block device (e.g. "/dev/sdb") by walking its sysfs
+// ancestry up to the owning USB device (idVendor/idProduct/serial/product).
+// Devices without a USB parent (loop devices, image files) get name = basename.
+// Property "block_device" is always set to dev_path. Caller frees with usb_info_free.
+UsbDeviceInfo *usb_info_from_block_device(const char *dev_path);
+
 #endif // USB_INFO_H
@@ -0,0 +1,54 @@
+#ifndef USBGUARD_CLIENT_H
+#define USBGUARD_CLIENT_H
+
+#include "usbguard_interface.h"
+#include <stdint.h>
+
+// Long-lived USBGuard D-Bus client.
+//
+// Connects once (system bus, or USBGUARD_DBUS_ADDRESS) and resolves which of the known
+// bus names USBGuard owns with NameHasOwner, so no request is sent to a missing
+// service. Requests are sent asynchronously and complete independently: issue several,
+// then wait for each. Every request has a bounded timeout. If the daemon goes away the
+// name is resolved again on the next request. A client may be shared by threads.
+//
+// Functions returning int give 0 or a negative errno: -ENOENT (USBGuard not on the
+// bus), -ETIMEDOUT, -ENOTCONN (bus connection lost), -EINVAL, -EIO (other D-Bus error).
+
+#define USBGUARD_CLIENT_TIMEOUT_MS 5000
+
+typedef struct UsbGuardClient UsbGuardClient;
+typedef struct UsbGuardCall UsbGuardCall;
+
+// timeout_ms <= 0 selects USBGUARD_CLIENT_TIMEOUT_MS. Returns NULL if the bus is unreachable.
+UsbGuardClient *usbguard_client_open(int timeout_ms);
+void usbguard_client_close(UsbGuardClient *client);
+
+// Bus name USBGuard was found under, or NULL if it is not running
+const char *usbguard_client_service(UsbGuardClient *client);
+
+// Start a request. Never NULL except on allocation failure; errors are reported by the wait.
+UsbGuardCall *usbguard_client_list_devices_async(UsbGuardClient *client, const char *query);
+UsbGuardCall *usbguard_client_apply_policy_async(UsbGuardClient *client, uint32_t device_id,
+                                                 UsbGuardTarget target, int permanent);
+// Policy1: listRules(label) and appendRule(rule, parent_id, temporary). parent_id is usually
+// USBGUARD_RULE_LAST_ID; a temporary rule is not written to the rules file.
+UsbGuardCall *usbguard_client_list_rules_async(UsbGuardClient *client, const char *label);
+UsbGuardCall *usbguard_client_append_rule_async(UsbGuardClient *client, const char *rule, uint32_t parent_id,
+                                                int temporary);
+
+// Wait for a request and consume it. *out is set on success (device or rule list: free with
+// usbguard_free_device_list, for rules usbguard_id is the rule id and raw_info the rule text;
+// policy / append: rule id).
+int usbguard_call_wait_devices(UsbGuardCall *call, UsbDeviceList **out);
+int usbguard_call_wait_u32(UsbGuardCall *call, uint32_t *out);
+
+// Abandon a request without waiting
+void usbguard_call_cancel(UsbGuardCall *call);
+
+// Synchronous helpers (send + wait)
+int usbguard_client_list_devices(UsbGuardClient *client, const char *query, UsbDeviceList **out);
+int usbguard_client_apply_policy(UsbGuardClient *client, uint32_t device_id, UsbGuardTarget target,
+                                 int permanent);
+
+#endif // USBGUARD_CLIENT_H
@@ -4,16 +4,66 @@
 #include "usb_info.h"
 #include <stddef.h>
 
+// USBGuard D-Bus API (org.usbguard.Devices1 on /org/usbguard1/Devices)
+#define USBGUARD_BUS_NAME       "org.usbguard1"
+#define USBGUARD_DEVICES_PATH   "/org/usbguard1/Devices"
+#define USBGUARD_DEVICES_IFACE  "org.usbguard.Devices1"
+
+// org.usbguard.Policy1 on /org/usbguard1/Policy: the rule set (listRules, appendRule)
+#define USBGUARD_POLICY_PATH    "/org/usbguard1/Policy"
+#define USBGUARD_POLICY_IFACE   "org.usbguard.Policy1"
+
+// appendRule parent id meaning "after the last rule" (USBGuard's Rule::LastID)
+#define USBGUARD_RULE_LAST_ID   0xFFFFFFFDu
+
+// If set, connect to this bus address instead of the system bus
+// (e.g. a private dbus-daemon running tools/usbguard_stub)
+#define USBGUARD_BUS_ENV        "USBGUARD_DBUS_ADDRESS"
+
+// Rule targets as used by USBGuard signals and applyDevicePolicy
+typedef enum {
+    USBGUARD_TARGET_ALLOW = 0,
+    USBGUARD_TARGET_BLOCK = 1,
+    USBGUARD_TARGET_REJECT = 2
+} UsbGuardTarget;
+
 // Danh sách thiết bị USB đọc từ USBGuard
 typedef struct {
     UsbDeviceInfo **devices;
     size_t count;
+    size_t capacity;
+    Arena *arena;       // non-NULL: devices, strings and the array live in one arena
 } UsbDeviceList;
 
+// Empty list. With use_arena every device appended via usbguard_device_list_new_device
+// is bump-allocated and the whole list is released by one arena_destroy.
+UsbDeviceList *usbguard_device_list_create(int use_arena);
+
+// Append (capacity doubles). Returns 0 or -ENOMEM; on failure a heap device is not freed.
+int usbguard_device_list_append(UsbDeviceList *list, UsbDeviceInfo *dev);
+
+// New device using the list's storage (not yet appended)
+UsbDeviceInfo *usbguard_device_list_new_device(UsbDeviceList *list);
+
 // Lấy danh sách thiết bị từ USBGuard (filter: "match", "allow", "block")
 // Trả về con trỏ đến UsbDeviceList (caller responsible to free via usbguard_free_device_list).
+// Goes through one process-wide UsbGuardClient (usbguard_client.h), so only the first call
+// connects and resolves the service; each call times out after USBGUARD_CLIENT_TIMEOUT_MS.
 UsbDeviceList *usbguard_list_devices(const char *query);
 
+// Build a UsbDeviceInfo from a USBGuard device rule (id, name, serial + properties
+// "usbguard_id" and "raw_info"). Returns NULL on allocation failure.
+UsbDeviceInfo *usbguard_device_from_rule(unsigned int device_id, const char *device_rule);
+// Same, allocating from arena (heap when NULL)
+UsbDeviceInfo *usbguard_device_from_rule_in(Arena *arena, unsigned int device_id, const char *device_rule);
+
+// Bus address from USBGUARD_DBUS_ADDRESS, or NULL for the system bus
+const char *usbguard_bus_address(void);
+
+// Bus names USBGuard may own, in the order they are tried (some systems expose
+// "org.usbguard" instead of USBGUARD_BUS_NAME); NULL-terminated
+extern const char *const usbguard_bus_names[];
+
 // Giải phóng danh sách
 void usbguard_free_device_list(UsbDeviceList *list);
 
@@ -0,0 +1,56 @@
+#ifndef USBGUARD_MONITOR_H
+#define USBGUARD_MONITOR_H
+
+#include "usb_info.h"
+#include "usbguard_interface.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Event-driven view of the USBGuard device table.
+//
+// The monitor subscribes to DevicePresenceChanged and DevicePolicyChanged on its own
+// bus connection, seeds its table with one listDevices call and from then on updates
+// it incrementally from the signals; no polling. It re-seeds when the USBGuard daemon
+// (re)appears on the bus. Callbacks run on the monitor thread as each signal arrives.
+//
+// Devices in the table carry the same fields/properties as usbguard_list_devices(),
+// plus property "target" ("allow", "block" or "reject").
+
+typedef enum {
+    USBGUARD_EVENT_PRESENT = 0,     // device already present (seeding / daemon restart)
+    USBGUARD_EVENT_INSERT = 1,
+    USBGUARD_EVENT_UPDATE = 2,
+    USBGUARD_EVENT_REMOVE = 3,
+    USBGUARD_EVENT_POLICY = 4       // allow/block/reject changed
+} UsbGuardEventType;
+
+typedef struct {
+    UsbGuardEventType type;
+    uint32_t id;                    // USBGuard device id
+    int target;                     // UsbGuardTarget after the event, -1 if unknown
+    int old_target;                 // previous target for USBGUARD_EVENT_POLICY, else -1
+    const UsbDeviceInfo *device;    // valid only during the callback
+} UsbGuardEvent;
+
+typedef void (*UsbGuardEventFn)(const UsbGuardEvent *event, void *user);
+
+typedef struct UsbGuardMonitor UsbGuardMonitor;
+
+// Connect (system bus, or USBGUARD_DBUS_ADDRESS), subscribe and start the monitor
+// thread. callback may be NULL to only maintain the table. The initial devices are
+// reported as USBGUARD_EVENT_PRESENT. Returns NULL if the bus is not reachable; a
+// missing USBGuard daemon is not an error (the table fills once it starts).
+UsbGuardMonitor *usbguard_monitor_start(UsbGuardEventFn callback, void *user);
+
+// Stop the thread, close the connection and free the table
+void usbguard_monitor_stop(UsbGuardMonitor *monitor);
+
+// Copy of the current table (free with usbguard_free_device_list)
+UsbDeviceList *usbguard_monitor_snapshot(UsbGuardMonitor *monitor);
+
+size_t usbguard_monitor_count(UsbGuardMonitor *monitor);
+
+const char *usbguard_event_name(UsbGuardEventType type);
+const char *usbguard_target_name(int target);
+
+#endif // USBGUARD_MONITOR_H
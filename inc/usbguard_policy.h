@@ -0,0 +1,65 @@
+#ifndef USBGUARD_POLICY_H
+#define USBGUARD_POLICY_H
+
+#include "usbguard_client.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Batched allow / block decisions for many devices.
+//
+// A batch is sent as pipelined D-Bus requests on one client: up to USBGUARD_BATCH_WINDOW
+// calls are in flight before the first reply is awaited, so a burst of freshly verified
+// sticks costs about one round trip instead of one per stick. Each decision gets its own
+// result; one rejected device does not fail the others.
+//
+// The rule cache remembers which permanent single-device rules the policy already holds
+// (seeded from listRules, extended by every successful permanent decision), keyed by
+// target plus the device's USBGuard hash, or VID:PID and serial for rules without a hash.
+// A permanent decision whose rule is cached is applied to the device without appending the
+// rule again; a cached appendRule is skipped altogether.
+
+#define USBGUARD_BATCH_WINDOW 64
+
+typedef struct UsbGuardRuleCache UsbGuardRuleCache;
+
+typedef struct {
+    uint32_t device_id;             // applyDevicePolicy target (ignored when rule is set)
+    UsbGuardTarget target;
+    int permanent;                  // also keep the decision as a rule in the policy
+    const char *device_rule;        // the device's rule text (raw_info from listDevices) for
+                                    // the cache key; NULL = never cached
+    const char *rule;               // non-NULL: appendRule(rule) instead of applyDevicePolicy,
+                                    // e.g. to allow a stick before it is plugged in
+} UsbGuardDecision;
+
+typedef struct {
+    int rc;                         // 0 or a negative errno (usbguard_client.h)
+    uint32_t rule_id;               // rule appended by the daemon, 0 if none
+    int cached;                     // permanent rule already present: not appended again
+} UsbGuardDecisionResult;
+
+typedef struct {
+    size_t calls;                   // D-Bus requests sent
+    size_t skipped;                 // appendRule decisions answered by the cache
+    size_t cached;                  // permanent decisions applied without a new rule
+    size_t failed;
+    size_t max_in_flight;
+    double seconds;
+} UsbGuardBatchStats;
+
+UsbGuardRuleCache *usbguard_rule_cache_create(void);
+void usbguard_rule_cache_free(UsbGuardRuleCache *cache);
+
+// Replace the cache contents with the daemon's current rule set. Returns 0 or a negative errno.
+int usbguard_rule_cache_load(UsbGuardRuleCache *cache, UsbGuardClient *client);
+
+// 1 if a permanent rule with this target for the device described by rule is known
+int usbguard_rule_cache_contains(UsbGuardRuleCache *cache, UsbGuardTarget target, const char *rule);
+size_t usbguard_rule_cache_size(UsbGuardRuleCache *cache);
+
+// Apply count decisions (cache may be NULL). results[i] belongs to decisions[i]. Returns the
+// number of failed decisions, or -EINVAL.
+int usbguard_apply_batch(UsbGuardClient *client, UsbGuardRuleCache *cache, const UsbGuardDecision *decisions,
+                         size_t count, UsbGuardDecisionResult *results, UsbGuardBatchStats *stats);
+
+#endif // USBGUARD_POLICY_H
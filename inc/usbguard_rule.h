@@ -0,0 +1,71 @@
+#ifndef USBGUARD_RULE_H
+#define USBGUARD_RULE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Single-pass tokenizer for USBGuard device rules, e.g.
+//   block id 0781:5567 serial "4C53\"01" name "Cruzer" hash "..." parent-hash "..."
+//     via-port "1-2" with-interface { 08:06:50 08:06:62 } with-connect-type "hotplug"
+//
+// Values are views into the caller's rule string (nothing is copied), so the string must
+// outlive the parsed rule. Quoted values are returned without the quotes and still
+// escaped; use strview_unescape / strview_dup to decode them.
+
+typedef struct {
+    const char *ptr;
+    size_t len;
+} StrView;
+
+typedef enum {
+    RULE_ATTR_ID = 0,
+    RULE_ATTR_HASH,
+    RULE_ATTR_PARENT_HASH,
+    RULE_ATTR_NAME,
+    RULE_ATTR_SERIAL,
+    RULE_ATTR_VIA_PORT,
+    RULE_ATTR_WITH_INTERFACE,
+    RULE_ATTR_WITH_CONNECT_TYPE,
+    RULE_ATTR_LABEL,
+    RULE_ATTR_IF,
+    RULE_ATTR_COUNT
+} UsbGuardRuleAttr;
+
+typedef struct {
+    StrView raw;            // single value (unquoted), or the text between { and }
+    StrView op;             // set operator (all-of, one-of, none-of, equals, ...), may be empty
+    uint16_t count;         // number of values (1 for a single value)
+    uint8_t present;
+    uint8_t is_set;
+    uint8_t quoted;         // single value was a quoted string
+    uint8_t escaped;        // some value contains a backslash escape
+} UsbGuardRuleValue;
+
+typedef struct {
+    StrView target;         // allow / block / reject / match / device, empty if absent
+    int target_id;          // UsbGuardTarget, -1 for match/device/none
+    UsbGuardRuleValue attrs[RULE_ATTR_COUNT];
+    size_t error_pos;       // offset of the offending token when parsing fails
+} UsbGuardRule;
+
+// Parse len bytes of rule (len may be (size_t)-1 for NUL-terminated input).
+// Returns 0, or -EINVAL with out->error_pos set (unknown attribute, unterminated
+// string or set, missing value).
+int usbguard_rule_parse(const char *rule, size_t len, UsbGuardRule *out);
+
+// Iterate the values of an attribute: *pos starts at 0. Returns 1 and sets *item
+// (unquoted, still escaped) while values remain, 0 at the end.
+int usbguard_rule_next_value(const UsbGuardRuleValue *value, size_t *pos, StrView *item);
+
+const char *usbguard_rule_attr_name(UsbGuardRuleAttr attr);
+
+// Decode escapes (\" \\ \n \t \r \xHH) into out (NUL-terminated, truncated to outsz).
+// Returns the decoded length, which may exceed outsz - 1.
+size_t strview_unescape(StrView v, char *out, size_t outsz);
+
+// malloc'd NUL-terminated copy; escapes decoded when unescape != 0
+char *strview_dup(StrView v, int unescape);
+
+int strview_eq(StrView v, const char *s);
+
+#endif // USBGUARD_RULE_H
@@ -2,17 +2,1082 @@
 #include "usbguard_interface.h"
 #include "cert_gen.h"
 #include "embed_cert.h"
+#include "station.h"
+#include "keypool.h"
+#include "cert_verify.h"
+#include "usbguard_monitor.h"
+#include "metrics.h"
+#include "ledger.h"
+#include "revocation.h"
+#include "bulk_issue.h"
+#include "image_clone.h"
+#include "fat32.h"
+#include "gpt.h"
+#include "audit.h"
+#include "usbguard_policy.h"
+#include "provd.h"
+#include <openssl/pem.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
 
 #define USB_SCRIPT_PATH "usbPartition.sh"
 #define USB_SIGNATURE_PATH "output/usb_cert.pem"
 #define USB_DEVICE "/dev/sdb"
+#define KEYPOOL_SPOOL_DIR "output/keyspool"
+#define CA_CERT_PATH "cert/ca.crt"
+#define CA_KEY_PATH "cert/ca.key"
+#define REVOCATION_STORE "cert/revoked.txt"
+#define CRL_PATH "cert/ca.crl"
+#define CRL_DAYS 30
+#define METRICS_ENV "USB_METRICS_FILE"
+#define LEDGER_DIR "output/ledger"
 
-int main() {
+static const char *g_metrics_path;
+
+// Serial allocator (NULL serial_file: random serials) and ledger (NULL dir: none) for an
+// issuing command. Returns 0, or 1 after printing the error.
+static int open_issuance(const char *serial_file, const char *ledger_dir, int ledger_flags,
+                         SerialAlloc **serials, Ledger **ledger) {
+    *serials = NULL;
+    *ledger = NULL;
+    if (serial_file) {
+        SerialAllocConfig scfg;
+        serial_alloc_config_init(&scfg);
+        scfg.state_path = serial_file;
+        int rc = serial_alloc_create(&scfg, serials);
+        if (rc != 0) {
+            fprintf(stderr, "Cannot open serial file %s: %s\n", serial_file, strerror(-rc));
+            return 1;
+        }
+    }
+    if (ledger_dir) {
+        int rc = ledger_open(ledger_dir, ledger_flags, ledger);
+        if (rc != 0) {
+            fprintf(stderr, "Cannot open ledger %s: %s\n", ledger_dir, strerror(-rc));
+            serial_alloc_free(*serials);
+            *serials = NULL;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s                                   embed %s into %s\n"
+            "  %s embed [--yes] [--format-data] <dev|image> <signature>\n"
+            "                                       partition + embed natively (no usbPartition.sh)\n"
+            "  %s read <dev|image>                  show the certificate stored in USB_SIG\n"
+            "  %s verify [--repeat N] <dev|image>...\n"
+            "                                       check chain against %s, device binding and\n"
+            "                                       revocation (%s, if present)\n"
+            "  %s audit [-j N] [--io N] [--loop] [--expiry-days N] [--json FILE]\n"
+            "            [--apply [--permanent]] [<dev|image>...]\n"
+            "                                       verify all attached sticks (or the given ones) in\n"
+            "                                       parallel, JSON report to stdout or FILE\n"
+            "                                       --apply allows verified sticks in USBGuard and\n"
+            "                                       blocks the others, in one batch\n"
+            "  %s renew <dev|image> <cert.pem>      renew in place (A/B slot), keeps the data partition\n"
+            "  %s station [-j N] [--alg ALG] [--renew] [--script] [--format-data] [--keypool]\n"
+            "            [--serial-file FILE] [--ledger DIR|--no-ledger] [--data-image IMG]\n"
+            "            [--metrics FILE] <dev>...\n"
+            "                                       provision several sticks in parallel\n"
+            "                                       (--script uses usbPartition.sh)\n"
+            "                                       --format-data makes USB_DATA a FAT32 volume\n"
+            "                                       --keypool pre-generates keys in the background\n"
+            "                                       (spooled encrypted to %s if USB_KEYPOOL_PASS is set)\n"
+            "                                       issued certificates are recorded in %s\n"
+            "                                       --data-image copies IMG into USB_DATA meanwhile\n"
+            "  %s clone [--dense] <dev|image> <IMG>\n"
+            "                                       stream a golden image into USB_DATA\n"
+            "  %s format <dev|image> [LABEL]        FAT32 on USB_DATA in place (no mkfs.vfat)\n"
+            "  %s bulk [-j N] [--alg ALG] [--days N] [--no-keys] [--serial-file FILE]\n"
+            "            [--ledger DIR|--no-ledger] <manifest|-> <bundle.jsonl|->\n"
+            "                                       issue certificates for the devices listed in a\n"
+            "                                       CSV / JSON-lines manifest, no stick needed\n"
+            "  %s ledger [--dir DIR] serial <HEX> | device <SERIAL> | list\n"
+            "                                       look up issued certificates\n"
+            "  %s revoke [--reason N] <HEX> | --device <SERIAL>\n"
+            "                                       revoke a certificate (or all issued for a stick)\n"
+            "                                       and regenerate %s\n"
+            "  %s crl [DAYS]                        regenerate %s from %s\n"
+            "  %s monitor                           print USBGuard device events until Ctrl-C\n"
+            "  %s daemon [--socket PATH] [-j N] [--queue N] [--batch N] [--window MS] [--alg ALG]\n"
+            "            [--format-data] [--keypool] [--serial-file FILE] [--ledger DIR|--no-ledger]\n"
+            "            [--no-usbguard] [--loop] [--group GID]\n"
+            "                                       serve provision / renew / verify requests on a\n"
+            "                                       Unix socket (default %s) until Ctrl-C\n"
+            "  %s submit [--socket PATH] provision|renew|verify|ping|stats [<dev|image>...]\n"
+            "                                       send requests to a running daemon\n"
+            "  %s ca-init <ALG> <ca.crt> <ca.key> [CN]\n"
+            "                                       create a new self-signed CA (never overwrites)\n"
+            "ALG: rsa2048 rsa3072 rsa4096 p256 p384 ed25519\n"
+            "--metrics FILE (or %s=FILE for any command): per-stage timings and counters,\n"
+            "  Prometheus text if FILE ends in .prom, else one JSON line appended per run\n"
+            "--serial-file FILE: certificate serials from a persistent counter (default random)\n",
+            prog, USB_SIGNATURE_PATH, USB_DEVICE, prog, prog, prog, CA_CERT_PATH, CRL_PATH, prog, prog, prog, KEYPOOL_SPOOL_DIR, LEDGER_DIR,
+            prog, prog, prog, prog, prog, CRL_PATH, prog, CRL_PATH, REVOCATION_STORE, prog, prog, PROVD_SOCKET_PATH, prog,
+            prog, METRICS_ENV);
+}
+
+// Station mode: ./main station [-j workers] [--format-data] /dev/sdb /dev/sdc ...
+static int run_station(int argc, char *argv[]) {
+    StationConfig cfg;
+    station_config_init(&cfg);
+    cfg.script_path = USB_SCRIPT_PATH;
+
+    int use_keypool = 0;
+    const char *serial_file = NULL;
+    const char *ledger_dir = LEDGER_DIR;
+    int i = 2;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            cfg.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--format-data") == 0) {
+            cfg.embed_flags |= EMBED_FLAG_FORMAT_DATA;
+        } else if (strcmp(argv[i], "--alg") == 0 && i + 1 < argc) {
+            if (key_alg_from_name(argv[++i], &cfg.key_alg) != 0) {
+                fprintf(stderr, "Unknown key algorithm: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--renew") == 0) {
+            cfg.renew = 1;
+        } else if (strcmp(argv[i], "--script") == 0) {
+            cfg.use_script = 1;
+        } else if (strcmp(argv[i], "--keypool") == 0) {
+            use_keypool = 1;
+        } else if (strcmp(argv[i], "--data-image") == 0 && i + 1 < argc) {
+            cfg.data_image = argv[++i];
+        } else if (strcmp(argv[i], "--serial-file") == 0 && i + 1 < argc) {
+            serial_file = argv[++i];
+        } else if (strcmp(argv[i], "--ledger") == 0 && i + 1 < argc) {
+            ledger_dir = argv[++i];
+        } else if (strcmp(argv[i], "--no-ledger") == 0) {
+            ledger_dir = NULL;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            g_metrics_path = argv[++i];
+            metrics_enable(1);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    size_t count = (size_t)(argc - i);
+    if (count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (cfg.data_image && (cfg.renew || cfg.use_script || (cfg.embed_flags & EMBED_FLAG_FORMAT_DATA))) {
+        fprintf(stderr, "--data-image needs native embedding (not with --renew, --script or --format-data).\n");
+        return 1;
+    }
+
+    SerialAlloc *serials;
+    Ledger *ledger;
+    if (open_issuance(serial_file, ledger_dir, 0, &serials, &ledger) != 0) return 1;
+    cfg.serials = serials;
+    cfg.ledger = ledger;
+
+    KeyPool *pool = NULL;
+    if (use_keypool) {
+        KeyPoolConfig kcfg;
+        keypool_config_init(&kcfg);
+        kcfg.alg = cfg.key_alg;
+        kcfg.high_watermark = count + 2;
+        kcfg.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        kcfg.spool_pass = getenv("USB_KEYPOOL_PASS");
+        kcfg.spool_dir = kcfg.spool_pass ? KEYPOOL_SPOOL_DIR : NULL;
+        pool = keypool_create(&kcfg);
+        if (!pool) fprintf(stderr, "Key pool unavailable, generating keys inline.\n");
+        certgen_set_keypool(pool);
+    }
+
+    StationResult *results = calloc(count, sizeof(StationResult));
+    if (!results) return 1;
+    int failed = station_run(&cfg, (const char *const *)&argv[i], count, results);
+    station_print_report(results, count);
+    free(results);
+    ledger_close(ledger);
+    serial_alloc_free(serials);
+
+    if (pool) {
+        KeyPoolStats st;
+        keypool_get_stats(pool, &st);
+        printf("Key pool: %llu taken, %llu generated, %llu from spool, waited %.3fs over %llu empty takes.\n",
+               (unsigned long long)st.taken, (unsigned long long)st.generated,
+               (unsigned long long)st.loaded, st.wait_seconds, (unsigned long long)st.waits);
+        certgen_set_keypool(NULL);
+        keypool_destroy(pool);
+    }
+    return failed == 0 ? 0 : 2;
+}
+
+// Bulk mode: ./main bulk [-j N] [--alg ALG] [--days N] [--no-keys] <manifest|-> <bundle|->
+static int run_bulk(int argc, char *argv[]) {
+    BulkConfig cfg;
+    bulk_config_init(&cfg);
+    cfg.ca_cert_path = CA_CERT_PATH;
+    cfg.ca_key_path = CA_KEY_PATH;
+    const char *serial_file = NULL;
+    const char *ledger_dir = LEDGER_DIR;
+    int i = 2;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            cfg.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--alg") == 0 && i + 1 < argc) {
+            if (key_alg_from_name(argv[++i], &cfg.key_alg) != 0) {
+                fprintf(stderr, "Unknown key algorithm: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+            cfg.days = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-keys") == 0) {
+            cfg.include_keys = 0;
+        } else if (strcmp(argv[i], "--serial-file") == 0 && i + 1 < argc) {
+            serial_file = argv[++i];
+        } else if (strcmp(argv[i], "--ledger") == 0 && i + 1 < argc) {
+            ledger_dir = argv[++i];
+        } else if (strcmp(argv[i], "--no-ledger") == 0) {
+            ledger_dir = NULL;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            g_metrics_path = argv[++i];
+            metrics_enable(1);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - i != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *manifest_path = argv[i], *bundle_path = argv[i + 1];
+
+    FILE *manifest = strcmp(manifest_path, "-") == 0 ? stdin : fopen(manifest_path, "r");
+    if (!manifest) {
+        fprintf(stderr, "Cannot open manifest %s: %s\n", manifest_path, strerror(errno));
+        return 1;
+    }
+    /* the bundle carries private keys unless --no-keys: never world-readable */
+    FILE *bundle = stdout;
+    if (strcmp(bundle_path, "-") != 0) {
+        int fd = open(bundle_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        bundle = fd >= 0 ? fdopen(fd, "w") : NULL;
+        if (!bundle) {
+            fprintf(stderr, "Cannot create bundle %s: %s\n", bundle_path, strerror(errno));
+            if (fd >= 0) close(fd);
+            if (manifest != stdin) fclose(manifest);
+            return 1;
+        }
+    }
+
+    SerialAlloc *serials;
+    Ledger *ledger;
+    int rc = 1;
+    /* one ledger sync at the end instead of one per certificate */
+    if (open_issuance(serial_file, ledger_dir, LEDGER_OPEN_NOSYNC, &serials, &ledger) == 0) {
+        cfg.serials = serials;
+        cfg.ledger = ledger;
+        BulkStats st;
+        rc = bulk_issue(&cfg, manifest, bundle, &st);
+        if (rc < 0) fprintf(stderr, "Bulk issuance failed: %s\n", strerror(-rc));
+        fprintf(stderr, "%llu device(s): %llu issued, %llu failed in %.2fs (%.1f certificates/s, %llu in flight max)\n",
+                (unsigned long long)st.devices, (unsigned long long)st.issued, (unsigned long long)st.failed,
+                st.seconds, st.seconds > 0 ? st.issued / st.seconds : 0.0, (unsigned long long)st.max_in_flight);
+        rc = rc == 0 ? 0 : rc < 0 ? 1 : 2;
+        ledger_close(ledger);
+        serial_alloc_free(serials);
+    }
+    if (manifest != stdin) fclose(manifest);
+    if (bundle != stdout && fclose(bundle) != 0 && rc == 0) {
+        fprintf(stderr, "Cannot write bundle %s: %s\n", bundle_path, strerror(errno));
+        rc = 1;
+    }
+    return rc;
+}
+
+// ./main embed [--yes] [--format-data] <dev> <signature>: native partition + embed
+static int run_embed(int argc, char *argv[]) {
+    int i = 2, assume_yes = 0, flags = 0;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "--yes") == 0) {
+            assume_yes = 1;
+        } else if (strcmp(argv[i], "--format-data") == 0) {
+            flags |= EMBED_FLAG_FORMAT_DATA;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - i != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *dev = argv[i], *sig = argv[i + 1];
+    if (!assume_yes) {
+        char buf[256];
+        printf("About to wipe and partition device: %s\nType the device path to CONFIRM: ", dev);
+        fflush(stdout);
+        if (!fgets(buf, sizeof(buf), stdin)) return 1;
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if (strcmp(buf, dev) != 0) {
+            printf("Confirmation mismatch. Abort.\n");
+            return 1;
+        }
+    }
+    int rc = embed_cert_native_file(dev, sig, flags);
+    if (rc != 0) {
+        fprintf(stderr, "Embedding failed: %s\n", strerror(-rc));
+        return 1;
+    }
+    printf("VERIFY: OK - %s written to USB_SIG on %s\n", sig, dev);
+    if (flags & EMBED_FLAG_FORMAT_DATA) printf("Data partition formatted (FAT32).\n");
+    return 0;
+}
+
+// ./main format <dev> [LABEL]: FAT32 on an existing USB_DATA partition
+static int run_format(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    Fat32Info fi;
+    int rc = fat32_format_device(argv[2], argc == 4 ? argv[3] : NULL, &fi);
+    if (rc != 0) {
+        fprintf(stderr, "Formatting %s on %s failed: %s\n", GPT_DATA_PART_NAME, argv[2], strerror(-rc));
+        return 1;
+    }
+    printf("Formatted %s on %s: FAT32, %u clusters of %u bytes, volume id %04X-%04X\n"
+           "(%.1f KiB written, %.1f KiB of FAT zero-filled)\n",
+           GPT_DATA_PART_NAME, argv[2], fi.clusters, fi.sectors_per_cluster * fi.bytes_per_sector,
+           fi.volume_id >> 16, fi.volume_id & 0xFFFF, fi.bytes_written / 1024.0, fi.bytes_zeroed / 1024.0);
+    return 0;
+}
+
+// ./main clone [--dense] <dev> <image>: golden image into USB_DATA (partitioned if needed)
+static int run_clone(int argc, char *argv[]) {
+    int i = 2, flags = IMAGE_CLONE_PARTITION;
+    if (i < argc && strcmp(argv[i], "--dense") == 0) { flags |= IMAGE_CLONE_DENSE; i++; }
+    if (argc - i != 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    CloneStats st;
+    int rc = image_clone_to_device(argv[i], argv[i + 1], flags, 0, &st);
+    if (rc != 0) return 1;
+    printf("Cloned %s into %s of %s: %.1f MiB in %.2fs, %.1f MB/s (%.1f MiB written, %.1f MiB zero-filled)\n",
+           argv[i + 1], GPT_DATA_PART_NAME, argv[i], st.image_bytes / 1048576.0, st.seconds, st.mbps,
+           st.bytes_written / 1048576.0, st.bytes_zeroed / 1048576.0);
+    return 0;
+}
+
+// ./main renew <dev> <cert.pem>: write into the inactive A/B slot, no repartitioning
+static int run_renew(int argc, char *argv[]) {
+    if (argc != 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    int rc = embed_cert_native_file(argv[2], argv[3], EMBED_FLAG_RENEW);
+    if (rc != 0) {
+        fprintf(stderr, "Renewal failed: %s\n", strerror(-rc));
+        return 1;
+    }
+    printf("Renewed certificate on %s\n", argv[2]);
+    return 0;
+}
+
+// ./main read <dev>: print the certificate stored in USB_SIG
+static int run_read(int argc, char *argv[]) {
+    if (argc != 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    X509 *cert = NULL;
+    SigContainerInfo info;
+    int rc = embed_read_cert(argv[2], &cert, &info);
+    if (rc != 0) {
+        fprintf(stderr, "No valid certificate in USB_SIG of %s: %s\n", argv[2], strerror(-rc));
+        return 1;
+    }
+    char subject[256];
+    X509_NAME_oneline(X509_get_subject_name(cert), subject, sizeof(subject));
+    printf("Container v%u gen %llu, %s key, %u byte certificate, %u byte chain\n", info.version,
+           (unsigned long long)info.generation,
+           info.alg < KEY_ALG_COUNT ? key_alg_name((KeyAlg)info.alg) : "unknown",
+           info.cert_len, info.chain_len);
+    printf("Subject: %s\n", subject);
+    PEM_write_X509(stdout, cert);
+    X509_free(cert);
+    return 0;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// cert/ca.crl, checked against the CA, when present (*crl stays NULL without one).
+// Returns 0, or 1 after printing the error.
+static int load_crl(const char *prog, RevocationList **crl) {
+    *crl = NULL;
+    if (access(CRL_PATH, F_OK) != 0) return 0;
+    *crl = revocation_list_create();
+    if (!*crl || revocation_list_load_crl(*crl, CRL_PATH, CA_CERT_PATH) != 0) {
+        fprintf(stderr, "Cannot load revocation list %s.\n", CRL_PATH);
+        revocation_list_free(*crl);
+        *crl = NULL;
+        return 1;
+    }
+    RevocationStats rs;
+    revocation_list_stats(*crl, &rs);
+    if (rs.next_update && rs.next_update < time(NULL))
+        fprintf(stderr, "Warning: %s is past its nextUpdate, regenerate it with '%s crl'.\n", CRL_PATH, prog);
+    return 0;
+}
+
+// ./main verify [--repeat N] <dev>...
+// The expected identity comes from USBGuard (matched by serial); without the daemon the
+// sysfs attributes of the block device are used instead.
+static int run_verify(int argc, char *argv[]) {
+    int repeat = 1;
+    int i = 2;
+    if (i + 1 < argc && strcmp(argv[i], "--repeat") == 0) {
+        repeat = atoi(argv[i + 1]);
+        if (repeat < 1) repeat = 1;
+        i += 2;
+    }
+    if (i >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    RevocationList *crl = NULL;
+    if (load_crl(argv[0], &crl) != 0) return 1;
+    CertVerifier *verifier = cert_verifier_create(CA_CERT_PATH, 256);
+    if (!verifier) {
+        revocation_list_free(crl);
+        return 1;
+    }
+    if (crl) cert_verifier_set_revocation(verifier, crl);
+    UsbDeviceList *guard = usbguard_list_devices("match");
+    if (!guard) fprintf(stderr, "USBGuard not available, using sysfs identity.\n");
+
+    int failures = 0;
+    for (; i < argc; i++) {
+        UsbDeviceInfo *block = usb_info_from_block_device(argv[i]);
+        const UsbDeviceInfo *expected = cert_verify_match_usbguard(guard, block);
+        if (!expected) expected = block;
+
+        for (int r = 0; r < repeat; r++) {
+            VerifyResult res;
+            double t0 = now_seconds();
+            VerifyStatus st = cert_verify_device(verifier, argv[i], expected, &res);
+            double us = (now_seconds() - t0) * 1e6;
+            printf("%s: %s%s  CN=%s serial=%s  %.1f us\n", argv[i], cert_verify_status_name(st),
+                   res.from_cache ? " (cached)" : "", res.subject_cn, res.serial_hex, us);
+            if (st == VERIFY_BAD_CHAIN || st == VERIFY_EXPIRED)
+                printf("  %s\n", X509_verify_cert_error_string(res.x509_error));
+            if (st != VERIFY_OK) {
+                failures++;
+                break;
+            }
+        }
+        usb_info_free(block);
+    }
+
+    VerifyCacheStats stats;
+    cert_verifier_cache_stats(verifier, &stats);
+    printf("Cache: %llu hits, %llu misses, %zu entries\n", (unsigned long long)stats.hits,
+           (unsigned long long)stats.misses, stats.entries);
+    usbguard_free_device_list(guard);
+    cert_verifier_free(verifier);
+    revocation_list_free(crl);
+    return failures ? 1 : 0;
+}
+
+static volatile sig_atomic_t g_interrupted;
+
+static void on_sigint(int sig) {
+    (void)sig;
+    g_interrupted = 1;
+}
+
+static void print_event(const UsbGuardEvent *ev, void *user) {
+    (void)user;
+    const UsbDeviceInfo *d = ev->device;
+    printf("%-8s id=%u target=%s", usbguard_event_name(ev->type), ev->id, usbguard_target_name(ev->target));
+    if (ev->type == USBGUARD_EVENT_POLICY) printf(" (was %s)", usbguard_target_name(ev->old_target));
+    if (d) printf("  %s serial=%s name=%s", d->id ? d->id : "-", d->serial ? d->serial : "-", d->name ? d->name : "-");
+    printf("\n");
+    fflush(stdout);
+}
+
+// audit --apply: allow the sticks USBGuard lists that verified OK and block the others,
+// as one pipelined batch. Permanent decisions skip rules the policy already holds.
+static int apply_audit_policy(const AuditDevice *results, size_t count, int permanent) {
+    UsbGuardDecision *d = calloc(count ? count : 1, sizeof(*d));
+    UsbGuardDecisionResult *res = calloc(count ? count : 1, sizeof(*res));
+    const AuditDevice **from = calloc(count ? count : 1, sizeof(*from));
+    UsbGuardClient *client = NULL;
+    UsbGuardRuleCache *cache = NULL;
+    int rc = 1;
+    if (!d || !res || !from) goto out;
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        const UsbDeviceInfo *g = results[i].guard_device;
+        if (!g || usb_info_usbguard_id(g, &d[n].device_id) != 0) continue;
+        d[n].target = results[i].verify.status == VERIFY_OK ? USBGUARD_TARGET_ALLOW : USBGUARD_TARGET_BLOCK;
+        d[n].permanent = permanent;
+        d[n].device_rule = usb_info_raw_info(g);
+        from[n++] = &results[i];
+    }
+    if (n == 0) {
+        fprintf(stderr, "USBGuard lists none of the audited sticks, no policy applied.\n");
+        rc = 0;
+        goto out;
+    }
+    if (!(client = usbguard_client_open(0))) {
+        fprintf(stderr, "Cannot connect to USBGuard.\n");
+        goto out;
+    }
+    if (permanent && (cache = usbguard_rule_cache_create()) && usbguard_rule_cache_load(cache, client) != 0)
+        fprintf(stderr, "Cannot list USBGuard rules, existing rules are not deduplicated.\n");
+
+    UsbGuardBatchStats st;
+    int failed = usbguard_apply_batch(client, cache, d, n, res, &st);
+    for (size_t i = 0; i < n && failed > 0; i++) {
+        if (res[i].rc != 0)
+            fprintf(stderr, "%s: USBGuard %s failed: %s\n", from[i]->device, usbguard_target_name(d[i].target),
+                    strerror(-res[i].rc));
+    }
+    fprintf(stderr, "USBGuard: %zu decision(s) in %.1f ms", n, st.seconds * 1e3);
+    if (permanent) fprintf(stderr, ", %zu rule(s) already present", st.cached);
+    fprintf(stderr, ", %zu failed\n", st.failed);
+    rc = failed == 0 ? 0 : 1;
+out:
+    usbguard_rule_cache_free(cache);
+    usbguard_client_close(client);
+    free(from);
+    free(res);
+    free(d);
+    return rc;
+}
+
+// ./main audit [-j N] [--io N] [--loop] [--expiry-days N] [--json FILE] [--apply [--permanent]] [<dev>...]:
+// check every attached stick (or the given devices / images) and write a JSON report
+static int run_audit(int argc, char *argv[]) {
+    AuditConfig cfg;
+    audit_config_init(&cfg);
+    cfg.ca_cert_path = CA_CERT_PATH;
+    const char *json_path = "-";
+    int find_flags = 0, apply = 0, permanent = 0, i = 2;
+    for (; i < argc && argv[i][0] == '-'; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            cfg.verify_workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--apply") == 0) {
+            apply = 1;
+        } else if (strcmp(argv[i], "--permanent") == 0) {
+            permanent = 1;
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            cfg.io_workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--loop") == 0) {
+            find_flags |= AUDIT_FIND_LOOP;
+        } else if (strcmp(argv[i], "--expiry-days") == 0 && i + 1 < argc) {
+            cfg.expiry_warn_days = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    char **found = NULL;
+    size_t count = (size_t)(argc - i);
+    const char *const *devices = (const char *const *)(argv + i);
+    if (count == 0) {
+        int rc = audit_find_devices(find_flags, &found, &count);
+        if (rc != 0) {
+            fprintf(stderr, "Cannot enumerate block devices: %s\n", strerror(-rc));
+            return 1;
+        }
+        devices = (const char *const *)found;
+    }
+
+    RevocationList *crl = NULL;
+    AuditDevice *results = calloc(count ? count : 1, sizeof(*results));
+    UsbDeviceList *guard = NULL;
+    int rc = 1;
+    if (!results || load_crl(argv[0], &crl) != 0) goto out;
+    cfg.revocation = crl;
+    guard = usbguard_list_devices("match");
+    if (!guard) fprintf(stderr, "USBGuard not available, using sysfs identity.\n");
+    cfg.guard = guard;
+
+    AuditSummary sum;
+    int arc = audit_run(&cfg, devices, count, results, &sum);
+    if (arc != 0) {
+        fprintf(stderr, "Audit failed: %s\n", strerror(-arc));
+        goto out;
+    }
+    FILE *out = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+    if (!out) {
+        fprintf(stderr, "Cannot create %s: %s\n", json_path, strerror(errno));
+        goto out;
+    }
+    arc = audit_write_json(out, &cfg, results, count, &sum);
+    if (out != stdout && fclose(out) != 0) arc = -errno;
+    if (arc != 0) {
+        fprintf(stderr, "Cannot write %s: %s\n", json_path, strerror(-arc));
+        goto out;
+    }
+
+    fprintf(stderr, "Audited %zu device(s) in %.2fs:", count, sum.seconds);
+    for (int s = 0; s < AUDIT_STATUS_COUNT; s++) {
+        if (sum.by_status[s]) fprintf(stderr, " %zu %s", sum.by_status[s], cert_verify_status_name((VerifyStatus)s));
+    }
+    if (sum.expiring) fprintf(stderr, " (%zu expiring within %d days)", sum.expiring, cfg.expiry_warn_days);
+    fprintf(stderr, "\n");
+    rc = sum.by_status[VERIFY_OK] == count ? 0 : 1;
+    if (apply && apply_audit_policy(results, count, permanent) != 0) rc = 1;
+out:
+    usbguard_free_device_list(guard);
+    revocation_list_free(crl);
+    free(results);
+    audit_free_devices(found, found ? count : 0);
+    return rc;
+}
+
+// ./main monitor: follow DevicePresenceChanged / DevicePolicyChanged
+static int run_monitor(void) {
+    UsbGuardMonitor *mon = usbguard_monitor_start(print_event, NULL);
+    if (!mon) return 1;
+    signal(SIGINT, on_sigint);
+    signal(SIGTERM, on_sigint);
+    while (!g_interrupted) pause();
+    printf("%zu device(s) known\n", usbguard_monitor_count(mon));
+    usbguard_monitor_stop(mon);
+    return 0;
+}
+
+// ./main daemon [...]: keep CA, verifier, USBGuard connection (and key pool) warm and serve
+// requests on a Unix socket until SIGINT / SIGTERM
+static int run_daemon(int argc, char *argv[]) {
+    ProvdConfig cfg;
+    provd_config_init(&cfg);
+    cfg.station.ca_cert_path = CA_CERT_PATH;
+    cfg.station.ca_key_path = CA_KEY_PATH;
+    int use_keypool = 0;
+    const char *serial_file = NULL;
+    const char *ledger_dir = LEDGER_DIR;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            cfg.socket_path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            cfg.station.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--queue") == 0 && i + 1 < argc) {
+            cfg.queue_depth = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            cfg.batch_max = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            cfg.batch_window_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--alg") == 0 && i + 1 < argc) {
+            if (key_alg_from_name(argv[++i], &cfg.station.key_alg) != 0) {
+                fprintf(stderr, "Unknown key algorithm: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--format-data") == 0) {
+            cfg.station.embed_flags |= EMBED_FLAG_FORMAT_DATA;
+        } else if (strcmp(argv[i], "--keypool") == 0) {
+            use_keypool = 1;
+        } else if (strcmp(argv[i], "--serial-file") == 0 && i + 1 < argc) {
+            serial_file = argv[++i];
+        } else if (strcmp(argv[i], "--ledger") == 0 && i + 1 < argc) {
+            ledger_dir = argv[++i];
+        } else if (strcmp(argv[i], "--no-ledger") == 0) {
+            ledger_dir = NULL;
+        } else if (strcmp(argv[i], "--no-usbguard") == 0) {
+            cfg.use_usbguard = 0;
+        } else if (strcmp(argv[i], "--loop") == 0) {
+            cfg.device_flags |= AUDIT_FIND_LOOP;
+        } else if (strcmp(argv[i], "--group") == 0 && i + 1 < argc) {
+            cfg.peer_gid = (gid_t)strtoul(argv[++i], NULL, 10);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    SerialAlloc *serials;
+    Ledger *ledger;
+    RevocationList *crl = NULL;
+    if (open_issuance(serial_file, ledger_dir, 0, &serials, &ledger) != 0) return 1;
+    if (load_crl(argv[0], &crl) != 0) {
+        ledger_close(ledger);
+        serial_alloc_free(serials);
+        return 1;
+    }
+    cfg.station.serials = serials;
+    cfg.station.ledger = ledger;
+    cfg.revocation = crl;
+
+    /* every thread started from here on inherits the mask, so the signals reach sigwait */
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    KeyPool *pool = NULL;
+    if (use_keypool) {
+        KeyPoolConfig kcfg;
+        keypool_config_init(&kcfg);
+        kcfg.alg = cfg.station.key_alg;
+        kcfg.high_watermark = (cfg.batch_max ? cfg.batch_max : 16) * 2;
+        kcfg.threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        kcfg.spool_pass = getenv("USB_KEYPOOL_PASS");
+        kcfg.spool_dir = kcfg.spool_pass ? KEYPOOL_SPOOL_DIR : NULL;
+        pool = keypool_create(&kcfg);
+        if (!pool) fprintf(stderr, "Key pool unavailable, generating keys inline.\n");
+        certgen_set_keypool(pool);
+    }
+
+    int rc = 1, err = 0;
+    ProvdServer *srv = provd_start(&cfg, &err);
+    if (!srv) {
+        fprintf(stderr, "Cannot start the daemon on %s: %s\n", cfg.socket_path, strerror(-err));
+    } else {
+        fprintf(stderr, "Serving on %s (Ctrl-C to stop)\n", cfg.socket_path);
+        int sig;
+        sigwait(&stop_signals, &sig);
+        ProvdStats st;
+        provd_get_stats(srv, &st);
+        provd_stop(srv);
+        fprintf(stderr, "%llu connection(s), %llu request(s) in %llu batch(es), largest %zu, queue peak %zu, "
+                "%llu backpressure stall(s)\n", (unsigned long long)st.connections,
+                (unsigned long long)st.requests, (unsigned long long)st.batches, st.max_batch, st.queue_peak,
+                (unsigned long long)st.stalls);
+        rc = 0;
+    }
+    certgen_set_keypool(NULL);
+    keypool_destroy(pool);
+    revocation_list_free(crl);
+    ledger_close(ledger);
+    serial_alloc_free(serials);
+    return rc;
+}
+
+// ./main submit [--socket PATH] <op> [<dev>...]: pipeline one request per device to the
+// daemon and print the replies. Exit status 0 only if every request succeeded.
+static int run_submit(int argc, char *argv[]) {
+    const char *socket_path = PROVD_SOCKET_PATH;
+    int i = 2;
+    if (i + 1 < argc && strcmp(argv[i], "--socket") == 0) {
+        socket_path = argv[i + 1];
+        i += 2;
+    }
+    ProvdOp op = PROVD_OP_COUNT;
+    for (int o = 0; i < argc && o < PROVD_OP_COUNT; o++) {
+        if (strcmp(argv[i], provd_op_name((ProvdOp)o)) == 0) op = (ProvdOp)o;
+    }
+    int has_device = op == PROVD_OP_PROVISION || op == PROVD_OP_RENEW || op == PROVD_OP_VERIFY;
+    if (op == PROVD_OP_COUNT || (has_device ? i + 1 >= argc : i + 1 != argc)) {
+        usage(argv[0]);
+        return 1;
+    }
+    i++;
+    int fd = provd_connect(socket_path);
+    if (fd < 0) {
+        fprintf(stderr, "Cannot connect to %s: %s\n", socket_path, strerror(-fd));
+        return 1;
+    }
+    size_t count = has_device ? (size_t)(argc - i) : 1;
+    double t0 = now_seconds();
+    int rc = 0;
+    for (size_t k = 0; k < count && rc == 0; k++) {
+        char path[PATH_MAX];
+        /* the daemon has its own working directory */
+        const char *dev = has_device ? realpath(argv[i + k], path) : NULL;
+        if (has_device && !dev) {
+            fprintf(stderr, "%s: %s\n", argv[i + k], strerror(errno));
+            dev = argv[i + k];
+        }
+        rc = provd_send(fd, (uint32_t)k, op, dev);
+    }
+    int failed = 0;
+    for (size_t k = 0; k < count && rc == 0; k++) {
+        ProvdReply r;
+        if ((rc = provd_recv(fd, &r)) != 0) break;
+        const char *name = has_device && r.id < count ? argv[i + r.id] : provd_op_name(op);
+        if (op == PROVD_OP_STATS) {
+            printf("%s\n", r.text);
+        } else if (r.rc != 0) {
+            failed++;
+            printf("%s: %s", name, strerror(-r.rc));
+            if (op != PROVD_OP_VERIFY && r.detail < STATION_STAGE_DONE)
+                printf(" (at %s)", station_stage_name((StationStage)r.detail));
+            printf("\n");
+        } else if (op == PROVD_OP_VERIFY) {
+            failed += r.detail != VERIFY_OK;
+            printf("%s: %s%s  CN=%s  %.1f ms\n", name, cert_verify_status_name((VerifyStatus)r.detail),
+                   r.from_cache ? " (cached)" : "", r.text, r.service_us / 1e3);
+        } else if (op == PROVD_OP_PING) {
+            printf("pong in %.1f us\n", (now_seconds() - t0) * 1e6);
+        } else {
+            printf("%s: ok  %s  %.2f s\n", name, r.text, r.service_us / 1e6);
+        }
+    }
+    close(fd);
+    if (rc != 0) {
+        fprintf(stderr, "Daemon connection failed: %s\n", strerror(-rc));
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
+
+static void print_ledger_entry(const LedgerEntry *e) {
+    char serial[2 * LEDGER_SERIAL_MAX + 1], issued[32], until[32];
+    ledger_serial_hex(e, serial, sizeof(serial));
+    time_t t = (time_t)e->issued_at;
+    strftime(issued, sizeof(issued), "%Y-%m-%d %H:%M:%S", gmtime(&t));
+    t = (time_t)e->not_after;
+    strftime(until, sizeof(until), "%Y-%m-%d", gmtime(&t));
+    printf("%-40s %-10s %-24s %s  until %s  %s\n", serial, e->device_id[0] ? e->device_id : "-",
+           e->device_serial[0] ? e->device_serial : "-", issued, until, e->subject);
+}
+
+static int print_ledger_cb(const LedgerEntry *e, void *user) {
+    (void)user;
+    print_ledger_entry(e);
+    return 0;
+}
+
+// ./main ledger [--dir DIR] serial <HEX> | device <SERIAL> | list
+static int run_ledger(int argc, char *argv[]) {
+    const char *dir = LEDGER_DIR;
+    int i = 2;
+    if (i + 1 < argc && strcmp(argv[i], "--dir") == 0) {
+        dir = argv[i + 1];
+        i += 2;
+    }
+    const char *cmd = i < argc ? argv[i] : "";
+    const char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(cmd, "list") != 0 && !arg) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Ledger *l;
+    int rc = ledger_open(dir, 0, &l);
+    if (rc != 0) {
+        fprintf(stderr, "Cannot open ledger %s: %s\n", dir, strerror(-rc));
+        return 1;
+    }
+    int status = 0;
+    if (strcmp(cmd, "serial") == 0) {
+        unsigned char serial[LEDGER_SERIAL_MAX];
+        size_t len;
+        LedgerEntry e;
+        if (ledger_serial_from_hex(arg, serial, &len) != 0) {
+            fprintf(stderr, "Not a hex serial: %s\n", arg);
+            status = 1;
+        } else if (ledger_find_serial(l, serial, len, &e) != 0) {
+            printf("Serial %s was not issued by this station.\n", arg);
+            status = 2;
+        } else {
+            print_ledger_entry(&e);
+        }
+    } else if (strcmp(cmd, "device") == 0) {
+        LedgerEntry found[16];
+        int n = ledger_find_device_serial(l, arg, found, 16);
+        for (int k = 0; k < n && k < 16; k++) print_ledger_entry(&found[k]);
+        printf("%d certificate(s) issued for device serial %s.\n", n < 0 ? 0 : n, arg);
+        status = n > 0 ? 0 : 2;
+    } else if (strcmp(cmd, "list") == 0) {
+        ledger_foreach(l, print_ledger_cb, NULL);
+        LedgerStats st;
+        ledger_get_stats(l, &st);
+        printf("%llu certificate(s), %llu bytes of log.\n", (unsigned long long)st.records,
+               (unsigned long long)st.log_bytes);
+    } else {
+        usage(argv[0]);
+        status = 1;
+    }
+    ledger_close(l);
+    return status;
+}
+
+static int regenerate_crl(int days) {
+    int n = revocation_crl_generate(REVOCATION_STORE, CA_CERT_PATH, CA_KEY_PATH, days, CRL_PATH);
+    if (n < 0) {
+        fprintf(stderr, "CRL generation failed: %s\n", strerror(-n));
+        return 1;
+    }
+    printf("Wrote %s: %d revoked certificate(s), valid for %d days.\n", CRL_PATH, n, days);
+    return 0;
+}
+
+// ./main crl [days]
+static int run_crl(int argc, char *argv[]) {
+    int days = argc > 2 ? atoi(argv[2]) : CRL_DAYS;
+    if (days <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    return regenerate_crl(days);
+}
+
+// ./main revoke [--reason N] <HEX> | --device <SERIAL>
+// --device revokes every certificate the ledger has for that stick.
+static int run_revoke(int argc, char *argv[]) {
+    int reason = REVOCATION_REASON_UNSPECIFIED;
+    int i = 2;
+    if (i + 1 < argc && strcmp(argv[i], "--reason") == 0) {
+        reason = atoi(argv[i + 1]);
+        i += 2;
+    }
+    if (i >= argc || reason < 0 || reason > 10) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    LedgerEntry found[16];
+    int n;
+    if (strcmp(argv[i], "--device") == 0) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        Ledger *l;
+        int rc = ledger_open(LEDGER_DIR, 0, &l);
+        if (rc != 0) {
+            fprintf(stderr, "Cannot open ledger %s: %s\n", LEDGER_DIR, strerror(-rc));
+            return 1;
+        }
+        n = ledger_find_device_serial(l, argv[i + 1], found, 16);
+        ledger_close(l);
+        if (n <= 0) {
+            fprintf(stderr, "No certificate issued for device serial %s.\n", argv[i + 1]);
+            return 2;
+        }
+        if (n > 16) n = 16;
+    } else {
+        if (ledger_serial_from_hex(argv[i], found[0].serial, &found[0].serial_len) != 0) {
+            fprintf(stderr, "Not a hex serial: %s\n", argv[i]);
+            return 1;
+        }
+        n = 1;
+    }
+
+    for (int k = 0; k < n; k++) {
+        char hex[2 * LEDGER_SERIAL_MAX + 1];
+        ledger_serial_hex(&found[k], hex, sizeof(hex));
+        int rc = revocation_store_add(REVOCATION_STORE, found[k].serial, found[k].serial_len, reason);
+        if (rc < 0) {
+            fprintf(stderr, "Cannot record revocation in %s: %s\n", REVOCATION_STORE, strerror(-rc));
+            return 1;
+        }
+        printf("%s %s\n", hex, rc == 1 ? "was already revoked" : "revoked");
+    }
+    return regenerate_crl(CRL_DAYS);
+}
+
+// ./main ca-init <alg> <ca.crt> <ca.key> [CN]
+static int run_ca_init(int argc, char *argv[]) {
+    KeyAlg alg;
+    if (argc < 5 || key_alg_from_name(argv[2], &alg) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (access(argv[3], F_OK) == 0 || access(argv[4], F_OK) == 0) {
+        fprintf(stderr, "Refusing to overwrite existing CA material (%s / %s).\n", argv[3], argv[4]);
+        return 1;
+    }
+    const char *cn = argc > 5 ? argv[5] : "USB Provisioning CA";
+    int rc = certgen_generate_ca(alg, cn, 3650, argv[3], argv[4]);
+    if (rc != 0) {
+        fprintf(stderr, "CA generation failed (%d).\n", rc);
+        return 1;
+    }
+    printf("Created %s CA: %s, %s\n", key_alg_name(alg), argv[3], argv[4]);
+    return 0;
+}
+
+static void export_metrics(void) {
+    if (!g_metrics_path) return;
+    int rc = metrics_export(g_metrics_path);
+    if (rc != 0) fprintf(stderr, "Cannot write metrics to %s: %s\n", g_metrics_path, strerror(-rc));
+}
+
+int main(int argc, char *argv[]) {
+    g_metrics_path = getenv(METRICS_ENV);
+    if (g_metrics_path && !g_metrics_path[0]) g_metrics_path = NULL;
+    if (g_metrics_path) metrics_enable(1);
+    atexit(export_metrics);
+
+    if (argc > 1 && strcmp(argv[1], "station") == 0) {
+        return run_station(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "bulk") == 0) {
+        return run_bulk(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "embed") == 0) {
+        return run_embed(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "clone") == 0) {
+        return run_clone(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "format") == 0) {
+        return run_format(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "renew") == 0) {
+        return run_renew(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "read") == 0) {
+        return run_read(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "verify") == 0) {
+        return run_verify(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "audit") == 0) {
+        return run_audit(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "monitor") == 0) {
+        return run_monitor();
+    }
+    if (argc > 1 && strcmp(argv[1], "daemon") == 0) {
+        return run_daemon(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "submit") == 0) {
+        return run_submit(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "ledger") == 0) {
+        return run_ledger(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "revoke") == 0) {
+        return run_revoke(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "crl") == 0) {
+        return run_crl(argc, argv);
+    }
+    if (argc > 1 && strcmp(argv[1], "ca-init") == 0) {
+        return run_ca_init(argc, argv);
+    }
+    if (argc > 1) {
+        usage(argv[0]);
+        return 1;
+    }
     embed_cert(USB_SCRIPT_PATH, USB_DEVICE, USB_SIGNATURE_PATH);
+    return 0;
 }
 
 
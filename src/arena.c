@@ -0,0 +1,121 @@
+#include "../inc/arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN         16
+#define ARENA_DEFAULT_CHUNK 4096
+
+typedef struct Chunk {
+    struct Chunk *prev;
+    size_t size;                // usable bytes in data[]
+    size_t used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+} Chunk;
+
+struct Arena {
+    Chunk *head;                // current chunk
+    size_t next_size;           // size of the next chunk (doubles)
+    void *last;                 // most recent allocation, for in-place growth
+    size_t used, reserved, chunks;
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static Chunk *chunk_new(Arena *a, size_t min) {
+    size_t size = a->next_size;
+    while (size < min) size *= 2;
+    Chunk *c = malloc(sizeof(Chunk) + size);
+    if (!c) return NULL;
+    c->prev = a->head;
+    c->size = size;
+    c->used = 0;
+    a->head = c;
+    a->next_size = size * 2;
+    a->reserved += size;
+    a->chunks++;
+    return c;
+}
+
+Arena *arena_create(size_t first_chunk) {
+    Arena *a = calloc(1, sizeof(Arena));
+    if (!a) return NULL;
+    a->next_size = first_chunk ? align_up(first_chunk) : ARENA_DEFAULT_CHUNK;
+    return a;
+}
+
+void arena_destroy(Arena *a) {
+    if (!a) return;
+    Chunk *c = a->head;
+    while (c) {
+        Chunk *prev = c->prev;
+        free(c);
+        c = prev;
+    }
+    free(a);
+}
+
+/* Bump `size` bytes aligned to `align` (a power of two) */
+static void *arena_bump(Arena *a, size_t size, size_t align) {
+    if (!a) return NULL;
+    Chunk *c = a->head;
+    size_t off = c ? (c->used + align - 1) & ~(align - 1) : 0;
+    if (!c || off > c->size || c->size - off < size) {
+        c = chunk_new(a, size);
+        if (!c) return NULL;
+        off = 0;
+    }
+    void *p = c->data + off;
+    a->used += size + (off - c->used);
+    c->used = off + size;
+    a->last = p;
+    return p;
+}
+
+void *arena_alloc(Arena *a, size_t size) {
+    return arena_bump(a, size ? size : 1, ARENA_ALIGN);
+}
+
+void *arena_zalloc(Arena *a, size_t size) {
+    void *p = arena_alloc(a, size);
+    if (p) memset(p, 0, size);
+    return p;
+}
+
+void *arena_realloc(Arena *a, void *ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(a, new_size);
+    if (new_size <= old_size) return ptr;
+    Chunk *c = a->head;
+    if (ptr == a->last && c) {
+        size_t start = (size_t)((unsigned char *)ptr - c->data);
+        if (new_size <= c->size - start) {
+            a->used += new_size - (c->used - start);
+            c->used = start + new_size;
+            return ptr;
+        }
+    }
+    void *p = arena_alloc(a, new_size);
+    if (p) memcpy(p, ptr, old_size);
+    return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t len) {
+    /* strings need no alignment: pack them */
+    char *d = arena_bump(a, len + 1, 1);
+    if (!d) return NULL;
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+    return s ? arena_strndup(a, s, strlen(s)) : NULL;
+}
+
+void arena_stats(const Arena *a, size_t *used, size_t *reserved, size_t *chunks) {
+    if (used) *used = a ? a->used : 0;
+    if (reserved) *reserved = a ? a->reserved : 0;
+    if (chunks) *chunks = a ? a->chunks : 0;
+}
@@ -0,0 +1,325 @@
+#define _GNU_SOURCE
+#include "../inc/audit.h"
+#include "../inc/cert_gen.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#define AUDIT_IO_WORKERS_DEFAULT    4
+#define AUDIT_EXPIRY_WARN_DEFAULT   30
+
+typedef struct {
+    const AuditConfig *cfg;
+    CertVerifier *verifier;
+    const char *const *devices;
+    size_t count;
+    AuditDevice *results;
+    VerifyPayload *payloads;
+    UsbDeviceInfo **blocks;         /* sysfs identity per device */
+    size_t next_read;               /* next device for a reader */
+    size_t *ready;                  /* FIFO of read devices waiting for verification */
+    size_t ready_head, ready_tail;
+    int readers_left;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Audit;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void audit_config_init(AuditConfig *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->ca_cert_path = "cert/ca.crt";
+    cfg->io_workers = AUDIT_IO_WORKERS_DEFAULT;
+    cfg->expiry_warn_days = AUDIT_EXPIRY_WARN_DEFAULT;
+}
+
+/* I/O stage: identity and USB_SIG payload, then hand the device to the verifiers */
+static void *audit_reader(void *arg) {
+    Audit *a = arg;
+    for (;;) {
+        pthread_mutex_lock(&a->lock);
+        size_t i = a->next_read++;
+        pthread_mutex_unlock(&a->lock);
+        if (i >= a->count) break;
+
+        double t0 = now_seconds();
+        a->blocks[i] = usb_info_from_block_device(a->devices[i]);
+        cert_verify_read(a->devices[i], &a->payloads[i]);
+        a->results[i].read_ms = (now_seconds() - t0) * 1e3;
+
+        pthread_mutex_lock(&a->lock);
+        a->ready[a->ready_tail++] = i;
+        pthread_cond_signal(&a->cond);
+        pthread_mutex_unlock(&a->lock);
+    }
+    pthread_mutex_lock(&a->lock);
+    a->readers_left--;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+/* CPU stage: chain, validity, revocation and binding for each read device */
+static void *audit_verifier(void *arg) {
+    Audit *a = arg;
+    for (;;) {
+        pthread_mutex_lock(&a->lock);
+        while (a->ready_head == a->ready_tail && a->readers_left > 0) pthread_cond_wait(&a->cond, &a->lock);
+        if (a->ready_head == a->ready_tail) {
+            pthread_mutex_unlock(&a->lock);
+            break;
+        }
+        size_t i = a->ready[a->ready_head++];
+        pthread_mutex_unlock(&a->lock);
+
+        AuditDevice *r = &a->results[i];
+        const UsbDeviceInfo *expected = cert_verify_match_usbguard(a->cfg->guard, a->blocks[i]);
+        r->identity = expected ? AUDIT_IDENTITY_USBGUARD : AUDIT_IDENTITY_SYSFS;
+        r->guard_device = expected;
+        if (!expected) expected = a->blocks[i];
+        if (expected) certgen_subject_cn(expected, r->expected_cn, sizeof(r->expected_cn));
+
+        double t0 = now_seconds();
+        cert_verify_payload(a->verifier, &a->payloads[i], expected, &r->verify);
+        r->verify_ms = (now_seconds() - t0) * 1e3;
+        if (r->verify.status == VERIFY_OK && a->cfg->expiry_warn_days > 0)
+            r->expiring = r->verify.not_after - time(NULL) < (time_t)a->cfg->expiry_warn_days * 86400;
+        cert_verify_payload_free(&a->payloads[i]);
+    }
+    return NULL;
+}
+
+int audit_run(const AuditConfig *cfg, const char *const *devices, size_t count,
+              AuditDevice *results, AuditSummary *summary) {
+    AuditConfig defaults;
+    if (!cfg) {
+        audit_config_init(&defaults);
+        cfg = &defaults;
+    }
+    if ((count && (!devices || !results)) || !summary) return -EINVAL;
+    memset(summary, 0, sizeof(*summary));
+    double t0 = now_seconds();
+
+    CertVerifier *verifier = cert_verifier_create(cfg->ca_cert_path ? cfg->ca_cert_path : "cert/ca.crt", 0);
+    if (!verifier) return -ENOENT;
+    if (cfg->revocation) cert_verifier_set_revocation(verifier, cfg->revocation);
+
+    int io_workers = cfg->io_workers > 0 ? cfg->io_workers : AUDIT_IO_WORKERS_DEFAULT;
+    int verify_workers = cfg->verify_workers;
+    if (verify_workers <= 0) verify_workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (verify_workers <= 0) verify_workers = 1;
+    if ((size_t)io_workers > count) io_workers = count ? (int)count : 1;
+    if ((size_t)verify_workers > count) verify_workers = count ? (int)count : 1;
+
+    Audit a = {
+        .cfg = cfg, .verifier = verifier, .devices = devices, .count = count, .results = results,
+        .readers_left = io_workers,
+    };
+    a.payloads = calloc(count ? count : 1, sizeof(*a.payloads));
+    a.blocks = calloc(count ? count : 1, sizeof(*a.blocks));
+    a.ready = calloc(count ? count : 1, sizeof(*a.ready));
+    pthread_t *threads = calloc((size_t)(io_workers + verify_workers), sizeof(pthread_t));
+    int rc = 0;
+    if (!a.payloads || !a.blocks || !a.ready || !threads) {
+        rc = -ENOMEM;
+        goto out;
+    }
+    for (size_t i = 0; i < count; i++) {
+        memset(&results[i], 0, sizeof(results[i]));
+        results[i].device = devices[i];
+    }
+
+    pthread_mutex_init(&a.lock, NULL);
+    pthread_cond_init(&a.cond, NULL);
+    int started = 0;
+    for (int i = 0; i < io_workers + verify_workers; i++) {
+        if (pthread_create(&threads[i], NULL, i < io_workers ? audit_reader : audit_verifier, &a) != 0) {
+            rc = -EAGAIN;
+            break;
+        }
+        started++;
+    }
+    if (rc != 0 && started < io_workers) {
+        /* readers that never started will not report done; no verifier was started */
+        pthread_mutex_lock(&a.lock);
+        a.readers_left -= io_workers - started;
+        pthread_cond_broadcast(&a.cond);
+        pthread_mutex_unlock(&a.lock);
+    }
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    pthread_cond_destroy(&a.cond);
+    pthread_mutex_destroy(&a.lock);
+    if (rc == 0) {
+        for (size_t i = 0; i < count; i++) {
+            summary->by_status[results[i].verify.status]++;
+            summary->expiring += results[i].expiring != 0;
+            summary->read_seconds += results[i].read_ms / 1e3;
+            summary->verify_seconds += results[i].verify_ms / 1e3;
+        }
+        summary->devices = count;
+    }
+out:
+    for (size_t i = 0; a.payloads && i < count; i++) cert_verify_payload_free(&a.payloads[i]);
+    for (size_t i = 0; a.blocks && i < count; i++) usb_info_free(a.blocks[i]);
+    free(a.payloads);
+    free(a.blocks);
+    free(a.ready);
+    free(threads);
+    cert_verifier_free(verifier);
+    summary->seconds = now_seconds() - t0;
+    return rc;
+}
+
+/* ---------- device discovery ---------- */
+
+static int sysfs_nonzero(const char *name, const char *attr) {
+    char path[PATH_MAX], buf[32];
+    snprintf(path, sizeof(path), "/sys/block/%s/%s", name, attr);
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int nonzero = fgets(buf, sizeof(buf), f) && strtoull(buf, NULL, 10) != 0;
+    fclose(f);
+    return nonzero;
+}
+
+static int is_candidate(const char *name, int flags) {
+    if (!sysfs_nonzero(name, "size")) return 0;     /* card reader without a medium */
+    if (strncmp(name, "loop", 4) == 0) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "/sys/block/%s/loop/backing_file", name);
+        return (flags & AUDIT_FIND_LOOP) && access(path, F_OK) == 0;
+    }
+    /* the whole-disk node resolves through the USB host controller for USB storage */
+    char link[PATH_MAX], real[PATH_MAX];
+    snprintf(link, sizeof(link), "/sys/block/%s", name);
+    return realpath(link, real) && strstr(real, "/usb") != NULL;
+}
+
+int audit_is_usb_disk(const char *device, int flags) {
+    struct stat st;
+    if (!device || stat(device, &st) != 0 || !S_ISBLK(st.st_mode)) return 0;
+    /* /sys/dev/block/M:m resolves to .../block/<disk> or .../block/<disk>/<partition> */
+    char link[PATH_MAX], real[PATH_MAX], path[PATH_MAX];
+    snprintf(link, sizeof(link), "/sys/dev/block/%u:%u", major(st.st_rdev), minor(st.st_rdev));
+    if (!realpath(link, real)) return 0;
+    const char *name = strrchr(real, '/');
+    if (!name) return 0;
+    name++;
+    snprintf(path, sizeof(path), "/sys/block/%s", name);
+    return access(path, F_OK) == 0 && is_candidate(name, flags);
+}
+
+static int cmp_str(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int audit_find_devices(int flags, char ***devices, size_t *count) {
+    if (!devices || !count) return -EINVAL;
+    *devices = NULL;
+    *count = 0;
+    DIR *dir = opendir("/sys/block");
+    if (!dir) return -errno;
+    char **list = NULL;
+    size_t n = 0, cap = 0;
+    int rc = 0;
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if (de->d_name[0] == '.' || !is_candidate(de->d_name, flags)) continue;
+        if (n == cap) {
+            size_t ncap = cap ? cap * 2 : 16;
+            char **grown = realloc(list, ncap * sizeof(*list));
+            if (!grown) { rc = -ENOMEM; break; }
+            list = grown;
+            cap = ncap;
+        }
+        size_t len = strlen(de->d_name) + sizeof("/dev/");
+        if (!(list[n] = malloc(len))) { rc = -ENOMEM; break; }
+        snprintf(list[n++], len, "/dev/%s", de->d_name);
+    }
+    closedir(dir);
+    if (rc != 0) {
+        audit_free_devices(list, n);
+        return rc;
+    }
+    if (n > 1) qsort(list, n, sizeof(*list), cmp_str);
+    *devices = list;
+    *count = n;
+    return 0;
+}
+
+void audit_free_devices(char **devices, size_t count) {
+    for (size_t i = 0; devices && i < count; i++) free(devices[i]);
+    free(devices);
+}
+
+/* ---------- JSON report ---------- */
+
+static void json_put_string(FILE *f, const char *key, const char *s) {
+    fprintf(f, "\"%s\":\"", key);
+    for (; s && *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+int audit_write_json(FILE *out, const AuditConfig *cfg, const AuditDevice *results, size_t count,
+                     const AuditSummary *summary) {
+    if (!out || !summary || (count && !results)) return -EINVAL;
+    time_t now = time(NULL);
+    fprintf(out, "{");
+    json_put_string(out, "ca", cfg && cfg->ca_cert_path ? cfg->ca_cert_path : "cert/ca.crt");
+    fprintf(out, ",\"time\":%lld,\"revocation\":%s,\"usbguard\":%s,\"seconds\":%.6f,\"read_seconds\":%.6f,"
+            "\"verify_seconds\":%.6f,\"devices\":%zu,\"summary\":{",
+            (long long)now, cfg && cfg->revocation ? "true" : "false", cfg && cfg->guard ? "true" : "false",
+            summary->seconds, summary->read_seconds, summary->verify_seconds, summary->devices);
+    for (int s = 0; s < AUDIT_STATUS_COUNT; s++)
+        fprintf(out, "%s\"%s\":%zu", s ? "," : "", cert_verify_status_name((VerifyStatus)s), summary->by_status[s]);
+    fprintf(out, ",\"expiring\":%zu},\"results\":[", summary->expiring);
+
+    for (size_t i = 0; i < count; i++) {
+        const AuditDevice *r = &results[i];
+        const VerifyResult *v = &r->verify;
+        fprintf(out, "%s\n{", i ? "," : "");
+        json_put_string(out, "device", r->device);
+        fputc(',', out);
+        json_put_string(out, "status", cert_verify_status_name(v->status));
+        fputc(',', out);
+        json_put_string(out, "identity", r->identity == AUDIT_IDENTITY_USBGUARD ? "usbguard" : "sysfs");
+        fputc(',', out);
+        json_put_string(out, "expected_cn", r->expected_cn);
+        if (v->subject_cn[0]) {
+            fputc(',', out);
+            json_put_string(out, "cn", v->subject_cn);
+            fputc(',', out);
+            json_put_string(out, "serial", v->serial_hex);
+        }
+        if (v->not_after)
+            fprintf(out, ",\"not_after\":%lld,\"days_left\":%lld,\"expiring\":%s", (long long)v->not_after,
+                    (long long)(v->not_after - now) / 86400, r->expiring ? "true" : "false");
+        if (v->status == VERIFY_BAD_CHAIN || v->status == VERIFY_EXPIRED) {
+            fprintf(out, ",\"x509_error\":%d,", v->x509_error);
+            json_put_string(out, "x509_message", X509_verify_cert_error_string(v->x509_error));
+        }
+        if (v->io_error) {
+            fprintf(out, ",\"errno\":%d,", -v->io_error);
+            json_put_string(out, "error", strerror(-v->io_error));
+        }
+        fprintf(out, ",\"read_ms\":%.3f,\"verify_ms\":%.3f}", r->read_ms, r->verify_ms);
+    }
+    fprintf(out, "%s]}\n", count ? "\n" : "");
+    return ferror(out) ? -EIO : 0;
+}
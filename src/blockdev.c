@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include "../inc/blockdev.h"
+#include "../inc/metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#define BLOCKDEV_ALIGN 4096
+#define ZERO_CHUNK (1024 * 1024)
+
+int blockdev_open(BlockDev *bd, const char *path, int writable) {
+    if (!bd || !path) return -EINVAL;
+    memset(bd, 0, sizeof(*bd));
+    bd->fd = -1;
+
+    struct stat st;
+    if (stat(path, &st) != 0) return -errno;
+    bd->is_block = S_ISBLK(st.st_mode);
+    if (!bd->is_block && !S_ISREG(st.st_mode)) return -ENOTBLK;
+
+    int flags = O_CLOEXEC | (writable ? O_RDWR : O_RDONLY);
+    if (writable && bd->is_block) flags |= O_EXCL;
+    bd->fd = open(path, flags);
+    if (bd->fd < 0) return -errno;
+
+    if (bd->is_block) {
+        int ss = 0;
+        uint64_t size = 0;
+        if (ioctl(bd->fd, BLKSSZGET, &ss) != 0 || ioctl(bd->fd, BLKGETSIZE64, &size) != 0) {
+            int err = -errno;
+            blockdev_close(bd);
+            return err;
+        }
+        bd->sector_size = (uint32_t)ss;
+        bd->size_bytes = size;
+    } else {
+        bd->sector_size = 512;
+        bd->size_bytes = (uint64_t)st.st_size;
+    }
+    return 0;
+}
+
+void blockdev_close(BlockDev *bd) {
+    if (!bd || bd->fd < 0) return;
+    close(bd->fd);
+    bd->fd = -1;
+}
+
+int blockdev_pread(BlockDev *bd, void *buf, size_t len, uint64_t off) {
+    unsigned char *p = buf;
+    while (len > 0) {
+        ssize_t n = pread(bd->fd, p, len, (off_t)off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        if (n == 0) return -EIO;    /* past the end of the device */
+        p += n; off += (uint64_t)n; len -= (size_t)n;
+    }
+    return 0;
+}
+
+int blockdev_pwrite(BlockDev *bd, const void *buf, size_t len, uint64_t off) {
+    const unsigned char *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(bd->fd, p, len, (off_t)off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        if (n == 0) return -ENOSPC;    /* no progress; retrying would spin */
+        metrics_add(METRIC_BYTES_WRITTEN, (uint64_t)n);
+        p += n; off += (uint64_t)n; len -= (size_t)n;
+    }
+    return 0;
+}
+
+int blockdev_zero(BlockDev *bd, uint64_t off, uint64_t len) {
+    if (len == 0) return 0;
+    if (bd->is_block) {
+        uint64_t range[2] = { off, len };
+        if (ioctl(bd->fd, BLKZEROOUT, range) == 0) goto zeroed;
+    } else {
+        if (fallocate(bd->fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, (off_t)off, (off_t)len) == 0) goto zeroed;
+        if (fallocate(bd->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)off, (off_t)len) == 0) goto zeroed;
+    }
+
+    /* fallback: plain zero writes */
+    size_t chunk = len < ZERO_CHUNK ? (size_t)len : ZERO_CHUNK;
+    void *zeros = blockdev_alloc(bd, chunk);
+    if (!zeros) return -ENOMEM;
+    int rc = 0;
+    while (len > 0 && rc == 0) {
+        size_t n = len < chunk ? (size_t)len : chunk;
+        rc = blockdev_pwrite(bd, zeros, n, off);
+        off += n; len -= n;
+    }
+    free(zeros);
+    return rc;
+zeroed:
+    metrics_add(METRIC_BYTES_WRITTEN, len);
+    return 0;
+}
+
+int blockdev_sync(BlockDev *bd) {
+    return fdatasync(bd->fd) == 0 ? 0 : -errno;
+}
+
+void blockdev_drop_cache(BlockDev *bd, uint64_t off, uint64_t len) {
+    (void)posix_fadvise(bd->fd, (off_t)off, (off_t)len, POSIX_FADV_DONTNEED);
+}
+
+int blockdev_reread_partitions(BlockDev *bd) {
+    if (!bd->is_block) return 0;
+    return ioctl(bd->fd, BLKRRPART) == 0 ? 0 : -errno;
+}
+
+void *blockdev_alloc(const BlockDev *bd, size_t len) {
+    size_t align = bd && bd->sector_size > BLOCKDEV_ALIGN ? bd->sector_size : BLOCKDEV_ALIGN;
+    void *p = NULL;
+    if (posix_memalign(&p, align, len ? len : align) != 0) return NULL;
+    memset(p, 0, len ? len : align);
+    return p;
+}
+
+size_t blockdev_round_up(const BlockDev *bd, size_t len) {
+    size_t ss = bd->sector_size;
+    return (len + ss - 1) / ss * ss;
+}
@@ -0,0 +1,452 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../inc/bulk_issue.h"
+#include "../inc/ca_signer.h"
+#include "../inc/cert_gen.h"
+#include "../inc/metrics.h"
+#include "../inc/usb_info.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#define BULK_ID_MAX     64
+#define BULK_NAME_MAX   256
+#define BULK_SERIAL_MAX 128
+
+typedef struct {
+    uint64_t line;
+    char id[BULK_ID_MAX];
+    char name[BULK_NAME_MAX];
+    char serial[BULK_SERIAL_MAX];
+    int parse_error;            /* entry could not be parsed; reported, never issued */
+    int done;
+    int failed;
+    char *out;                  /* bundle line, malloc'ed */
+    size_t out_len;
+} BulkSlot;
+
+typedef struct {
+    const BulkConfig *cfg;
+    CaSigner *signer;
+    FILE *bundle;
+    BulkSlot *slots;
+    size_t window;
+    /* sequence numbers: [next_out, next_take) being issued, [next_take, next_read) queued */
+    uint64_t next_read, next_take, next_out;
+    int eof;
+    int write_error;
+    BulkStats *stats;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* a device was queued, or the manifest ended */
+    pthread_cond_t space;       /* the window moved on */
+} BulkRun;
+
+void bulk_config_init(BulkConfig *cfg) {
+    if (!cfg) return;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->ca_cert_path = "cert/ca.crt";
+    cfg->ca_key_path = "cert/ca.key";
+    cfg->key_alg = KEY_ALG_RSA2048;
+    cfg->days = 365;
+    cfg->include_keys = 1;
+}
+
+/* ---------- manifest ---------- */
+
+static char *trim(char *s, char *end) {
+    while (s < end && isspace((unsigned char)*s)) s++;
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+    *end = '\0';
+    return s;
+}
+
+static int copy_field(char *dst, size_t dstsz, const char *src) {
+    size_t n = strlen(src);
+    if (n >= dstsz) return -1;
+    memcpy(dst, src, n + 1);
+    return 0;
+}
+
+/* "vid:pid,name,serial": first field id, last field serial, the rest is the name */
+static int parse_csv(char *line, BulkSlot *s) {
+    char *first = strchr(line, ',');
+    char *last = strrchr(line, ',');
+    if (!first || first == last) return -1;
+    char *id = trim(line, first);
+    char *name = trim(first + 1, last);
+    char *serial = trim(last + 1, last + 1 + strlen(last + 1));
+    if (copy_field(s->id, sizeof(s->id), id) != 0 || copy_field(s->name, sizeof(s->name), name) != 0 ||
+        copy_field(s->serial, sizeof(s->serial), serial) != 0) return -1;
+    return 0;
+}
+
+/* JSON string at *p (just past the opening quote) into out; advances *p past the closing quote */
+static int json_string(const char **p, char *out, size_t outsz) {
+    size_t n = 0;
+    const char *q = *p;
+    for (;;) {
+        unsigned c = (unsigned char)*q++;
+        if (c == '\0') return -1;
+        if (c == '"') break;
+        if (c == '\\') {
+            c = (unsigned char)*q++;
+            switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case '"': case '\\': case '/': break;
+            case 'u': {
+                unsigned v = 0;
+                for (int i = 0; i < 4; i++, q++) {
+                    int d = isdigit((unsigned char)*q) ? *q - '0'
+                          : isxdigit((unsigned char)*q) ? (tolower((unsigned char)*q) - 'a' + 10) : -1;
+                    if (d < 0) return -1;
+                    v = v << 4 | (unsigned)d;
+                }
+                /* UTF-8 for the BMP; surrogate pairs are not expected in device strings */
+                unsigned char enc[3];
+                size_t len = v < 0x80 ? 1 : v < 0x800 ? 2 : 3;
+                if (v >= 0xd800 && v < 0xe000) return -1;
+                if (len == 1) enc[0] = (unsigned char)v;
+                else if (len == 2) { enc[0] = (unsigned char)(0xc0 | v >> 6); enc[1] = (unsigned char)(0x80 | (v & 0x3f)); }
+                else {
+                    enc[0] = (unsigned char)(0xe0 | v >> 12);
+                    enc[1] = (unsigned char)(0x80 | ((v >> 6) & 0x3f));
+                    enc[2] = (unsigned char)(0x80 | (v & 0x3f));
+                }
+                if (n + len >= outsz) return -1;
+                memcpy(out + n, enc, len);
+                n += len;
+                continue;
+            }
+            default: return -1;
+            }
+        }
+        if (n + 1 >= outsz) return -1;
+        out[n++] = (char)c;
+    }
+    out[n] = '\0';
+    *p = q;
+    return 0;
+}
+
+/* Flat object with string values; keys id (or vid_pid), name, serial; other members ignored */
+static int parse_json(const char *p, BulkSlot *s) {
+    char key[32], value[BULK_NAME_MAX];
+    p++;   /* '{' */
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '}') return s->id[0] || s->serial[0] ? 0 : -1;
+        if (*p++ != '"' || json_string(&p, key, sizeof(key)) != 0) return -1;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p++ != ':') return -1;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '"') {
+            p++;
+            if (json_string(&p, value, sizeof(value)) != 0) return -1;
+            int rc = 0;
+            if (strcmp(key, "id") == 0 || strcmp(key, "vid_pid") == 0) rc = copy_field(s->id, sizeof(s->id), value);
+            else if (strcmp(key, "name") == 0) rc = copy_field(s->name, sizeof(s->name), value);
+            else if (strcmp(key, "serial") == 0) rc = copy_field(s->serial, sizeof(s->serial), value);
+            if (rc != 0) return -1;
+        } else {
+            /* numbers, true/false/null: skip the token */
+            if (*p == '{' || *p == '[') return -1;
+            while (*p && *p != ',' && *p != '}') p++;
+        }
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == ',') p++;
+        else if (*p != '}') return -1;
+    }
+}
+
+/* 1: device entry in s, 0: nothing on this line (blank, comment, CSV header) */
+static int parse_line(char *line, uint64_t lineno, BulkSlot *s) {
+    line = trim(line, line + strlen(line));
+    if (line[0] == '\0' || line[0] == '#') return 0;
+    if (lineno == 1 && strncasecmp(line, "id,", 3) == 0) return 0;
+    memset(s, 0, sizeof(*s));
+    s->line = lineno;
+    s->parse_error = (line[0] == '{' ? parse_json(line, s) : parse_csv(line, s)) != 0;
+    if (!s->parse_error && s->id[0] && (!strchr(s->id, ':') || strlen(s->id) != 9)) s->parse_error = 1;
+    return 1;
+}
+
+/* ---------- bundle lines ---------- */
+
+static void json_put_string(FILE *f, const char *key, const char *s) {
+    fprintf(f, ",\"%s\":\"", key);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static int json_put_base64(FILE *f, const char *key, const unsigned char *der, size_t len) {
+    unsigned char *b64 = malloc(4 * ((len + 2) / 3) + 1);
+    if (!b64) return -ENOMEM;
+    EVP_EncodeBlock(b64, der, (int)len);
+    fprintf(f, ",\"%s\":\"%s\"", key, b64);
+    OPENSSL_cleanse(b64, 4 * ((len + 2) / 3));
+    free(b64);
+    return 0;
+}
+
+static void format_failure(BulkSlot *s, const char *stage, int rc) {
+    s->failed = 1;
+    FILE *f = open_memstream(&s->out, &s->out_len);
+    if (!f) return;
+    fprintf(f, "{\"line\":%llu", (unsigned long long)s->line);
+    json_put_string(f, "serial", s->serial);
+    fprintf(f, ",\"error\":\"%s\",\"rc\":%d}\n", stage, rc);
+    fclose(f);
+}
+
+static int format_success(BulkRun *run, BulkSlot *s, const char *cn, X509 *cert, EVP_PKEY *pkey) {
+    unsigned char *cert_der = NULL, *key_der = NULL;
+    size_t cert_len = 0;
+    int key_len = 0;
+    if (certgen_cert_to_der(cert, &cert_der, &cert_len) != 0) return -ENOMEM;
+    if (run->cfg->include_keys) {
+        PKCS8_PRIV_KEY_INFO *p8 = EVP_PKEY2PKCS8(pkey);
+        key_len = p8 ? i2d_PKCS8_PRIV_KEY_INFO(p8, &key_der) : -1;
+        PKCS8_PRIV_KEY_INFO_free(p8);
+        if (key_len <= 0) {
+            OPENSSL_free(cert_der);
+            return -ENOMEM;
+        }
+    }
+
+    char *serial_hex = NULL;
+    BIGNUM *bn = ASN1_INTEGER_to_BN(X509_get0_serialNumber(cert), NULL);
+    if (bn) serial_hex = BN_bn2hex(bn);
+    BN_free(bn);
+    int days = 0, secs = 0;
+    ASN1_TIME_diff(&days, &secs, NULL, X509_get0_notAfter(cert));
+
+    int rc = -ENOMEM;
+    FILE *f = open_memstream(&s->out, &s->out_len);
+    if (f) {
+        fprintf(f, "{\"line\":%llu", (unsigned long long)s->line);
+        json_put_string(f, "id", s->id);
+        json_put_string(f, "name", s->name);
+        json_put_string(f, "serial", s->serial);
+        json_put_string(f, "cn", cn);
+        json_put_string(f, "cert_serial", serial_hex ? serial_hex : "");
+        fprintf(f, ",\"not_after\":%lld", (long long)time(NULL) + (long long)days * 86400 + secs);
+        rc = json_put_base64(f, "cert", cert_der, cert_len);
+        if (rc == 0 && key_der) rc = json_put_base64(f, "key", key_der, (size_t)key_len);
+        fputs("}\n", f);
+        if (fclose(f) != 0 && rc == 0) rc = -ENOMEM;
+        if (rc != 0) {
+            free(s->out);
+            s->out = NULL;
+        }
+    }
+    OPENSSL_free(serial_hex);
+    OPENSSL_free(cert_der);
+    if (key_der) OPENSSL_cleanse(key_der, (size_t)key_len);
+    OPENSSL_free(key_der);
+    return rc;
+}
+
+/* ---------- pipeline ---------- */
+
+/* Issue one device; the slot is owned by the calling worker until done is set */
+static void issue_one(BulkRun *run, BulkSlot *s) {
+    const BulkConfig *cfg = run->cfg;
+    if (s->parse_error) {
+        format_failure(s, "manifest", -EINVAL);
+        metrics_add(METRIC_DEVICES_FAILED, 1);
+        return;
+    }
+    EVP_PKEY *pkey = NULL;
+    X509_REQ *req = NULL;
+    X509 *cert = NULL;
+    const char *stage = "info";
+    MetricStage mstage = METRIC_STAGE_INFO;
+    uint64_t t = metrics_span_begin();
+    int rc = -ENOMEM;
+
+    UsbDeviceInfo *info = usb_info_create();
+    if (!info) goto out;
+    if (s->id[0]) info->id = usb_info_strndup(info, s->id, strlen(s->id));
+    if (s->name[0]) usb_info_set_name(info, s->name);
+    if (s->serial[0]) usb_info_set_serial(info, s->serial);
+
+    metrics_span_end(mstage, t);
+    stage = "key", mstage = METRIC_STAGE_KEY, t = metrics_span_begin();
+    pkey = certgen_generate_key_alg(cfg->key_alg);
+    if (!pkey) { rc = CERTGEN_ERR_KEY; goto out; }
+
+    metrics_span_end(mstage, t);
+    stage = "csr", mstage = METRIC_STAGE_CSR, t = metrics_span_begin();
+    req = certgen_build_csr(pkey, info);
+    if (!req) { rc = CERTGEN_ERR_CSR; goto out; }
+
+    metrics_span_end(mstage, t);
+    stage = "sign", mstage = METRIC_STAGE_SIGN, t = metrics_span_begin();
+    cert = ca_signer_sign(run->signer, req, cfg->days);
+    if (!cert) { rc = CERTGEN_ERR_SIGN; goto out; }
+    if (cfg->ledger) {
+        LedgerEntry entry;
+        rc = ledger_entry_from_cert(cert, info, &entry);
+        if (rc == 0) rc = ledger_append(cfg->ledger, &entry);
+        if (rc != 0) goto out;
+    }
+
+    metrics_span_end(mstage, t);
+    stage = "write", mstage = METRIC_STAGE_WRITE, t = metrics_span_begin();
+    char cn[256];
+    certgen_subject_cn(info, cn, sizeof(cn));
+    rc = format_success(run, s, cn, cert, pkey);
+out:
+    metrics_span_end(mstage, t);
+    if (rc != 0) {
+        metrics_failure(mstage, rc);
+        metrics_add(METRIC_DEVICES_FAILED, 1);
+        format_failure(s, stage, rc);
+    } else {
+        metrics_add(METRIC_DEVICES_PROVISIONED, 1);
+    }
+    X509_free(cert);
+    X509_REQ_free(req);
+    EVP_PKEY_free(pkey);
+    usb_info_free(info);
+}
+
+/* Write finished slots in manifest order. Called with the lock held. */
+static void flush_in_order(BulkRun *run) {
+    while (run->next_out < run->next_take) {
+        BulkSlot *s = &run->slots[run->next_out % run->window];
+        if (!s->done) break;
+        if (!s->out) {
+            run->stats->failed++;
+            run->write_error = -ENOMEM;
+        } else {
+            if (s->failed) run->stats->failed++;
+            else run->stats->issued++;
+            if (!run->write_error && fwrite(s->out, 1, s->out_len, run->bundle) != s->out_len) run->write_error = -EIO;
+            /* the line may hold a private key */
+            OPENSSL_cleanse(s->out, s->out_len);
+            free(s->out);
+        }
+        s->out = NULL;
+        s->done = 0;
+        run->next_out++;
+        pthread_cond_broadcast(&run->space);
+    }
+}
+
+static void *bulk_worker(void *arg) {
+    BulkRun *run = arg;
+    pthread_mutex_lock(&run->lock);
+    for (;;) {
+        while (run->next_take == run->next_read && !run->eof) pthread_cond_wait(&run->work, &run->lock);
+        if (run->next_take == run->next_read) break;
+        BulkSlot *s = &run->slots[run->next_take++ % run->window];
+        pthread_mutex_unlock(&run->lock);
+        issue_one(run, s);
+        pthread_mutex_lock(&run->lock);
+        s->done = 1;
+        flush_in_order(run);
+    }
+    pthread_mutex_unlock(&run->lock);
+    return NULL;
+}
+
+int bulk_issue(const BulkConfig *cfg, FILE *manifest, FILE *bundle, BulkStats *stats) {
+    BulkStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (!cfg || !manifest || !bundle) return -EINVAL;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    size_t workers = cfg->workers > 0 ? (size_t)cfg->workers : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    BulkRun run = { .cfg = cfg, .bundle = bundle, .stats = stats };
+    run.window = cfg->window ? cfg->window : 8 * workers;
+    run.signer = ca_signer_create(cfg->ca_cert_path, cfg->ca_key_path);
+    if (!run.signer) return -ENOENT;
+    ca_signer_set_serials(run.signer, cfg->serials);
+    run.slots = calloc(run.window, sizeof(BulkSlot));
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    if (!run.slots || !threads) {
+        free(run.slots);
+        free(threads);
+        ca_signer_free(run.signer);
+        return -ENOMEM;
+    }
+    pthread_mutex_init(&run.lock, NULL);
+    pthread_cond_init(&run.work, NULL);
+    pthread_cond_init(&run.space, NULL);
+
+    size_t started = 0;
+    for (; started < workers; started++) {
+        if (pthread_create(&threads[started], NULL, bulk_worker, &run) != 0) break;
+    }
+    /* without a worker the reader would wait forever for the window to move */
+    if (started == 0) {
+        pthread_cond_destroy(&run.space);
+        pthread_cond_destroy(&run.work);
+        pthread_mutex_destroy(&run.lock);
+        free(threads);
+        free(run.slots);
+        ca_signer_free(run.signer);
+        return -EAGAIN;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    uint64_t lineno = 0;
+    BulkSlot parsed;
+    while (getline(&line, &cap, manifest) >= 0) {
+        if (!parse_line(line, ++lineno, &parsed)) continue;
+        stats->devices++;
+        pthread_mutex_lock(&run.lock);
+        while (run.next_read - run.next_out >= run.window && !run.write_error) pthread_cond_wait(&run.space, &run.lock);
+        if (run.write_error) {
+            pthread_mutex_unlock(&run.lock);
+            break;
+        }
+        run.slots[run.next_read++ % run.window] = parsed;
+        if (run.next_read - run.next_out > stats->max_in_flight) stats->max_in_flight = run.next_read - run.next_out;
+        pthread_cond_signal(&run.work);
+        pthread_mutex_unlock(&run.lock);
+    }
+    free(line);
+
+    pthread_mutex_lock(&run.lock);
+    run.eof = 1;
+    pthread_cond_broadcast(&run.work);
+    pthread_mutex_unlock(&run.lock);
+    for (size_t i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    int rc = run.write_error;
+    if (rc == 0 && fflush(bundle) != 0) rc = -EIO;
+    if (rc == 0 && cfg->ledger) rc = ledger_sync(cfg->ledger);
+    pthread_cond_destroy(&run.space);
+    pthread_cond_destroy(&run.work);
+    pthread_mutex_destroy(&run.lock);
+    free(threads);
+    free(run.slots);
+    ca_signer_free(run.signer);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    stats->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    return rc != 0 ? rc : (int)stats->failed;
+}
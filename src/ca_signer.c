@@ -0,0 +1,153 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../inc/ca_signer.h"
+#include "../inc/cert_gen.h"
+#include "../inc/key_alg.h"
+
+#include <openssl/x509v3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CA_SIGNER_EXT_COUNT 2
+
+struct CaSigner {
+    X509 *ca;
+    EVP_PKEY *key;
+    X509_NAME *issuer;                          /* cached copy of the CA subject */
+    X509_EXTENSION *exts[CA_SIGNER_EXT_COUNT];  /* leaf extensions, identical for every cert */
+    X509_EXTENSION *ku_rsa;                     /* keyUsage for RSA leaves (signature + key encipherment) */
+    X509_EXTENSION *ku_sig;                     /* keyUsage for EC/EdDSA leaves (signature only) */
+    EVP_MD_CTX *sign_tmpl;                      /* DigestSignInit done once with the CA key */
+    SerialAlloc *serials;                       /* borrowed; NULL = random serials */
+};
+
+CaSigner *ca_signer_from_objects(X509 *ca, EVP_PKEY *ca_pkey) {
+    if (!ca || !ca_pkey) return NULL;
+    CaSigner *s = calloc(1, sizeof(CaSigner));
+    if (!s) return NULL;
+
+    X509_up_ref(ca);
+    EVP_PKEY_up_ref(ca_pkey);
+    s->ca = ca;
+    s->key = ca_pkey;
+
+    s->issuer = X509_NAME_dup(X509_get_subject_name(ca));
+    if (!s->issuer) goto fail;
+
+    /* basicConstraints=CA:FALSE, keyUsage, extendedKeyUsage (clientAuth) */
+    s->exts[0] = X509V3_EXT_conf_nid(NULL, NULL, NID_basic_constraints, "CA:FALSE");
+    s->exts[1] = X509V3_EXT_conf_nid(NULL, NULL, NID_ext_key_usage, "clientAuth");
+    for (int i = 0; i < CA_SIGNER_EXT_COUNT; i++) {
+        if (!s->exts[i]) goto fail;
+    }
+    s->ku_rsa = X509V3_EXT_conf_nid(NULL, NULL, NID_key_usage, "digitalSignature,keyEncipherment");
+    s->ku_sig = X509V3_EXT_conf_nid(NULL, NULL, NID_key_usage, "digitalSignature");
+    if (!s->ku_rsa || !s->ku_sig) goto fail;
+
+    /* digest follows the CA key: SHA-256/384, none for Ed25519 */
+    s->sign_tmpl = EVP_MD_CTX_new();
+    if (!s->sign_tmpl) goto fail;
+    if (EVP_DigestSignInit(s->sign_tmpl, NULL, key_alg_digest_for_key(s->key), NULL, s->key) != 1) {
+        fprintf(stderr, "ca_signer: cannot initialise signing context for CA key\n");
+        goto fail;
+    }
+    return s;
+
+fail:
+    ca_signer_free(s);
+    return NULL;
+}
+
+CaSigner *ca_signer_create(const char *ca_cert_path, const char *ca_key_path) {
+    X509 *ca = NULL;
+    EVP_PKEY *key = NULL;
+    if (certgen_load_ca(ca_cert_path, ca_key_path, &ca, &key) != 0) return NULL;
+
+    /* the CA key must belong to the CA certificate */
+    if (X509_check_private_key(ca, key) != 1) {
+        fprintf(stderr, "ca_signer: %s does not match %s\n", ca_key_path, ca_cert_path);
+        X509_free(ca);
+        EVP_PKEY_free(key);
+        return NULL;
+    }
+
+    CaSigner *s = ca_signer_from_objects(ca, key);
+    X509_free(ca);
+    EVP_PKEY_free(key);
+    return s;
+}
+
+void ca_signer_set_serials(CaSigner *s, SerialAlloc *serials) {
+    if (s) s->serials = serials;
+}
+
+X509 *ca_signer_sign(CaSigner *s, X509_REQ *req, int days) {
+    if (!s || !req) return NULL;
+    if (days <= 0) days = 365;
+
+    X509 *cert = X509_new();
+    EVP_MD_CTX *mctx = EVP_MD_CTX_new();
+    EVP_PKEY *req_pubkey = NULL;
+    if (!cert || !mctx) goto fail;
+
+    /* Version 3 (value 2) */
+    X509_set_version(cert, 2);
+
+    /* unique across threads and runs (persistent counter or 127-bit random) */
+    if (serial_alloc_assign(s->serials, X509_get_serialNumber(cert)) != 0) {
+        fprintf(stderr, "ca_signer: cannot allocate a serial number\n");
+        goto fail;
+    }
+
+    /* Validity */
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), (long)60*60*24*days);
+
+    if (X509_set_issuer_name(cert, s->issuer) != 1) goto fail;
+    if (X509_set_subject_name(cert, X509_REQ_get_subject_name(req)) != 1) goto fail;
+
+    req_pubkey = X509_REQ_get_pubkey(req);
+    if (!req_pubkey || X509_set_pubkey(cert, req_pubkey) != 1) goto fail;
+
+    /* basicConstraints, keyUsage (by leaf key type), extendedKeyUsage */
+    X509_EXTENSION *ku = EVP_PKEY_get_base_id(req_pubkey) == EVP_PKEY_RSA ? s->ku_rsa : s->ku_sig;
+    if (X509_add_ext(cert, s->exts[0], -1) != 1 ||
+        X509_add_ext(cert, ku, -1) != 1 ||
+        X509_add_ext(cert, s->exts[1], -1) != 1) goto fail;
+
+    /* a copy of the prepared context skips key and digest setup */
+    if (EVP_MD_CTX_copy_ex(mctx, s->sign_tmpl) != 1 || X509_sign_ctx(cert, mctx) <= 0) {
+        fprintf(stderr, "ca_signer: failed to sign certificate with CA key\n");
+        goto fail;
+    }
+
+    EVP_PKEY_free(req_pubkey);
+    EVP_MD_CTX_free(mctx);
+    return cert;
+
+fail:
+    EVP_PKEY_free(req_pubkey);
+    EVP_MD_CTX_free(mctx);
+    X509_free(cert);
+    return NULL;
+}
+
+X509 *ca_signer_cert(const CaSigner *s) {
+    return s ? s->ca : NULL;
+}
+
+EVP_PKEY *ca_signer_key(const CaSigner *s) {
+    return s ? s->key : NULL;
+}
+
+void ca_signer_free(CaSigner *s) {
+    if (!s) return;
+    EVP_MD_CTX_free(s->sign_tmpl);
+    for (int i = 0; i < CA_SIGNER_EXT_COUNT; i++) X509_EXTENSION_free(s->exts[i]);
+    X509_EXTENSION_free(s->ku_rsa);
+    X509_EXTENSION_free(s->ku_sig);
+    X509_NAME_free(s->issuer);
+    EVP_PKEY_free(s->key);
+    X509_free(s->ca);
+    free(s);
+}
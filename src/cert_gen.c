@@ -1,5 +1,7 @@
 #define _POSIX_C_SOURCE 200809L
 #include "../inc/cert_gen.h"
+#include "../inc/ca_signer.h"
+#include "../inc/key_alg.h"
 
 #include <openssl/evp.h>
 #include <openssl/pem.h>
@@ -9,7 +11,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 /* Helper: sanitize small strings for subject components */
@@ -32,7 +35,7 @@ static void sanitize_component(const char *in, char *out, size_t outsz) {
     out[j] = '\0';
 }
 
-/* Ensure directory exists for a given path (best-effort) */
+/* Ensure directory exists for a given path (best-effort, mkdir -p without a shell) */
 static void ensure_parent_dir(const char *path) {
     if (!path) return;
     const char *p = strrchr(path, '/');
@@ -43,13 +46,23 @@ static void ensure_parent_dir(const char *path) {
     if (len >= sizeof(dir)) return;
     memcpy(dir, path, len);
     dir[len] = '\0';
-    char cmd[1200];
-    /* mkdir -p is convenient; error ignored if not available */
-    snprintf(cmd, sizeof(cmd), "mkdir -p '%s' 2>/usbInfo/null", dir);
-    (void)system(cmd);
+    for (char *q = dir + 1; *q; q++) {
+        if (*q != '/') continue;
+        *q = '\0';
+        mkdir(dir, 0755);   /* EEXIST and friends are ignored, like mkdir -p 2>/dev/null */
+        *q = '/';
+    }
+    mkdir(dir, 0755);
 }
 
-/* Generate EVP_PKEY RSA key of given bits */
+/* Optional pre-generated key source (see certgen_set_keypool) */
+static KeyPool *g_keypool = NULL;
+
+void certgen_set_keypool(KeyPool *pool) {
+    g_keypool = pool;
+}
+
+/* Generate EVP_PKEY RSA key of given bits (sizes without a KeyAlg, generated inline) */
 static EVP_PKEY *generate_rsa_key_obj(int bits) {
     EVP_PKEY_CTX *ctx = NULL;
     EVP_PKEY *pkey = NULL;
@@ -62,97 +75,249 @@ static EVP_PKEY *generate_rsa_key_obj(int bits) {
     return pkey;
 }
 
-int certgen_generate_key_pem(const char *key_path, int bits) {
-    if (!key_path || bits < 1024) return -1;
-    ensure_parent_dir(key_path);
-
-    EVP_PKEY *pkey = generate_rsa_key_obj(bits);
-    if (!pkey) {
-        fprintf(stderr, "certgen: failed to generate RSA key\n");
-        return -2;
-    }
 
-    FILE *f = fopen(key_path, "wb");
-    if (!f) {
-        perror("certgen: fopen key");
-        EVP_PKEY_free(pkey);
-        return -3;
-    }
+/* ---- In-memory pipeline ---- */
 
-    int rc = PEM_write_PrivateKey(f, pkey, NULL, NULL, 0, NULL, NULL) ? 0 : -4;
-    fclose(f);
-    /* set file to 0600 if possible (best-effort) */
-    chmod(key_path, S_IRUSR | S_IWUSR);
+void certgen_subject_cn(const UsbDeviceInfo *usbInfo, char *cn, size_t cnsz) {
+    if (!cn || cnsz == 0) return;
+    cn[0] = '\0';
+    if (!usbInfo) return;
+    if (usbInfo->serial && usbInfo->serial[0]) sanitize_component(usbInfo->serial, cn, cnsz);
+    else if (usbInfo->id && usbInfo->id[0]) sanitize_component(usbInfo->id, cn, cnsz);
+    else if (usbInfo->name && usbInfo->name[0]) sanitize_component(usbInfo->name, cn, cnsz);
+    else snprintf(cn, cnsz, "usb-device");
+}
 
-    EVP_PKEY_free(pkey);
-    return rc;
+EVP_PKEY *certgen_generate_key_alg(KeyAlg alg) {
+    /* taken from the key pool when one of the same algorithm is installed */
+    if (g_keypool && keypool_alg(g_keypool) == alg) {
+        EVP_PKEY *pooled = keypool_take(g_keypool);
+        if (pooled) return pooled;
+    }
+    return key_alg_generate(alg);
 }
 
-int certgen_generate_csr_pem(const char *key_path, const char *csr_path, const UsbDeviceInfo *usbInfo) {
-    if (!key_path || !csr_path || !usbInfo) return -1;
-    ensure_parent_dir(csr_path);
+EVP_PKEY *certgen_generate_key(int bits) {
+    if (bits < 1024) return NULL;
+    KeyAlg alg;
+    if (key_alg_from_rsa_bits(bits, &alg) == 0) return certgen_generate_key_alg(alg);
+    return generate_rsa_key_obj(bits);
+}
 
-    /* Load private key */
-    FILE *kf = fopen(key_path, "rb");
-    if (!kf) {
-        perror("certgen: fopen key for csr");
-        return -2;
-    }
-    EVP_PKEY *pkey = PEM_read_PrivateKey(kf, NULL, NULL, NULL);
-    fclose(kf);
-    if (!pkey) {
-        fprintf(stderr, "certgen: failed to read private key from %s\n", key_path);
-        return -3;
-    }
+X509_REQ *certgen_build_csr(EVP_PKEY *pkey, const UsbDeviceInfo *usbInfo) {
+    if (!pkey || !usbInfo) return NULL;
 
     /* Create X509_REQ */
     X509_REQ *req = X509_REQ_new();
-    if (!req) { EVP_PKEY_free(pkey); return -4; }
+    if (!req) return NULL;
 
-    if (X509_REQ_set_pubkey(req, pkey) != 1) { X509_REQ_free(req); EVP_PKEY_free(pkey); return -5; }
+    if (X509_REQ_set_pubkey(req, pkey) != 1) { X509_REQ_free(req); return NULL; }
 
     /* Compose subject: CN = serial || id || name ; O = name */
-    char cn[256]; cn[0]='\0';
-    if (usbInfo->serial && usbInfo->serial[0]) sanitize_component(usbInfo->serial, cn, sizeof(cn));
-    else if (usbInfo->id && usbInfo->id[0]) sanitize_component(usbInfo->id, cn, sizeof(cn));
-    else if (usbInfo->name && usbInfo->name[0]) sanitize_component(usbInfo->name, cn, sizeof(cn));
-    else strncpy(cn, "usb-device", sizeof(cn)-1);
+    char cn[256];
+    certgen_subject_cn(usbInfo, cn, sizeof(cn));
 
     char org[256]; org[0]='\0';
     if (usbInfo->name && usbInfo->name[0]) sanitize_component(usbInfo->name, org, sizeof(org));
     else strncpy(org, "unknown", sizeof(org)-1);
 
     X509_NAME *name = X509_NAME_new();
-    if (!name) { X509_REQ_free(req); EVP_PKEY_free(pkey); return -6; }
+    if (!name) { X509_REQ_free(req); return NULL; }
 
     X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (unsigned char*)cn, -1, -1, 0);
     X509_NAME_add_entry_by_txt(name, "O", MBSTRING_ASC, (unsigned char*)org, -1, -1, 0);
     X509_NAME_add_entry_by_txt(name, "OU", MBSTRING_ASC, (unsigned char*)"usb", -1, -1, 0);
 
     if (X509_REQ_set_subject_name(req, name) != 1) {
-        X509_NAME_free(name); X509_REQ_free(req); EVP_PKEY_free(pkey); return -7;
+        X509_NAME_free(name); X509_REQ_free(req); return NULL;
     }
     X509_NAME_free(name);
 
-    /* Optionally add attributes or extensions in the CSR (not required here) */
+    /* Sign CSR with private key (digest follows the key type, none for Ed25519) */
+    if (X509_REQ_sign(req, pkey, key_alg_digest_for_key(pkey)) <= 0) {
+        X509_REQ_free(req); return NULL;
+    }
+    return req;
+}
+
+X509 *certgen_sign_csr(X509_REQ *req, X509 *ca, EVP_PKEY *ca_pkey, int days) {
+    /* one-shot signer; callers signing many certificates should keep a CaSigner */
+    CaSigner *signer = ca_signer_from_objects(ca, ca_pkey);
+    if (!signer) return NULL;
+    X509 *cert = ca_signer_sign(signer, req, days);
+    ca_signer_free(signer);
+    return cert;
+}
+
+int certgen_load_ca(const char *ca_cert_path, const char *ca_key_path, X509 **ca_out, EVP_PKEY **ca_key_out) {
+    if (!ca_cert_path || !ca_key_path || !ca_out || !ca_key_out) return -1;
+
+    /* Read CA cert */
+    FILE *caf = fopen(ca_cert_path, "rb");
+    if (!caf) { perror("certgen: fopen ca cert"); return -4; }
+    X509 *ca = PEM_read_X509(caf, NULL, NULL, NULL);
+    fclose(caf);
+    if (!ca) { fprintf(stderr, "certgen: failed to read CA cert\n"); return CERTGEN_ERR_CA; }
+
+    /* Read CA private key */
+    FILE *kaf = fopen(ca_key_path, "rb");
+    if (!kaf) { perror("certgen: fopen ca key"); X509_free(ca); return -6; }
+    EVP_PKEY *ca_pkey = PEM_read_PrivateKey(kaf, NULL, NULL, NULL);
+    fclose(kaf);
+    if (!ca_pkey) { fprintf(stderr, "certgen: failed to read CA key\n"); X509_free(ca); return -7; }
+
+    *ca_out = ca;
+    *ca_key_out = ca_pkey;
+    return 0;
+}
+
+/* ---- Serialization of final artifacts ---- */
+
+int certgen_write_key_pem(const char *key_path, EVP_PKEY *pkey) {
+    if (!key_path || !pkey) return -1;
+    ensure_parent_dir(key_path);
 
-    /* Sign CSR with private key */
-    if (X509_REQ_sign(req, pkey, EVP_sha256()) <= 0) {
-        X509_REQ_free(req); EVP_PKEY_free(pkey); return -8;
+    /* create the file 0600 up front so the key is never world-readable */
+    int fd = open(key_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (!f) {
+        perror("certgen: fopen key");
+        if (fd >= 0) close(fd);
+        return -3;
     }
+    int rc = PEM_write_PrivateKey(f, pkey, NULL, NULL, 0, NULL, NULL) ? 0 : -4;
+    fclose(f);
+    /* pre-existing file keeps its mode through O_TRUNC; tighten it (best-effort) */
+    chmod(key_path, S_IRUSR | S_IWUSR);
+    return rc;
+}
 
-    /* Write CSR to file */
+int certgen_write_csr_pem(const char *csr_path, X509_REQ *req) {
+    if (!csr_path || !req) return -1;
+    ensure_parent_dir(csr_path);
     FILE *cf = fopen(csr_path, "wb");
-    if (!cf) {
-        perror("certgen: fopen csr");
-        X509_REQ_free(req); EVP_PKEY_free(pkey);
-        return -9;
-    }
+    if (!cf) { perror("certgen: fopen csr"); return -9; }
     int rc = PEM_write_X509_REQ(cf, req) ? 0 : -10;
     fclose(cf);
+    return rc;
+}
 
-    X509_REQ_free(req);
+int certgen_write_cert_pem(const char *cert_path, X509 *cert) {
+    if (!cert_path || !cert) return -1;
+    ensure_parent_dir(cert_path);
+    FILE *of = fopen(cert_path, "wb");
+    if (!of) { perror("certgen: fopen out cert"); return -13; }
+    int rc = PEM_write_X509(of, cert) ? 0 : -14;
+    fclose(of);
+    return rc;
+}
+
+int certgen_cert_to_der(X509 *cert, unsigned char **der, size_t *der_len) {
+    if (!cert || !der || !der_len) return -1;
+    unsigned char *buf = NULL;
+    int len = i2d_X509(cert, &buf);
+    if (len <= 0) return -2;
+    *der = buf;                 /* free with OPENSSL_free */
+    *der_len = (size_t)len;
+    return 0;
+}
+
+/* ---- CA bootstrap ---- */
+
+int certgen_generate_ca(KeyAlg alg, const char *common_name, int days,
+                        const char *ca_cert_path, const char *ca_key_path) {
+    if (!common_name || !ca_cert_path || !ca_key_path) return -1;
+    if (days <= 0) days = 3650;
+
+    EVP_PKEY *pkey = key_alg_generate(alg);
+    if (!pkey) { fprintf(stderr, "certgen: failed to generate %s CA key\n", key_alg_name(alg)); return -2; }
+
+    X509 *ca = X509_new();
+    if (!ca) { EVP_PKEY_free(pkey); return -8; }
+    X509_set_version(ca, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(ca), 1);
+    X509_gmtime_adj(X509_getm_notBefore(ca), 0);
+    X509_gmtime_adj(X509_getm_notAfter(ca), (long)60*60*24*days);
+    X509_set_pubkey(ca, pkey);
+
+    X509_NAME *name = X509_get_subject_name(ca);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)common_name, -1, -1, 0);
+    X509_set_issuer_name(ca, name);
+
+    X509V3_CTX ctx;
+    X509V3_set_ctx(&ctx, ca, ca, NULL, NULL, 0);
+    static const struct { int nid; const char *value; } exts[] = {
+        { NID_basic_constraints, "critical,CA:TRUE" },
+        { NID_key_usage, "critical,keyCertSign,cRLSign" },
+        { NID_subject_key_identifier, "hash" },
+    };
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        X509_EXTENSION *ext = X509V3_EXT_conf_nid(NULL, &ctx, exts[i].nid, exts[i].value);
+        if (ext) { X509_add_ext(ca, ext, -1); X509_EXTENSION_free(ext); }
+    }
+
+    int rc = -12;
+    if (X509_sign(ca, pkey, key_alg_digest_for_key(pkey))) {
+        rc = certgen_write_key_pem(ca_key_path, pkey);
+        if (rc == 0) rc = certgen_write_cert_pem(ca_cert_path, ca);
+    } else {
+        fprintf(stderr, "certgen: failed to self-sign CA certificate\n");
+    }
+    X509_free(ca);
+    EVP_PKEY_free(pkey);
+    return rc;
+}
+
+/* ---- File-based wrappers (original API) ---- */
+
+int certgen_generate_key_pem_alg(const char *key_path, KeyAlg alg) {
+    if (!key_path) return -1;
+
+    EVP_PKEY *pkey = certgen_generate_key_alg(alg);
+    if (!pkey) {
+        fprintf(stderr, "certgen: failed to generate %s key\n", key_alg_name(alg));
+        return -2;
+    }
+    int rc = certgen_write_key_pem(key_path, pkey);
+    EVP_PKEY_free(pkey);
+    return rc;
+}
+
+int certgen_generate_key_pem(const char *key_path, int bits) {
+    if (!key_path || bits < 1024) return -1;
+
+    EVP_PKEY *pkey = certgen_generate_key(bits);
+    if (!pkey) {
+        fprintf(stderr, "certgen: failed to generate RSA key\n");
+        return -2;
+    }
+    int rc = certgen_write_key_pem(key_path, pkey);
+    EVP_PKEY_free(pkey);
+    return rc;
+}
+
+int certgen_generate_csr_pem(const char *key_path, const char *csr_path, const UsbDeviceInfo *usbInfo) {
+    if (!key_path || !csr_path || !usbInfo) return -1;
+
+    /* Load private key */
+    FILE *kf = fopen(key_path, "rb");
+    if (!kf) {
+        perror("certgen: fopen key for csr");
+        return -2;
+    }
+    EVP_PKEY *pkey = PEM_read_PrivateKey(kf, NULL, NULL, NULL);
+    fclose(kf);
+    if (!pkey) {
+        fprintf(stderr, "certgen: failed to read private key from %s\n", key_path);
+        return -3;
+    }
+
+    X509_REQ *req = certgen_build_csr(pkey, usbInfo);
     EVP_PKEY_free(pkey);
+    if (!req) return -8;
+
+    int rc = certgen_write_csr_pem(csr_path, req);
+    X509_REQ_free(req);
     return rc;
 }
 
@@ -163,8 +328,6 @@ int certgen_sign_csr_with_ca(const char *csr_path,
                              const char *out_cert_path,
                              int days) {
     if (!csr_path || !ca_cert_path || !ca_key_path || !out_cert_path) return -1;
-    if (days <= 0) days = 365;
-    ensure_parent_dir(out_cert_path);
 
     /* Read CSR */
     FILE *cf = fopen(csr_path, "rb");
@@ -173,92 +336,15 @@ int certgen_sign_csr_with_ca(const char *csr_path,
     fclose(cf);
     if (!req) { fprintf(stderr, "certgen: failed to read CSR\n"); return -3; }
 
-    /* Read CA cert */
-    FILE *caf = fopen(ca_cert_path, "rb");
-    if (!caf) { perror("certgen: fopen ca cert"); X509_REQ_free(req); return -4; }
-    X509 *ca = PEM_read_X509(caf, NULL, NULL, NULL);
-    fclose(caf);
-    if (!ca) { fprintf(stderr, "certgen: failed to read CA cert\n"); X509_REQ_free(req); return -5; }
-
-    /* Read CA private key */
-    FILE *kaf = fopen(ca_key_path, "rb");
-    if (!kaf) { perror("certgen: fopen ca key"); X509_free(ca); X509_REQ_free(req); return -6; }
-    EVP_PKEY *ca_pkey = PEM_read_PrivateKey(kaf, NULL, NULL, NULL);
-    fclose(kaf);
-    if (!ca_pkey) { fprintf(stderr, "certgen: failed to read CA key\n"); X509_free(ca); X509_REQ_free(req); return -7; }
-
-    /* Create new X509 cert and populate */
-    X509 *cert = X509_new();
-    if (!cert) { EVP_PKEY_free(ca_pkey); X509_free(ca); X509_REQ_free(req); return -8; }
-
-    /* Version 3 (value 2) */
-    X509_set_version(cert, 2);
-
-    /* Serial number - use current time + rand for simplicity */
-    ASN1_INTEGER *serial = ASN1_INTEGER_new();
-    if (!serial) { X509_free(cert); EVP_PKEY_free(ca_pkey); X509_free(ca); X509_REQ_free(req); return -9; }
-    /* create a serial based on time */
-    long srl = (long)time(NULL);
-    ASN1_INTEGER_set(serial, srl);
-    X509_set_serialNumber(cert, serial);
-    ASN1_INTEGER_free(serial);
-
-    /* Validity */
-    X509_gmtime_adj(X509_get_notBefore(cert), 0);
-    X509_gmtime_adj(X509_get_notAfter(cert), (long)60*60*24*days);
-
-    /* Set issuer from CA */
-    X509_set_issuer_name(cert, X509_get_subject_name(ca));
-
-    /* Set subject from CSR */
-    X509_NAME *req_subject = X509_REQ_get_subject_name(req);
-    X509_set_subject_name(cert, req_subject);
-
-    /* Set public key from CSR */
-    EVP_PKEY *req_pubkey = X509_REQ_get_pubkey(req);
-    if (!req_pubkey) { X509_free(cert); EVP_PKEY_free(ca_pkey); X509_free(ca); X509_REQ_free(req); return -10; }
-    if (X509_set_pubkey(cert, req_pubkey) != 1) {
-        EVP_PKEY_free(req_pubkey); X509_free(cert); EVP_PKEY_free(ca_pkey); X509_free(ca); X509_REQ_free(req); return -11;
-    }
-    EVP_PKEY_free(req_pubkey);
-
-    /* Optionally copy extensions from CSR (not implemented) */
-
-    /* Add basic extensions: basicConstraints=CA:FALSE, keyUsage, extendedKeyUsage (clientAuth) */
-    X509_EXTENSION *ext = NULL;
-    X509V3_CTX ctx;
-    X509V3_set_ctx(&ctx, ca, cert, NULL, NULL, 0);
+    CaSigner *signer = ca_signer_create(ca_cert_path, ca_key_path);
+    if (!signer) { X509_REQ_free(req); return CERTGEN_ERR_CA; }
 
-    ext = X509V3_EXT_conf_nid(NULL, &ctx, NID_basic_constraints, "CA:FALSE");
-    if (ext) { X509_add_ext(cert, ext, -1); X509_EXTENSION_free(ext); }
-
-    ext = X509V3_EXT_conf_nid(NULL, &ctx, NID_key_usage, "digitalSignature,keyEncipherment");
-    if (ext) { X509_add_ext(cert, ext, -1); X509_EXTENSION_free(ext); }
-
-    ext = X509V3_EXT_conf_nid(NULL, &ctx, NID_ext_key_usage, "clientAuth");
-    if (ext) { X509_add_ext(cert, ext, -1); X509_EXTENSION_free(ext); }
-
-    /* Sign certificate with CA private key */
-    if (!X509_sign(cert, ca_pkey, EVP_sha256())) {
-        fprintf(stderr, "certgen: failed to sign certificate with CA key\n");
-        X509_free(cert); EVP_PKEY_free(ca_pkey); X509_free(ca); X509_REQ_free(req);
-        return -12;
-    }
-
-    /* Write cert to out_cert_path (PEM) */
-    FILE *of = fopen(out_cert_path, "wb");
-    if (!of) {
-        perror("certgen: fopen out cert");
-        X509_free(cert); EVP_PKEY_free(ca_pkey); X509_free(ca); X509_REQ_free(req);
-        return -13;
-    }
-    int rc = PEM_write_X509(of, cert) ? 0 : -14;
-    fclose(of);
+    X509 *cert = ca_signer_sign(signer, req, days);
+    int rc = cert ? certgen_write_cert_pem(out_cert_path, cert) : -12;
 
     /* cleanup */
     X509_free(cert);
-    EVP_PKEY_free(ca_pkey);
-    X509_free(ca);
+    ca_signer_free(signer);
     X509_REQ_free(req);
 
     return rc;
@@ -0,0 +1,418 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../inc/cert_verify.h"
+#include "../inc/cert_gen.h"
+#include "../inc/blockdev.h"
+#include "../inc/gpt.h"
+#include "../inc/revocation.h"
+#include "../inc/sig_container.h"
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VERIFY_CN_MAX 256
+
+typedef struct CacheEntry {
+    char cn[VERIFY_CN_MAX];             /* expected device CN (key part 1) */
+    unsigned char sha256[32];           /* payload hash (key part 2) */
+    char serial_hex[80];
+    unsigned char serial[REVOCATION_SERIAL_MAX];    /* re-checked against the revocation list on hits */
+    size_t serial_len;
+    time_t not_before;
+    time_t not_after;
+    struct CacheEntry *hnext;           /* hash bucket chain */
+    struct CacheEntry *prev, *next;     /* LRU list, head = most recent */
+} CacheEntry;
+
+struct CertVerifier {
+    X509_STORE *store;                  /* trusted CA(s), shared by all verifications */
+    RevocationList *revocation;         /* borrowed, may be NULL; has its own synchronisation */
+    pthread_mutex_t lock;               /* protects everything below */
+    CacheEntry **buckets;
+    size_t nbuckets;                    /* power of two */
+    size_t capacity;
+    size_t count;
+    CacheEntry *head, *tail;
+    VerifyCacheStats stats;
+};
+
+/* ---------- cache ---------- */
+
+static size_t cache_hash(const char *cn, const unsigned char *sha) {
+    /* the SHA-256 is already uniformly distributed; mix in the CN with FNV-1a */
+    uint64_t h = 1469598103934665603ULL;
+    for (const char *p = cn; *p; p++) { h ^= (unsigned char)*p; h *= 1099511628211ULL; }
+    uint64_t s;
+    memcpy(&s, sha, sizeof(s));
+    return (size_t)(h ^ s);
+}
+
+static void lru_unlink(CertVerifier *v, CacheEntry *e) {
+    if (e->prev) e->prev->next = e->next; else v->head = e->next;
+    if (e->next) e->next->prev = e->prev; else v->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(CertVerifier *v, CacheEntry *e) {
+    e->prev = NULL;
+    e->next = v->head;
+    if (v->head) v->head->prev = e;
+    v->head = e;
+    if (!v->tail) v->tail = e;
+}
+
+static void cache_remove(CertVerifier *v, CacheEntry *e) {
+    CacheEntry **pp = &v->buckets[cache_hash(e->cn, e->sha256) & (v->nbuckets - 1)];
+    while (*pp && *pp != e) pp = &(*pp)->hnext;
+    if (*pp) *pp = e->hnext;
+    lru_unlink(v, e);
+    v->count--;
+    free(e);
+}
+
+/* Look up (cn, sha). Expired entries are dropped. Called with the lock held. */
+static CacheEntry *cache_find(CertVerifier *v, const char *cn, const unsigned char *sha, time_t now) {
+    CacheEntry *e = v->buckets[cache_hash(cn, sha) & (v->nbuckets - 1)];
+    for (; e; e = e->hnext) {
+        if (memcmp(e->sha256, sha, 32) == 0 && strcmp(e->cn, cn) == 0) break;
+    }
+    if (!e) return NULL;
+    if (now < e->not_before || now >= e->not_after) {
+        cache_remove(v, e);
+        return NULL;
+    }
+    lru_unlink(v, e);
+    lru_push_front(v, e);
+    return e;
+}
+
+static void cache_insert(CertVerifier *v, const char *cn, const unsigned char *sha, X509 *cert,
+                         const VerifyResult *res, time_t not_before) {
+    if (v->capacity == 0) return;
+    pthread_mutex_lock(&v->lock);
+    /* another thread may have verified the same stick meanwhile */
+    if (cache_find(v, cn, sha, time(NULL))) {
+        pthread_mutex_unlock(&v->lock);
+        return;
+    }
+    if (v->count >= v->capacity && v->tail) {
+        cache_remove(v, v->tail);
+        v->stats.evictions++;
+    }
+    CacheEntry *e = calloc(1, sizeof(CacheEntry));
+    if (e) {
+        snprintf(e->cn, sizeof(e->cn), "%s", cn);
+        memcpy(e->sha256, sha, 32);
+        snprintf(e->serial_hex, sizeof(e->serial_hex), "%s", res->serial_hex);
+        const ASN1_INTEGER *serial = X509_get0_serialNumber(cert);
+        int len = ASN1_STRING_length(serial);
+        if (len > 0 && len <= REVOCATION_SERIAL_MAX) {
+            memcpy(e->serial, ASN1_STRING_get0_data(serial), (size_t)len);
+            e->serial_len = (size_t)len;
+        }
+        e->not_before = not_before;
+        e->not_after = res->not_after;
+        size_t b = cache_hash(cn, sha) & (v->nbuckets - 1);
+        e->hnext = v->buckets[b];
+        v->buckets[b] = e;
+        lru_push_front(v, e);
+        v->count++;
+    }
+    pthread_mutex_unlock(&v->lock);
+}
+
+/* ---------- helpers ---------- */
+
+static time_t asn1_to_time_t(const ASN1_TIME *t, time_t now) {
+    int days = 0, secs = 0;
+    if (!t || ASN1_TIME_diff(&days, &secs, NULL, t) != 1) return 0;
+    return now + (time_t)days * 86400 + secs;
+}
+
+static void serial_to_hex(X509 *cert, char *out, size_t outsz) {
+    out[0] = '\0';
+    BIGNUM *bn = ASN1_INTEGER_to_BN(X509_get0_serialNumber(cert), NULL);
+    char *hex = bn ? BN_bn2hex(bn) : NULL;
+    if (hex) snprintf(out, outsz, "%s", hex);
+    OPENSSL_free(hex);
+    BN_free(bn);
+}
+
+/* Concatenated DER certificates -> stack. Returns NULL on empty input or parse error. */
+static STACK_OF(X509) *chain_from_der(const unsigned char *der, size_t len) {
+    if (!der || len == 0) return NULL;
+    STACK_OF(X509) *sk = sk_X509_new_null();
+    if (!sk) return NULL;
+    const unsigned char *p = der, *end = der + len;
+    while (p < end) {
+        X509 *c = d2i_X509(NULL, &p, (long)(end - p));
+        if (!c || !sk_X509_push(sk, c)) {
+            X509_free(c);
+            sk_X509_pop_free(sk, X509_free);
+            return NULL;
+        }
+    }
+    return sk;
+}
+
+/* Full check of a parsed certificate; result->sha256 must already be set. */
+static int is_revoked(CertVerifier *v, X509 *cert) {
+    RevocationList *rl = __atomic_load_n(&v->revocation, __ATOMIC_ACQUIRE);
+    if (!rl) return 0;
+    const ASN1_INTEGER *serial = X509_get0_serialNumber(cert);
+    return revocation_list_is_revoked(rl, ASN1_STRING_get0_data(serial), (size_t)ASN1_STRING_length(serial));
+}
+
+static VerifyStatus verify_uncached(CertVerifier *v, X509 *cert, STACK_OF(X509) *chain,
+                                    const char *expected_cn, VerifyResult *res, time_t *not_before) {
+    time_t now = time(NULL);
+    X509_NAME_get_text_by_NID(X509_get_subject_name(cert), NID_commonName,
+                              res->subject_cn, sizeof(res->subject_cn));
+    serial_to_hex(cert, res->serial_hex, sizeof(res->serial_hex));
+    res->not_after = asn1_to_time_t(X509_get0_notAfter(cert), now);
+    *not_before = asn1_to_time_t(X509_get0_notBefore(cert), now);
+
+    X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+    if (!ctx || X509_STORE_CTX_init(ctx, v->store, cert, chain) != 1) {
+        X509_STORE_CTX_free(ctx);
+        res->x509_error = X509_V_ERR_OUT_OF_MEM;
+        return res->status = VERIFY_BAD_CHAIN;
+    }
+    X509_STORE_CTX_set_purpose(ctx, X509_PURPOSE_SSL_CLIENT);
+    int ok = X509_verify_cert(ctx);
+    res->x509_error = ok == 1 ? X509_V_OK : X509_STORE_CTX_get_error(ctx);
+    X509_STORE_CTX_free(ctx);
+
+    if (ok != 1) {
+        if (res->x509_error == X509_V_ERR_CERT_HAS_EXPIRED ||
+            res->x509_error == X509_V_ERR_CERT_NOT_YET_VALID)
+            return res->status = VERIFY_EXPIRED;
+        return res->status = VERIFY_BAD_CHAIN;
+    }
+    if (is_revoked(v, cert)) return res->status = VERIFY_REVOKED;
+
+    /* the certificate must have been issued for this device */
+    if (expected_cn && strcmp(res->subject_cn, expected_cn) != 0) return res->status = VERIFY_MISBOUND;
+    return res->status = VERIFY_OK;
+}
+
+/* Cache lookup for (expected CN, res->sha256); fills res on a hit. */
+static int try_cache(CertVerifier *v, const char *cn, VerifyResult *res) {
+    if (v->capacity == 0 || !cn) return 0;
+    pthread_mutex_lock(&v->lock);
+    CacheEntry *e = cache_find(v, cn, res->sha256, time(NULL));
+    int hit = e != NULL;
+    if (e) {
+        v->stats.hits++;
+        snprintf(res->subject_cn, sizeof(res->subject_cn), "%s", e->cn);
+        snprintf(res->serial_hex, sizeof(res->serial_hex), "%s", e->serial_hex);
+        res->not_after = e->not_after;
+        res->from_cache = 1;
+        res->status = VERIFY_OK;
+        /* revoked since it was cached: answer from the entry once, then forget it */
+        RevocationList *rl = __atomic_load_n(&v->revocation, __ATOMIC_ACQUIRE);
+        if (rl && revocation_list_is_revoked(rl, e->serial, e->serial_len)) {
+            res->status = VERIFY_REVOKED;
+            cache_remove(v, e);
+        }
+    } else {
+        v->stats.misses++;
+    }
+    pthread_mutex_unlock(&v->lock);
+    return hit;
+}
+
+/* ---------- public API ---------- */
+
+CertVerifier *cert_verifier_create(const char *ca_cert_path, size_t cache_capacity) {
+    if (!ca_cert_path) return NULL;
+    CertVerifier *v = calloc(1, sizeof(CertVerifier));
+    if (!v) return NULL;
+    pthread_mutex_init(&v->lock, NULL);
+
+    v->store = X509_STORE_new();
+    if (!v->store || X509_STORE_load_file(v->store, ca_cert_path) != 1) {
+        fprintf(stderr, "cert_verify: cannot load CA certificate %s\n", ca_cert_path);
+        cert_verifier_free(v);
+        return NULL;
+    }
+
+    v->capacity = cache_capacity;
+    v->nbuckets = 16;
+    while (v->nbuckets < cache_capacity * 2) v->nbuckets <<= 1;
+    v->buckets = calloc(v->nbuckets, sizeof(CacheEntry *));
+    if (!v->buckets) {
+        cert_verifier_free(v);
+        return NULL;
+    }
+    return v;
+}
+
+void cert_verifier_set_revocation(CertVerifier *v, RevocationList *list) {
+    if (v) __atomic_store_n(&v->revocation, list, __ATOMIC_RELEASE);
+}
+
+void cert_verifier_flush(CertVerifier *v) {
+    if (!v) return;
+    pthread_mutex_lock(&v->lock);
+    while (v->head) cache_remove(v, v->head);
+    pthread_mutex_unlock(&v->lock);
+}
+
+void cert_verifier_free(CertVerifier *v) {
+    if (!v) return;
+    if (v->buckets) cert_verifier_flush(v);
+    free(v->buckets);
+    X509_STORE_free(v->store);
+    pthread_mutex_destroy(&v->lock);
+    free(v);
+}
+
+void cert_verifier_cache_stats(CertVerifier *v, VerifyCacheStats *stats) {
+    if (!v || !stats) return;
+    pthread_mutex_lock(&v->lock);
+    *stats = v->stats;
+    stats->entries = v->count;
+    pthread_mutex_unlock(&v->lock);
+}
+
+VerifyStatus cert_verify_x509(CertVerifier *v, X509 *cert, STACK_OF(X509) *chain,
+                              const UsbDeviceInfo *expected, VerifyResult *res) {
+    VerifyResult local;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+    if (!v || !cert) return res->status = VERIFY_NO_CERT;
+
+    char cn[VERIFY_CN_MAX];
+    if (expected) certgen_subject_cn(expected, cn, sizeof(cn));
+
+    unsigned int mdlen = 0;
+    if (X509_digest(cert, EVP_sha256(), res->sha256, &mdlen) != 1) return res->status = VERIFY_BAD_CHAIN;
+    if (expected && try_cache(v, cn, res)) return res->status;
+
+    time_t not_before = 0;
+    if (verify_uncached(v, cert, chain, expected ? cn : NULL, res, &not_before) == VERIFY_OK && expected)
+        cache_insert(v, cn, res->sha256, cert, res, not_before);
+    return res->status;
+}
+
+VerifyStatus cert_verify_read(const char *dev_path, VerifyPayload *payload) {
+    memset(payload, 0, sizeof(*payload));
+    if (!dev_path) {
+        payload->rc = -EINVAL;
+        return payload->status = VERIFY_IO_ERROR;
+    }
+    BlockDev bd;
+    int rc = blockdev_open(&bd, dev_path, 0);
+    if (rc != 0) {
+        payload->rc = rc;
+        return payload->status = VERIFY_IO_ERROR;
+    }
+    GptPartition part;
+    if ((rc = gpt_find_partition(&bd, GPT_SIG_PART_NAME, &part)) == 0)
+        rc = sig_slots_read(&bd, gpt_part_offset(&part), gpt_part_size(&part), &payload->info,
+                            &payload->der, &payload->der_len, &payload->chain_der, &payload->chain_len, NULL);
+    blockdev_close(&bd);
+    payload->rc = rc;
+    if (rc != 0) return payload->status = (rc == -EIO ? VERIFY_IO_ERROR : VERIFY_NO_CERT);
+    return payload->status = VERIFY_OK;
+}
+
+void cert_verify_payload_free(VerifyPayload *payload) {
+    if (!payload) return;
+    free(payload->der);
+    free(payload->chain_der);
+    payload->der = payload->chain_der = NULL;
+}
+
+VerifyStatus cert_verify_payload(CertVerifier *v, const VerifyPayload *payload,
+                                 const UsbDeviceInfo *expected, VerifyResult *res) {
+    VerifyResult local;
+    if (!res) res = &local;
+    memset(res, 0, sizeof(*res));
+    if (!v || !payload) return res->status = VERIFY_IO_ERROR;
+    if (payload->status != VERIFY_OK) {
+        res->io_error = payload->rc;
+        return res->status = payload->status;
+    }
+
+    /* the payload hash was checked by sig_slots_read; it is the cache key */
+    memcpy(res->sha256, payload->info.sha256, sizeof(res->sha256));
+    char cn[VERIFY_CN_MAX];
+    if (expected) certgen_subject_cn(expected, cn, sizeof(cn));
+
+    if (!(expected && try_cache(v, cn, res))) {
+        const unsigned char *p = payload->der;
+        X509 *cert = d2i_X509(NULL, &p, (long)payload->der_len);
+        STACK_OF(X509) *chain = chain_from_der(payload->chain_der, payload->chain_len);
+        if (!cert) {
+            res->status = VERIFY_NO_CERT;
+            res->io_error = -EBADMSG;
+        } else {
+            time_t not_before = 0;
+            if (verify_uncached(v, cert, chain, expected ? cn : NULL, res, &not_before) == VERIFY_OK && expected)
+                cache_insert(v, cn, res->sha256, cert, res, not_before);
+        }
+        sk_X509_pop_free(chain, X509_free);
+        X509_free(cert);
+    }
+    return res->status;
+}
+
+VerifyStatus cert_verify_device(CertVerifier *v, const char *dev_path,
+                                const UsbDeviceInfo *expected, VerifyResult *res) {
+    VerifyResult local;
+    if (!res) res = &local;
+    if (!v || !dev_path) {
+        memset(res, 0, sizeof(*res));
+        return res->status = VERIFY_IO_ERROR;
+    }
+    VerifyPayload payload;
+    cert_verify_read(dev_path, &payload);
+    cert_verify_payload(v, &payload, expected, res);
+    cert_verify_payload_free(&payload);
+    return res->status;
+}
+
+const UsbDeviceInfo *cert_verify_match_usbguard(const UsbDeviceList *list, const UsbDeviceInfo *block_info) {
+    if (!list || !block_info) return NULL;
+    /* a serial identifies the stick: if USBGuard does not list it, another stick of the
+     * same model must not stand in for it. VID:PID only for serial-less sticks, and only
+     * if it is unambiguous. */
+    if (block_info->serial && block_info->serial[0]) {
+        for (size_t i = 0; i < list->count; i++) {
+            const UsbDeviceInfo *d = list->devices[i];
+            if (d && d->serial && strcmp(d->serial, block_info->serial) == 0) return d;
+        }
+        return NULL;
+    }
+    const UsbDeviceInfo *match = NULL;
+    if (block_info->id && block_info->id[0]) {
+        for (size_t i = 0; i < list->count; i++) {
+            const UsbDeviceInfo *d = list->devices[i];
+            if (!d || !d->id || strcmp(d->id, block_info->id) != 0) continue;
+            if (match) return NULL;
+            match = d;
+        }
+    }
+    return match;
+}
+
+const char *cert_verify_status_name(VerifyStatus status) {
+    switch (status) {
+    case VERIFY_OK:         return "ok";
+    case VERIFY_NO_CERT:    return "no-certificate";
+    case VERIFY_BAD_CHAIN:  return "bad-chain";
+    case VERIFY_EXPIRED:    return "expired";
+    case VERIFY_MISBOUND:   return "wrong-device";
+    case VERIFY_IO_ERROR:   return "io-error";
+    case VERIFY_REVOKED:    return "revoked";
+    }
+    return "unknown";
+}
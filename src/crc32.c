@@ -0,0 +1,36 @@
+#include "../inc/crc32.h"
+
+#include <pthread.h>
+
+static uint32_t crc32_table[256];
+static uint32_t crc32c_table[256];
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+static void fill_table(uint32_t table[256], uint32_t poly) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ poly : c >> 1;
+        table[i] = c;
+    }
+}
+
+static void crc32_init_table(void) {
+    fill_table(crc32_table, 0xEDB88320u);
+    fill_table(crc32c_table, 0x82F63B78u);
+}
+
+uint32_t crc32_ieee(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc32_once, crc32_init_table);
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (len--) crc = crc32_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc32_once, crc32_init_table);
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (len--) crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
@@ -1,15 +1,231 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
 #include "../inc/embed_cert.h"
+#include "../inc/blockdev.h"
+#include "../inc/fat32.h"
+#include "../inc/gpt.h"
+#include "../inc/key_alg.h"
+#include "../inc/metrics.h"
 
-void embed_cert(const char *usb_script, const char *usb_device, const char *signature_path){
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd), "sudo ./%s %s %s", usb_script, usb_device, signature_path);
+#include <openssl/pem.h>
 
-    int ret = system(cmd);
+void embed_cert(const char *usb_script, const char *usb_device, const char *signature_path){
+    int ret = embed_cert_ex(usb_script, usb_device, signature_path, 0);
     if (ret != 0) {
         fprintf(stderr, "Error running script. Return code: %d\n", ret);
     }else{
         printf("Script executed successfully.\n");
     }
-}
\ No newline at end of file
+}
+
+int embed_cert_ex(const char *usb_script, const char *usb_device, const char *signature_path, int flags){
+    if (!usb_script || !usb_device || !signature_path) return -1;
+
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "sudo ./%s %s %s%s%s", usb_script, usb_device, signature_path,
+             (flags & EMBED_FLAG_FORMAT_DATA) ? " --format-data" : "",
+             (flags & EMBED_FLAG_ASSUME_YES) ? " --yes" : "");
+
+    uint64_t t = metrics_span_begin();
+    int ret = system(cmd);
+    metrics_span_end(METRIC_STAGE_SCRIPT, t);
+    if (ret == -1) return -1;
+    if (WIFEXITED(ret)) return WEXITSTATUS(ret);
+    return ret;
+}
+
+int embed_cert_native(const char *usb_device, const unsigned char *sig, size_t sig_len, int flags){
+    if (!usb_device || !sig || sig_len == 0) return -EINVAL;
+
+    BlockDev bd;
+    int rc = blockdev_open(&bd, usb_device, 1);
+    if (rc != 0) {
+        fprintf(stderr, "embed: cannot open %s: %s\n", usb_device, strerror(-rc));
+        return rc;
+    }
+
+    GptPartition part, data;
+    size_t wlen = blockdev_round_up(&bd, sig_len);
+    unsigned char *wbuf = NULL, *rbuf = NULL;
+    /* the stage a failure is recorded under; its span is open while in_span is set */
+    MetricStage mstage = METRIC_STAGE_PARTITION;
+    uint64_t t = 0;
+    int in_span = 0;
+
+    /* reserved partition is exactly 1 MiB */
+    if (sig_len > 1024 * 1024) { rc = -EFBIG; goto out; }
+
+    t = metrics_span_begin(), in_span = 1;
+    rc = gpt_write_usb_layout(&bd, &part, &data);
+    if (rc != 0) {
+        fprintf(stderr, "embed: writing GPT on %s failed: %s\n", usb_device, strerror(-rc));
+        goto out;
+    }
+
+    metrics_span_end(mstage, t), in_span = 0;
+
+    /* signature, zero-padded to whole sectors; the rest of USB_SIG is zeroed */
+    mstage = METRIC_STAGE_SIG_WRITE;
+    wbuf = blockdev_alloc(&bd, wlen);
+    rbuf = blockdev_alloc(&bd, wlen);
+    if (!wbuf || !rbuf) { rc = -ENOMEM; goto out; }
+    memcpy(wbuf, sig, sig_len);
+
+    uint64_t off = gpt_part_offset(&part);
+    t = metrics_span_begin(), in_span = 1;
+    if ((rc = blockdev_pwrite(&bd, wbuf, wlen, off)) != 0 ||
+        (rc = blockdev_zero(&bd, off + wlen, gpt_part_size(&part) - wlen)) != 0 ||
+        (rc = blockdev_sync(&bd)) != 0) {
+        fprintf(stderr, "embed: writing signature failed: %s\n", strerror(-rc));
+        goto out;
+    }
+    metrics_span_end(mstage, t), in_span = 0;
+
+    /* verify: read back only the sectors just written, bypassing cached pages */
+    mstage = METRIC_STAGE_VERIFY;
+    t = metrics_span_begin(), in_span = 1;
+    blockdev_drop_cache(&bd, off, wlen);
+    rc = blockdev_pread(&bd, rbuf, wlen, off);
+    if (rc != 0) goto out;
+    if (memcmp(wbuf, rbuf, wlen) != 0) {
+        fprintf(stderr, "embed: VERIFY MISMATCH on %s\n", usb_device);
+        rc = -EBADMSG;
+        goto out;
+    }
+    metrics_span_end(mstage, t), in_span = 0;
+
+    /* FAT32 straight into USB_DATA's byte range: no partition node, no settle before it.
+     * fat32_format records its own span and failure. */
+    if ((flags & EMBED_FLAG_FORMAT_DATA) &&
+        (rc = fat32_format(&bd, gpt_part_offset(&data), gpt_part_size(&data), NULL, 0, NULL)) != 0) {
+        fprintf(stderr, "embed: formatting %s on %s failed: %s\n", GPT_DATA_PART_NAME, usb_device, strerror(-rc));
+        mstage = METRIC_STAGE_FORMAT;
+        goto out;
+    }
+
+    /* let the kernel pick up the new partitions (best-effort, not needed for the write) */
+    t = metrics_span_begin();
+    blockdev_reread_partitions(&bd);
+    metrics_span_end(METRIC_STAGE_SETTLE, t);
+out:
+    if (in_span) metrics_span_end(mstage, t);
+    if (rc != 0 && mstage != METRIC_STAGE_FORMAT) metrics_failure(mstage, rc);
+    free(wbuf);
+    free(rbuf);
+    blockdev_close(&bd);
+    return rc;
+}
+
+/* Encode cert (+ chain as concatenated DER) into a USB_SIG container */
+static int build_container(X509 *cert, STACK_OF(X509) *chain, unsigned char **out, size_t *out_len){
+    unsigned char *cert_der = NULL, *chain_der = NULL;
+    size_t chain_len = 0;
+    int rc = -ENOMEM;
+
+    int cert_len = i2d_X509(cert, &cert_der);
+    if (cert_len <= 0) return -EINVAL;
+
+    for (int i = 0; chain && i < sk_X509_num(chain); i++) {
+        int n = i2d_X509(sk_X509_value(chain, i), NULL);
+        if (n <= 0) { rc = -EINVAL; goto out; }
+        unsigned char *grown = realloc(chain_der, chain_len + (size_t)n);
+        if (!grown) goto out;
+        chain_der = grown;
+        unsigned char *p = chain_der + chain_len;
+        i2d_X509(sk_X509_value(chain, i), &p);
+        chain_len += (size_t)n;
+    }
+
+    KeyAlg alg;
+    int alg_id = key_alg_of_key(X509_get0_pubkey(cert), &alg) == 0 ? (int)alg : -1;
+    rc = sig_container_encode(cert_der, (size_t)cert_len, chain_der, chain_len, alg_id, out, out_len);
+out:
+    OPENSSL_free(cert_der);
+    free(chain_der);
+    return rc;
+}
+
+int embed_cert_x509(const char *usb_device, X509 *cert, STACK_OF(X509) *chain, int flags){
+    if (!usb_device || !cert) return -EINVAL;
+    unsigned char *container = NULL;
+    size_t container_len = 0;
+    /* fresh layout: slot A, generation 1; slot B is zeroed with the rest of USB_SIG */
+    int rc = build_container(cert, chain, &container, &container_len);
+    if (rc == 0 && container_len > SIG_SLOT_BYTES) rc = -EFBIG;
+    if (rc == 0) rc = embed_cert_native(usb_device, container, container_len, flags);
+    free(container);
+    return rc;
+}
+
+int embed_renew_x509(const char *usb_device, X509 *cert, STACK_OF(X509) *chain, int *slot, uint64_t *generation){
+    if (!usb_device || !cert) return -EINVAL;
+    BlockDev bd;
+    int rc = blockdev_open(&bd, usb_device, 1);
+    if (rc != 0) return rc;
+
+    GptPartition part;
+    unsigned char *container = NULL;
+    size_t container_len = 0;
+    if ((rc = gpt_find_partition(&bd, GPT_SIG_PART_NAME, &part)) != 0) {
+        if (rc == -EBADMSG) rc = -ENOENT;   /* no GPT at all: same as no USB_SIG */
+        fprintf(stderr, "embed: %s has no %s partition, provision it first\n", usb_device, GPT_SIG_PART_NAME);
+        goto out;
+    }
+    if ((rc = build_container(cert, chain, &container, &container_len)) != 0) goto out;
+    uint64_t t = metrics_span_begin();
+    rc = sig_slots_write_next(&bd, gpt_part_offset(&part), gpt_part_size(&part),
+                              container, container_len, slot, generation);
+    metrics_span_end(METRIC_STAGE_SIG_WRITE, t);
+    if (rc != 0) metrics_failure(METRIC_STAGE_SIG_WRITE, rc);
+out:
+    free(container);
+    blockdev_close(&bd);
+    return rc;
+}
+
+int embed_cert_native_file(const char *usb_device, const char *signature_path, int flags){
+    if (!signature_path) return -EINVAL;
+    FILE *f = fopen(signature_path, "rb");
+    if (!f) return -errno;
+    X509 *cert = PEM_read_X509(f, NULL, NULL, NULL);
+    STACK_OF(X509) *chain = sk_X509_new_null();
+    X509 *extra;
+    while (cert && chain && (extra = PEM_read_X509(f, NULL, NULL, NULL)) != NULL) {
+        if (!sk_X509_push(chain, extra)) X509_free(extra);
+    }
+    fclose(f);
+    int rc = -EINVAL;
+    if (cert && chain) {
+        rc = (flags & EMBED_FLAG_RENEW) ? embed_renew_x509(usb_device, cert, chain, NULL, NULL)
+                                        : embed_cert_x509(usb_device, cert, chain, flags);
+    }
+    if (!cert) fprintf(stderr, "embed: %s does not start with a PEM certificate\n", signature_path);
+    sk_X509_pop_free(chain, X509_free);
+    X509_free(cert);
+    return rc;
+}
+
+int embed_read_cert(const char *usb_device, X509 **cert_out, SigContainerInfo *info){
+    if (!usb_device || !cert_out) return -EINVAL;
+    BlockDev bd;
+    int rc = blockdev_open(&bd, usb_device, 0);
+    if (rc != 0) return rc;
+
+    GptPartition part;
+    SigContainerInfo local;
+    unsigned char *der = NULL;
+    size_t der_len = 0;
+    if ((rc = gpt_find_partition(&bd, GPT_SIG_PART_NAME, &part)) == 0)
+        rc = sig_slots_read(&bd, gpt_part_offset(&part), gpt_part_size(&part),
+                            info ? info : &local, &der, &der_len, NULL, NULL, NULL);
+    blockdev_close(&bd);
+    if (rc != 0) return rc;
+
+    const unsigned char *p = der;
+    *cert_out = d2i_X509(NULL, &p, (long)der_len);
+    free(der);
+    return *cert_out ? 0 : -EBADMSG;
+}
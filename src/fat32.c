@@ -0,0 +1,205 @@
+#include "../inc/fat32.h"
+#include "../inc/gpt.h"
+#include "../inc/metrics.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/rand.h>
+
+#define FAT32_RESERVED      32          /* minimum reserved sectors (dosfstools default) */
+#define FAT32_FSINFO_SECTOR 1
+#define FAT32_BACKUP_SECTOR 6
+#define FAT32_ROOT_CLUSTER  2
+#define FAT32_MEDIA         0xF8
+#define FAT32_EOC           0x0FFFFFFFu
+
+static void put_le16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put_le32(uint8_t *p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = v >> (8 * i); }
+
+/* Cluster size in bytes for a volume of the given size (Microsoft's FAT32 table) */
+static uint32_t cluster_bytes_for(uint64_t bytes) {
+    const uint64_t MIB = 1024ull * 1024;
+    if (bytes <= 260 * MIB) return 512;
+    if (bytes <= 8192 * MIB) return 4096;
+    if (bytes <= 16384 * MIB) return 8192;
+    if (bytes <= 32768 * MIB) return 16384;
+    return 32768;
+}
+
+/* Reserved sectors, FAT size and cluster count for total sectors of bps bytes. The FAT size
+ * and the cluster count depend on each other: grow the FAT until it covers every cluster
+ * left after it. The reserved area is padded so the data region starts on a cluster
+ * boundary (relative to the partition, which itself is 1 MiB aligned). */
+static int compute_geometry(uint64_t total, uint32_t bps, Fat32Info *g) {
+    uint32_t spc = cluster_bytes_for(total * bps) / bps;
+    if (spc == 0) spc = 1;
+    uint32_t fat = 1, reserved = 0;
+    uint64_t clusters = 0;
+    for (;;) {
+        reserved = FAT32_RESERVED;
+        reserved += (spc - (reserved + 2 * fat) % spc) % spc;
+        uint64_t data = (uint64_t)reserved + 2ull * fat;
+        if (data + spc > total) return -ENOSPC;
+        clusters = (total - data) / spc;
+        uint64_t need = ((clusters + 2) * 4 + bps - 1) / bps;
+        if (need <= fat) break;
+        fat = (uint32_t)need;
+    }
+    if (clusters < FAT32_MIN_CLUSTERS) return -ENOSPC;
+    if (clusters > FAT32_MAX_CLUSTERS) return -EFBIG;
+    g->bytes_per_sector = bps;
+    g->sectors_per_cluster = spc;
+    g->reserved_sectors = reserved;
+    g->fat_sectors = fat;
+    g->clusters = (uint32_t)clusters;
+    g->total_sectors = total;
+    return 0;
+}
+
+/* 11-byte space-padded volume label; returns 0 when there is none */
+static int make_label(const char *label, char out[11]) {
+    memset(out, ' ', 11);
+    if (!label || !*label) {
+        memcpy(out, "NO NAME", 7);
+        return 0;
+    }
+    for (size_t i = 0; i < 11 && label[i]; i++) {
+        unsigned char c = (unsigned char)label[i];
+        out[i] = c < 0x20 || c >= 0x7F || strchr("\"*+,./:;<=>?[\\]|", c) ? '_' : (char)toupper(c);
+    }
+    return 1;
+}
+
+static void fill_boot_sector(uint8_t *b, const Fat32Info *g, uint32_t hidden, const char label[11]) {
+    static const uint8_t JUMP[3] = { 0xEB, 0x58, 0x90 };
+    /* jumped to from JUMP: cli; hlt; jmp back to hlt - the volume is not bootable */
+    static const uint8_t BOOT_CODE[4] = { 0xFA, 0xF4, 0xEB, 0xFD };
+    memset(b, 0, g->bytes_per_sector);
+    memcpy(b, JUMP, sizeof(JUMP));
+    memcpy(b + 3, "MSWIN4.1", 8);
+    put_le16(b + 11, (uint16_t)g->bytes_per_sector);
+    b[13] = (uint8_t)g->sectors_per_cluster;
+    put_le16(b + 14, (uint16_t)g->reserved_sectors);
+    b[16] = 2;                                      /* number of FATs */
+    /* root entry count, 16-bit total sectors and 16-bit FAT size stay 0 on FAT32 */
+    b[21] = FAT32_MEDIA;
+    put_le16(b + 24, 63);                           /* sectors per track (CHS, unused) */
+    put_le16(b + 26, 255);                          /* heads */
+    put_le32(b + 28, hidden);                       /* sectors before the partition */
+    put_le32(b + 32, (uint32_t)g->total_sectors);
+    put_le32(b + 36, g->fat_sectors);
+    /* ext flags 0: FATs mirrored; version 0.0 */
+    put_le32(b + 44, FAT32_ROOT_CLUSTER);
+    put_le16(b + 48, FAT32_FSINFO_SECTOR);
+    put_le16(b + 50, FAT32_BACKUP_SECTOR);
+    b[64] = 0x80;                                   /* drive number */
+    b[66] = 0x29;                                   /* extended boot signature */
+    put_le32(b + 67, g->volume_id);
+    memcpy(b + 71, label, 11);
+    memcpy(b + 82, "FAT32   ", 8);
+    memcpy(b + 90, BOOT_CODE, sizeof(BOOT_CODE));
+    b[510] = 0x55;
+    b[511] = 0xAA;
+}
+
+static void fill_fsinfo(uint8_t *s, const Fat32Info *g) {
+    memset(s, 0, g->bytes_per_sector);
+    put_le32(s, 0x41615252);
+    put_le32(s + 484, 0x61417272);
+    put_le32(s + 488, g->clusters - 1);            /* the root directory takes one cluster */
+    put_le32(s + 492, FAT32_ROOT_CLUSTER + 1);     /* next free cluster hint */
+    put_le32(s + 508, 0xAA550000);
+}
+
+/* Root directory cluster: empty, or just the volume label entry */
+static void fill_root(uint8_t *c, const char label[11]) {
+    memcpy(c, label, 11);
+    c[11] = 0x08;                                   /* ATTR_VOLUME_ID */
+    time_t now = time(NULL);
+    struct tm tm;
+    if (localtime_r(&now, &tm) && tm.tm_year >= 80) {
+        put_le16(c + 22, (uint16_t)(tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2));
+        put_le16(c + 24, (uint16_t)((tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday));
+    }
+}
+
+int fat32_format(BlockDev *bd, uint64_t part_offset, uint64_t part_bytes, const char *label,
+                 uint32_t volume_id, Fat32Info *info) {
+    Fat32Info local;
+    if (!info) info = &local;
+    memset(info, 0, sizeof(*info));
+    if (!bd) return -EINVAL;
+    uint32_t bps = bd->sector_size ? bd->sector_size : 512;
+    if (bps < 512 || bps > 4096 || part_offset % bps != 0) return -EINVAL;
+    if (part_bytes / bps > UINT32_MAX) return -EFBIG;     /* 32-bit sector count in the BPB */
+    int rc = compute_geometry(part_bytes / bps, bps, info);
+    if (rc != 0) return rc;
+    if (volume_id == 0 && RAND_bytes((unsigned char *)&volume_id, sizeof(volume_id)) != 1)
+        volume_id = (uint32_t)time(NULL);
+    info->volume_id = volume_id;
+
+    char vol_label[11];
+    int has_label = make_label(label, vol_label);
+    uint64_t t = metrics_span_begin();
+    size_t reserved_len = (size_t)info->reserved_sectors * bps;
+    size_t cluster_len = (size_t)info->sectors_per_cluster * bps;
+    uint64_t fat_off = part_offset + reserved_len;
+    uint64_t fat_len = (uint64_t)info->fat_sectors * bps;
+    uint64_t root_off = fat_off + 2 * fat_len;
+    uint8_t *reserved = blockdev_alloc(bd, reserved_len);
+    uint8_t *fat_head = blockdev_alloc(bd, bps);
+    uint8_t *root = blockdev_alloc(bd, cluster_len);
+    if (!reserved || !fat_head || !root) {
+        rc = -ENOMEM;
+        goto out;
+    }
+
+    /* reserved area with sector 0 still zero: FSInfo, backup boot sector, backup FSInfo */
+    uint8_t *boot = reserved + (size_t)FAT32_BACKUP_SECTOR * bps;
+    fill_boot_sector(boot, info, (uint32_t)(part_offset / bps), vol_label);
+    fill_fsinfo(reserved + (size_t)FAT32_FSINFO_SECTOR * bps, info);
+    fill_fsinfo(reserved + (size_t)(FAT32_BACKUP_SECTOR + 1) * bps, info);
+    put_le32(fat_head, 0x0FFFFF00u | FAT32_MEDIA);
+    put_le32(fat_head + 4, FAT32_EOC);
+    put_le32(fat_head + 8, FAT32_EOC);              /* root directory: one cluster */
+    if (has_label) fill_root(root, vol_label);
+
+    /* Everything but the boot sector first (which also invalidates an old one), then sync,
+     * then the boot sector: a torn format is never mistaken for a file system. */
+    if ((rc = blockdev_pwrite(bd, reserved, reserved_len, part_offset)) != 0 ||
+        (rc = blockdev_zero(bd, fat_off, 2 * fat_len)) != 0 ||
+        (rc = blockdev_pwrite(bd, fat_head, bps, fat_off)) != 0 ||
+        (rc = blockdev_pwrite(bd, fat_head, bps, fat_off + fat_len)) != 0 ||
+        (rc = blockdev_pwrite(bd, root, cluster_len, root_off)) != 0 ||
+        (rc = blockdev_sync(bd)) != 0 ||
+        (rc = blockdev_pwrite(bd, boot, bps, part_offset)) != 0 ||
+        (rc = blockdev_sync(bd)) != 0)
+        goto out;
+    info->bytes_written = reserved_len + 2 * (uint64_t)bps + cluster_len + bps;
+    info->bytes_zeroed = 2 * fat_len;
+out:
+    free(reserved);
+    free(fat_head);
+    free(root);
+    metrics_span_end(METRIC_STAGE_FORMAT, t);
+    if (rc != 0) metrics_failure(METRIC_STAGE_FORMAT, rc);
+    return rc;
+}
+
+int fat32_format_device(const char *device, const char *label, Fat32Info *info) {
+    if (!device) return -EINVAL;
+    BlockDev bd;
+    int rc = blockdev_open(&bd, device, 1);
+    if (rc != 0) return rc;
+    GptPartition part;
+    rc = gpt_find_partition(&bd, GPT_DATA_PART_NAME, &part);
+    if (rc == -EBADMSG) rc = -ENOENT;   /* no GPT at all: same as no USB_DATA */
+    if (rc == 0) rc = fat32_format(&bd, gpt_part_offset(&part), gpt_part_size(&part), label, 0, info);
+    blockdev_close(&bd);
+    return rc;
+}
@@ -0,0 +1,213 @@
+#include "../inc/gpt.h"
+#include "../inc/crc32.h"
+
+#include <openssl/rand.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GPT_ENTRY_COUNT   128
+#define GPT_ENTRY_SIZE    128
+#define GPT_HEADER_SIZE   92
+#define GPT_REVISION      0x00010000u
+#define MIB               (1024ULL * 1024)
+
+/* Linux filesystem data 0FC63DAF-8483-4772-8E79-3D69D8477DE4 (what parted's mkpart uses), on-disk order */
+static const uint8_t GPT_TYPE_LINUX_DATA[16] = {
+    0xAF, 0x3D, 0xC6, 0x0F, 0x83, 0x84, 0x72, 0x47, 0x8E, 0x79, 0x3D, 0x69, 0xD8, 0x47, 0x7D, 0xE4
+};
+
+static void put_le16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put_le32(uint8_t *p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = v >> (8 * i); }
+static void put_le64(uint8_t *p, uint64_t v) { for (int i = 0; i < 8; i++) p[i] = v >> (8 * i); }
+static uint32_t get_le32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+static uint64_t get_le64(const uint8_t *p) { return get_le32(p) | (uint64_t)get_le32(p + 4) << 32; }
+
+uint64_t gpt_part_offset(const GptPartition *part) {
+    return part->first_lba * part->sector_size;
+}
+
+uint64_t gpt_part_size(const GptPartition *part) {
+    return (part->last_lba - part->first_lba + 1) * part->sector_size;
+}
+
+/* Random version-4 GUID in GPT on-disk byte order */
+static int random_guid(uint8_t guid[16]) {
+    if (RAND_bytes(guid, 16) != 1) return -EIO;
+    guid[7] = (guid[7] & 0x0F) | 0x40;
+    guid[8] = (guid[8] & 0x3F) | 0x80;
+    return 0;
+}
+
+static void fill_entry(uint8_t *e, const GptPartition *part, const uint8_t uniq[16]) {
+    memcpy(e, GPT_TYPE_LINUX_DATA, 16);
+    memcpy(e + 16, uniq, 16);
+    put_le64(e + 32, part->first_lba);
+    put_le64(e + 40, part->last_lba);
+    put_le64(e + 48, 0);                           /* attributes */
+    for (size_t i = 0; i < 36 && part->name[i]; i++)
+        put_le16(e + 56 + 2 * i, (uint8_t)part->name[i]);
+}
+
+static void fill_header(uint8_t *h, uint64_t my_lba, uint64_t alt_lba, uint64_t first_usable,
+                        uint64_t last_usable, const uint8_t disk_guid[16], uint64_t entries_lba,
+                        uint32_t entries_crc) {
+    memcpy(h, "EFI PART", 8);
+    put_le32(h + 8, GPT_REVISION);
+    put_le32(h + 12, GPT_HEADER_SIZE);
+    put_le32(h + 16, 0);                           /* header CRC, filled below */
+    put_le32(h + 20, 0);
+    put_le64(h + 24, my_lba);
+    put_le64(h + 32, alt_lba);
+    put_le64(h + 40, first_usable);
+    put_le64(h + 48, last_usable);
+    memcpy(h + 56, disk_guid, 16);
+    put_le64(h + 72, entries_lba);
+    put_le32(h + 80, GPT_ENTRY_COUNT);
+    put_le32(h + 84, GPT_ENTRY_SIZE);
+    put_le32(h + 88, entries_crc);
+    put_le32(h + 16, crc32_ieee(0, h, GPT_HEADER_SIZE));
+}
+
+int gpt_write_usb_layout(BlockDev *bd, GptPartition *sig_out, GptPartition *data_out) {
+    if (!bd || bd->fd < 0) return -EINVAL;
+    const uint32_t ss = bd->sector_size;
+    if (ss < 512 || MIB % ss != 0) return -EINVAL;
+    if (bd->size_bytes < GPT_MIN_DEVICE_BYTES) return -ENOSPC;
+
+    const uint64_t total = bd->size_bytes / ss;
+    const uint64_t mib = MIB / ss;
+    const size_t entries_bytes = GPT_ENTRY_COUNT * GPT_ENTRY_SIZE;
+    const uint64_t entries_sectors = (entries_bytes + ss - 1) / ss;
+    const uint64_t last_lba = total - 1;
+    const uint64_t backup_entries_lba = last_lba - entries_sectors;
+    const uint64_t first_usable = 2 + entries_sectors;
+    const uint64_t last_usable = backup_entries_lba - 1;
+
+    GptPartition sig = { .first_lba = mib, .last_lba = 2 * mib - 1, .sector_size = ss };
+    GptPartition data = { .first_lba = 2 * mib, .last_lba = (last_usable + 1) / mib * mib - 1, .sector_size = ss };
+    strcpy(sig.name, GPT_SIG_PART_NAME);
+    strcpy(data.name, GPT_DATA_PART_NAME);
+    if (data.last_lba < data.first_lba) return -ENOSPC;
+
+    uint8_t disk_guid[16], sig_guid[16], data_guid[16];
+    if (random_guid(disk_guid) || random_guid(sig_guid) || random_guid(data_guid)) return -EIO;
+
+    /* MBR sector, header sector and the partition entry array */
+    size_t entries_len = entries_sectors * ss;
+    uint8_t *mbr = blockdev_alloc(bd, ss);
+    uint8_t *hdr = blockdev_alloc(bd, ss);
+    uint8_t *entries = blockdev_alloc(bd, entries_len);
+    int rc = -ENOMEM;
+    if (!mbr || !hdr || !entries) goto out;
+
+    fill_entry(entries, &sig, sig_guid);
+    fill_entry(entries + GPT_ENTRY_SIZE, &data, data_guid);
+    uint32_t entries_crc = crc32_ieee(0, entries, entries_bytes);
+
+    /* protective MBR: one 0xEE partition covering the disk (capped at 32 bits) */
+    uint8_t *pe = mbr + 446;
+    pe[1] = 0x00; pe[2] = 0x02; pe[3] = 0x00;     /* CHS start 0/0/2 */
+    pe[4] = 0xEE;
+    pe[5] = 0xFF; pe[6] = 0xFF; pe[7] = 0xFF;     /* CHS end: max */
+    put_le32(pe + 8, 1);
+    put_le32(pe + 12, total - 1 > 0xFFFFFFFFu ? 0xFFFFFFFFu : (uint32_t)(total - 1));
+    mbr[510] = 0x55; mbr[511] = 0xAA;
+
+    /* backup first, primary last: a torn write leaves at most a stale backup */
+    fill_header(hdr, last_lba, 1, first_usable, last_usable, disk_guid, backup_entries_lba, entries_crc);
+    if ((rc = blockdev_pwrite(bd, entries, entries_len, backup_entries_lba * ss)) != 0) goto out;
+    if ((rc = blockdev_pwrite(bd, hdr, ss, last_lba * ss)) != 0) goto out;
+
+    memset(hdr, 0, ss);
+    fill_header(hdr, 1, last_lba, first_usable, last_usable, disk_guid, 2, entries_crc);
+    if ((rc = blockdev_pwrite(bd, entries, entries_len, 2 * ss)) != 0) goto out;
+    if ((rc = blockdev_pwrite(bd, hdr, ss, 1 * ss)) != 0) goto out;
+    if ((rc = blockdev_pwrite(bd, mbr, ss, 0)) != 0) goto out;
+
+    /* the gap up to USB_SIG may hold an old bootloader/table remnant */
+    if ((rc = blockdev_zero(bd, first_usable * ss, (sig.first_lba - first_usable) * ss)) != 0) goto out;
+    rc = blockdev_sync(bd);
+
+    if (rc == 0) {
+        if (sig_out) *sig_out = sig;
+        if (data_out) *data_out = data;
+    }
+out:
+    free(mbr);
+    free(hdr);
+    free(entries);
+    return rc;
+}
+
+/* Read and validate the header at lba, then its entry array. *entries_out is malloc'd. */
+static int read_gpt_at(BlockDev *bd, uint64_t lba, uint8_t **entries_out, uint32_t *count, uint32_t *esize) {
+    const uint32_t ss = bd->sector_size;
+    uint8_t *hdr = blockdev_alloc(bd, ss);
+    if (!hdr) return -ENOMEM;
+    int rc = blockdev_pread(bd, hdr, ss, lba * ss);
+    if (rc != 0) { free(hdr); return rc; }
+
+    uint32_t hsize = get_le32(hdr + 12);
+    rc = -EBADMSG;
+    if (memcmp(hdr, "EFI PART", 8) != 0 || hsize < GPT_HEADER_SIZE || hsize > ss) goto bad;
+    uint32_t hcrc = get_le32(hdr + 16);
+    put_le32(hdr + 16, 0);
+    if (crc32_ieee(0, hdr, hsize) != hcrc) goto bad;
+
+    uint64_t entries_lba = get_le64(hdr + 72);
+    *count = get_le32(hdr + 80);
+    *esize = get_le32(hdr + 84);
+    uint32_t ecrc = get_le32(hdr + 88);
+    if (*esize < 128 || *esize % 128 || *esize > 4096 || *count == 0 || *count > 1024) goto bad;
+
+    size_t len = (size_t)*count * *esize;
+    size_t rlen = (len + ss - 1) / ss * ss;
+    if (entries_lba > bd->size_bytes / ss || rlen > bd->size_bytes - entries_lba * ss) goto bad;
+    uint8_t *entries = blockdev_alloc(bd, rlen);
+    if (!entries) { rc = -ENOMEM; goto bad; }
+    if ((rc = blockdev_pread(bd, entries, rlen, entries_lba * ss)) != 0 ||
+        crc32_ieee(0, entries, len) != ecrc) {
+        free(entries);
+        if (rc == 0) rc = -EBADMSG;
+        goto bad;
+    }
+    free(hdr);
+    *entries_out = entries;
+    return 0;
+bad:
+    free(hdr);
+    return rc;
+}
+
+int gpt_find_partition(BlockDev *bd, const char *name, GptPartition *out) {
+    if (!bd || bd->fd < 0 || !name || !out) return -EINVAL;
+    uint8_t *entries = NULL;
+    uint32_t count = 0, esize = 0;
+    int rc = read_gpt_at(bd, 1, &entries, &count, &esize);
+    if (rc != 0) rc = read_gpt_at(bd, bd->size_bytes / bd->sector_size - 1, &entries, &count, &esize);
+    if (rc != 0) return rc;
+
+    static const uint8_t zero_guid[16];
+    rc = -ENOENT;
+    for (uint32_t i = 0; i < count; i++) {
+        const uint8_t *e = entries + (size_t)i * esize;
+        if (memcmp(e, zero_guid, 16) == 0) continue;
+        char ascii[37] = {0};
+        for (int k = 0; k < 36; k++) {
+            uint16_t c = e[56 + 2 * k] | e[57 + 2 * k] << 8;
+            if (c == 0) break;
+            ascii[k] = c < 0x80 ? (char)c : '?';
+        }
+        if (strcmp(ascii, name) != 0) continue;
+        out->first_lba = get_le64(e + 32);
+        out->last_lba = get_le64(e + 40);
+        out->sector_size = bd->sector_size;
+        memcpy(out->name, ascii, sizeof(out->name));
+        rc = out->last_lba >= out->first_lba ? 0 : -EBADMSG;
+        break;
+    }
+    free(entries);
+    return rc;
+}
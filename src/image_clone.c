@@ -0,0 +1,263 @@
+#define _GNU_SOURCE
+#include "../inc/image_clone.h"
+#include "../inc/blockdev.h"
+#include "../inc/gpt.h"
+#include "../inc/metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CLONE_ALIGN 4096
+
+typedef enum { ITEM_DATA, ITEM_ZERO, ITEM_END, ITEM_ERROR } ItemKind;
+
+typedef struct {
+    ItemKind kind;
+    int rc;                     /* ITEM_ERROR */
+    uint64_t off;               /* image offset */
+    uint64_t len;
+    unsigned char *buf;         /* ITEM_DATA: len bytes */
+    int full;                   /* handed to the writer, not yet written */
+} CloneItem;
+
+typedef struct {
+    int fd;
+    uint64_t size;
+    int flags;
+    size_t chunk;
+    CloneItem items[2];         /* double buffer, used alternately */
+    int stop;                   /* writer failed: reader gives up */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Cloner;
+
+static int all_zero(const unsigned char *p, size_t len) {
+    /* buffers are CLONE_ALIGN aligned: compare words, then the tail */
+    const uint64_t *w = (const uint64_t *)p;
+    size_t n = len / 8;
+    for (size_t i = 0; i < n; i++) {
+        if (w[i]) return 0;
+    }
+    for (size_t i = n * 8; i < len; i++) {
+        if (p[i]) return 0;
+    }
+    return 1;
+}
+
+/* Hand the next item to the writer; blocks while that buffer is still being written.
+ * Returns the item to fill, or NULL once the writer has stopped. */
+static CloneItem *next_slot(Cloner *c, unsigned *seq) {
+    CloneItem *it = &c->items[*seq & 1];
+    pthread_mutex_lock(&c->lock);
+    while (it->full && !c->stop) pthread_cond_wait(&c->cond, &c->lock);
+    int stop = c->stop;
+    pthread_mutex_unlock(&c->lock);
+    if (stop) return NULL;
+    (*seq)++;
+    return it;
+}
+
+static void publish(Cloner *c, CloneItem *it) {
+    pthread_mutex_lock(&c->lock);
+    it->full = 1;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+}
+
+static int emit(Cloner *c, unsigned *seq, ItemKind kind, uint64_t off, uint64_t len, int rc) {
+    CloneItem *it = next_slot(c, seq);
+    if (!it) return -ECANCELED;
+    it->kind = kind;
+    it->off = off;
+    it->len = len;
+    it->rc = rc;
+    publish(c, it);
+    return 0;
+}
+
+/* Reader: walk the image by extents and queue data / zero items in image order */
+static void *clone_reader(void *arg) {
+    Cloner *c = arg;
+    unsigned seq = 0;
+    uint64_t off = 0;
+    int rc = 0;
+    while (off < c->size && rc == 0) {
+        uint64_t data = off, hole = c->size;
+        if (!(c->flags & IMAGE_CLONE_DENSE)) {
+            off_t d = lseek(c->fd, (off_t)off, SEEK_DATA);
+            if (d >= 0) {
+                data = (uint64_t)d;
+                off_t h = lseek(c->fd, d, SEEK_HOLE);
+                hole = h >= 0 ? (uint64_t)h : c->size;
+            } else if (errno == ENXIO) {
+                data = c->size;     /* only a hole left */
+            } else if (errno != EINVAL && errno != ENOTSUP) {
+                rc = -errno;
+                break;
+            }
+        }
+        if (data > off) rc = emit(c, &seq, ITEM_ZERO, off, data - off, 0);
+
+        for (uint64_t p = data; p < hole && rc == 0; ) {
+            size_t n = hole - p < c->chunk ? (size_t)(hole - p) : c->chunk;
+            CloneItem *it = next_slot(c, &seq);
+            if (!it) { rc = -ECANCELED; break; }
+            size_t got = 0;
+            while (got < n && rc == 0) {
+                ssize_t r = pread(c->fd, it->buf + got, n - got, (off_t)(p + got));
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0) rc = r < 0 ? -errno : -EIO;   /* image shrank underneath us */
+                else got += (size_t)r;
+            }
+            it->off = p;
+            it->len = n;
+            if (rc != 0) {
+                /* this slot carries the error; nothing else is queued after it */
+                it->kind = ITEM_ERROR;
+                it->rc = rc;
+                publish(c, it);
+                return NULL;
+            }
+            it->kind = !(c->flags & IMAGE_CLONE_DENSE) && all_zero(it->buf, n) ? ITEM_ZERO : ITEM_DATA;
+            publish(c, it);
+            p += n;
+        }
+        off = hole;
+    }
+    if (rc == 0) emit(c, &seq, ITEM_END, 0, 0, 0);
+    else if (rc != -ECANCELED) emit(c, &seq, ITEM_ERROR, off, 0, rc);
+    return NULL;
+}
+
+/* Writer side: consume items in order until the end marker or an error */
+static int clone_write(Cloner *c, BlockDev *bd, uint64_t base, CloneStats *st) {
+    unsigned seq = 0;
+    for (;;) {
+        CloneItem *it = &c->items[seq++ & 1];
+        pthread_mutex_lock(&c->lock);
+        while (!it->full) pthread_cond_wait(&c->cond, &c->lock);
+        pthread_mutex_unlock(&c->lock);
+
+        int rc = 0;
+        switch (it->kind) {
+        case ITEM_END:
+            return 0;
+        case ITEM_ERROR:
+            return it->rc ? it->rc : -EIO;
+        case ITEM_DATA:
+            rc = blockdev_pwrite(bd, it->buf, (size_t)it->len, base + it->off);
+            if (rc == 0) st->bytes_written += it->len;
+            break;
+        case ITEM_ZERO:
+            if (c->flags & IMAGE_CLONE_NO_ZERO) {
+                st->bytes_skipped += it->len;
+            } else {
+                rc = blockdev_zero(bd, base + it->off, it->len);
+                if (rc == 0) st->bytes_zeroed += it->len;
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&c->lock);
+        it->full = 0;
+        if (rc != 0) c->stop = 1;
+        pthread_cond_broadcast(&c->cond);
+        pthread_mutex_unlock(&c->lock);
+        if (rc != 0) return rc;
+    }
+}
+
+int image_clone_to_device(const char *device, const char *image_path, int flags, size_t chunk_size,
+                          CloneStats *stats) {
+    CloneStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (!device || !image_path) return -EINVAL;
+    uint64_t t = metrics_span_begin();
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    Cloner c = { .fd = -1, .flags = flags };
+    c.chunk = chunk_size ? (chunk_size + CLONE_ALIGN - 1) / CLONE_ALIGN * CLONE_ALIGN : IMAGE_CLONE_CHUNK_DEFAULT;
+    BlockDev bd;
+    int rc = blockdev_open(&bd, device, 1);
+    if (rc != 0) {
+        fprintf(stderr, "clone: cannot open %s: %s\n", device, strerror(-rc));
+        metrics_span_end(METRIC_STAGE_CLONE, t);
+        return rc;
+    }
+
+    struct stat st;
+    GptPartition part;
+    c.fd = open(image_path, O_RDONLY | O_CLOEXEC);
+    if (c.fd < 0 || fstat(c.fd, &st) != 0) {
+        rc = -errno;
+        fprintf(stderr, "clone: cannot open image %s: %s\n", image_path, strerror(-rc));
+        goto out;
+    }
+    c.size = (uint64_t)st.st_size;
+    stats->image_bytes = c.size;
+    (void)posix_fadvise(c.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    rc = gpt_find_partition(&bd, GPT_DATA_PART_NAME, &part);
+    if (rc != 0 && (flags & IMAGE_CLONE_PARTITION)) {
+        uint64_t tp = metrics_span_begin();
+        rc = gpt_write_usb_layout(&bd, NULL, &part);
+        metrics_span_end(METRIC_STAGE_PARTITION, tp);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "clone: no %s partition on %s: %s\n", GPT_DATA_PART_NAME, device, strerror(-rc));
+        goto out;
+    }
+    if (c.size > gpt_part_size(&part)) {
+        fprintf(stderr, "clone: %s (%llu bytes) does not fit %s (%llu bytes)\n", image_path,
+                (unsigned long long)c.size, GPT_DATA_PART_NAME, (unsigned long long)gpt_part_size(&part));
+        rc = -EFBIG;
+        goto out;
+    }
+
+    c.items[0].buf = blockdev_alloc(&bd, c.chunk);
+    c.items[1].buf = blockdev_alloc(&bd, c.chunk);
+    if (!c.items[0].buf || !c.items[1].buf) {
+        rc = -ENOMEM;
+        goto out;
+    }
+    pthread_mutex_init(&c.lock, NULL);
+    pthread_cond_init(&c.cond, NULL);
+    pthread_t reader;
+    if (pthread_create(&reader, NULL, clone_reader, &c) != 0) {
+        rc = -EAGAIN;
+    } else {
+        rc = clone_write(&c, &bd, gpt_part_offset(&part), stats);
+        if (rc != 0) {
+            /* release a reader blocked on a full buffer */
+            pthread_mutex_lock(&c.lock);
+            c.stop = 1;
+            pthread_cond_broadcast(&c.cond);
+            pthread_mutex_unlock(&c.lock);
+        }
+        pthread_join(reader, NULL);
+    }
+    pthread_cond_destroy(&c.cond);
+    pthread_mutex_destroy(&c.lock);
+    if (rc == 0) rc = blockdev_sync(&bd);
+    if (rc != 0) fprintf(stderr, "clone: copying %s to %s failed: %s\n", image_path, device, strerror(-rc));
+out:
+    free(c.items[0].buf);
+    free(c.items[1].buf);
+    if (c.fd >= 0) close(c.fd);
+    blockdev_close(&bd);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    stats->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    stats->mbps = stats->seconds > 0 ? stats->image_bytes / stats->seconds / 1e6 : 0;
+    metrics_span_end(METRIC_STAGE_CLONE, t);
+    if (rc != 0) metrics_failure(METRIC_STAGE_CLONE, rc);
+    return rc;
+}
@@ -0,0 +1,76 @@
+#include "../inc/key_alg.h"
+
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include <openssl/rsa.h>
+
+#include <string.h>
+
+static const char *ALG_NAMES[KEY_ALG_COUNT] = {
+    "rsa2048", "rsa3072", "rsa4096", "p256", "p384", "ed25519"
+};
+
+const char *key_alg_name(KeyAlg alg) {
+    if ((int)alg < 0 || alg >= KEY_ALG_COUNT) return "?";
+    return ALG_NAMES[alg];
+}
+
+int key_alg_from_name(const char *name, KeyAlg *alg) {
+    if (!name || !alg) return -1;
+    for (int i = 0; i < KEY_ALG_COUNT; i++) {
+        if (strcmp(name, ALG_NAMES[i]) == 0) { *alg = (KeyAlg)i; return 0; }
+    }
+    return -1;
+}
+
+int key_alg_from_rsa_bits(int bits, KeyAlg *alg) {
+    if (!alg) return -1;
+    switch (bits) {
+    case 2048: *alg = KEY_ALG_RSA2048; return 0;
+    case 3072: *alg = KEY_ALG_RSA3072; return 0;
+    case 4096: *alg = KEY_ALG_RSA4096; return 0;
+    default: return -1;
+    }
+}
+
+int key_alg_of_key(const EVP_PKEY *pkey, KeyAlg *alg) {
+    if (!pkey || !alg) return -1;
+    switch (EVP_PKEY_get_base_id(pkey)) {
+    case EVP_PKEY_RSA:
+        return key_alg_from_rsa_bits(EVP_PKEY_get_bits(pkey), alg);
+    case EVP_PKEY_EC: {
+        char group[64];
+        if (!EVP_PKEY_get_group_name(pkey, group, sizeof(group), NULL)) return -1;
+        if (strcmp(group, SN_X9_62_prime256v1) == 0) { *alg = KEY_ALG_EC_P256; return 0; }
+        if (strcmp(group, SN_secp384r1) == 0) { *alg = KEY_ALG_EC_P384; return 0; }
+        return -1;
+    }
+    case EVP_PKEY_ED25519:
+        *alg = KEY_ALG_ED25519;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+EVP_PKEY *key_alg_generate(KeyAlg alg) {
+    switch (alg) {
+    case KEY_ALG_RSA2048: return EVP_RSA_gen(2048);
+    case KEY_ALG_RSA3072: return EVP_RSA_gen(3072);
+    case KEY_ALG_RSA4096: return EVP_RSA_gen(4096);
+    case KEY_ALG_EC_P256: return EVP_EC_gen(SN_X9_62_prime256v1);
+    case KEY_ALG_EC_P384: return EVP_EC_gen(SN_secp384r1);
+    case KEY_ALG_ED25519: return EVP_PKEY_Q_keygen(NULL, NULL, "ED25519");
+    default: return NULL;
+    }
+}
+
+const EVP_MD *key_alg_digest_for_key(const EVP_PKEY *pkey) {
+    KeyAlg alg;
+    if (key_alg_of_key(pkey, &alg) != 0) return EVP_sha256();
+    switch (alg) {
+    case KEY_ALG_ED25519: return NULL;
+    case KEY_ALG_EC_P384: return EVP_sha384();
+    default: return EVP_sha256();
+    }
+}
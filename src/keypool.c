@@ -0,0 +1,259 @@
+#define _DEFAULT_SOURCE
+#include "../inc/keypool.h"
+
+#include <openssl/crypto.h>
+#include <openssl/pem.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+struct KeyPool {
+    KeyPoolConfig cfg;
+    char *spool_dir;
+    char *spool_pass;
+
+    EVP_PKEY **ring;            /* ready keys, FIFO of size cfg.high_watermark */
+    size_t head;
+    size_t count;
+    int refill;                 /* producers run while set; cleared at high, set at low watermark */
+    int stop;
+
+    pthread_mutex_t lock;
+    pthread_cond_t need_keys;   /* producers wait here */
+    pthread_cond_t have_keys;   /* consumers wait here */
+    pthread_t *threads;
+    int nthreads;
+
+    KeyPoolStats stats;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Push a key; caller holds the lock and has checked count < high_watermark */
+static void ring_push(KeyPool *pool, EVP_PKEY *pkey) {
+    size_t cap = pool->cfg.high_watermark;
+    pool->ring[(pool->head + pool->count) % cap] = pkey;
+    pool->count++;
+    if (pool->count >= cap) pool->refill = 0;
+    pthread_cond_signal(&pool->have_keys);
+}
+
+static EVP_PKEY *ring_pop(KeyPool *pool) {
+    EVP_PKEY *pkey = pool->ring[pool->head];
+    pool->ring[pool->head] = NULL;
+    pool->head = (pool->head + 1) % pool->cfg.high_watermark;
+    pool->count--;
+    if (pool->count <= pool->cfg.low_watermark && !pool->refill) {
+        pool->refill = 1;
+        pthread_cond_broadcast(&pool->need_keys);
+    }
+    return pkey;
+}
+
+static void *keypool_producer(void *arg) {
+    KeyPool *pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop && !pool->refill) pthread_cond_wait(&pool->need_keys, &pool->lock);
+        int stop = pool->stop;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) break;
+
+        /* keygen runs outside the lock; that's the whole point */
+        EVP_PKEY *pkey = key_alg_generate(pool->cfg.alg);
+        if (!pkey) {
+            fprintf(stderr, "keypool: %s keygen failed\n", key_alg_name(pool->cfg.alg));
+            sleep(1);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (!pool->stop && pool->count < pool->cfg.high_watermark) {
+            ring_push(pool, pkey);
+            pool->stats.generated++;
+            pkey = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+        EVP_PKEY_free(pkey);    /* surplus from a race with another producer */
+    }
+    return NULL;
+}
+
+/* Load up to high_watermark keys from the spool; each loaded file is removed */
+static void spool_load(KeyPool *pool) {
+    DIR *d = opendir(pool->spool_dir);
+    if (!d) return;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL && pool->count < pool->cfg.high_watermark) {
+        if (strncmp(de->d_name, "key-", 4) != 0) continue;
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", pool->spool_dir, de->d_name);
+        FILE *f = fopen(path, "rb");
+        if (!f) continue;
+        EVP_PKEY *pkey = PEM_read_PrivateKey(f, NULL, NULL, pool->spool_pass);
+        fclose(f);
+        /* a key is handed out at most once: drop the file whether or not it parsed */
+        unlink(path);
+        if (!pkey) {
+            fprintf(stderr, "keypool: discarding unreadable spool entry %s\n", de->d_name);
+            continue;
+        }
+        KeyAlg alg;
+        if (key_alg_of_key(pkey, &alg) != 0 || alg != pool->cfg.alg) {
+            EVP_PKEY_free(pkey);
+            continue;
+        }
+        ring_push(pool, pkey);
+        pool->stats.loaded++;
+    }
+    closedir(d);
+}
+
+/* Write one key to a fresh 0600 spool file, encrypted with the spool passphrase */
+static int spool_store(KeyPool *pool, EVP_PKEY *pkey) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/key-XXXXXX", pool->spool_dir);
+    int fd = mkstemp(path);     /* mkstemp creates the file 0600 */
+    if (fd < 0) return -1;
+    FILE *f = fdopen(fd, "wb");
+    if (!f) { close(fd); unlink(path); return -1; }
+    int ok = PEM_write_PrivateKey(f, pkey, EVP_aes_256_cbc(),
+                                  (unsigned char *)pool->spool_pass, (int)strlen(pool->spool_pass),
+                                  NULL, NULL);
+    if (fflush(f) != 0 || fsync(fileno(f)) != 0) ok = 0;
+    fclose(f);
+    if (!ok) { unlink(path); return -1; }
+    return 0;
+}
+
+void keypool_config_init(KeyPoolConfig *cfg) {
+    if (!cfg) return;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->alg = KEY_ALG_RSA2048;
+    cfg->high_watermark = 8;
+    cfg->low_watermark = 2;
+    cfg->threads = 1;
+}
+
+KeyPool *keypool_create(const KeyPoolConfig *cfg) {
+    if (!cfg || (int)cfg->alg < 0 || cfg->alg >= KEY_ALG_COUNT || cfg->high_watermark == 0) return NULL;
+    if (cfg->spool_dir && !cfg->spool_pass) {
+        fprintf(stderr, "keypool: spool_dir requires spool_pass\n");
+        return NULL;
+    }
+
+    KeyPool *pool = calloc(1, sizeof(KeyPool));
+    if (!pool) return NULL;
+    pool->cfg = *cfg;
+    if (pool->cfg.low_watermark >= pool->cfg.high_watermark)
+        pool->cfg.low_watermark = pool->cfg.high_watermark - 1;
+    if (pool->cfg.threads < 1) pool->cfg.threads = 1;
+    pool->ring = calloc(pool->cfg.high_watermark, sizeof(EVP_PKEY *));
+    pool->threads = calloc((size_t)pool->cfg.threads, sizeof(pthread_t));
+    if (cfg->spool_dir) {
+        pool->spool_dir = strdup(cfg->spool_dir);
+        pool->spool_pass = strdup(cfg->spool_pass);
+    }
+    if (!pool->ring || !pool->threads || (cfg->spool_dir && (!pool->spool_dir || !pool->spool_pass))) {
+        free(pool->ring); free(pool->threads); free(pool->spool_dir); free(pool->spool_pass); free(pool);
+        return NULL;
+    }
+    pool->cfg.spool_dir = pool->spool_dir;
+    pool->cfg.spool_pass = pool->spool_pass;
+    pool->refill = 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->need_keys, NULL);
+    pthread_cond_init(&pool->have_keys, NULL);
+
+    if (pool->spool_dir) {
+        if (mkdir(pool->spool_dir, 0700) != 0 && errno != EEXIST)
+            perror("keypool: mkdir spool");
+        spool_load(pool);
+    }
+
+    for (int i = 0; i < pool->cfg.threads; i++) {
+        if (pthread_create(&pool->threads[i], NULL, keypool_producer, pool) != 0) break;
+        pool->nthreads++;
+    }
+    if (pool->nthreads == 0) {
+        keypool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+EVP_PKEY *keypool_take(KeyPool *pool) {
+    if (!pool) return NULL;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->count == 0 && !pool->stop) {
+        double t0 = now_seconds();
+        pool->stats.waits++;
+        if (!pool->refill) {
+            pool->refill = 1;
+            pthread_cond_broadcast(&pool->need_keys);
+        }
+        while (pool->count == 0 && !pool->stop) pthread_cond_wait(&pool->have_keys, &pool->lock);
+        pool->stats.wait_seconds += now_seconds() - t0;
+    }
+    EVP_PKEY *pkey = NULL;
+    if (pool->count > 0) {
+        pkey = ring_pop(pool);
+        pool->stats.taken++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return pkey;
+}
+
+KeyAlg keypool_alg(const KeyPool *pool) {
+    return pool ? pool->cfg.alg : KEY_ALG_COUNT;
+}
+
+void keypool_get_stats(KeyPool *pool, KeyPoolStats *stats) {
+    if (!pool || !stats) return;
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    stats->available = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void keypool_destroy(KeyPool *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->need_keys);
+    pthread_cond_broadcast(&pool->have_keys);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nthreads; i++) pthread_join(pool->threads[i], NULL);
+
+    /* EVP_PKEY_free clears private key components (BN_clear_free / cleanse) before releasing them */
+    size_t spilled = 0;
+    while (pool->count > 0) {
+        EVP_PKEY *pkey = ring_pop(pool);
+        if (pool->spool_dir && spool_store(pool, pkey) == 0) spilled++;
+        EVP_PKEY_free(pkey);
+    }
+    if (spilled) printf("keypool: spooled %zu unused key(s) to %s\n", spilled, pool->spool_dir);
+
+    pthread_cond_destroy(&pool->need_keys);
+    pthread_cond_destroy(&pool->have_keys);
+    pthread_mutex_destroy(&pool->lock);
+    if (pool->spool_pass) {
+        OPENSSL_cleanse(pool->spool_pass, strlen(pool->spool_pass));
+        free(pool->spool_pass);
+    }
+    free(pool->spool_dir);
+    free(pool->threads);
+    free(pool->ring);
+    free(pool);
+}
@@ -0,0 +1,626 @@
+#define _DEFAULT_SOURCE
+#include "../inc/ledger.h"
+#include "../inc/crc32.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/asn1.h>
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+
+#define REC_MAGIC "LGR1"
+#define REC_VERSION 1
+#define REC_HDR 80
+#define REC_MAX (REC_HDR + LEDGER_SERIAL_MAX + LEDGER_DEVICE_ID_MAX + LEDGER_DEVICE_SERIAL_MAX + LEDGER_SUBJECT_MAX + 8)
+
+#define IDX_MAGIC "LGRIDX1"
+#define IDX_HDR 64              /* magic[8], capacity, slots used, covered log bytes, covered records (u64) */
+#define IDX_MIN_CAPACITY 1024
+
+typedef struct {
+    uint64_t hash;
+    uint64_t off1;              /* log offset + 1, 0 = empty slot */
+} IdxSlot;
+
+typedef struct {
+    char path[PATH_MAX];
+    int fd;
+    unsigned char *map;         /* header + slots */
+    size_t map_len;
+    IdxSlot *slots;
+    uint64_t capacity;          /* power of two */
+    uint64_t count;
+    uint64_t dirty_lo, dirty_hi;    /* slots changed since the last checkpoint, lo >= hi: none */
+} LedgerIndex;
+
+enum { IDX_SERIAL = 0, IDX_DEVICE, IDX_COUNT };
+static const char *IDX_NAMES[IDX_COUNT] = { "serial.idx", "device.idx" };
+
+struct Ledger {
+    int fd;                     /* ledger.log, O_APPEND */
+    int flags;
+    uint64_t log_len;
+    uint64_t records;
+    LedgerIndex idx[IDX_COUNT];
+    pthread_rwlock_t lock;
+    LedgerStats open_stats;
+    int ready;                  /* opened and replayed */
+};
+
+static void put_le16(unsigned char *p, uint16_t v) { p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); }
+static void put_le32(unsigned char *p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i)); }
+static void put_le64(unsigned char *p, uint64_t v) { for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i)); }
+static uint16_t get_le16(const unsigned char *p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t get_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+static uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* FNV-1a; never 0 so a zero hash can not be confused with anything */
+static uint64_t key_hash(const void *key, size_t len) {
+    const unsigned char *p = key;
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) h = (h ^ p[i]) * 0x100000001b3ull;
+    return h ? h : 1;
+}
+
+/* ---- records ---- */
+
+static size_t rec_encode(const LedgerEntry *e, unsigned char *buf) {
+    size_t dev_id = strnlen(e->device_id, LEDGER_DEVICE_ID_MAX - 1);
+    size_t dev_serial = strnlen(e->device_serial, LEDGER_DEVICE_SERIAL_MAX - 1);
+    size_t subject = strnlen(e->subject, LEDGER_SUBJECT_MAX - 1);
+    size_t len = REC_HDR + e->serial_len + dev_id + dev_serial + subject;
+    size_t padded = (len + 7) & ~(size_t)7;
+
+    memset(buf, 0, padded);
+    memcpy(buf, REC_MAGIC, 4);
+    put_le32(buf + 4, (uint32_t)padded);
+    put_le16(buf + 12, REC_VERSION);
+    buf[14] = (unsigned char)e->serial_len;
+    buf[15] = (unsigned char)dev_id;
+    put_le64(buf + 16, (uint64_t)e->issued_at);
+    put_le64(buf + 24, (uint64_t)e->not_before);
+    put_le64(buf + 32, (uint64_t)e->not_after);
+    memcpy(buf + 40, e->sha256, 32);
+    put_le16(buf + 72, (uint16_t)dev_serial);
+    put_le16(buf + 74, (uint16_t)subject);
+    unsigned char *p = buf + REC_HDR;
+    memcpy(p, e->serial, e->serial_len); p += e->serial_len;
+    memcpy(p, e->device_id, dev_id); p += dev_id;
+    memcpy(p, e->device_serial, dev_serial); p += dev_serial;
+    memcpy(p, e->subject, subject);
+    put_le32(buf + 8, crc32c(0, buf, padded));
+    return padded;
+}
+
+/* Validate and decode one record; returns its length, 0 if torn/incomplete, -EBADMSG if invalid */
+static long rec_decode(unsigned char *buf, size_t avail, LedgerEntry *e) {
+    if (avail < REC_HDR) return 0;
+    if (memcmp(buf, REC_MAGIC, 4) != 0) return -EBADMSG;
+    uint32_t len = get_le32(buf + 4);
+    if (len < REC_HDR || len > REC_MAX || (len & 7)) return -EBADMSG;
+    if (len > avail) return 0;
+    uint32_t crc = get_le32(buf + 8);
+    put_le32(buf + 8, 0);
+    uint32_t calc = crc32c(0, buf, len);
+    put_le32(buf + 8, crc);
+    if (crc != calc) return -EBADMSG;
+
+    size_t serial_len = buf[14], dev_id = buf[15];
+    size_t dev_serial = get_le16(buf + 72), subject = get_le16(buf + 74);
+    if (serial_len > LEDGER_SERIAL_MAX || dev_id >= LEDGER_DEVICE_ID_MAX ||
+        dev_serial >= LEDGER_DEVICE_SERIAL_MAX || subject >= LEDGER_SUBJECT_MAX ||
+        REC_HDR + serial_len + dev_id + dev_serial + subject > len) return -EBADMSG;
+    if (!e) return len;
+
+    e->serial_len = serial_len;
+    e->issued_at = (int64_t)get_le64(buf + 16);
+    e->not_before = (int64_t)get_le64(buf + 24);
+    e->not_after = (int64_t)get_le64(buf + 32);
+    memcpy(e->sha256, buf + 40, 32);
+    const unsigned char *p = buf + REC_HDR;
+    memcpy(e->serial, p, serial_len); p += serial_len;
+    memcpy(e->device_id, p, dev_id); e->device_id[dev_id] = '\0'; p += dev_id;
+    memcpy(e->device_serial, p, dev_serial); e->device_serial[dev_serial] = '\0'; p += dev_serial;
+    memcpy(e->subject, p, subject); e->subject[subject] = '\0';
+    return len;
+}
+
+/* Record at off into e; returns its length or a negative errno */
+static int rec_read(Ledger *l, uint64_t off, LedgerEntry *e) {
+    unsigned char buf[REC_MAX];
+    size_t avail = l->log_len - off < sizeof(buf) ? (size_t)(l->log_len - off) : sizeof(buf);
+    ssize_t n = pread(l->fd, buf, avail, (off_t)off);
+    if (n < 0) return -errno;
+    long len = rec_decode(buf, (size_t)n, e);
+    if (len <= 0) return -EBADMSG;
+    e->offset = off;
+    return (int)len;
+}
+
+/* ---- indexes ---- */
+
+static void idx_unmap(LedgerIndex *x) {
+    if (x->map) munmap(x->map, x->map_len);
+    if (x->fd >= 0) close(x->fd);
+    x->map = NULL;
+    x->slots = NULL;
+    x->fd = -1;
+}
+
+/* Map an index file with the given capacity (existing content kept) */
+static int idx_map(LedgerIndex *x, const char *path, uint64_t capacity) {
+    size_t len = IDX_HDR + capacity * sizeof(IdxSlot);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) return -errno;
+    if (ftruncate(fd, (off_t)len) != 0) {
+        int rc = -errno;
+        close(fd);
+        return rc;
+    }
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        int rc = -errno;
+        close(fd);
+        return rc;
+    }
+    x->fd = fd;
+    x->map = map;
+    x->map_len = len;
+    x->slots = (IdxSlot *)(x->map + IDX_HDR);
+    x->capacity = capacity;
+    x->dirty_lo = capacity;
+    x->dirty_hi = 0;
+    return 0;
+}
+
+static uint64_t idx_covered(const LedgerIndex *x) {
+    return get_le64(x->map + 24);
+}
+
+static void idx_set_header(LedgerIndex *x, uint64_t covered, uint64_t records) {
+    memcpy(x->map, IDX_MAGIC, 8);
+    put_le64(x->map + 8, x->capacity);
+    put_le64(x->map + 16, x->count);
+    put_le64(x->map + 24, covered);
+    put_le64(x->map + 32, records);
+}
+
+/* Insert (hash, off) unless that offset is already present (log replay is idempotent) */
+static void idx_put(LedgerIndex *x, uint64_t hash, uint64_t off) {
+    uint64_t mask = x->capacity - 1;
+    for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+        IdxSlot *s = &x->slots[i];
+        if (s->off1 == 0) {
+            s->hash = hash;
+            s->off1 = off + 1;
+            x->count++;
+            if (i < x->dirty_lo) x->dirty_lo = i;
+            if (i >= x->dirty_hi) x->dirty_hi = i + 1;
+            return;
+        }
+        if (s->off1 == off + 1) return;
+    }
+}
+
+/* Make the changed slots durable, then advance the header to cover the log up to `covered`.
+ * Writeback of a shared mapping is unordered, so the header must never reach the disk
+ * ahead of the slots it claims to cover. */
+static int idx_checkpoint(LedgerIndex *x, uint64_t covered, uint64_t records) {
+    if (x->dirty_lo < x->dirty_hi) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t lo = (IDX_HDR + x->dirty_lo * sizeof(IdxSlot)) / page * page;
+        size_t hi = IDX_HDR + x->dirty_hi * sizeof(IdxSlot);
+        if (msync(x->map + lo, hi - lo, MS_SYNC) != 0) return -errno;
+        x->dirty_lo = x->capacity;
+        x->dirty_hi = 0;
+    }
+    idx_set_header(x, covered, records);
+    return msync(x->map, IDX_HDR, MS_SYNC) == 0 ? 0 : -errno;
+}
+
+/* Occupied slots; the header count lags behind slots written back after the last checkpoint */
+static void idx_recount(LedgerIndex *x) {
+    x->count = 0;
+    for (uint64_t i = 0; i < x->capacity; i++) x->count += x->slots[i].off1 != 0;
+}
+
+/* Double the table into a fresh file, then swap it in. The header keeps the old coverage,
+ * and the new file is synced before it replaces the old one. */
+static int idx_grow(LedgerIndex *x) {
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", x->path);
+    unlink(tmp);
+    LedgerIndex n = { .fd = -1 };
+    memcpy(n.path, x->path, sizeof(n.path));
+    int rc = idx_map(&n, tmp, x->capacity * 2);
+    if (rc != 0) return rc;
+    for (uint64_t i = 0; i < x->capacity; i++) {
+        if (x->slots[i].off1) idx_put(&n, x->slots[i].hash, x->slots[i].off1 - 1);
+    }
+    memcpy(n.map, x->map, IDX_HDR);
+    put_le64(n.map + 8, n.capacity);
+    put_le64(n.map + 16, n.count);
+    n.dirty_lo = n.capacity;
+    n.dirty_hi = 0;
+    if (msync(n.map, n.map_len, MS_SYNC) != 0 || rename(tmp, x->path) != 0) {
+        rc = -errno;
+        idx_unmap(&n);
+        unlink(tmp);
+        return rc;
+    }
+    idx_unmap(x);
+    *x = n;
+    return 0;
+}
+
+static int idx_add(LedgerIndex *x, uint64_t hash, uint64_t off) {
+    if ((x->count + 1) * 4 > x->capacity * 3) {
+        int rc = idx_grow(x);
+        if (rc != 0) return rc;
+    }
+    idx_put(x, hash, off);
+    return 0;
+}
+
+/* Open an index; a missing, foreign or inconsistent file starts empty (covered = 0) */
+static int idx_open(LedgerIndex *x, const char *dir, const char *name, uint64_t log_len, int *rebuilt) {
+    x->fd = -1;
+    snprintf(x->path, sizeof(x->path), "%s/%s", dir, name);
+    struct stat st;
+    uint64_t capacity = IDX_MIN_CAPACITY;
+    int valid = 0;
+    if (stat(x->path, &st) == 0 && st.st_size >= IDX_HDR) {
+        unsigned char hdr[IDX_HDR];
+        int fd = open(x->path, O_RDONLY | O_CLOEXEC);
+        if (fd >= 0 && pread(fd, hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr)) {
+            uint64_t cap = get_le64(hdr + 8);
+            valid = memcmp(hdr, IDX_MAGIC, 8) == 0 && cap >= IDX_MIN_CAPACITY && !(cap & (cap - 1)) &&
+                    (uint64_t)st.st_size == IDX_HDR + cap * sizeof(IdxSlot) &&
+                    get_le64(hdr + 16) < cap && get_le64(hdr + 24) <= log_len;
+            if (valid) capacity = cap;
+        }
+        if (fd >= 0) close(fd);
+    }
+    if (!valid) {
+        unlink(x->path);
+        *rebuilt = 1;
+    }
+    int rc = idx_map(x, x->path, capacity);
+    if (rc != 0) return rc;
+    if (valid) {
+        x->count = get_le64(x->map + 16);
+    } else {
+        x->count = 0;
+        idx_set_header(x, 0, 0);
+    }
+    return 0;
+}
+
+static uint64_t entry_key_hash(int which, const LedgerEntry *e) {
+    return which == IDX_SERIAL ? key_hash(e->serial, e->serial_len)
+                               : key_hash(e->device_serial, strlen(e->device_serial));
+}
+
+static int index_entry(Ledger *l, const LedgerEntry *e, uint64_t off, const uint64_t from[IDX_COUNT]) {
+    for (int i = 0; i < IDX_COUNT; i++) {
+        if (off < from[i]) continue;    /* this index already has it */
+        if (i == IDX_DEVICE && !e->device_serial[0]) continue;
+        int rc = idx_add(&l->idx[i], entry_key_hash(i, e), off);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
+
+/* Index the log from the oldest point any index is missing; cut a torn tail */
+static int replay(Ledger *l) {
+    uint64_t from[IDX_COUNT];
+    int oldest = 0;
+    for (int i = 0; i < IDX_COUNT; i++) {
+        from[i] = idx_covered(&l->idx[i]);
+        if (from[i] < from[oldest]) oldest = i;
+    }
+    uint64_t off = from[oldest];
+    l->records = get_le64(l->idx[oldest].map + 32);
+    for (int i = 0; i < IDX_COUNT; i++) {
+        if (from[i] < l->log_len) idx_recount(&l->idx[i]);
+    }
+
+    size_t cap = 1 << 20, have = 0;
+    unsigned char *buf = malloc(cap);
+    if (!buf) return -ENOMEM;
+    int rc = 0;
+    for (;;) {
+        if (off + have < l->log_len) {
+            ssize_t n = pread(l->fd, buf + have, cap - have, (off_t)(off + have));
+            if (n < 0) { rc = -errno; goto out; }
+            if (n == 0) l->log_len = off + have;
+            have += (size_t)n;
+        }
+        size_t pos = 0;
+        long len;
+        LedgerEntry e;
+        while ((len = rec_decode(buf + pos, have - pos, &e)) > 0) {
+            if ((rc = index_entry(l, &e, off + pos, from)) != 0) goto out;
+            l->open_stats.replayed++;
+            l->records++;
+            pos += (size_t)len;
+        }
+        off += pos;
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+        if (len < 0) {
+            /* garbage: a torn append if it is at the very end, corruption otherwise */
+            if (off + REC_MAX < l->log_len) { rc = -EBADMSG; goto out; }
+            break;
+        }
+        if (off + have >= l->log_len) break;
+    }
+    if (off < l->log_len) {
+        if (ftruncate(l->fd, (off_t)off) != 0) { rc = -errno; goto out; }
+        l->log_len = off;
+        l->open_stats.truncated = 1;
+    }
+    for (int i = 0; i < IDX_COUNT; i++) {
+        if (from[i] != l->log_len && (rc = idx_checkpoint(&l->idx[i], l->log_len, l->records)) != 0) goto out;
+    }
+out:
+    free(buf);
+    return rc;
+}
+
+int ledger_open(const char *dir, int flags, Ledger **out) {
+    if (!dir || !out) return -EINVAL;
+    *out = NULL;
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return -errno;
+
+    Ledger *l = calloc(1, sizeof(Ledger));
+    if (!l) return -ENOMEM;
+    l->flags = flags;
+    for (int i = 0; i < IDX_COUNT; i++) l->idx[i].fd = -1;
+    pthread_rwlock_init(&l->lock, NULL);
+
+    char path[PATH_MAX];
+    int rc;
+    snprintf(path, sizeof(path), "%s/ledger.log", dir);
+    l->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (l->fd < 0) { rc = -errno; goto fail; }
+    if (flock(l->fd, LOCK_EX | LOCK_NB) != 0) {
+        rc = errno == EWOULDBLOCK ? -EBUSY : -errno;
+        goto fail;
+    }
+    struct stat st;
+    if (fstat(l->fd, &st) != 0) { rc = -errno; goto fail; }
+    l->log_len = (uint64_t)st.st_size;
+
+    for (int i = 0; i < IDX_COUNT; i++) {
+        if ((rc = idx_open(&l->idx[i], dir, IDX_NAMES[i], l->log_len, &l->open_stats.rebuilt)) != 0) goto fail;
+    }
+    if ((rc = replay(l)) != 0) goto fail;
+    l->ready = 1;
+    *out = l;
+    return 0;
+
+fail:
+    ledger_close(l);
+    return rc;
+}
+
+void ledger_close(Ledger *l) {
+    if (!l) return;
+    /* unsynced appends (LEDGER_OPEN_NOSYNC) become durable and covered here */
+    if (l->ready) ledger_sync(l);
+    for (int i = 0; i < IDX_COUNT; i++) idx_unmap(&l->idx[i]);
+    if (l->fd >= 0) close(l->fd);
+    pthread_rwlock_destroy(&l->lock);
+    free(l);
+}
+
+int ledger_entry_from_cert(X509 *cert, const UsbDeviceInfo *info, LedgerEntry *e) {
+    if (!cert || !e) return -EINVAL;
+    memset(e, 0, sizeof(*e));
+
+    BIGNUM *bn = ASN1_INTEGER_to_BN(X509_get0_serialNumber(cert), NULL);
+    int n = bn ? BN_num_bytes(bn) : -1;
+    if (n < 0 || n > LEDGER_SERIAL_MAX) {
+        BN_free(bn);
+        return -EINVAL;
+    }
+    e->serial_len = (size_t)BN_bn2bin(bn, e->serial);
+    BN_free(bn);
+
+    X509_NAME_oneline(X509_get_subject_name(cert), e->subject, sizeof(e->subject));
+    struct tm tm;
+    if (ASN1_TIME_to_tm(X509_get0_notBefore(cert), &tm) == 1) e->not_before = (int64_t)timegm(&tm);
+    if (ASN1_TIME_to_tm(X509_get0_notAfter(cert), &tm) == 1) e->not_after = (int64_t)timegm(&tm);
+    e->issued_at = (int64_t)time(NULL);
+    unsigned int md_len = 0;
+    if (X509_digest(cert, EVP_sha256(), e->sha256, &md_len) != 1) return -EINVAL;
+
+    if (info) {
+        if (info->id) snprintf(e->device_id, sizeof(e->device_id), "%s", info->id);
+        if (info->serial) snprintf(e->device_serial, sizeof(e->device_serial), "%s", info->serial);
+    }
+    return 0;
+}
+
+int ledger_append(Ledger *l, LedgerEntry *e) {
+    if (!l || !e || e->serial_len == 0 || e->serial_len > LEDGER_SERIAL_MAX) return -EINVAL;
+    unsigned char buf[REC_MAX];
+    size_t len = rec_encode(e, buf);
+
+    pthread_rwlock_wrlock(&l->lock);
+    uint64_t off = l->log_len;
+    int rc = 0;
+    ssize_t n = write(l->fd, buf, len);
+    if (n != (ssize_t)len) {
+        rc = n < 0 ? -errno : -EIO;
+        /* never leave a partial record in front of the next append */
+        if (n > 0 && ftruncate(l->fd, (off_t)off) != 0) rc = -errno;
+    } else if (!(l->flags & LEDGER_OPEN_NOSYNC) && fdatasync(l->fd) != 0) {
+        rc = -errno;
+    }
+    if (rc == 0) {
+        l->log_len += len;
+        l->records++;
+        e->offset = off;
+        uint64_t from[IDX_COUNT] = { 0 };
+        /* the record is in the log; an index failure only costs a replay at next open.
+         * Without NOSYNC the indexes cover it on return, otherwise from ledger_sync on. */
+        if (index_entry(l, e, off, from) == 0 && !(l->flags & LEDGER_OPEN_NOSYNC)) {
+            for (int i = 0; i < IDX_COUNT; i++) idx_checkpoint(&l->idx[i], l->log_len, l->records);
+        }
+    }
+    pthread_rwlock_unlock(&l->lock);
+    return rc;
+}
+
+int ledger_sync(Ledger *l) {
+    if (!l) return -EINVAL;
+    pthread_rwlock_wrlock(&l->lock);
+    int rc = fdatasync(l->fd) == 0 ? 0 : -errno;
+    for (int i = 0; i < IDX_COUNT && rc == 0; i++) rc = idx_checkpoint(&l->idx[i], l->log_len, l->records);
+    pthread_rwlock_unlock(&l->lock);
+    return rc;
+}
+
+/* Offsets of the records whose key hash matches, in probe order: up to max are stored,
+ * the number of matches is returned */
+static size_t idx_candidates(const LedgerIndex *x, uint64_t hash, uint64_t *offs, size_t max) {
+    uint64_t mask = x->capacity - 1;
+    size_t n = 0;
+    for (uint64_t i = hash & mask; x->slots[i].off1; i = (i + 1) & mask) {
+        if (x->slots[i].hash != hash) continue;
+        if (n < max) offs[n] = x->slots[i].off1 - 1;
+        n++;
+    }
+    return n;
+}
+
+int ledger_find_serial(Ledger *l, const unsigned char *serial, size_t serial_len, LedgerEntry *out) {
+    if (!l || !serial || !out || serial_len == 0 || serial_len > LEDGER_SERIAL_MAX) return -EINVAL;
+    uint64_t offs[16];
+    pthread_rwlock_rdlock(&l->lock);
+    size_t n = idx_candidates(&l->idx[IDX_SERIAL], key_hash(serial, serial_len), offs, 16);
+    int rc = -ENOENT;
+    for (size_t i = 0; i < n; i++) {
+        if (rec_read(l, offs[i], out) > 0 && out->serial_len == serial_len &&
+            memcmp(out->serial, serial, serial_len) == 0) {
+            rc = 0;
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&l->lock);
+    return rc;
+}
+
+static int cmp_off_desc(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+int ledger_find_device_serial(Ledger *l, const char *device_serial, LedgerEntry *out, size_t max) {
+    if (!l || !device_serial || !device_serial[0] || (max && !out)) return -EINVAL;
+    uint64_t stack[256], *offs = stack;
+    uint64_t hash = key_hash(device_serial, strlen(device_serial));
+    pthread_rwlock_rdlock(&l->lock);
+    size_t n = idx_candidates(&l->idx[IDX_DEVICE], hash, offs, 256);
+    if (n > 256) {
+        /* a stick re-provisioned more often than that: collect all of them */
+        if (!(offs = malloc(n * sizeof(*offs)))) {
+            pthread_rwlock_unlock(&l->lock);
+            return -ENOMEM;
+        }
+        idx_candidates(&l->idx[IDX_DEVICE], hash, offs, n);
+    }
+    qsort(offs, n, sizeof(uint64_t), cmp_off_desc);
+    int found = 0;
+    for (size_t i = 0; i < n; i++) {
+        LedgerEntry e;
+        if (rec_read(l, offs[i], &e) <= 0 || strcmp(e.device_serial, device_serial) != 0) continue;
+        if ((size_t)found < max) out[found] = e;
+        found++;
+    }
+    pthread_rwlock_unlock(&l->lock);
+    if (offs != stack) free(offs);
+    return found;
+}
+
+int ledger_foreach(Ledger *l, int (*cb)(const LedgerEntry *e, void *user), void *user) {
+    if (!l || !cb) return -EINVAL;
+    pthread_rwlock_rdlock(&l->lock);
+    int rc = 0;
+    for (uint64_t off = 0; off < l->log_len && rc == 0;) {
+        LedgerEntry e;
+        int len = rec_read(l, off, &e);
+        if (len < 0) {
+            rc = len;
+            break;
+        }
+        rc = cb(&e, user);
+        off += (uint64_t)len;
+    }
+    pthread_rwlock_unlock(&l->lock);
+    return rc;
+}
+
+void ledger_get_stats(Ledger *l, LedgerStats *st) {
+    if (!st) return;
+    memset(st, 0, sizeof(*st));
+    if (!l) return;
+    pthread_rwlock_rdlock(&l->lock);
+    *st = l->open_stats;
+    st->records = l->records;
+    st->log_bytes = l->log_len;
+    pthread_rwlock_unlock(&l->lock);
+}
+
+void ledger_serial_hex(const LedgerEntry *e, char *buf, size_t len) {
+    static const char HEX[] = "0123456789ABCDEF";
+    size_t o = 0;
+    for (size_t i = 0; e && i < e->serial_len && o + 2 < len; i++) {
+        buf[o++] = HEX[e->serial[i] >> 4];
+        buf[o++] = HEX[e->serial[i] & 15];
+    }
+    if (len) buf[o] = '\0';
+}
+
+int ledger_serial_from_hex(const char *hex, unsigned char *out, size_t *out_len) {
+    if (!hex || !out || !out_len) return -EINVAL;
+    size_t n = strlen(hex);
+    if (n == 0 || n > 2 * LEDGER_SERIAL_MAX) return -EINVAL;
+    /* odd length: implied leading zero nibble */
+    size_t bytes = (n + 1) / 2, o = 0;
+    for (size_t i = 0; i < n;) {
+        int v = 0;
+        for (int k = (i == 0 && (n & 1)) ? 1 : 0; k < 2; k++, i++) {
+            char c = hex[i];
+            int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                  : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+            if (d < 0) return -EINVAL;
+            v = v << 4 | d;
+        }
+        out[o++] = (unsigned char)v;
+    }
+    /* serials are stored without leading zero bytes, as BN_bn2bin produces them */
+    size_t skip = 0;
+    while (skip + 1 < bytes && out[skip] == 0) skip++;
+    memmove(out, out + skip, bytes - skip);
+    *out_len = bytes - skip;
+    return 0;
+}
@@ -0,0 +1,231 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../inc/metrics.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Histogram upper bounds (the last bucket is +Inf)
+static const uint64_t BUCKET_NS[] = {
+    1000000, 5000000, 10000000, 50000000, 100000000, 500000000,
+    1000000000, 5000000000, 10000000000, 30000000000,
+};
+#define BUCKETS (sizeof(BUCKET_NS) / sizeof(BUCKET_NS[0]))
+#define MAX_FAILURE_KEYS 64
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t buckets[BUCKETS + 1];      // non-cumulative; summed on export
+} SpanHist;
+
+typedef struct {
+    MetricStage stage;
+    int code;
+    uint64_t count;
+} FailureKey;
+
+static const char *STAGE_NAMES[METRIC_STAGE_COUNT] = {
+    "info", "key", "csr", "sign", "write", "embed",
+    "partition", "sig_write", "verify", "settle", "script", "dbus",
+    "clone", "clone_wait", "format",
+};
+
+static const struct { const char *name, *help; } COUNTERS[METRIC_COUNTER_COUNT] = {
+    { "usb_provision_devices_total", "Devices provisioned successfully" },
+    { "usb_provision_devices_failed_total", "Devices whose provisioning failed" },
+    { "usb_provision_bytes_written_total", "Bytes written or zeroed on target devices" },
+};
+
+int metrics_on;
+static SpanHist g_spans[METRIC_STAGE_COUNT];
+static uint64_t g_counters[METRIC_COUNTER_COUNT];
+// failures are rare: a small table under a lock
+static pthread_mutex_t g_fail_lock = PTHREAD_MUTEX_INITIALIZER;
+static FailureKey g_failures[MAX_FAILURE_KEYS];
+static size_t g_nfailures;
+static uint64_t g_failures_dropped;
+
+void metrics_enable(int on) {
+    __atomic_store_n(&metrics_on, on ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_record_span(MetricStage stage, uint64_t ns) {
+    if ((unsigned)stage >= METRIC_STAGE_COUNT) return;
+    SpanHist *h = &g_spans[stage];
+    size_t b = 0;
+    while (b < BUCKETS && ns > BUCKET_NS[b]) b++;
+    __atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&h->max_ns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void metrics_record_add(MetricCounter counter, uint64_t n) {
+    if ((unsigned)counter >= METRIC_COUNTER_COUNT) return;
+    __atomic_fetch_add(&g_counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void metrics_record_failure(MetricStage stage, int code) {
+    if ((unsigned)stage >= METRIC_STAGE_COUNT) return;
+    pthread_mutex_lock(&g_fail_lock);
+    size_t i = 0;
+    while (i < g_nfailures && (g_failures[i].stage != stage || g_failures[i].code != code)) i++;
+    if (i < g_nfailures) {
+        g_failures[i].count++;
+    } else if (g_nfailures < MAX_FAILURE_KEYS) {
+        g_failures[g_nfailures++] = (FailureKey){ stage, code, 1 };
+    } else {
+        g_failures_dropped++;
+    }
+    pthread_mutex_unlock(&g_fail_lock);
+}
+
+void metrics_span_stats(MetricStage stage, MetricSpanStats *out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if ((unsigned)stage >= METRIC_STAGE_COUNT) return;
+    out->count = __atomic_load_n(&g_spans[stage].count, __ATOMIC_RELAXED);
+    out->sum_ns = __atomic_load_n(&g_spans[stage].sum_ns, __ATOMIC_RELAXED);
+    out->max_ns = __atomic_load_n(&g_spans[stage].max_ns, __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_counter(MetricCounter counter) {
+    if ((unsigned)counter >= METRIC_COUNTER_COUNT) return 0;
+    return __atomic_load_n(&g_counters[counter], __ATOMIC_RELAXED);
+}
+
+void metrics_reset(void) {
+    pthread_mutex_lock(&g_fail_lock);
+    memset(g_spans, 0, sizeof(g_spans));
+    memset(g_counters, 0, sizeof(g_counters));
+    g_nfailures = 0;
+    g_failures_dropped = 0;
+    pthread_mutex_unlock(&g_fail_lock);
+}
+
+const char *metrics_stage_name(MetricStage stage) {
+    if ((unsigned)stage >= METRIC_STAGE_COUNT) return "?";
+    return STAGE_NAMES[stage];
+}
+
+/* Copy of the failure table, so export does not hold the lock while writing */
+static size_t failures_snapshot(FailureKey *out, uint64_t *dropped) {
+    pthread_mutex_lock(&g_fail_lock);
+    size_t n = g_nfailures;
+    memcpy(out, g_failures, n * sizeof(FailureKey));
+    *dropped = g_failures_dropped;
+    pthread_mutex_unlock(&g_fail_lock);
+    return n;
+}
+
+int metrics_write_prometheus(FILE *out) {
+    if (!out) return -EINVAL;
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", COUNTERS[c].name, COUNTERS[c].help,
+                COUNTERS[c].name, COUNTERS[c].name, (unsigned long long)metrics_counter(c));
+    }
+
+    FailureKey fails[MAX_FAILURE_KEYS];
+    uint64_t dropped;
+    size_t nfails = failures_snapshot(fails, &dropped);
+    fprintf(out, "# HELP usb_provision_failures_total Failed stages by return code\n"
+                 "# TYPE usb_provision_failures_total counter\n");
+    for (size_t i = 0; i < nfails; i++) {
+        fprintf(out, "usb_provision_failures_total{stage=\"%s\",code=\"%d\"} %llu\n",
+                STAGE_NAMES[fails[i].stage], fails[i].code, (unsigned long long)fails[i].count);
+    }
+    if (dropped) fprintf(out, "usb_provision_failures_total{stage=\"other\",code=\"other\"} %llu\n",
+                         (unsigned long long)dropped);
+
+    fprintf(out, "# HELP usb_provision_stage_seconds Time spent per pipeline stage\n"
+                 "# TYPE usb_provision_stage_seconds histogram\n");
+    for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+        const SpanHist *h = &g_spans[s];
+        uint64_t count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        if (count == 0) continue;
+        uint64_t cum = 0;
+        for (size_t b = 0; b < BUCKETS; b++) {
+            cum += __atomic_load_n(&h->buckets[b], __ATOMIC_RELAXED);
+            fprintf(out, "usb_provision_stage_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                    STAGE_NAMES[s], BUCKET_NS[b] / 1e9, (unsigned long long)cum);
+        }
+        cum += __atomic_load_n(&h->buckets[BUCKETS], __ATOMIC_RELAXED);
+        fprintf(out, "usb_provision_stage_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                STAGE_NAMES[s], (unsigned long long)cum);
+        fprintf(out, "usb_provision_stage_seconds_sum{stage=\"%s\"} %.9f\n", STAGE_NAMES[s],
+                __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) / 1e9);
+        fprintf(out, "usb_provision_stage_seconds_count{stage=\"%s\"} %llu\n", STAGE_NAMES[s],
+                (unsigned long long)cum);
+    }
+    return ferror(out) ? -EIO : 0;
+}
+
+int metrics_write_json(FILE *out) {
+    if (!out) return -EINVAL;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    fprintf(out, "{\"ts\":%lld.%03ld,\"counters\":{\"devices_provisioned\":%llu,\"devices_failed\":%llu,"
+                 "\"bytes_written\":%llu},\"stages\":{",
+            (long long)ts.tv_sec, ts.tv_nsec / 1000000,
+            (unsigned long long)metrics_counter(METRIC_DEVICES_PROVISIONED),
+            (unsigned long long)metrics_counter(METRIC_DEVICES_FAILED),
+            (unsigned long long)metrics_counter(METRIC_BYTES_WRITTEN));
+    int first = 1;
+    for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+        MetricSpanStats st;
+        metrics_span_stats(s, &st);
+        if (st.count == 0) continue;
+        fprintf(out, "%s\"%s\":{\"count\":%llu,\"sum_s\":%.6f,\"max_s\":%.6f}", first ? "" : ",",
+                STAGE_NAMES[s], (unsigned long long)st.count, st.sum_ns / 1e9, st.max_ns / 1e9);
+        first = 0;
+    }
+    fputs("},\"failures\":[", out);
+
+    FailureKey fails[MAX_FAILURE_KEYS];
+    uint64_t dropped;
+    size_t nfails = failures_snapshot(fails, &dropped);
+    for (size_t i = 0; i < nfails; i++) {
+        fprintf(out, "%s{\"stage\":\"%s\",\"code\":%d,\"count\":%llu}", i ? "," : "",
+                STAGE_NAMES[fails[i].stage], fails[i].code, (unsigned long long)fails[i].count);
+    }
+    fputs("]}\n", out);
+    return ferror(out) ? -EIO : 0;
+}
+
+int metrics_export(const char *path) {
+    if (!path || !path[0]) return -EINVAL;
+    size_t len = strlen(path);
+    int prom = len > 5 && strcmp(path + len - 5, ".prom") == 0;
+    if (!prom) {
+        FILE *f = fopen(path, "a");
+        if (!f) return -errno;
+        int rc = metrics_write_json(f);
+        if (fclose(f) != 0 && rc == 0) rc = -errno;
+        return rc;
+    }
+
+    // scrapers must never see a half-written file
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid()) >= (int)sizeof(tmp))
+        return -ENAMETOOLONG;
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -errno;
+    int rc = metrics_write_prometheus(f);
+    if (fclose(f) != 0 && rc == 0) rc = -errno;
+    if (rc == 0 && rename(tmp, path) != 0) rc = -errno;
+    if (rc != 0) unlink(tmp);
+    return rc;
+}
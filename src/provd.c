@@ -0,0 +1,684 @@
+#define _GNU_SOURCE
+#include "../inc/provd.h"
+#include "../inc/audit.h"
+#include "../inc/cert_verify.h"
+#include "../inc/usb_info.h"
+#include "../inc/usbguard_client.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LANE_STATION 0          /* provision + renew */
+#define LANE_VERIFY  1
+#define LANE_COUNT   2
+
+typedef struct ProvdJob {
+    struct ProvdJob *next;
+    size_t conn;                /* connection slot and its generation at submission */
+    uint32_t gen;
+    uint32_t id;
+    ProvdOp op;
+    double received;
+    int rc;
+    uint8_t detail;
+    uint8_t from_cache;
+    char text[PATH_MAX];
+    char device[];
+} ProvdJob;
+
+typedef struct {
+    ProvdServer *server;
+    int index;
+    ProvdJob *head, *tail;
+    size_t count;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int started;
+} ProvdLane;
+
+/* Socket-thread only */
+typedef struct {
+    int fd;                     /* -1 = free slot */
+    uint32_t gen;
+    int eof;                    /* peer shut down its side: close once the replies are out */
+    int stalled;                /* a complete frame waits for queue space */
+    size_t inflight;
+    size_t in_len;
+    unsigned char in[PROVD_HEADER_SIZE + PROVD_MAX_PAYLOAD];
+    unsigned char *out;
+    size_t out_off, out_len, out_cap;
+} ProvdConn;
+
+struct ProvdServer {
+    ProvdConfig cfg;
+    char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int listen_fd;
+    int wake[2];
+    CaSigner *signer;
+    CertVerifier *verifier;
+    UsbGuardClient *guard;
+
+    pthread_mutex_t lock;       /* lanes, done list, queued, stopping, stats */
+    ProvdLane lanes[LANE_COUNT];
+    ProvdJob *done_head, *done_tail;
+    size_t queued;
+    int stopping;
+    ProvdStats stats;
+
+    ProvdConn *conns;
+    size_t nconns;
+    pthread_t loop;
+    int loop_started;
+};
+
+static const char *OP_NAMES[PROVD_OP_COUNT] = { "ping", "provision", "renew", "verify", "stats" };
+
+const char *provd_op_name(ProvdOp op) {
+    return (unsigned)op < PROVD_OP_COUNT ? OP_NAMES[op] : "unknown";
+}
+
+void provd_config_init(ProvdConfig *cfg) {
+    if (!cfg) return;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->socket_path = PROVD_SOCKET_PATH;
+    station_config_init(&cfg->station);
+    cfg->use_usbguard = 1;
+    cfg->verify_cache = 256;
+    cfg->queue_depth = 256;
+    cfg->conn_inflight = 64;
+    cfg->batch_max = 16;
+    cfg->batch_window_ms = 2;
+    cfg->peer_uid = geteuid();
+    cfg->peer_gid = getegid();
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void put_le16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void wake_loop(ProvdServer *s) {
+    char b = 1;
+    ssize_t n = write(s->wake[1], &b, 1);    /* pipe full: a wake-up is already pending */
+    (void)n;
+}
+
+/* ---------- lanes ---------- */
+
+static void run_station_batch(ProvdServer *s, ProvdJob **jobs, size_t n, ProvdOp op) {
+    const char **devices = calloc(n, sizeof(*devices));
+    StationResult *results = calloc(n, sizeof(*results));
+    ProvdJob **mine = calloc(n, sizeof(*mine));
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (jobs[i]->op != op) continue;
+        if (!devices || !results || !mine) {
+            jobs[i]->rc = -ENOMEM;
+            continue;
+        }
+        mine[m] = jobs[i];
+        devices[m++] = jobs[i]->device;
+    }
+    if (m > 0) {
+        StationConfig cfg = s->cfg.station;
+        cfg.renew = op == PROVD_OP_RENEW;
+        cfg.signer = s->signer;
+        station_run(&cfg, devices, m, results);
+    }
+    for (size_t i = 0; i < m; i++) {
+        const StationResult *r = &results[i];
+        mine[i]->detail = (uint8_t)r->stage;
+        mine[i]->rc = r->stage == STATION_STAGE_DONE ? 0 : r->rc < 0 ? r->rc : -EIO;
+        snprintf(mine[i]->text, sizeof(mine[i]->text), "%s", r->stage == STATION_STAGE_DONE ? r->cert_path : "");
+    }
+    free(mine);
+    free(results);
+    free(devices);
+}
+
+/* One USBGuard listing for the whole batch; sysfs identity when USBGuard is unavailable */
+static void run_verify_batch(ProvdServer *s, ProvdJob **jobs, size_t n) {
+    UsbDeviceList *guard = NULL;
+    if (s->guard && usbguard_client_list_devices(s->guard, "match", &guard) != 0) guard = NULL;
+    for (size_t i = 0; i < n; i++) {
+        ProvdJob *j = jobs[i];
+        UsbDeviceInfo *block = usb_info_from_block_device(j->device);
+        const UsbDeviceInfo *expected = cert_verify_match_usbguard(guard, block);
+        VerifyResult r;
+        j->detail = (uint8_t)cert_verify_device(s->verifier, j->device, expected ? expected : block, &r);
+        j->from_cache = (uint8_t)r.from_cache;
+        j->rc = 0;
+        snprintf(j->text, sizeof(j->text), "%s", r.subject_cn);
+        usb_info_free(block);
+    }
+    usbguard_free_device_list(guard);
+}
+
+/* Called with the lock held: up to batch_max jobs off the lane, never the same device twice
+ * in one provisioning batch (the second request waits for the next one). */
+static size_t take_batch(ProvdServer *s, ProvdLane *lane, ProvdJob **batch) {
+    size_t n = 0;
+    ProvdJob **link = &lane->head;
+    lane->tail = NULL;
+    while (*link) {
+        ProvdJob *j = *link;
+        int keep = n == s->cfg.batch_max;
+        for (size_t k = 0; lane->index == LANE_STATION && k < n && !keep; k++)
+            keep = strcmp(batch[k]->device, j->device) == 0;
+        if (keep) {
+            lane->tail = j;
+            link = &j->next;
+            continue;
+        }
+        *link = j->next;
+        j->next = NULL;
+        batch[n++] = j;
+    }
+    lane->count -= n;
+    s->queued -= n;
+    return n;
+}
+
+static void *provd_lane(void *arg) {
+    ProvdLane *lane = arg;
+    ProvdServer *s = lane->server;
+    ProvdJob **batch = calloc(s->cfg.batch_max, sizeof(*batch));
+    if (!batch) return NULL;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!lane->head && !s->stopping) pthread_cond_wait(&lane->cond, &s->lock);
+        if (s->stopping) break;
+        /* a burst rarely arrives in one read: give it the window to fill the batch. Verify
+         * batches only take what queued up meanwhile, a lone plug-in check must not wait. */
+        if (lane->index == LANE_STATION && lane->count < s->cfg.batch_max && s->cfg.batch_window_ms > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += (long)s->cfg.batch_window_ms * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            while (!s->stopping && lane->count < s->cfg.batch_max &&
+                   pthread_cond_timedwait(&lane->cond, &s->lock, &deadline) != ETIMEDOUT)
+                ;
+            if (s->stopping) break;
+        }
+        size_t n = take_batch(s, lane, batch);
+        pthread_mutex_unlock(&s->lock);
+
+        if (lane->index == LANE_VERIFY) {
+            run_verify_batch(s, batch, n);
+        } else {
+            run_station_batch(s, batch, n, PROVD_OP_PROVISION);
+            run_station_batch(s, batch, n, PROVD_OP_RENEW);
+        }
+
+        pthread_mutex_lock(&s->lock);
+        for (size_t i = 0; i < n; i++) {
+            if (s->done_tail) s->done_tail->next = batch[i];
+            else s->done_head = batch[i];
+            s->done_tail = batch[i];
+        }
+        s->stats.completed += n;
+        s->stats.batches++;
+        if (n > s->stats.max_batch) s->stats.max_batch = n;
+        wake_loop(s);
+    }
+    pthread_mutex_unlock(&s->lock);
+    free(batch);
+    return NULL;
+}
+
+/* ---------- socket thread ---------- */
+
+static void conn_close(ProvdConn *c) {
+    close(c->fd);
+    free(c->out);
+    uint32_t gen = c->gen + 1;
+    memset(c, 0, sizeof(*c));
+    c->fd = -1;
+    c->gen = gen;
+}
+
+static int conn_reply(ProvdConn *c, uint32_t id, ProvdOp op, int rc, uint8_t detail, uint8_t from_cache,
+                      double service_s, const char *text) {
+    size_t tlen = text ? strlen(text) : 0;
+    if (tlen > PROVD_MAX_PAYLOAD - PROVD_REPLY_FIXED) tlen = PROVD_MAX_PAYLOAD - PROVD_REPLY_FIXED;
+    size_t need = PROVD_HEADER_SIZE + PROVD_REPLY_FIXED + tlen;
+    if (c->out_off > 0 && c->out_off == c->out_len) c->out_off = c->out_len = 0;
+    if (c->out_len + need > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < c->out_len + need) cap *= 2;
+        unsigned char *p = realloc(c->out, cap);
+        if (!p) return -ENOMEM;
+        c->out = p;
+        c->out_cap = cap;
+    }
+    unsigned char *p = c->out + c->out_len;
+    put_le32(p, (uint32_t)(PROVD_REPLY_FIXED + tlen));
+    put_le32(p + 4, id);
+    p[8] = (unsigned char)(op | PROVD_OP_REPLY);
+    p[9] = 0;
+    put_le16(p + 10, 0);
+    p += PROVD_HEADER_SIZE;
+    put_le32(p, (uint32_t)rc);
+    p[4] = detail;
+    p[5] = from_cache;
+    put_le16(p + 6, 0);
+    double us = service_s * 1e6;
+    put_le32(p + 8, us < 0 ? 0 : us > 4e9 ? 0xFFFFFFFFu : (uint32_t)us);
+    memcpy(p + PROVD_REPLY_FIXED, text, tlen);
+    c->out_len += need;
+    return 0;
+}
+
+/* Returns -1 when the connection has to be closed */
+static int conn_flush(ProvdConn *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) return -1;
+        c->out_off += (size_t)n;
+    }
+    c->out_off = c->out_len = 0;
+    return 0;
+}
+
+static void stats_json(ProvdServer *s, char *out, size_t outsz) {
+    VerifyCacheStats vc;
+    cert_verifier_cache_stats(s->verifier, &vc);
+    pthread_mutex_lock(&s->lock);
+    ProvdStats st = s->stats;
+    size_t queued = s->queued;
+    pthread_mutex_unlock(&s->lock);
+    snprintf(out, outsz,
+             "{\"connections\":%llu,\"requests\":%llu,\"completed\":%llu,\"queued\":%zu,\"queue_peak\":%zu,"
+             "\"batches\":%llu,\"max_batch\":%zu,\"stalls\":%llu,\"refused\":%llu,"
+             "\"verify_cache\":{\"hits\":%llu,\"misses\":%llu,\"entries\":%zu}}",
+             (unsigned long long)st.connections, (unsigned long long)st.requests,
+             (unsigned long long)st.completed, queued, st.queue_peak, (unsigned long long)st.batches,
+             st.max_batch, (unsigned long long)st.stalls, (unsigned long long)st.refused,
+             (unsigned long long)vc.hits,
+             (unsigned long long)vc.misses, vc.entries);
+}
+
+/* Queue a provision / renew / verify request. Returns 0, 1 if there is no room (the frame
+ * stays buffered), or a negative errno for the reply. */
+static int submit_job(ProvdServer *s, size_t slot, ProvdConn *c, uint32_t id, ProvdOp op,
+                      const unsigned char *path, size_t len) {
+    if (len == 0 || path[0] != '/' || memchr(path, 0, len)) return -EINVAL;
+    char device[PROVD_MAX_PAYLOAD + 1];
+    memcpy(device, path, len);
+    device[len] = '\0';
+    struct stat st;
+    int image = s->cfg.allow_image_files && stat(device, &st) == 0 && S_ISREG(st.st_mode);
+    if (!image && !audit_is_usb_disk(device, s->cfg.device_flags)) return -ENODEV;
+    pthread_mutex_lock(&s->lock);
+    int full = s->queued >= s->cfg.queue_depth || c->inflight >= s->cfg.conn_inflight;
+    if (full && !c->stalled) s->stats.stalls++;
+    pthread_mutex_unlock(&s->lock);
+    c->stalled = full;
+    if (full) return 1;
+
+    ProvdJob *j = calloc(1, sizeof(*j) + len + 1);
+    if (!j) return -ENOMEM;
+    j->conn = slot;
+    j->gen = c->gen;
+    j->id = id;
+    j->op = op;
+    j->received = now_seconds();
+    memcpy(j->device, path, len);
+
+    ProvdLane *lane = &s->lanes[op == PROVD_OP_VERIFY ? LANE_VERIFY : LANE_STATION];
+    pthread_mutex_lock(&s->lock);
+    if (lane->tail) lane->tail->next = j;
+    else lane->head = j;
+    lane->tail = j;
+    lane->count++;
+    if (++s->queued > s->stats.queue_peak) s->stats.queue_peak = s->queued;
+    s->stats.requests++;
+    pthread_cond_signal(&lane->cond);
+    pthread_mutex_unlock(&s->lock);
+    c->inflight++;
+    return 0;
+}
+
+/* Handle every complete frame in the input buffer. Returns -1 on a protocol error. */
+static int conn_parse(ProvdServer *s, size_t slot) {
+    ProvdConn *c = &s->conns[slot];
+    size_t off = 0;
+    int rc = 0;
+    while (c->in_len - off >= PROVD_HEADER_SIZE) {
+        const unsigned char *h = c->in + off;
+        uint32_t len = get_le32(h), id = get_le32(h + 4);
+        ProvdOp op = (ProvdOp)h[8];
+        if (len > PROVD_MAX_PAYLOAD) {
+            rc = -1;
+            break;
+        }
+        if (c->in_len - off < PROVD_HEADER_SIZE + len) break;
+        const unsigned char *payload = h + PROVD_HEADER_SIZE;
+        int r = 0;
+        if (op == PROVD_OP_PING) {
+            r = conn_reply(c, id, op, 0, 0, 0, 0, "");
+        } else if (op == PROVD_OP_STATS) {
+            char json[1024];
+            stats_json(s, json, sizeof(json));
+            r = conn_reply(c, id, op, 0, 0, 0, 0, json);
+        } else if (op == PROVD_OP_PROVISION || op == PROVD_OP_RENEW || op == PROVD_OP_VERIFY) {
+            int q = submit_job(s, slot, c, id, op, payload, len);
+            if (q == 1) break;
+            if (q < 0) r = conn_reply(c, id, op, q, 0, 0, 0, "");
+        } else {
+            r = conn_reply(c, id, op, -EOPNOTSUPP, 0, 0, 0, "");
+        }
+        if (r != 0) {
+            rc = -1;
+            break;
+        }
+        off += PROVD_HEADER_SIZE + len;
+    }
+    if (off > 0) {
+        memmove(c->in, c->in + off, c->in_len - off);
+        c->in_len -= off;
+    }
+    return rc;
+}
+
+/* Returns -1 when the connection has to be closed */
+static int conn_read(ProvdServer *s, size_t slot) {
+    ProvdConn *c = &s->conns[slot];
+    ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, MSG_DONTWAIT);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    if (n == 0) {
+        c->eof = 1;
+        return 0;
+    }
+    c->in_len += (size_t)n;
+    return conn_parse(s, slot);
+}
+
+static int peer_allowed(const ProvdServer *s, int fd) {
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) return 0;
+    return cred.uid == 0 || cred.uid == s->cfg.peer_uid ||
+           (s->cfg.peer_gid != (gid_t)-1 && cred.gid == s->cfg.peer_gid);
+}
+
+static void accept_all(ProvdServer *s) {
+    for (;;) {
+        int fd = accept4(s->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        if (!peer_allowed(s, fd)) {
+            close(fd);
+            pthread_mutex_lock(&s->lock);
+            s->stats.refused++;
+            pthread_mutex_unlock(&s->lock);
+            continue;
+        }
+        size_t slot = 0;
+        while (slot < s->nconns && s->conns[slot].fd >= 0) slot++;
+        if (slot == s->nconns) {
+            size_t n = s->nconns ? s->nconns * 2 : 16;
+            ProvdConn *p = realloc(s->conns, n * sizeof(*p));
+            if (!p) {
+                close(fd);
+                return;
+            }
+            for (size_t i = s->nconns; i < n; i++) {
+                memset(&p[i], 0, sizeof(p[i]));
+                p[i].fd = -1;
+            }
+            s->conns = p;
+            s->nconns = n;
+        }
+        s->conns[slot].fd = fd;
+        pthread_mutex_lock(&s->lock);
+        s->stats.connections++;
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/* Replies of finished batches go to their connections (if still open) */
+static void deliver_done(ProvdServer *s) {
+    pthread_mutex_lock(&s->lock);
+    ProvdJob *j = s->done_head;
+    s->done_head = s->done_tail = NULL;
+    pthread_mutex_unlock(&s->lock);
+    double now = now_seconds();
+    while (j) {
+        ProvdJob *next = j->next;
+        ProvdConn *c = j->conn < s->nconns ? &s->conns[j->conn] : NULL;
+        if (c && c->fd >= 0 && c->gen == j->gen) {
+            c->inflight--;
+            if (conn_reply(c, j->id, j->op, j->rc, j->detail, j->from_cache, now - j->received, j->text) != 0)
+                conn_close(c);
+        }
+        free(j);
+        j = next;
+    }
+}
+
+static void *provd_loop(void *arg) {
+    ProvdServer *s = arg;
+    struct pollfd *pfds = NULL;
+    size_t *slots = NULL, pcap = 0;
+    for (;;) {
+        deliver_done(s);
+        pthread_mutex_lock(&s->lock);
+        int stopping = s->stopping;
+        pthread_mutex_unlock(&s->lock);
+        if (stopping) break;
+
+        if (pcap < s->nconns + 2) {
+            pcap = s->nconns + 2;
+            struct pollfd *p = realloc(pfds, pcap * sizeof(*p));
+            size_t *q = realloc(slots, pcap * sizeof(*q));
+            if (p) pfds = p;
+            if (q) slots = q;
+            if (!p || !q) break;
+        }
+        pfds[0] = (struct pollfd){ .fd = s->wake[0], .events = POLLIN };
+        pfds[1] = (struct pollfd){ .fd = s->listen_fd, .events = POLLIN };
+        size_t np = 2;
+        for (size_t i = 0; i < s->nconns; i++) {
+            ProvdConn *c = &s->conns[i];
+            if (c->fd < 0) continue;
+            /* frames held back for queue space, replies written meanwhile */
+            if ((c->stalled && conn_parse(s, i) != 0) || conn_flush(c) != 0 ||
+                (c->eof && !c->stalled && c->inflight == 0 && c->out_len == 0)) {
+                conn_close(c);
+                continue;
+            }
+            short ev = c->out_len > c->out_off ? POLLOUT : 0;
+            if (!c->eof && !c->stalled && c->in_len < sizeof(c->in)) ev |= POLLIN;
+            pfds[np] = (struct pollfd){ .fd = c->fd, .events = ev };
+            slots[np++] = i;
+        }
+        if (poll(pfds, np, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (pfds[0].revents & POLLIN) {
+            char buf[64];
+            while (read(s->wake[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+        for (size_t k = 2; k < np; k++) {
+            ProvdConn *c = &s->conns[slots[k]];
+            short re = pfds[k].revents;
+            if (c->fd < 0 || !re) continue;
+            if ((re & POLLERR) || ((re & POLLHUP) && !(re & POLLIN)) ||
+                ((re & POLLIN) && conn_read(s, slots[k]) != 0) || ((re & POLLOUT) && conn_flush(c) != 0))
+                conn_close(c);
+        }
+        if (pfds[1].revents & POLLIN) accept_all(s);
+    }
+    free(pfds);
+    free(slots);
+    return NULL;
+}
+
+/* ---------- lifecycle ---------- */
+
+static void free_jobs(ProvdJob *j) {
+    while (j) {
+        ProvdJob *next = j->next;
+        free(j);
+        j = next;
+    }
+}
+
+static void provd_free(ProvdServer *s) {
+    pthread_mutex_lock(&s->lock);
+    s->stopping = 1;
+    for (int i = 0; i < LANE_COUNT; i++) pthread_cond_broadcast(&s->lanes[i].cond);
+    pthread_mutex_unlock(&s->lock);
+    if (s->wake[1] >= 0) wake_loop(s);
+    if (s->loop_started) pthread_join(s->loop, NULL);
+    for (int i = 0; i < LANE_COUNT; i++) {
+        if (s->lanes[i].started) pthread_join(s->lanes[i].thread, NULL);
+        free_jobs(s->lanes[i].head);
+        pthread_cond_destroy(&s->lanes[i].cond);
+    }
+    free_jobs(s->done_head);
+    for (size_t i = 0; i < s->nconns; i++) {
+        if (s->conns[i].fd >= 0) conn_close(&s->conns[i]);
+    }
+    free(s->conns);
+    if (s->listen_fd >= 0) {
+        close(s->listen_fd);
+        unlink(s->socket_path);
+    }
+    if (s->wake[0] >= 0) close(s->wake[0]);
+    if (s->wake[1] >= 0) close(s->wake[1]);
+    usbguard_client_close(s->guard);
+    cert_verifier_free(s->verifier);
+    ca_signer_free(s->signer);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+}
+
+/* Bound, listening socket. A socket file nobody answers on is left over from a daemon that
+ * did not shut down cleanly and is replaced. */
+static int listen_socket(const char *path, int *fd_out) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) return -errno;
+    int live = connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    int probe_errno = errno;
+    close(probe);
+    if (live) return -EADDRINUSE;
+    if (probe_errno == ECONNREFUSED) unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -errno;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || chmod(path, 0660) != 0 || listen(fd, 128) != 0) {
+        int rc = -errno;
+        close(fd);
+        return rc;
+    }
+    *fd_out = fd;
+    return 0;
+}
+
+ProvdServer *provd_start(const ProvdConfig *cfg, int *error) {
+    int dummy;
+    if (!error) error = &dummy;
+    ProvdConfig defaults;
+    if (!cfg) {
+        provd_config_init(&defaults);
+        cfg = &defaults;
+    }
+    const char *path = cfg->socket_path ? cfg->socket_path : PROVD_SOCKET_PATH;
+    if (cfg->station.use_script || cfg->station.data_image) {
+        *error = -EINVAL;
+        return NULL;
+    }
+    ProvdServer *s = calloc(1, sizeof(*s));
+    if (!s) {
+        *error = -ENOMEM;
+        return NULL;
+    }
+    if (strlen(path) >= sizeof(s->socket_path)) {
+        free(s);
+        *error = -ENAMETOOLONG;
+        return NULL;
+    }
+    memcpy(s->socket_path, path, strlen(path) + 1);
+    s->cfg = *cfg;
+    if (!s->cfg.queue_depth) s->cfg.queue_depth = 256;
+    if (!s->cfg.conn_inflight) s->cfg.conn_inflight = 64;
+    if (!s->cfg.batch_max) s->cfg.batch_max = 16;
+    s->listen_fd = s->wake[0] = s->wake[1] = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    for (int i = 0; i < LANE_COUNT; i++) {
+        s->lanes[i].server = s;
+        s->lanes[i].index = i;
+        pthread_cond_init(&s->lanes[i].cond, NULL);
+    }
+
+    int rc = 0;
+    const StationConfig *st = &s->cfg.station;
+    s->signer = ca_signer_create(st->ca_cert_path, st->ca_key_path);
+    s->verifier = s->signer ? cert_verifier_create(st->ca_cert_path, s->cfg.verify_cache) : NULL;
+    if (!s->verifier) rc = -ENOENT;
+    if (rc == 0) {
+        ca_signer_set_serials(s->signer, st->serials);
+        if (s->cfg.revocation) cert_verifier_set_revocation(s->verifier, s->cfg.revocation);
+        if (s->cfg.use_usbguard) s->guard = usbguard_client_open(0);
+        rc = listen_socket(path, &s->listen_fd);
+    }
+    if (rc == 0 && pipe2(s->wake, O_NONBLOCK | O_CLOEXEC) != 0) rc = -errno;
+    for (int i = 0; i < LANE_COUNT && rc == 0; i++) {
+        if (pthread_create(&s->lanes[i].thread, NULL, provd_lane, &s->lanes[i]) != 0) rc = -EAGAIN;
+        else s->lanes[i].started = 1;
+    }
+    if (rc == 0) {
+        if (pthread_create(&s->loop, NULL, provd_loop, s) != 0) rc = -EAGAIN;
+        else s->loop_started = 1;
+    }
+    if (rc != 0) {
+        provd_free(s);
+        *error = rc;
+        return NULL;
+    }
+    *error = 0;
+    return s;
+}
+
+void provd_stop(ProvdServer *s) {
+    if (s) provd_free(s);
+}
+
+void provd_get_stats(ProvdServer *s, ProvdStats *stats) {
+    if (!s || !stats) return;
+    pthread_mutex_lock(&s->lock);
+    *stats = s->stats;
+    pthread_mutex_unlock(&s->lock);
+}
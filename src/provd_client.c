@@ -0,0 +1,93 @@
+#include "../inc/provd.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int provd_connect(const char *socket_path) {
+    const char *path = socket_path ? socket_path : PROVD_SOCKET_PATH;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) return -ENAMETOOLONG;
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -errno;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int rc = -errno;
+        close(fd);
+        return rc;
+    }
+    return fd;
+}
+
+static int write_all(int fd, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return w < 0 ? -errno : -EPIPE;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static int read_all(int fd, unsigned char *p, size_t n) {
+    while (n > 0) {
+        ssize_t r = recv(fd, p, n, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return r < 0 ? -errno : -EPIPE;
+        p += r;
+        n -= (size_t)r;
+    }
+    return 0;
+}
+
+int provd_send(int fd, uint32_t id, ProvdOp op, const char *device) {
+    size_t len = device ? strlen(device) : 0;
+    if (fd < 0 || (unsigned)op >= PROVD_OP_COUNT || len > PROVD_MAX_PAYLOAD) return -EINVAL;
+    /* one send per frame, so the daemon usually reads whole frames */
+    unsigned char frame[PROVD_HEADER_SIZE + PROVD_MAX_PAYLOAD];
+    put_le32(frame, (uint32_t)len);
+    put_le32(frame + 4, id);
+    frame[8] = (unsigned char)op;
+    frame[9] = frame[10] = frame[11] = 0;
+    if (len) memcpy(frame + PROVD_HEADER_SIZE, device, len);
+    return write_all(fd, frame, PROVD_HEADER_SIZE + len);
+}
+
+int provd_recv(int fd, ProvdReply *reply) {
+    if (fd < 0 || !reply) return -EINVAL;
+    unsigned char h[PROVD_HEADER_SIZE], body[PROVD_MAX_PAYLOAD];
+    int rc = read_all(fd, h, sizeof(h));
+    if (rc != 0) return rc;
+    uint32_t len = get_le32(h);
+    if (len < PROVD_REPLY_FIXED || len > PROVD_MAX_PAYLOAD || !(h[8] & PROVD_OP_REPLY)) return -EPROTO;
+    if ((rc = read_all(fd, body, len)) != 0) return rc;
+    reply->id = get_le32(h + 4);
+    reply->op = (ProvdOp)(h[8] & ~PROVD_OP_REPLY);
+    reply->rc = (int)get_le32(body);
+    reply->detail = body[4];
+    reply->from_cache = body[5];
+    reply->service_us = get_le32(body + 8);
+    memcpy(reply->text, body + PROVD_REPLY_FIXED, len - PROVD_REPLY_FIXED);
+    reply->text[len - PROVD_REPLY_FIXED] = '\0';
+    return 0;
+}
+
+int provd_call(int fd, ProvdOp op, const char *device, ProvdReply *reply) {
+    static uint32_t next_id;
+    uint32_t id = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+    int rc = provd_send(fd, id, op, device);
+    if (rc == 0) rc = provd_recv(fd, reply);
+    if (rc == 0 && reply->id != id) rc = -EPROTO;
+    return rc;
+}
@@ -0,0 +1,502 @@
+#define _DEFAULT_SOURCE
+#include "../inc/revocation.h"
+#include "../inc/cert_gen.h"
+#include "../inc/key_alg.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/bn.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+#define KEY_LEN REVOCATION_SERIAL_MAX
+#define BLOOM_BITS_PER_ENTRY 10
+#define BLOOM_HASHES 7
+#define FENCE_STRIDE 64         /* keys per fence: the fence array stays cache resident */
+
+typedef unsigned char SerialKey[KEY_LEN];   /* big-endian, left-padded with zeros */
+
+typedef struct {
+    SerialKey *keys;            /* sorted, unique */
+    size_t n;
+    SerialKey *fence;           /* keys[i * FENCE_STRIDE], narrows the search to one block */
+    size_t nfence;
+    uint64_t *bloom;
+    uint64_t bloom_mask;        /* bit count - 1 */
+    time_t this_update;
+    time_t next_update;
+    int64_t number;
+} RevSet;
+
+struct RevocationList {
+    RevSet *cur;                /* atomic; never NULL */
+    uint64_t epoch;             /* atomic; parity selects the reader counter */
+    uint64_t readers[2][8];     /* atomic; [i][0] used, padded to separate cache lines */
+    pthread_mutex_t reload_lock;
+    uint64_t generation;        /* under reload_lock */
+};
+
+/* ---------- serial keys ---------- */
+
+/* Normalise big-endian serial bytes (leading zeros ignored) to a fixed-width key */
+static int make_key(const unsigned char *serial, size_t len, SerialKey key) {
+    while (len > 0 && serial[0] == 0) { serial++; len--; }
+    if (len > KEY_LEN) return -EINVAL;
+    memset(key, 0, KEY_LEN);
+    memcpy(key + KEY_LEN - len, serial, len);
+    return 0;
+}
+
+static int key_from_hex(const char *hex, size_t n, SerialKey key) {
+    unsigned char buf[KEY_LEN];
+    if (n == 0 || n > 2 * KEY_LEN) return -EINVAL;
+    memset(buf, 0, sizeof(buf));
+    /* fill from the right, one nibble at a time */
+    for (size_t i = 0; i < n; i++) {
+        char c = hex[n - 1 - i];
+        int d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10
+              : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (d < 0) return -EINVAL;
+        buf[KEY_LEN - 1 - i / 2] |= (unsigned char)(i & 1 ? d << 4 : d);
+    }
+    memcpy(key, buf, KEY_LEN);
+    return 0;
+}
+
+static void key_to_hex(const SerialKey key, char *out) {
+    static const char HEX[] = "0123456789ABCDEF";
+    size_t i = 0;
+    while (i + 1 < KEY_LEN && key[i] == 0) i++;
+    char *p = out;
+    for (; i < KEY_LEN; i++) {
+        *p++ = HEX[key[i] >> 4];
+        *p++ = HEX[key[i] & 15];
+    }
+    *p = '\0';
+}
+
+static int key_cmp(const void *a, const void *b) {
+    return memcmp(a, b, KEY_LEN);
+}
+
+static void key_hashes(const SerialKey key, uint64_t *h1, uint64_t *h2) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < KEY_LEN; i++) h = (h ^ key[i]) * 0x100000001b3ull;
+    *h1 = h;
+    /* splitmix64 finaliser for an independent second hash; odd so every probe differs */
+    h += 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    *h2 = (h ^ (h >> 31)) | 1;
+}
+
+/* ---------- immutable sets ---------- */
+
+static void set_free(RevSet *s) {
+    if (!s) return;
+    free(s->keys);
+    free(s->fence);
+    free(s->bloom);
+    free(s);
+}
+
+/* Take ownership of keys[0..n): sort, drop duplicates, build the Bloom filter */
+static RevSet *set_build(SerialKey *keys, size_t n) {
+    RevSet *s = calloc(1, sizeof(RevSet));
+    if (!s) {
+        free(keys);
+        return NULL;
+    }
+    qsort(keys, n, KEY_LEN, key_cmp);
+    size_t u = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (u == 0 || memcmp(keys[u - 1], keys[i], KEY_LEN) != 0) memmove(keys[u++], keys[i], KEY_LEN);
+    }
+    s->keys = keys;
+    s->n = u;
+
+    uint64_t bits = 512;
+    while (bits < (uint64_t)u * BLOOM_BITS_PER_ENTRY) bits <<= 1;
+    s->bloom = calloc(bits / 64, sizeof(uint64_t));
+    s->nfence = (u + FENCE_STRIDE - 1) / FENCE_STRIDE;
+    s->fence = malloc((s->nfence ? s->nfence : 1) * sizeof(SerialKey));
+    if (!s->bloom || !s->fence) {
+        set_free(s);
+        return NULL;
+    }
+    s->bloom_mask = bits - 1;
+    for (size_t i = 0; i < s->nfence; i++) memcpy(s->fence[i], keys[i * FENCE_STRIDE], KEY_LEN);
+    for (size_t i = 0; i < u; i++) {
+        uint64_t h1, h2;
+        key_hashes(keys[i], &h1, &h2);
+        for (int k = 0; k < BLOOM_HASHES; k++) {
+            uint64_t b = (h1 + (uint64_t)k * h2) & s->bloom_mask;
+            s->bloom[b >> 6] |= 1ull << (b & 63);
+        }
+    }
+    return s;
+}
+
+static int set_contains(const RevSet *s, const SerialKey key) {
+    if (s->n == 0) return 0;
+    uint64_t h1, h2;
+    key_hashes(key, &h1, &h2);
+    for (int k = 0; k < BLOOM_HASHES; k++) {
+        uint64_t b = (h1 + (uint64_t)k * h2) & s->bloom_mask;
+        if (!(s->bloom[b >> 6] & (1ull << (b & 63)))) return 0;
+    }
+    /* last fence <= key, then a search within its block */
+    size_t lo = 0, hi = s->nfence;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (memcmp(s->fence[mid], key, KEY_LEN) <= 0) lo = mid;
+        else hi = mid;
+    }
+    size_t first = lo * FENCE_STRIDE;
+    size_t count = s->n - first < FENCE_STRIDE ? s->n - first : FENCE_STRIDE;
+    return bsearch(key, s->keys[first], count, KEY_LEN, key_cmp) != NULL;
+}
+
+/* ---------- store ---------- */
+
+typedef struct {
+    SerialKey *keys;
+    time_t *when;
+    int *reason;
+    size_t n, cap;
+} StoreEntries;
+
+static void store_entries_free(StoreEntries *e) {
+    free(e->keys);
+    free(e->when);
+    free(e->reason);
+    memset(e, 0, sizeof(*e));
+}
+
+static int store_push(StoreEntries *e, const SerialKey key, time_t when, int reason) {
+    if (e->n == e->cap) {
+        size_t cap = e->cap ? e->cap * 2 : 256;
+        SerialKey *k = realloc(e->keys, cap * sizeof(SerialKey));
+        if (k) e->keys = k;
+        time_t *w = realloc(e->when, cap * sizeof(time_t));
+        if (w) e->when = w;
+        int *r = realloc(e->reason, cap * sizeof(int));
+        if (r) e->reason = r;
+        if (!k || !w || !r) return -ENOMEM;
+        e->cap = cap;
+    }
+    memcpy(e->keys[e->n], key, KEY_LEN);
+    e->when[e->n] = when;
+    e->reason[e->n] = reason;
+    e->n++;
+    return 0;
+}
+
+/* Parse the store; a missing file is an empty store. Malformed lines are skipped. */
+static int store_read(const char *path, StoreEntries *out) {
+    memset(out, 0, sizeof(*out));
+    FILE *f = fopen(path, "r");
+    if (!f) return errno == ENOENT ? 0 : -errno;
+    char line[256];
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        char *p = line;
+        size_t n = strspn(p, "0123456789abcdefABCDEF");
+        SerialKey key;
+        if (n == 0 || (p[n] != ' ' && p[n] != '\n' && p[n] != '\0') || key_from_hex(p, n, key) != 0) continue;
+        char *end;
+        long long when = strtoll(p + n, &end, 10);
+        long reason = strtol(end, NULL, 10);
+        rc = store_push(out, key, (time_t)when, (int)reason);
+    }
+    fclose(f);
+    if (rc != 0) store_entries_free(out);
+    return rc;
+}
+
+int revocation_store_add(const char *store_path, const unsigned char *serial, size_t serial_len, int reason) {
+    if (!store_path || !serial) return -EINVAL;
+    SerialKey key;
+    if (make_key(serial, serial_len, key) != 0) return -EINVAL;
+
+    StoreEntries e;
+    int rc = store_read(store_path, &e);
+    if (rc != 0) return rc;
+    int found = 0;
+    for (size_t i = 0; i < e.n && !found; i++) found = memcmp(e.keys[i], key, KEY_LEN) == 0;
+    store_entries_free(&e);
+    if (found) return 1;
+
+    char hex[2 * KEY_LEN + 1], line[128];
+    key_to_hex(key, hex);
+    int len = snprintf(line, sizeof(line), "%s %lld %d\n", hex, (long long)time(NULL), reason);
+    int fd = open(store_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return -errno;
+    if (write(fd, line, (size_t)len) != len || fsync(fd) != 0) rc = errno ? -errno : -EIO;
+    close(fd);
+    return rc;
+}
+
+/* ---------- CRL ---------- */
+
+static ASN1_INTEGER *key_to_asn1(const SerialKey key) {
+    BIGNUM *bn = BN_bin2bn(key, KEY_LEN, NULL);
+    ASN1_INTEGER *ai = bn ? BN_to_ASN1_INTEGER(bn, NULL) : NULL;
+    BN_free(bn);
+    return ai;
+}
+
+static int add_revoked(X509_CRL *crl, const SerialKey key, time_t when, int reason) {
+    X509_REVOKED *r = X509_REVOKED_new();
+    ASN1_INTEGER *serial = key_to_asn1(key);
+    ASN1_TIME *t = ASN1_TIME_set(NULL, when);
+    ASN1_ENUMERATED *code = ASN1_ENUMERATED_new();
+    int ok = r && serial && t && code &&
+             X509_REVOKED_set_serialNumber(r, serial) == 1 &&
+             X509_REVOKED_set_revocationDate(r, t) == 1 &&
+             ASN1_ENUMERATED_set(code, reason) == 1 &&
+             (reason == REVOCATION_REASON_UNSPECIFIED ||
+              X509_REVOKED_add1_ext_i2d(r, NID_crl_reason, code, 0, 0) == 1) &&
+             X509_CRL_add0_revoked(crl, r) == 1;
+    if (!ok) X509_REVOKED_free(r);
+    ASN1_INTEGER_free(serial);
+    ASN1_TIME_free(t);
+    ASN1_ENUMERATED_free(code);
+    return ok ? 0 : -ENOMEM;
+}
+
+/* CRL number extension of crl, 0 when absent or unreadable */
+static int64_t crl_number_of(const X509_CRL *crl) {
+    int64_t v = 0;
+    ASN1_INTEGER *ai = X509_CRL_get_ext_d2i(crl, NID_crl_number, NULL, NULL);
+    if (!ai || ASN1_INTEGER_get_int64(&v, ai) != 1 || v < 0) v = 0;
+    ASN1_INTEGER_free(ai);
+    return v;
+}
+
+/* CRL number of the CRL currently at crl_path, 0 without one */
+static int64_t previous_crl_number(const char *crl_path) {
+    FILE *f = fopen(crl_path, "r");
+    if (!f) return 0;
+    X509_CRL *crl = PEM_read_X509_CRL(f, NULL, NULL, NULL);
+    fclose(f);
+    int64_t v = crl ? crl_number_of(crl) : 0;
+    X509_CRL_free(crl);
+    return v;
+}
+
+int revocation_crl_generate(const char *store_path, const char *ca_cert_path, const char *ca_key_path,
+                            int days, const char *crl_path) {
+    if (!store_path || !ca_cert_path || !ca_key_path || !crl_path) return -EINVAL;
+    if (days <= 0) days = 30;
+
+    StoreEntries e;
+    int rc = store_read(store_path, &e);
+    if (rc != 0) return rc;
+    X509 *ca = NULL;
+    EVP_PKEY *key = NULL;
+    X509_CRL *crl = NULL;
+    ASN1_TIME *now = NULL, *next = NULL;
+    ASN1_INTEGER *number = NULL;
+    if (certgen_load_ca(ca_cert_path, ca_key_path, &ca, &key) != 0) {
+        rc = -ENOENT;
+        goto out;
+    }
+
+    rc = -ENOMEM;
+    time_t t = time(NULL);
+    crl = X509_CRL_new();
+    now = ASN1_TIME_set(NULL, t);
+    next = ASN1_TIME_set(NULL, t + (time_t)days * 86400);
+    /* CRL number: strictly above the one being replaced, even within a second or after the
+     * clock stepped back; the time keeps numbers from different hosts roughly ordered */
+    int64_t prev = previous_crl_number(crl_path);
+    int64_t seq = prev < INT64_MAX && prev + 1 > (int64_t)t ? prev + 1 : (int64_t)t;
+    number = ASN1_INTEGER_new();
+    if (!crl || !now || !next || !number || ASN1_INTEGER_set_int64(number, seq) != 1 ||
+        X509_CRL_set_version(crl, 1) != 1 ||
+        X509_CRL_set_issuer_name(crl, X509_get_subject_name(ca)) != 1 ||
+        X509_CRL_set1_lastUpdate(crl, now) != 1 || X509_CRL_set1_nextUpdate(crl, next) != 1 ||
+        X509_CRL_add1_ext_i2d(crl, NID_crl_number, number, 0, 0) != 1) goto out;
+
+    for (size_t i = 0; i < e.n; i++) {
+        if ((rc = add_revoked(crl, e.keys[i], e.when[i], e.reason[i])) != 0) goto out;
+    }
+    X509_CRL_sort(crl);
+    if (X509_CRL_sign(crl, key, key_alg_digest_for_key(key)) <= 0) {
+        fprintf(stderr, "revocation: failed to sign CRL with CA key\n");
+        rc = -EINVAL;
+        goto out;
+    }
+
+    /* replace atomically: verifiers may reload at any time */
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", crl_path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) {
+        rc = -errno;
+        goto out;
+    }
+    int ok = PEM_write_X509_CRL(f, crl) == 1;
+    if (fclose(f) != 0) ok = 0;
+    if (!ok || rename(tmp, crl_path) != 0) {
+        rc = errno ? -errno : -EIO;
+        unlink(tmp);
+        goto out;
+    }
+    rc = (int)e.n;
+out:
+    ASN1_INTEGER_free(number);
+    ASN1_TIME_free(now);
+    ASN1_TIME_free(next);
+    X509_CRL_free(crl);
+    EVP_PKEY_free(key);
+    X509_free(ca);
+    store_entries_free(&e);
+    return rc;
+}
+
+/* ---------- lists ---------- */
+
+RevocationList *revocation_list_create(void) {
+    RevocationList *l = calloc(1, sizeof(RevocationList));
+    if (!l) return NULL;
+    l->cur = set_build(NULL, 0);
+    if (!l->cur) {
+        free(l);
+        return NULL;
+    }
+    pthread_mutex_init(&l->reload_lock, NULL);
+    return l;
+}
+
+void revocation_list_free(RevocationList *l) {
+    if (!l) return;
+    set_free(l->cur);
+    pthread_mutex_destroy(&l->reload_lock);
+    free(l);
+}
+
+/* Publish s and free the previous set once no lookup can still be using it */
+static void publish(RevocationList *l, RevSet *s) {
+    pthread_mutex_lock(&l->reload_lock);
+    RevSet *old = __atomic_exchange_n(&l->cur, s, __ATOMIC_SEQ_CST);
+    uint64_t e = __atomic_fetch_add(&l->epoch, 1, __ATOMIC_SEQ_CST);
+    /* new lookups count themselves in the other slot; wait for this one to drain */
+    while (__atomic_load_n(&l->readers[e & 1][0], __ATOMIC_SEQ_CST) != 0) sched_yield();
+    set_free(old);
+    l->generation++;
+    pthread_mutex_unlock(&l->reload_lock);
+}
+
+int revocation_list_is_revoked(RevocationList *l, const unsigned char *serial, size_t serial_len) {
+    SerialKey key;
+    if (!l || !serial || make_key(serial, serial_len, key) != 0) return 0;
+
+    uint64_t e;
+    for (;;) {
+        e = __atomic_load_n(&l->epoch, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&l->readers[e & 1][0], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&l->epoch, __ATOMIC_SEQ_CST) == e) break;
+        /* a reload moved on between the two loads: count in the current slot instead */
+        __atomic_fetch_sub(&l->readers[e & 1][0], 1, __ATOMIC_SEQ_CST);
+    }
+    const RevSet *s = __atomic_load_n(&l->cur, __ATOMIC_SEQ_CST);
+    int revoked = set_contains(s, key);
+    __atomic_fetch_sub(&l->readers[e & 1][0], 1, __ATOMIC_RELEASE);
+    return revoked;
+}
+
+static time_t asn1_time_to_time_t(const ASN1_TIME *t) {
+    struct tm tm;
+    if (!t || ASN1_TIME_to_tm(t, &tm) != 1) return 0;
+    return timegm(&tm);
+}
+
+int revocation_list_load_crl(RevocationList *l, const char *crl_path, const char *ca_cert_path) {
+    if (!l || !crl_path || !ca_cert_path) return -EINVAL;
+    FILE *f = fopen(crl_path, "r");
+    if (!f) return -errno;
+    X509_CRL *crl = PEM_read_X509_CRL(f, NULL, NULL, NULL);
+    fclose(f);
+    f = fopen(ca_cert_path, "r");
+    if (!f) {
+        X509_CRL_free(crl);
+        return -errno;
+    }
+    X509 *ca = PEM_read_X509(f, NULL, NULL, NULL);
+    fclose(f);
+
+    int rc = -EBADMSG;
+    SerialKey *keys = NULL;
+    if (!crl || !ca || X509_NAME_cmp(X509_CRL_get_issuer(crl), X509_get_subject_name(ca)) != 0 ||
+        X509_CRL_verify(crl, X509_get0_pubkey(ca)) != 1) {
+        fprintf(stderr, "revocation: %s is not a CRL signed by %s\n", crl_path, ca_cert_path);
+        goto out;
+    }
+
+    STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(crl);
+    size_t n = revoked ? (size_t)sk_X509_REVOKED_num(revoked) : 0;
+    keys = malloc((n ? n : 1) * sizeof(SerialKey));
+    if (!keys) {
+        rc = -ENOMEM;
+        goto out;
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < n; i++) {
+        const ASN1_INTEGER *ai = X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, (int)i));
+        if (make_key(ASN1_STRING_get0_data(ai), (size_t)ASN1_STRING_length(ai), keys[k]) == 0) k++;
+    }
+    RevSet *s = set_build(keys, k);
+    keys = NULL;
+    if (!s) {
+        rc = -ENOMEM;
+        goto out;
+    }
+    s->this_update = asn1_time_to_time_t(X509_CRL_get0_lastUpdate(crl));
+    s->next_update = asn1_time_to_time_t(X509_CRL_get0_nextUpdate(crl));
+    s->number = crl_number_of(crl);
+    publish(l, s);
+    rc = 0;
+out:
+    free(keys);
+    X509_free(ca);
+    X509_CRL_free(crl);
+    return rc;
+}
+
+int revocation_list_load_store(RevocationList *l, const char *store_path) {
+    if (!l || !store_path) return -EINVAL;
+    StoreEntries e;
+    int rc = store_read(store_path, &e);
+    if (rc != 0) return rc;
+    RevSet *s = set_build(e.keys, e.n);
+    e.keys = NULL;
+    store_entries_free(&e);
+    if (!s) return -ENOMEM;
+    publish(l, s);
+    return 0;
+}
+
+void revocation_list_stats(RevocationList *l, RevocationStats *st) {
+    if (!st) return;
+    memset(st, 0, sizeof(*st));
+    if (!l) return;
+    /* the reload lock keeps the set alive while it is inspected */
+    pthread_mutex_lock(&l->reload_lock);
+    const RevSet *s = l->cur;
+    st->entries = s->n;
+    st->generation = l->generation;
+    st->this_update = s->this_update;
+    st->next_update = s->next_update;
+    st->number = s->number;
+    st->bloom_bytes = (size_t)((s->bloom_mask + 1) / 8);
+    pthread_mutex_unlock(&l->reload_lock);
+}
@@ -0,0 +1,189 @@
+#define _DEFAULT_SOURCE
+#include "../inc/serial_alloc.h"
+#include "../inc/crc32.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <openssl/bn.h>
+#include <openssl/rand.h>
+
+#define SERIAL_STATE_MAGIC "USBSERL1"
+#define SERIAL_STATE_BYTES 24           /* magic, reserved end (LE), crc32c, pad */
+#define SERIAL_RANDOM_BYTES 16
+
+struct SerialAlloc {
+    int fd;                     /* state file, -1 in random mode */
+    uint64_t block;
+    uint64_t start;             /* first serial this allocator could hand out */
+    uint64_t next;              /* atomic: next serial */
+    uint64_t limit;             /* atomic: end of the persisted reservation */
+    uint64_t blocks;            /* under lock */
+    uint64_t random_issued;     /* atomic, random mode */
+    pthread_mutex_t lock;       /* serialises block reservations */
+};
+
+void serial_alloc_config_init(SerialAllocConfig *cfg) {
+    if (!cfg) return;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->block_size = 4096;
+    cfg->first_serial = 1ull << 32;
+}
+
+static void put_le64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_le64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* One sector-sized record rewritten in place: a single pwrite + fdatasync per block */
+static int state_write(int fd, uint64_t limit) {
+    unsigned char rec[SERIAL_STATE_BYTES] = { 0 };
+    memcpy(rec, SERIAL_STATE_MAGIC, 8);
+    put_le64(rec + 8, limit);
+    uint32_t crc = crc32c(0, rec, 16);
+    for (int i = 0; i < 4; i++) rec[16 + i] = (unsigned char)(crc >> (8 * i));
+    if (pwrite(fd, rec, sizeof(rec), 0) != (ssize_t)sizeof(rec)) return errno ? -errno : -EIO;
+    return fdatasync(fd) == 0 ? 0 : -errno;
+}
+
+/* 1: valid record in *limit, 0: empty file, negative errno otherwise */
+static int state_read(int fd, uint64_t *limit) {
+    unsigned char rec[SERIAL_STATE_BYTES];
+    ssize_t n = pread(fd, rec, sizeof(rec), 0);
+    if (n < 0) return -errno;
+    if (n == 0) return 0;
+    if (n != (ssize_t)sizeof(rec) || memcmp(rec, SERIAL_STATE_MAGIC, 8) != 0) return -EBADMSG;
+    uint32_t crc = 0;
+    for (int i = 3; i >= 0; i--) crc = (crc << 8) | rec[16 + i];
+    if (crc != crc32c(0, rec, 16)) return -EBADMSG;
+    *limit = get_le64(rec + 8);
+    return 1;
+}
+
+int serial_alloc_create(const SerialAllocConfig *cfg, SerialAlloc **out) {
+    if (!cfg || !out) return -EINVAL;
+    *out = NULL;
+    SerialAlloc *a = calloc(1, sizeof(SerialAlloc));
+    if (!a) return -ENOMEM;
+    a->fd = -1;
+    a->block = cfg->block_size ? cfg->block_size : 4096;
+    pthread_mutex_init(&a->lock, NULL);
+
+    if (cfg->state_path) {
+        int rc;
+        uint64_t limit = cfg->first_serial ? cfg->first_serial : 1;
+        a->fd = open(cfg->state_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (a->fd < 0) {
+            rc = -errno;
+            goto fail;
+        }
+        if (flock(a->fd, LOCK_EX | LOCK_NB) != 0) {
+            rc = errno == EWOULDBLOCK ? -EBUSY : -errno;
+            goto fail;
+        }
+        rc = state_read(a->fd, &limit);
+        if (rc < 0) goto fail;
+        if (rc == 0 && (rc = state_write(a->fd, limit)) != 0) goto fail;
+        /* whatever the previous run reserved is gone: start after it */
+        a->start = a->next = a->limit = limit;
+        *out = a;
+        return 0;
+fail:
+        serial_alloc_free(a);
+        return rc;
+    }
+    *out = a;
+    return 0;
+}
+
+/* Slow path: persist a reservation that covers v */
+static int reserve_block(SerialAlloc *a, uint64_t v) {
+    int rc = 0;
+    pthread_mutex_lock(&a->lock);
+    uint64_t limit = __atomic_load_n(&a->limit, __ATOMIC_RELAXED);
+    if (v >= limit) {
+        uint64_t end = v + a->block;
+        if (end < v || end > (uint64_t)INT64_MAX) {
+            rc = -EOVERFLOW;
+        } else if ((rc = state_write(a->fd, end)) == 0) {
+            a->blocks++;
+            __atomic_store_n(&a->limit, end, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&a->lock);
+    return rc;
+}
+
+int serial_alloc_next_u64(SerialAlloc *a, uint64_t *out) {
+    if (!a || !out || a->fd < 0) return -EINVAL;
+    /* every caller gets a distinct v; it may only be used once the file covers it */
+    uint64_t v = __atomic_fetch_add(&a->next, 1, __ATOMIC_RELAXED);
+    if (v >= __atomic_load_n(&a->limit, __ATOMIC_ACQUIRE)) {
+        int rc = reserve_block(a, v);
+        if (rc != 0) return rc;
+    }
+    *out = v;
+    return 0;
+}
+
+/* 127 random bits, top bit clear so the DER INTEGER stays positive */
+static int assign_random(ASN1_INTEGER *serial) {
+    unsigned char buf[SERIAL_RANDOM_BYTES];
+    BIGNUM *bn = NULL;
+    do {
+        if (RAND_bytes(buf, sizeof(buf)) != 1) return -EIO;
+        buf[0] &= 0x7f;
+        BN_free(bn);
+        bn = BN_bin2bn(buf, sizeof(buf), NULL);
+        if (!bn) return -ENOMEM;
+    } while (BN_is_zero(bn));
+    int rc = BN_to_ASN1_INTEGER(bn, serial) ? 0 : -ENOMEM;
+    BN_free(bn);
+    return rc;
+}
+
+int serial_alloc_assign(SerialAlloc *a, ASN1_INTEGER *serial) {
+    if (!serial) return -EINVAL;
+    if (!a || a->fd < 0) {
+        if (a) __atomic_fetch_add(&a->random_issued, 1, __ATOMIC_RELAXED);
+        return assign_random(serial);
+    }
+    uint64_t v;
+    int rc = serial_alloc_next_u64(a, &v);
+    if (rc != 0) return rc;
+    return ASN1_INTEGER_set_uint64(serial, v) == 1 ? 0 : -ENOMEM;
+}
+
+void serial_alloc_get_stats(SerialAlloc *a, SerialAllocStats *st) {
+    if (!st) return;
+    memset(st, 0, sizeof(*st));
+    if (!a) return;
+    st->random = a->fd < 0;
+    if (st->random) {
+        st->issued = __atomic_load_n(&a->random_issued, __ATOMIC_RELAXED);
+        return;
+    }
+    st->next = __atomic_load_n(&a->next, __ATOMIC_RELAXED);
+    st->reserved = __atomic_load_n(&a->limit, __ATOMIC_ACQUIRE);
+    st->issued = (st->next < st->reserved ? st->next : st->reserved) - a->start;
+    pthread_mutex_lock(&a->lock);
+    st->blocks = a->blocks;
+    pthread_mutex_unlock(&a->lock);
+}
+
+void serial_alloc_free(SerialAlloc *a) {
+    if (!a) return;
+    if (a->fd >= 0) close(a->fd);   /* also drops the flock */
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+}
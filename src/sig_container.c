@@ -0,0 +1,221 @@
+#include "../inc/sig_container.h"
+#include "../inc/crc32.h"
+
+#include <openssl/sha.h>
+#include <openssl/crypto.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HDR_USED        128
+#define HDR_CRC_OFFSET  124
+#define MAX_PAYLOAD     (1024u * 1024u - SIG_CONTAINER_SECTOR)
+
+static void put_le16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put_le32(uint8_t *p, uint32_t v) { for (int i = 0; i < 4; i++) p[i] = v >> (8 * i); }
+static uint16_t get_le16(const uint8_t *p) { return p[0] | p[1] << 8; }
+static uint32_t get_le32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+static void put_le64(uint8_t *p, uint64_t v) { for (int i = 0; i < 8; i++) p[i] = v >> (8 * i); }
+static uint64_t get_le64(const uint8_t *p) { return get_le32(p) | (uint64_t)get_le32(p + 4) << 32; }
+
+int sig_container_encode(const unsigned char *cert_der, size_t cert_len,
+                         const unsigned char *chain_der, size_t chain_len,
+                         int alg, unsigned char **out, size_t *out_len) {
+    if (!cert_der || cert_len == 0 || !out || !out_len) return -EINVAL;
+    if (!chain_der) chain_len = 0;
+    size_t payload = cert_len + chain_len;
+    if (payload > MAX_PAYLOAD) return -EFBIG;
+
+    size_t total = SIG_CONTAINER_SECTOR + (payload + SIG_CONTAINER_SECTOR - 1) / SIG_CONTAINER_SECTOR * SIG_CONTAINER_SECTOR;
+    uint8_t *buf = calloc(1, total);
+    if (!buf) return -ENOMEM;
+
+    uint8_t *body = buf + SIG_CONTAINER_SECTOR;
+    memcpy(body, cert_der, cert_len);
+    if (chain_len) memcpy(body + cert_len, chain_der, chain_len);
+
+    memcpy(buf, SIG_CONTAINER_MAGIC, sizeof(SIG_CONTAINER_MAGIC));
+    put_le16(buf + 8, SIG_CONTAINER_VERSION);
+    put_le16(buf + 10, HDR_USED);
+    put_le16(buf + 12, alg < 0 ? SIG_CONTAINER_ALG_UNKNOWN : (uint16_t)alg);
+    put_le16(buf + 14, chain_len ? SIG_CONTAINER_FLAG_CHAIN : 0);
+    put_le32(buf + 16, (uint32_t)cert_len);
+    put_le32(buf + 20, (uint32_t)chain_len);
+    put_le32(buf + 24, SIG_CONTAINER_SECTOR);
+    put_le32(buf + 28, crc32c(0, body, payload));
+    SHA256(body, payload, buf + 32);
+    put_le64(buf + 64, 1);
+    put_le32(buf + HDR_CRC_OFFSET, crc32c(0, buf, HDR_CRC_OFFSET));
+
+    *out = buf;
+    *out_len = total;
+    return 0;
+}
+
+int sig_container_parse_header(const unsigned char *hdr, size_t hdr_len, SigContainerInfo *info) {
+    if (!hdr || !info || hdr_len < HDR_USED) return -EINVAL;
+    if (memcmp(hdr, SIG_CONTAINER_MAGIC, sizeof(SIG_CONTAINER_MAGIC)) != 0) return -EBADMSG;
+    if (crc32c(0, hdr, HDR_CRC_OFFSET) != get_le32(hdr + HDR_CRC_OFFSET)) return -EBADMSG;
+
+    memset(info, 0, sizeof(*info));
+    info->version = get_le16(hdr + 8);
+    info->alg = get_le16(hdr + 12);
+    info->flags = get_le16(hdr + 14);
+    info->cert_len = get_le32(hdr + 16);
+    info->chain_len = get_le32(hdr + 20);
+    info->payload_offset = get_le32(hdr + 24);
+    info->payload_crc = get_le32(hdr + 28);
+    memcpy(info->sha256, hdr + 32, 32);
+    info->generation = get_le64(hdr + 64);
+
+    if (info->version != SIG_CONTAINER_VERSION) return -EBADMSG;
+    if (info->cert_len == 0 || (uint64_t)info->cert_len + info->chain_len > MAX_PAYLOAD) return -EBADMSG;
+    if (info->payload_offset < SIG_CONTAINER_SECTOR || info->payload_offset % SIG_CONTAINER_SECTOR) return -EBADMSG;
+    return 0;
+}
+
+int sig_container_check_payload(const SigContainerInfo *info, const unsigned char *payload, size_t len) {
+    if (!info || !payload || len != (size_t)info->cert_len + info->chain_len) return -EINVAL;
+    if (crc32c(0, payload, len) != info->payload_crc) return -EBADMSG;
+    unsigned char md[SHA256_DIGEST_LENGTH];
+    SHA256(payload, len, md);
+    return CRYPTO_memcmp(md, info->sha256, sizeof(md)) == 0 ? 0 : -EBADMSG;
+}
+
+int sig_container_read(BlockDev *bd, uint64_t off, uint64_t max_len, SigContainerInfo *info,
+                       unsigned char **cert_der, size_t *cert_len,
+                       unsigned char **chain_der, size_t *chain_len) {
+    if (!bd || !info || !cert_der || !cert_len) return -EINVAL;
+    unsigned char hdr[SIG_CONTAINER_SECTOR];
+    int rc = blockdev_pread(bd, hdr, sizeof(hdr), off);
+    if (rc != 0) return rc;
+    if ((rc = sig_container_parse_header(hdr, sizeof(hdr), info)) != 0) return rc;
+
+    size_t len = (size_t)info->cert_len + info->chain_len;
+    if ((uint64_t)info->payload_offset + len > max_len) return -EBADMSG;
+
+    unsigned char *payload = malloc(len);
+    if (!payload) return -ENOMEM;
+    if ((rc = blockdev_pread(bd, payload, len, off + info->payload_offset)) != 0 ||
+        (rc = sig_container_check_payload(info, payload, len)) != 0) {
+        free(payload);
+        return rc;
+    }
+
+    unsigned char *chain = NULL;
+    if (chain_der && info->chain_len) {
+        chain = malloc(info->chain_len);
+        if (!chain) { free(payload); return -ENOMEM; }
+        memcpy(chain, payload + info->cert_len, info->chain_len);
+    }
+    /* certificate is the payload prefix: hand out the buffer itself */
+    *cert_der = payload;
+    *cert_len = info->cert_len;
+    if (chain_der) *chain_der = chain;
+    if (chain_len) *chain_len = chain ? info->chain_len : 0;
+    return 0;
+}
+
+void sig_container_set_generation(unsigned char *container, uint64_t generation) {
+    if (!container) return;
+    put_le64(container + 64, generation);
+    put_le32(container + HDR_CRC_OFFSET, crc32c(0, container, HDR_CRC_OFFSET));
+}
+
+/* Generation of each slot header and whether the header is valid at all: containers
+ * written before A/B slots existed are valid with generation 0 */
+static int read_slot_generations(BlockDev *bd, uint64_t part_off, uint64_t gen[SIG_SLOT_COUNT],
+                                 int valid[SIG_SLOT_COUNT]) {
+    for (int i = 0; i < SIG_SLOT_COUNT; i++) {
+        unsigned char hdr[SIG_CONTAINER_SECTOR];
+        SigContainerInfo info;
+        int rc = blockdev_pread(bd, hdr, sizeof(hdr), part_off + (uint64_t)i * SIG_SLOT_BYTES);
+        if (rc != 0) return rc;
+        valid[i] = sig_container_parse_header(hdr, sizeof(hdr), &info) == 0;
+        gen[i] = valid[i] ? info.generation : 0;
+    }
+    return 0;
+}
+
+int sig_slots_read(BlockDev *bd, uint64_t part_off, uint64_t part_len, SigContainerInfo *info,
+                   unsigned char **cert_der, size_t *cert_len,
+                   unsigned char **chain_der, size_t *chain_len, int *slot) {
+    if (!bd || !info || !cert_der || !cert_len) return -EINVAL;
+    if (part_len < (uint64_t)SIG_SLOT_COUNT * SIG_SLOT_BYTES) return -EINVAL;
+
+    uint64_t gen[SIG_SLOT_COUNT];
+    int valid[SIG_SLOT_COUNT];
+    int rc = read_slot_generations(bd, part_off, gen, valid);
+    if (rc != 0) return rc;
+
+    /* newest valid slot first (A on a tie), the other one as fallback if its header is valid */
+    int order[SIG_SLOT_COUNT] = { 0, 1 };
+    if (valid[1] && (!valid[0] || gen[1] > gen[0])) { order[0] = 1; order[1] = 0; }
+    rc = -EBADMSG;
+    for (int k = 0; k < SIG_SLOT_COUNT; k++) {
+        int i = order[k];
+        if (!valid[i] && k > 0) break;
+        rc = sig_container_read(bd, part_off + (uint64_t)i * SIG_SLOT_BYTES, SIG_SLOT_BYTES, info,
+                                cert_der, cert_len, chain_der, chain_len);
+        if (rc == 0) {
+            if (slot) *slot = i;
+            return 0;
+        }
+    }
+    return rc;
+}
+
+int sig_slots_write_next(BlockDev *bd, uint64_t part_off, uint64_t part_len,
+                         unsigned char *container, size_t len, int *slot, uint64_t *generation) {
+    if (!bd || !container || len <= SIG_CONTAINER_SECTOR || len % SIG_CONTAINER_SECTOR) return -EINVAL;
+    if (part_len < (uint64_t)SIG_SLOT_COUNT * SIG_SLOT_BYTES) return -EINVAL;
+    if (len > SIG_SLOT_BYTES) return -EFBIG;
+
+    uint64_t gen[SIG_SLOT_COUNT];
+    int valid[SIG_SLOT_COUNT];
+    int rc = read_slot_generations(bd, part_off, gen, valid);
+    if (rc != 0) return rc;
+
+    /* never overwrite the slot sig_slots_read returns, payload checks included: a newer
+     * header over a damaged payload is what gets replaced. With no readable slot, write
+     * the one that is not newest by header (B on a tie). Generation 0 (a pre-A/B
+     * container) is a valid current slot. */
+    int current = valid[1] && (!valid[0] || gen[1] > gen[0]) ? 1 : 0;
+    SigContainerInfo info;
+    unsigned char *cert = NULL;
+    size_t cert_len = 0;
+    rc = sig_slots_read(bd, part_off, part_len, &info, &cert, &cert_len, NULL, NULL, &current);
+    free(cert);
+    if (rc != 0 && rc != -EBADMSG) return rc;
+    int target = current ^ 1;
+    uint64_t next = 1;
+    for (int i = 0; i < SIG_SLOT_COUNT; i++) {
+        if (valid[i] && gen[i] + 1 > next) next = gen[i] + 1;
+    }
+    sig_container_set_generation(container, next);
+
+    uint64_t off = part_off + (uint64_t)target * SIG_SLOT_BYTES;
+    size_t body = len - SIG_CONTAINER_SECTOR;
+    unsigned char *check = malloc(len);
+    if (!check) return -ENOMEM;
+
+    /* payload, sync, header, sync: the header is the commit point */
+    if ((rc = blockdev_pwrite(bd, container + SIG_CONTAINER_SECTOR, body, off + SIG_CONTAINER_SECTOR)) != 0 ||
+        (rc = blockdev_sync(bd)) != 0 ||
+        (rc = blockdev_pwrite(bd, container, SIG_CONTAINER_SECTOR, off)) != 0 ||
+        (rc = blockdev_sync(bd)) != 0) {
+        free(check);
+        return rc;
+    }
+
+    blockdev_drop_cache(bd, off, len);
+    rc = blockdev_pread(bd, check, len, off);
+    if (rc == 0 && memcmp(check, container, len) != 0) rc = -EBADMSG;
+    free(check);
+    if (rc != 0) return rc;
+
+    if (slot) *slot = target;
+    if (generation) *generation = next;
+    return 0;
+}
@@ -0,0 +1,278 @@
+#define _POSIX_C_SOURCE 200809L
+#include "../inc/station.h"
+#include "../inc/usb_info.h"
+#include "../inc/cert_gen.h"
+#include "../inc/ca_signer.h"
+#include "../inc/embed_cert.h"
+#include "../inc/image_clone.h"
+#include "../inc/metrics.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const StationConfig *cfg;
+    const char *const *devices;
+    StationResult *results;
+    CaSigner *signer;           /* CA loaded once, shared by all workers */
+    size_t count;
+    size_t next;                /* next device index to hand out */
+    pthread_mutex_t lock;
+} StationPool;
+
+static const char *STAGE_NAMES[] = { "info", "key", "csr", "sign", "write", "clone", "embed", "done" };
+static const MetricStage STAGE_METRICS[] = {
+    METRIC_STAGE_INFO, METRIC_STAGE_KEY, METRIC_STAGE_CSR,
+    METRIC_STAGE_SIGN, METRIC_STAGE_WRITE, METRIC_STAGE_CLONE_WAIT, METRIC_STAGE_EMBED,
+};
+
+/* Golden-image copy running next to the certificate stages of the same device */
+typedef struct {
+    const char *device;
+    const char *image;
+    int rc;
+    CloneStats stats;
+} CloneJob;
+
+static void *clone_thread(void *arg) {
+    CloneJob *job = arg;
+    job->rc = image_clone_to_device(job->device, job->image, IMAGE_CLONE_PARTITION, 0, &job->stats);
+    return NULL;
+}
+
+const char *station_stage_name(StationStage stage) {
+    if ((int)stage < 0 || stage > STATION_STAGE_DONE) return "?";
+    return STAGE_NAMES[stage];
+}
+
+void station_config_init(StationConfig *cfg) {
+    if (!cfg) return;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->ca_cert_path = "cert/ca.crt";
+    cfg->ca_key_path = "cert/ca.key";
+    cfg->script_path = "usbPartition.sh";
+    cfg->output_dir = "output/station";
+    cfg->key_alg = KEY_ALG_RSA2048;
+    cfg->days = 365;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Move res to the next stage, closing the metrics span of the previous one */
+static void station_enter(StationResult *res, StationStage next, uint64_t *span) {
+    metrics_span_end(STAGE_METRICS[res->stage], *span);
+    res->stage = next;
+    *span = next == STATION_STAGE_DONE ? 0 : metrics_span_begin();
+}
+
+/* Directory name for a device's artifacts, unique per device path: the path without its
+ * leading '/', with '/' as '-' and every other byte outside [A-Za-z0-9.] (and a leading '.')
+ * as "_xx" hex, so "/dev/sdb" -> "dev-sdb" and images of the same name in different
+ * directories stay apart. A name longer than NAME_MAX becomes <basename>-<path hash>. */
+static void device_dir_name(const char *device, char *out, size_t outsz) {
+    static const char hex[] = "0123456789abcdef";
+    const char *p = device;
+    while (*p == '/') p++;
+    size_t n = 0;
+    for (; *p && n + 4 <= outsz && n <= NAME_MAX; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '/') {
+            out[n++] = '-';
+        } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || (c == '.' && n)) {
+            out[n++] = (char)c;
+        } else {
+            out[n++] = '_';
+            out[n++] = hex[c >> 4];
+            out[n++] = hex[c & 15];
+        }
+    }
+    out[n] = '\0';
+    if (!*p && n <= NAME_MAX) return;
+
+    uint64_t h = 14695981039346656037ull;    /* FNV-1a */
+    for (p = device; *p; p++) h = (h ^ (unsigned char)*p) * 1099511628211ull;
+    const char *base = strrchr(device, '/');
+    base = base ? base + 1 : device;
+    snprintf(out, outsz, "%.200s-%016llx", base, (unsigned long long)h);
+}
+
+/* Run the whole pipeline for one device; fills res.
+ * Key, CSR and certificate stay in memory; only the key and the certificate are written. */
+static void station_provision_one(const StationConfig *cfg, CaSigner *signer,
+                                  const char *device, StationResult *res) {
+    double t0 = now_seconds();
+    char dir[PATH_MAX - 32];   /* leaves room for the artifact file names */
+    char name[NAME_MAX + 1];
+    EVP_PKEY *pkey = NULL;
+    X509_REQ *req = NULL;
+    X509 *cert = NULL;
+    UsbDeviceInfo *info = NULL;
+    CloneJob clone = { .device = device, .image = cfg->data_image };
+    pthread_t clone_tid;
+    int cloning = 0;
+
+    res->device = device;
+    res->rc = 0;
+
+    uint64_t t = 0;
+    station_enter(res, STATION_STAGE_INFO, &t);
+    device_dir_name(device, name, sizeof(name));
+    snprintf(dir, sizeof(dir), "%s/%s", cfg->output_dir, name);
+    snprintf(res->key_path, sizeof(res->key_path), "%s/usb.key", dir);
+    snprintf(res->cert_path, sizeof(res->cert_path), "%s/usb_cert.pem", dir);
+    info = usb_info_from_block_device(device);
+    if (!info) { res->rc = -1; goto out; }
+    /* the copy only needs USB_DATA; it overlaps key generation, CSR and signing */
+    if (cfg->data_image && !cfg->renew && !cfg->use_script) {
+        if (pthread_create(&clone_tid, NULL, clone_thread, &clone) == 0) cloning = 1;
+        else clone_thread(&clone);
+    }
+
+    station_enter(res, STATION_STAGE_KEY, &t);
+    pkey = certgen_generate_key_alg(cfg->key_alg);
+    if (!pkey) { res->rc = CERTGEN_ERR_KEY; goto out; }
+
+    station_enter(res, STATION_STAGE_CSR, &t);
+    req = certgen_build_csr(pkey, info);
+    if (!req) { res->rc = CERTGEN_ERR_CSR; goto out; }
+
+    station_enter(res, STATION_STAGE_SIGN, &t);
+    cert = ca_signer_sign(signer, req, cfg->days);
+    if (!cert) { res->rc = CERTGEN_ERR_SIGN; goto out; }
+    if (cfg->ledger) {
+        LedgerEntry entry;
+        res->rc = ledger_entry_from_cert(cert, info, &entry);
+        if (res->rc == 0) res->rc = ledger_append(cfg->ledger, &entry);
+        if (res->rc != 0) goto out;
+    }
+
+    station_enter(res, STATION_STAGE_WRITE, &t);
+    res->rc = certgen_write_key_pem(res->key_path, pkey);
+    if (res->rc == 0) res->rc = certgen_write_cert_pem(res->cert_path, cert);
+    if (res->rc != 0) goto out;
+
+    station_enter(res, STATION_STAGE_CLONE, &t);
+    if (cloning) {
+        pthread_join(clone_tid, NULL);
+        cloning = 0;
+    }
+    res->rc = clone.rc;
+    res->clone_mbps = clone.stats.mbps;
+    if (res->rc != 0) goto out;
+
+    station_enter(res, STATION_STAGE_EMBED, &t);
+    if (cfg->renew) {
+        res->rc = embed_renew_x509(device, cert, NULL, NULL, NULL);
+    } else if (cfg->use_script) {
+        res->rc = embed_cert_ex(cfg->script_path, device, res->cert_path,
+                                cfg->embed_flags | EMBED_FLAG_ASSUME_YES);
+    } else {
+        res->rc = embed_cert_x509(device, cert, NULL, cfg->embed_flags);
+    }
+    if (res->rc != 0) goto out;
+
+    station_enter(res, STATION_STAGE_DONE, &t);
+    metrics_add(METRIC_DEVICES_PROVISIONED, 1);
+out:
+    /* an earlier stage failed: the copy still has the device open */
+    if (cloning) pthread_join(clone_tid, NULL);
+    if (res->stage != STATION_STAGE_DONE) {
+        metrics_span_end(STAGE_METRICS[res->stage], t);
+        metrics_failure(STAGE_METRICS[res->stage], res->rc);
+        metrics_add(METRIC_DEVICES_FAILED, 1);
+    }
+    X509_free(cert);
+    X509_REQ_free(req);
+    EVP_PKEY_free(pkey);
+    usb_info_free(info);
+    res->seconds = now_seconds() - t0;
+}
+
+static void *station_worker(void *arg) {
+    StationPool *pool = arg;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        size_t i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count) break;
+        station_provision_one(pool->cfg, pool->signer, pool->devices[i], &pool->results[i]);
+    }
+    return NULL;
+}
+
+int station_run(const StationConfig *cfg, const char *const *devices, size_t count, StationResult *results) {
+    if (!cfg || !devices || !results) return -EINVAL;
+    /* the golden image lands in USB_DATA before embedding, so formatting it would wipe the clone */
+    if (cfg->data_image && (cfg->embed_flags & EMBED_FLAG_FORMAT_DATA)) return -EINVAL;
+    if (count == 0) return 0;
+    memset(results, 0, count * sizeof(*results));
+
+    size_t workers = cfg->workers > 0 ? (size_t)cfg->workers : (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > count) workers = count;
+
+    StationPool pool = { .cfg = cfg, .devices = devices, .results = results, .count = count, .next = 0 };
+    pool.signer = cfg->signer ? cfg->signer : ca_signer_create(cfg->ca_cert_path, cfg->ca_key_path);
+    if (!pool.signer) {
+        for (size_t i = 0; i < count; i++) {
+            results[i].device = devices[i];
+            results[i].stage = STATION_STAGE_SIGN;
+            results[i].rc = CERTGEN_ERR_CA;
+        }
+        metrics_failure(METRIC_STAGE_SIGN, CERTGEN_ERR_CA);
+        metrics_add(METRIC_DEVICES_FAILED, count);
+        return (int)count;
+    }
+    if (!cfg->signer) ca_signer_set_serials(pool.signer, cfg->serials);
+    pthread_mutex_init(&pool.lock, NULL);
+
+    pthread_t *threads = calloc(workers, sizeof(pthread_t));
+    size_t started = 0;
+    if (threads) {
+        for (; started < workers; started++) {
+            if (pthread_create(&threads[started], NULL, station_worker, &pool) != 0) break;
+        }
+    }
+    /* no thread could be started: run inline so the batch still completes */
+    if (started == 0) station_worker(&pool);
+    for (size_t i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+    if (!cfg->signer) ca_signer_free(pool.signer);
+
+    int failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].stage != STATION_STAGE_DONE) failed++;
+    }
+    return failed;
+}
+
+void station_print_report(const StationResult *results, size_t count) {
+    if (!results) return;
+    size_t ok = 0;
+    printf("%-20s %-6s %6s %8s  %s\n", "DEVICE", "STATUS", "RC", "SECONDS", "CERT / FAILED STAGE");
+    for (size_t i = 0; i < count; i++) {
+        const StationResult *r = &results[i];
+        if (r->stage == STATION_STAGE_DONE) {
+            ok++;
+            printf("%-20s %-6s %6d %8.2f  %s", r->device, "OK", 0, r->seconds, r->cert_path);
+            if (r->clone_mbps > 0) printf("  (data image %.1f MB/s)", r->clone_mbps);
+            printf("\n");
+        } else {
+            printf("%-20s %-6s %6d %8.2f  failed at %s\n", r->device ? r->device : "(null)", "FAIL",
+                   r->rc, r->seconds, station_stage_name(r->stage));
+        }
+    }
+    printf("%zu/%zu device(s) provisioned.\n", ok, count);
+}
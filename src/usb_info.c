@@ -2,57 +2,246 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+
+static const char *ATOM_NAMES[USB_PROP_ATOM_COUNT] = {
+    "usbguard_id", "raw_info", "hash", "parent-hash", "via-port",
+    "with-interface", "with-connect-type", "label", "target", "block_device",
+};
+
+/* Candidate atom from the first characters of a key of len bytes (-1 if none) */
+static int atom_candidate(const char *key, size_t len) {
+    switch (key[0]) {
+    case 'u': return USB_PROP_USBGUARD_ID;
+    case 'r': return USB_PROP_RAW_INFO;
+    case 'h': return USB_PROP_HASH;
+    case 'p': return USB_PROP_PARENT_HASH;
+    case 'v': return USB_PROP_VIA_PORT;
+    case 'w': return len > 5 && key[5] == 'i' ? USB_PROP_WITH_INTERFACE : USB_PROP_WITH_CONNECT_TYPE;
+    case 'l': return USB_PROP_LABEL;
+    case 't': return USB_PROP_TARGET;
+    case 'b': return USB_PROP_BLOCK_DEVICE;
+    }
+    return -1;
+}
+
+int usb_prop_atom(const char *key, size_t len) {
+    if (!key || !len) return -1;
+    int a = atom_candidate(key, len);
+    return a >= 0 && strncmp(key, ATOM_NAMES[a], len) == 0 && ATOM_NAMES[a][len] == '\0' ? a : -1;
+}
+
+/* usb_prop_atom for a NUL-terminated key, measuring only as far as atom_candidate looks */
+static int atom_of_cstr(const char *key) {
+    if (!key[0]) return -1;
+    int a = atom_candidate(key, strnlen(key, 6));
+    return a >= 0 && strcmp(key, ATOM_NAMES[a]) == 0 ? a : -1;
+}
+
+const char *usb_prop_atom_name(UsbPropAtom atom) {
+    return (unsigned)atom < USB_PROP_ATOM_COUNT ? ATOM_NAMES[atom] : NULL;
+}
+
+/* Keys of well-known properties point at ATOM_NAMES and are never freed */
+static int is_atom_key(const char *key) {
+    int atom = atom_of_cstr(key);
+    return atom >= 0 && key == ATOM_NAMES[atom];
+}
 
 UsbDeviceInfo *usb_info_create(void) {
     UsbDeviceInfo *info = calloc(1, sizeof(UsbDeviceInfo));
     return info;
 }
 
+UsbDeviceInfo *usb_info_create_in(Arena *arena) {
+    if (!arena) return usb_info_create();
+    UsbDeviceInfo *info = arena_zalloc(arena, sizeof(UsbDeviceInfo));
+    if (info) info->arena = arena;
+    return info;
+}
+
 void usb_info_free(UsbDeviceInfo *info) {
-    if (!info) return;
+    if (!info || info->arena) return;   // arena-backed: released with the arena
 
     free(info->id);
     free(info->name);
     free(info->serial);
 
     for (size_t i = 0; i < info->property_count; i++) {
-        free(info->properties[i].key);
+        if (!is_atom_key(info->properties[i].key)) free(info->properties[i].key);
         free(info->properties[i].value);
     }
     free(info->properties);
+    free(info->prop_index);
 
     free(info);
 }
 
+/* String copy in the device's arena or on the heap */
+static char *info_strndup(UsbDeviceInfo *info, const char *s, size_t len) {
+    if (info->arena) return arena_strndup(info->arena, s, len);
+    char *d = malloc(len + 1);
+    if (!d) return NULL;
+    memcpy(d, s, len);
+    d[len] = '\0';
+    return d;
+}
+
+char *usb_info_strndup(UsbDeviceInfo *info, const char *s, size_t len) {
+    return info && s ? info_strndup(info, s, len) : NULL;
+}
+
+static void info_release(UsbDeviceInfo *info, char *s) {
+    if (!info->arena) free(s);
+}
+
 void usb_info_set_id(UsbDeviceInfo *info, const char *vendor_id, const char *product_id) {
     if (!info) return;
-    free(info->id); // tránh leak memory
+    info_release(info, info->id); // tránh leak memory
     size_t len = strlen(vendor_id) + strlen(product_id) + 2; // +1 cho ':' và +1 cho '\0'
-    info->id = malloc(len);
+    info->id = info->arena ? arena_alloc(info->arena, len) : malloc(len);
     if (info->id)
         snprintf(info->id, len, "%s:%s", vendor_id, product_id);
 }
 
 void usb_info_set_name(UsbDeviceInfo *info, const char *name) {
     if (!info) return;
-    free(info->name);
-    info->name = name ? strdup(name) : NULL;
+    info_release(info, info->name);
+    info->name = name ? info_strndup(info, name, strlen(name)) : NULL;
 }
 
 void usb_info_set_serial(UsbDeviceInfo *info, const char *serial) {
     if (!info) return;
-    free(info->serial);
-    info->serial = serial ? strdup(serial) : NULL;
+    info_release(info, info->serial);
+    info->serial = serial ? info_strndup(info, serial, strlen(serial)) : NULL;
+}
+
+/* Room for one more property; capacity doubles */
+static UsbProperty *property_slot(UsbDeviceInfo *info) {
+    if (info->property_count == info->property_capacity) {
+        size_t cap = info->property_capacity ? info->property_capacity * 2 : 8;
+        UsbProperty *tmp = info->arena
+            ? arena_realloc(info->arena, info->properties, info->property_capacity * sizeof(UsbProperty),
+                            cap * sizeof(UsbProperty))
+            : realloc(info->properties, cap * sizeof(UsbProperty));
+        if (!tmp) return NULL;
+        info->properties = tmp;
+        info->property_capacity = cap;
+    }
+    return &info->properties[info->property_count];
+}
+
+static size_t key_hash(const char *key) {
+    size_t h = 2166136261u;
+    for (; *key; key++) h = (h ^ (unsigned char)*key) * 16777619u;
+    return h;
+}
+
+/* Add property i (a non-atom key) to the index unless the key is already there */
+static void index_insert(UsbDeviceInfo *info, size_t i) {
+    size_t mask = info->prop_index_size - 1;
+    for (size_t h = key_hash(info->properties[i].key) & mask;; h = (h + 1) & mask) {
+        uint16_t slot = info->prop_index[h];
+        if (!slot) {
+            info->prop_index[h] = (uint16_t)(i + 1);
+            return;
+        }
+        if (strcmp(info->properties[slot - 1].key, info->properties[i].key) == 0) return;
+    }
+}
+
+/* (Re)build the index at a load factor of at most 1/2 */
+static void index_rebuild(UsbDeviceInfo *info) {
+    size_t size = 16;
+    while (size < info->property_count * 2) size *= 2;
+    if (size > UINT16_MAX) return;          // absurd property counts fall back to scanning
+    uint16_t *idx = info->arena ? arena_zalloc(info->arena, size * sizeof(uint16_t))
+                                : calloc(size, sizeof(uint16_t));
+    if (!idx) return;
+    if (!info->arena) free(info->prop_index);
+    info->prop_index = idx;
+    info->prop_index_size = size;
+    for (size_t i = 0; i < info->property_count; i++)
+        if (!is_atom_key(info->properties[i].key)) index_insert(info, i);
+}
+
+/* Bookkeeping after properties[property_count - 1] was added */
+static void property_added(UsbDeviceInfo *info, int atom) {
+    size_t i = info->property_count - 1;
+    const char *value = info->properties[i].value;
+    if (atom >= 0) {
+        if (!info->atoms[atom]) {
+            info->atoms[atom] = value;
+            if (atom == USB_PROP_USBGUARD_ID) {
+                char *end;
+                unsigned long v = strtoul(value, &end, 10);
+                if (end != value && *end == '\0' && v <= UINT32_MAX) {
+                    info->usbguard_id = (uint32_t)v;
+                    info->has_usbguard_id = 1;
+                }
+            }
+        }
+        return;
+    }
+    if (info->prop_index_size) {
+        if (info->property_count * 2 > info->prop_index_size) index_rebuild(info);
+        else index_insert(info, i);
+    } else if (info->property_count > USB_PROP_INDEX_MIN) {
+        index_rebuild(info);
+    }
 }
 
 void usb_info_add_property(UsbDeviceInfo *info, const char *key, const char *value) {
+    if (!value) value = "";
+    usb_info_add_property_n(info, key, value, strlen(value));
+}
+
+void usb_info_add_property_n(UsbDeviceInfo *info, const char *key, const char *value, size_t value_len) {
     if (!info || !key) return;
-    UsbProperty *tmp = realloc(info->properties, (info->property_count + 1) * sizeof(UsbProperty));
-    if (!tmp) return;
-    info->properties = tmp;
-    info->properties[info->property_count].key = strdup(key);
-    info->properties[info->property_count].value = value ? strdup(value) : strdup("");
+    size_t key_len = strlen(key);
+    int atom = usb_prop_atom(key, key_len);
+    if (atom >= 0) {
+        usb_info_add_atom(info, (UsbPropAtom)atom, value, value_len);
+        return;
+    }
+    UsbProperty *p = property_slot(info);
+    if (!p) return;
+    p->key = info_strndup(info, key, key_len);
+    p->value = info_strndup(info, value ? value : "", value ? value_len : 0);
+    if (!p->key || !p->value) {
+        info_release(info, p->key);
+        info_release(info, p->value);
+        return;
+    }
+    info->property_count++;
+    property_added(info, -1);
+}
+
+void usb_info_add_atom(UsbDeviceInfo *info, UsbPropAtom atom, const char *value, size_t value_len) {
+    if (!info || (unsigned)atom >= USB_PROP_ATOM_COUNT) return;
+    UsbProperty *p = property_slot(info);
+    if (!p) return;
+    p->key = (char *)ATOM_NAMES[atom];
+    p->value = info_strndup(info, value ? value : "", value ? value_len : 0);
+    if (!p->value) return;
     info->property_count++;
+    property_added(info, (int)atom);
+}
+
+UsbDeviceInfo *usb_info_clone(Arena *arena, const UsbDeviceInfo *src) {
+    if (!src) return NULL;
+    UsbDeviceInfo *d = usb_info_create_in(arena);
+    if (!d) return NULL;
+    if (src->id) d->id = info_strndup(d, src->id, strlen(src->id));
+    if (src->name) d->name = info_strndup(d, src->name, strlen(src->name));
+    if (src->serial) d->serial = info_strndup(d, src->serial, strlen(src->serial));
+    for (size_t i = 0; i < src->property_count; i++) {
+        const UsbProperty *p = &src->properties[i];
+        int atom = usb_prop_atom(p->key, strlen(p->key));
+        if (atom >= 0) usb_info_add_atom(d, (UsbPropAtom)atom, p->value, strlen(p->value));
+        else usb_info_add_property(d, p->key, p->value);
+    }
+    return d;
 }
 
 void usb_info_print(const UsbDeviceInfo *info) {
@@ -71,6 +260,17 @@ void usb_info_print(const UsbDeviceInfo *info) {
 
 const char *usb_info_get_property(const UsbDeviceInfo *info, const char *key) {
     if (!info || !key) return NULL;
+    int atom = atom_of_cstr(key);
+    if (atom >= 0) return info->atoms[atom];
+
+    if (info->prop_index_size) {
+        size_t mask = info->prop_index_size - 1;
+        for (size_t h = key_hash(key) & mask;; h = (h + 1) & mask) {
+            uint16_t slot = info->prop_index[h];
+            if (!slot) return NULL;
+            if (strcmp(info->properties[slot - 1].key, key) == 0) return info->properties[slot - 1].value;
+        }
+    }
     for (size_t i = 0; i < info->property_count; i++) {
         if (info->properties[i].key && strcmp(info->properties[i].key, key) == 0) {
             return info->properties[i].value;
@@ -78,3 +278,61 @@ const char *usb_info_get_property(const UsbDeviceInfo *info, const char *key) {
     }
     return NULL;
 }
+
+const char *usb_info_get_atom(const UsbDeviceInfo *info, UsbPropAtom atom) {
+    if (!info || (unsigned)atom >= USB_PROP_ATOM_COUNT) return NULL;
+    return info->atoms[atom];
+}
+
+int usb_info_usbguard_id(const UsbDeviceInfo *info, uint32_t *id) {
+    if (!info || !info->has_usbguard_id) return -1;
+    if (id) *id = info->usbguard_id;
+    return 0;
+}
+
+/* Read a single-line sysfs attribute <dir>/<attr> into out (trailing newline stripped) */
+static int read_sysfs_attr(const char *dir, const char *attr, char *out, size_t outsz) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    if (!fgets(out, (int)outsz, f)) { fclose(f); return -1; }
+    fclose(f);
+    out[strcspn(out, "\r\n")] = '\0';
+    return 0;
+}
+
+UsbDeviceInfo *usb_info_from_block_device(const char *dev_path) {
+    if (!dev_path) return NULL;
+    UsbDeviceInfo *info = usb_info_create();
+    if (!info) return NULL;
+
+    const char *base = strrchr(dev_path, '/');
+    base = base ? base + 1 : dev_path;
+    usb_info_add_atom(info, USB_PROP_BLOCK_DEVICE, dev_path, strlen(dev_path));
+
+    /* /sys/class/block/<name> -> /sys/devices/.../usbX/X-Y/X-Y:1.0/.../block/<name> */
+    char link[PATH_MAX];
+    char dir[PATH_MAX];
+    snprintf(link, sizeof(link), "/sys/class/block/%s", base);
+    if (realpath(link, dir)) {
+        char vid[16], pid[16];
+        /* walk up until a directory carrying idVendor (the USB device node) */
+        for (char *slash = strrchr(dir, '/'); slash && slash != dir; slash = strrchr(dir, '/')) {
+            if (read_sysfs_attr(dir, "idVendor", vid, sizeof(vid)) == 0 &&
+                read_sysfs_attr(dir, "idProduct", pid, sizeof(pid)) == 0) {
+                char buf[256];
+                usb_info_set_id(info, vid, pid);
+                if (read_sysfs_attr(dir, "product", buf, sizeof(buf)) == 0)
+                    usb_info_set_name(info, buf);
+                if (read_sysfs_attr(dir, "serial", buf, sizeof(buf)) == 0)
+                    usb_info_set_serial(info, buf);
+                break;
+            }
+            *slash = '\0';
+        }
+    }
+
+    if (!info->name) usb_info_set_name(info, base);
+    return info;
+}
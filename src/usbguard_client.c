@@ -0,0 +1,318 @@
+#include "../inc/usbguard_client.h"
+#include "../inc/metrics.h"
+#include <dbus/dbus.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct UsbGuardClient {
+    DBusConnection *conn;
+    int timeout_ms;
+    pthread_mutex_t lock;       // protects service
+    const char *service;        // resolved bus name, NULL = not resolved / not running
+};
+
+struct UsbGuardCall {
+    UsbGuardClient *client;
+    DBusPendingCall *pending;
+    int error;                  // set when the request could not be sent
+    uint64_t started;           // metrics span start (0 when metrics are off)
+};
+
+/* NameHasOwner on the bus daemon: local to the bus, never routed to USBGuard. */
+static int name_has_owner(UsbGuardClient *c, const char *name) {
+    DBusMessage *msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                                    DBUS_INTERFACE_DBUS, "NameHasOwner");
+    if (!msg) return 0;
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(c->conn, msg, c->timeout_ms, NULL);
+    dbus_message_unref(msg);
+    dbus_bool_t has = FALSE;
+    if (reply) {
+        dbus_message_get_args(reply, NULL, DBUS_TYPE_BOOLEAN, &has, DBUS_TYPE_INVALID);
+        dbus_message_unref(reply);
+    }
+    return has ? 1 : 0;
+}
+
+/* Resolved service name, resolving it if needed. */
+static const char *client_service(UsbGuardClient *c) {
+    pthread_mutex_lock(&c->lock);
+    const char *svc = c->service;
+    pthread_mutex_unlock(&c->lock);
+    if (svc) return svc;
+
+    for (const char *const *cand = usbguard_bus_names; *cand; cand++) {
+        if (name_has_owner(c, *cand)) {
+            svc = *cand;
+            break;
+        }
+    }
+    pthread_mutex_lock(&c->lock);
+    c->service = svc;
+    pthread_mutex_unlock(&c->lock);
+    return svc;
+}
+
+static void client_forget_service(UsbGuardClient *c) {
+    pthread_mutex_lock(&c->lock);
+    c->service = NULL;
+    pthread_mutex_unlock(&c->lock);
+}
+
+UsbGuardClient *usbguard_client_open(int timeout_ms) {
+    // the connection is shared by every thread using the client
+    dbus_threads_init_default();
+
+    UsbGuardClient *c = calloc(1, sizeof(UsbGuardClient));
+    if (!c) return NULL;
+    c->timeout_ms = timeout_ms > 0 ? timeout_ms : USBGUARD_CLIENT_TIMEOUT_MS;
+    pthread_mutex_init(&c->lock, NULL);
+
+    DBusError err;
+    dbus_error_init(&err);
+    const char *addr = usbguard_bus_address();
+    c->conn = addr ? dbus_connection_open_private(addr, &err) : dbus_bus_get_private(DBUS_BUS_SYSTEM, &err);
+    if (c->conn && addr && !dbus_bus_register(c->conn, &err)) {
+        dbus_connection_close(c->conn);
+        dbus_connection_unref(c->conn);
+        c->conn = NULL;
+    }
+    if (!c->conn) {
+        fprintf(stderr, "usbguard_client: cannot connect to %s: %s\n", addr ? addr : "system bus",
+                dbus_error_is_set(&err) ? err.message : "unknown error");
+        dbus_error_free(&err);
+        pthread_mutex_destroy(&c->lock);
+        free(c);
+        return NULL;
+    }
+    dbus_connection_set_exit_on_disconnect(c->conn, FALSE);
+    client_service(c);
+    return c;
+}
+
+void usbguard_client_close(UsbGuardClient *c) {
+    if (!c) return;
+    dbus_connection_close(c->conn);
+    dbus_connection_unref(c->conn);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+const char *usbguard_client_service(UsbGuardClient *c) {
+    return c ? client_service(c) : NULL;
+}
+
+/* Takes ownership of msg (may be NULL after an allocation failure). */
+static UsbGuardCall *client_send(UsbGuardClient *c, DBusMessage *msg) {
+    UsbGuardCall *call = calloc(1, sizeof(UsbGuardCall));
+    if (!call) {
+        if (msg) dbus_message_unref(msg);
+        return NULL;
+    }
+    call->client = c;
+    call->started = metrics_span_begin();
+    if (!msg) {
+        call->error = -ENOMEM;
+    } else if (!dbus_connection_get_is_connected(c->conn)) {
+        call->error = -ENOTCONN;
+    } else if (!dbus_connection_send_with_reply(c->conn, msg, &call->pending, c->timeout_ms) || !call->pending) {
+        call->error = -ENOTCONN;
+    }
+    if (msg) dbus_message_unref(msg);
+    return call;
+}
+
+static DBusMessage *new_call(UsbGuardClient *c, const char *path, const char *iface, const char *method,
+                             int *error) {
+    const char *svc = client_service(c);
+    if (!svc) {
+        *error = -ENOENT;
+        return NULL;
+    }
+    DBusMessage *msg = dbus_message_new_method_call(svc, path, iface, method);
+    if (!msg) *error = -ENOMEM;
+    return msg;
+}
+
+static UsbGuardCall *error_call(UsbGuardClient *c, int error) {
+    UsbGuardCall *call = calloc(1, sizeof(UsbGuardCall));
+    if (call) {
+        call->client = c;
+        call->error = error;
+    }
+    return call;
+}
+
+UsbGuardCall *usbguard_client_list_devices_async(UsbGuardClient *c, const char *query) {
+    if (!c) return NULL;
+    int error = 0;
+    DBusMessage *msg = new_call(c, USBGUARD_DEVICES_PATH, USBGUARD_DEVICES_IFACE, "listDevices", &error);
+    if (!msg) return error_call(c, error);
+    // query can be "" or "allow"/"block"/"match ..."
+    const char *q = query ? query : "";
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &q, DBUS_TYPE_INVALID)) {
+        dbus_message_unref(msg);
+        return error_call(c, -ENOMEM);
+    }
+    return client_send(c, msg);
+}
+
+UsbGuardCall *usbguard_client_apply_policy_async(UsbGuardClient *c, uint32_t device_id,
+                                                 UsbGuardTarget target, int permanent) {
+    if (!c) return NULL;
+    if (target < USBGUARD_TARGET_ALLOW || target > USBGUARD_TARGET_REJECT) return error_call(c, -EINVAL);
+    int error = 0;
+    DBusMessage *msg = new_call(c, USBGUARD_DEVICES_PATH, USBGUARD_DEVICES_IFACE, "applyDevicePolicy", &error);
+    if (!msg) return error_call(c, error);
+    dbus_uint32_t id = device_id, t = (dbus_uint32_t)target;
+    dbus_bool_t perm = permanent ? TRUE : FALSE;
+    if (!dbus_message_append_args(msg, DBUS_TYPE_UINT32, &id, DBUS_TYPE_UINT32, &t,
+                                  DBUS_TYPE_BOOLEAN, &perm, DBUS_TYPE_INVALID)) {
+        dbus_message_unref(msg);
+        return error_call(c, -ENOMEM);
+    }
+    return client_send(c, msg);
+}
+
+UsbGuardCall *usbguard_client_list_rules_async(UsbGuardClient *c, const char *label) {
+    if (!c) return NULL;
+    int error = 0;
+    DBusMessage *msg = new_call(c, USBGUARD_POLICY_PATH, USBGUARD_POLICY_IFACE, "listRules", &error);
+    if (!msg) return error_call(c, error);
+    const char *l = label ? label : "";
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &l, DBUS_TYPE_INVALID)) {
+        dbus_message_unref(msg);
+        return error_call(c, -ENOMEM);
+    }
+    return client_send(c, msg);
+}
+
+UsbGuardCall *usbguard_client_append_rule_async(UsbGuardClient *c, const char *rule, uint32_t parent_id,
+                                                int temporary) {
+    if (!c) return NULL;
+    if (!rule || !*rule) return error_call(c, -EINVAL);
+    int error = 0;
+    DBusMessage *msg = new_call(c, USBGUARD_POLICY_PATH, USBGUARD_POLICY_IFACE, "appendRule", &error);
+    if (!msg) return error_call(c, error);
+    dbus_uint32_t parent = parent_id;
+    dbus_bool_t temp = temporary ? TRUE : FALSE;
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &rule, DBUS_TYPE_UINT32, &parent,
+                                  DBUS_TYPE_BOOLEAN, &temp, DBUS_TYPE_INVALID)) {
+        dbus_message_unref(msg);
+        return error_call(c, -ENOMEM);
+    }
+    return client_send(c, msg);
+}
+
+/* Block for the reply and free the call. Returns the reply or NULL with *error set. */
+static DBusMessage *call_finish(UsbGuardCall *call, int *error) {
+    *error = call->error;
+    DBusMessage *reply = NULL;
+    if (!call->error) {
+        dbus_pending_call_block(call->pending);
+        reply = dbus_pending_call_steal_reply(call->pending);
+        if (!reply) {
+            *error = -EIO;
+        } else if (dbus_message_get_type(reply) == DBUS_MESSAGE_TYPE_ERROR) {
+            const char *name = dbus_message_get_error_name(reply);
+            if (!strcmp(name, DBUS_ERROR_SERVICE_UNKNOWN) || !strcmp(name, DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+                // daemon restarted or stopped: resolve again next time
+                client_forget_service(call->client);
+                *error = -ENOENT;
+            } else if (!strcmp(name, DBUS_ERROR_NO_REPLY) || !strcmp(name, DBUS_ERROR_TIMEOUT)) {
+                *error = -ETIMEDOUT;
+            } else if (!strcmp(name, DBUS_ERROR_DISCONNECTED)) {
+                *error = -ENOTCONN;
+            } else if (!strcmp(name, DBUS_ERROR_INVALID_ARGS)) {
+                *error = -EINVAL;
+            } else {
+                fprintf(stderr, "DBus call error: %s\n", name);
+                *error = -EIO;
+            }
+            dbus_message_unref(reply);
+            reply = NULL;
+        }
+    }
+    metrics_span_end(METRIC_STAGE_DBUS, call->started);
+    if (*error) metrics_failure(METRIC_STAGE_DBUS, *error);
+    usbguard_call_cancel(call);
+    return reply;
+}
+
+void usbguard_call_cancel(UsbGuardCall *call) {
+    if (!call) return;
+    if (call->pending) {
+        dbus_pending_call_cancel(call->pending);
+        dbus_pending_call_unref(call->pending);
+    }
+    free(call);
+}
+
+/* Parse a listDevices / listRules reply: OUT a(us) devices or rules, into one arena */
+static UsbDeviceList *devices_from_reply(DBusMessage *reply) {
+    UsbDeviceList *list = usbguard_device_list_create(1);
+    if (!list) return NULL;
+
+    DBusMessageIter args, arrayIter, structIter;
+    if (!dbus_message_iter_init(reply, &args) || dbus_message_iter_get_arg_type(&args) != DBUS_TYPE_ARRAY)
+        return list;
+
+    dbus_message_iter_recurse(&args, &arrayIter);
+    while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_STRUCT) {
+        dbus_message_iter_recurse(&arrayIter, &structIter);
+
+        // Read u (device id)
+        dbus_uint32_t device_id = 0;
+        if (dbus_message_iter_get_arg_type(&structIter) == DBUS_TYPE_UINT32)
+            dbus_message_iter_get_basic(&structIter, &device_id);
+        dbus_message_iter_next(&structIter);
+
+        // Read s (device rule string)
+        const char *device_rule = NULL;
+        if (dbus_message_iter_get_arg_type(&structIter) == DBUS_TYPE_STRING)
+            dbus_message_iter_get_basic(&structIter, &device_rule);
+
+        UsbDeviceInfo *dev = usbguard_device_from_rule_in(list->arena, device_id, device_rule);
+        if (dev) usbguard_device_list_append(list, dev);
+
+        dbus_message_iter_next(&arrayIter);
+    }
+    return list;
+}
+
+int usbguard_call_wait_devices(UsbGuardCall *call, UsbDeviceList **out) {
+    if (!call || !out) {
+        usbguard_call_cancel(call);
+        return -EINVAL;
+    }
+    int error;
+    DBusMessage *reply = call_finish(call, &error);
+    if (!reply) return error;
+    *out = devices_from_reply(reply);
+    dbus_message_unref(reply);
+    return *out ? 0 : -ENOMEM;
+}
+
+int usbguard_call_wait_u32(UsbGuardCall *call, uint32_t *out) {
+    if (!call) return -EINVAL;
+    int error;
+    DBusMessage *reply = call_finish(call, &error);
+    if (!reply) return error;
+    dbus_uint32_t v = 0;
+    int ok = dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &v, DBUS_TYPE_INVALID);
+    dbus_message_unref(reply);
+    if (!ok) return -EIO;
+    if (out) *out = v;
+    return 0;
+}
+
+int usbguard_client_list_devices(UsbGuardClient *c, const char *query, UsbDeviceList **out) {
+    return usbguard_call_wait_devices(usbguard_client_list_devices_async(c, query), out);
+}
+
+int usbguard_client_apply_policy(UsbGuardClient *c, uint32_t device_id, UsbGuardTarget target, int permanent) {
+    return usbguard_call_wait_u32(usbguard_client_apply_policy_async(c, device_id, target, permanent), NULL);
+}
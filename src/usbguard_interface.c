@@ -1,202 +1,199 @@
 #include "../inc/usbguard_interface.h"
-#include <dbus/dbus.h>
+#include "../inc/usbguard_client.h"
+#include "../inc/usbguard_rule.h"
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-// Constants for D-Bus
-static const char *OBJ_PATH = "/org/usbguard1/Devices";
-static const char *IFACE = "org.usbguard.Devices1";
-// Try a couple of well-known bus names (some systems expose different names)
-static const char *SERVICE_CANDIDATES[] = { "org.usbguard1", "org.usbguard", NULL };
+// Process-wide client behind usbguard_list_devices(): connected and resolved once.
+// Reference-counted so a reconnect never closes a client another thread is using:
+// g_client holds one reference, every call in progress another.
+typedef struct {
+    UsbGuardClient *client;
+    unsigned refs;              // guarded by g_client_lock
+} SharedClient;
 
-UsbDeviceList *usbguard_list_devices(const char *query) {
-    DBusConnection *conn;
-    DBusError err;
-    DBusMessage *msg = NULL, *reply = NULL;
-    DBusMessageIter args, arrayIter, structIter;
-    UsbDeviceList *list = NULL;
+static pthread_mutex_t g_client_lock = PTHREAD_MUTEX_INITIALIZER;
+static SharedClient *g_client;
 
-    dbus_error_init(&err);
-
-    list = calloc(1, sizeof(UsbDeviceList));
-    if (!list) return NULL;
+const char *const usbguard_bus_names[] = { USBGUARD_BUS_NAME, "org.usbguard", NULL };
 
-    // Kết nối tới system bus
-    conn = dbus_bus_get(DBUS_BUS_SYSTEM, &err);
-    if (dbus_error_is_set(&err)) {
-        fprintf(stderr, "dbus_bus_get error: %s\n", err.message);
-        dbus_error_free(&err);
-    }
-    if (!conn) {
-        fprintf(stderr, "Cannot connect to system bus\n");
-        free(list);
-        return NULL;
-    }
+const char *usbguard_bus_address(void) {
+    const char *addr = getenv(USBGUARD_BUS_ENV);
+    return addr && addr[0] ? addr : NULL;
+}
 
-    // Tạo message (we'll try multiple service names if needed)
-    for (const char **svc = SERVICE_CANDIDATES; *svc != NULL; svc++) {
-        msg = dbus_message_new_method_call(
-            *svc,
-            OBJ_PATH,
-            IFACE,
-            "listDevices"
-        );
-        if (!msg) {
-            fprintf(stderr, "Failed to create DBus message for service %s\n", *svc);
-            continue;
-        }
+/* Copy a view into the device's storage, decoding escapes in place if needed */
+static char *device_strview(UsbDeviceInfo *dev, StrView v, int unescape) {
+    char *s = usb_info_strndup(dev, v.ptr, v.len);
+    if (s && unescape) strview_unescape((StrView){ s, v.len }, s, v.len + 1);
+    return s;
+}
 
-        // Append query string (can be "" or "allow"/"block"/"match ...")
-        const char *q = query ? query : "";
-        if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &q, DBUS_TYPE_INVALID)) {
-            dbus_message_unref(msg);
-            msg = NULL;
-            continue;
-        }
+UsbDeviceInfo *usbguard_device_from_rule(unsigned int device_id, const char *device_rule) {
+    return usbguard_device_from_rule_in(NULL, device_id, device_rule);
+}
 
-        // Send and wait for reply
-        reply = dbus_connection_send_with_reply_and_block(conn, msg, -1, &err);
-        if (dbus_error_is_set(&err)) {
-            // If service unknown, try next candidate; otherwise report and abort
-            if (strstr(err.name, "ServiceUnknown") != NULL || strstr(err.name, "NameHasNoOwner") != NULL) {
-                dbus_error_free(&err);
-                dbus_message_unref(msg);
-                msg = NULL;
-                reply = NULL;
-                continue; // try next candidate service
+UsbDeviceInfo *usbguard_device_from_rule_in(Arena *arena, unsigned int device_id, const char *device_rule) {
+    UsbDeviceInfo *dev = usb_info_create_in(arena);
+    if (!dev) return NULL;
+
+    // store usbguard numeric id as property
+    char id_buf[32];
+    int id_len = snprintf(id_buf, sizeof(id_buf), "%u", device_id);
+    usb_info_add_atom(dev, USB_PROP_USBGUARD_ID, id_buf, (size_t)id_len);
+
+    // store raw rule string as property "raw_info"
+    if (device_rule)
+        usb_info_add_atom(dev, USB_PROP_RAW_INFO, device_rule, strlen(device_rule));
+    else
+        usb_info_add_atom(dev, USB_PROP_RAW_INFO, "", 0);
+
+    // One pass over the rule; values are views into device_rule until copied below.
+    // Example: block id 1d6b:0002 serial "..." name "..." hash "..." via-port "usb1" ...
+    if (device_rule) {
+        UsbGuardRule rule;
+        // on a syntax error the attributes before it are still usable
+        usbguard_rule_parse(device_rule, (size_t)-1, &rule);
+
+        const UsbGuardRuleValue *v = &rule.attrs[RULE_ATTR_ID];
+        if (v->present && !v->is_set && memchr(v->raw.ptr, ':', v->raw.len))
+            dev->id = device_strview(dev, v->raw, 0);
+        v = &rule.attrs[RULE_ATTR_NAME];
+        if (v->present && !v->is_set) dev->name = device_strview(dev, v->raw, v->escaped);
+        v = &rule.attrs[RULE_ATTR_SERIAL];
+        if (v->present && !v->is_set) dev->serial = device_strview(dev, v->raw, v->escaped);
+
+        // remaining attributes as properties (sets as their space-separated values)
+        static const struct { UsbGuardRuleAttr attr; UsbPropAtom atom; } extra[] = {
+            { RULE_ATTR_HASH, USB_PROP_HASH },
+            { RULE_ATTR_PARENT_HASH, USB_PROP_PARENT_HASH },
+            { RULE_ATTR_VIA_PORT, USB_PROP_VIA_PORT },
+            { RULE_ATTR_WITH_INTERFACE, USB_PROP_WITH_INTERFACE },
+            { RULE_ATTR_WITH_CONNECT_TYPE, USB_PROP_WITH_CONNECT_TYPE },
+            { RULE_ATTR_LABEL, USB_PROP_LABEL },
+        };
+        for (size_t i = 0; i < sizeof(extra) / sizeof(extra[0]); i++) {
+            v = &rule.attrs[extra[i].attr];
+            if (!v->present) continue;
+            StrView raw = v->raw;
+            while (raw.len && (raw.ptr[0] == ' ' || raw.ptr[0] == '\t')) { raw.ptr++; raw.len--; }
+            while (raw.len && (raw.ptr[raw.len - 1] == ' ' || raw.ptr[raw.len - 1] == '\t')) raw.len--;
+            if (v->escaped) {
+                char tmp[512];
+                size_t len = strview_unescape(raw, tmp, sizeof(tmp));
+                if (len < sizeof(tmp)) {
+                    usb_info_add_atom(dev, extra[i].atom, tmp, len);
+                    continue;
+                }
+                char *big = strview_dup(raw, 1);
+                if (big) usb_info_add_atom(dev, extra[i].atom, big, strlen(big));
+                free(big);
             } else {
-                fprintf(stderr, "DBus call error: %s\n", err.message);
-                dbus_error_free(&err);
-                dbus_message_unref(msg);
-                msg = NULL;
-                break;
+                usb_info_add_atom(dev, extra[i].atom, raw.ptr, raw.len);
             }
         }
-
-        // If we got a reply, break out of trying services
-        if (reply) break;
-        if (msg) { dbus_message_unref(msg); msg = NULL; }
-    }
-
-    if (!reply) {
-        // no reply from any service
-        free(list);
-        return NULL;
     }
 
-    // Parse reply: OUT a(us) devices
-    if (dbus_message_iter_init(reply, &args) &&
-        DBUS_TYPE_ARRAY == dbus_message_iter_get_arg_type(&args)) {
-
-        dbus_message_iter_recurse(&args, &arrayIter);
-
-        while (dbus_message_iter_get_arg_type(&arrayIter) == DBUS_TYPE_STRUCT) {
-            dbus_message_iter_recurse(&arrayIter, &structIter);
-
-            // Read u (device id)
-            unsigned int device_id = 0;
-            if (dbus_message_iter_get_arg_type(&structIter) == DBUS_TYPE_UINT32) {
-                dbus_message_iter_get_basic(&structIter, &device_id);
-            }
-            dbus_message_iter_next(&structIter);
-
-            // Read s (device rule string)
-            char *device_rule = NULL;
-            if (dbus_message_iter_get_arg_type(&structIter) == DBUS_TYPE_STRING) {
-                dbus_message_iter_get_basic(&structIter, &device_rule);
-            }
+    return dev;
+}
 
-            // Create UsbDeviceInfo and populate some properties
-            UsbDeviceInfo *dev = usb_info_create();
-            if (!dev) {
-                // allocation failed; skip
-                dbus_message_iter_next(&arrayIter);
-                continue;
-            }
+/* A reference to the shared client, connecting it first if needed; NULL if the bus is unreachable */
+static SharedClient *shared_client_get(void) {
+    pthread_mutex_lock(&g_client_lock);
+    if (!g_client && (g_client = calloc(1, sizeof(SharedClient))) != NULL) {
+        g_client->refs = 1;
+        if (!(g_client->client = usbguard_client_open(0))) {
+            free(g_client);
+            g_client = NULL;
+        }
+    }
+    SharedClient *sc = g_client;
+    if (sc) sc->refs++;
+    pthread_mutex_unlock(&g_client_lock);
+    return sc;
+}
 
-            // store usbguard numeric id as property
-            char id_buf[32];
-            snprintf(id_buf, sizeof(id_buf), "%u", device_id);
-            usb_info_add_property(dev, "usbguard_id", id_buf);
-
-            // store raw rule string as property "raw_info"
-            if (device_rule)
-                usb_info_add_property(dev, "raw_info", device_rule);
-            else
-                usb_info_add_property(dev, "raw_info", "");
-
-            // Attempt to parse some known attributes from device_rule (simple parse)
-            // Example rule contains: id 1d6b:0002 serial "..." name "..." ...
-            if (device_rule) {
-                // find id (VID:PID)
-                char *p = strstr(device_rule, "id ");
-                if (p) {
-                    p += 3;
-                    char vidpid[32] = {0};
-                    sscanf(p, "%31s", vidpid);
-                    if (strlen(vidpid) > 0) {
-                        // split vendor/product
-                        char *colon = strchr(vidpid, ':');
-                        if (colon) {
-                            *colon = '\0';
-                            usb_info_set_id(dev, vidpid, colon+1);
-                        }
-                    }
-                }
+static void shared_client_put(SharedClient *sc) {
+    pthread_mutex_lock(&g_client_lock);
+    int last = --sc->refs == 0;
+    pthread_mutex_unlock(&g_client_lock);
+    if (last) {
+        usbguard_client_close(sc->client);
+        free(sc);
+    }
+}
 
-                // find name "..."
-                p = strstr(device_rule, "name \"");
-                if (p) {
-                    p += strlen("name \"");
-                    char tmp[256] = {0};
-                    char *q = strchr(p, '"');
-                    if (q) {
-                        size_t len = q - p;
-                        if (len >= sizeof(tmp)) len = sizeof(tmp)-1;
-                        memcpy(tmp, p, len);
-                        usb_info_set_name(dev, tmp);
-                    }
-                }
+/* Stop handing out sc; it is closed once the last call using it returns */
+static void shared_client_retire(SharedClient *sc) {
+    pthread_mutex_lock(&g_client_lock);
+    int retired = g_client == sc;
+    if (retired) g_client = NULL;
+    pthread_mutex_unlock(&g_client_lock);
+    if (retired) shared_client_put(sc);
+}
 
-                // find serial "..."
-                p = strstr(device_rule, "serial \"");
-                if (p) {
-                    p += strlen("serial \"");
-                    char tmp[256] = {0};
-                    char *q = strchr(p, '"');
-                    if (q) {
-                        size_t len = q - p;
-                        if (len >= sizeof(tmp)) len = sizeof(tmp)-1;
-                        memcpy(tmp, p, len);
-                        usb_info_set_serial(dev, tmp);
-                    }
-                }
-            }
+UsbDeviceList *usbguard_list_devices(const char *query) {
+    SharedClient *sc = shared_client_get();
+    if (!sc) {
+        fprintf(stderr, "Cannot connect to system bus\n");
+        return NULL;
+    }
 
-            // Append to list
-            UsbDeviceInfo **tmp = realloc(list->devices, (list->count + 1) * sizeof(UsbDeviceInfo *));
-            if (!tmp) {
-                usb_info_free(dev);
-            } else {
-                list->devices = tmp;
-                list->devices[list->count] = dev;
-                list->count++;
-            }
+    UsbDeviceList *list = NULL;
+    int rc = usbguard_client_list_devices(sc->client, query, &list);
+    if (rc == -ENOTCONN) {
+        // bus connection lost (e.g. dbus restart): reconnect once
+        shared_client_retire(sc);
+        shared_client_put(sc);
+        sc = shared_client_get();
+        rc = sc ? usbguard_client_list_devices(sc->client, query, &list) : -ENOTCONN;
+    }
+    if (sc) shared_client_put(sc);
+    if (rc != 0) return NULL;
+    return list;
+}
 
-            dbus_message_iter_next(&arrayIter);
-        }
+UsbDeviceList *usbguard_device_list_create(int use_arena) {
+    UsbDeviceList *list = calloc(1, sizeof(UsbDeviceList));
+    if (!list) return NULL;
+    if (use_arena && !(list->arena = arena_create(64 * 1024))) {
+        free(list);
+        return NULL;
     }
+    return list;
+}
 
-    // cleanup
-    if (msg) dbus_message_unref(msg);
-    if (reply) dbus_message_unref(reply);
+UsbDeviceInfo *usbguard_device_list_new_device(UsbDeviceList *list) {
+    return list ? usb_info_create_in(list->arena) : NULL;
+}
 
-    return list;
+int usbguard_device_list_append(UsbDeviceList *list, UsbDeviceInfo *dev) {
+    if (!list || !dev) return -EINVAL;
+    if (list->count == list->capacity) {
+        size_t cap = list->capacity ? list->capacity * 2 : 16;
+        UsbDeviceInfo **tmp = list->arena
+            ? arena_realloc(list->arena, list->devices, list->capacity * sizeof(UsbDeviceInfo *),
+                            cap * sizeof(UsbDeviceInfo *))
+            : realloc(list->devices, cap * sizeof(UsbDeviceInfo *));
+        if (!tmp) return -ENOMEM;
+        list->devices = tmp;
+        list->capacity = cap;
+    }
+    list->devices[list->count++] = dev;
+    return 0;
 }
 
 void usbguard_free_device_list(UsbDeviceList *list) {
     if (!list) return;
+    if (list->arena) {
+        // one release for every device, string and the array
+        arena_destroy(list->arena);
+        free(list);
+        return;
+    }
     for (size_t i = 0; i < list->count; i++) {
         usb_info_free(list->devices[i]);
     }
@@ -0,0 +1,433 @@
+#include "../inc/usbguard_monitor.h"
+#include <dbus/dbus.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MONITOR_SEED_TIMEOUT_MS     5000
+#define MONITOR_POLL_MS             200     // only bounds how long stop() waits
+#define MONITOR_INITIAL_BUCKETS     64
+
+typedef struct DevEntry {
+    uint32_t id;
+    int target;
+    int seen;                       // mark for re-seeding
+    UsbDeviceInfo *info;
+    struct DevEntry *next;
+} DevEntry;
+
+struct UsbGuardMonitor {
+    DBusConnection *conn;
+    pthread_t thread;
+    int stop;                       // __atomic: set by stop(), read by the monitor thread
+    const char *service;            // entry of usbguard_bus_names owned by USBGuard, NULL =
+                                    // not running; seeding and the monitor thread only
+    UsbGuardEventFn callback;
+    void *user;
+
+    // only the monitor thread modifies the table; the lock guards it against readers
+    pthread_mutex_t lock;
+    DevEntry **buckets;
+    size_t nbuckets;
+    size_t count;
+};
+
+static const char *PRESENCE_MATCH =
+    "type='signal',interface='" USBGUARD_DEVICES_IFACE "',path='" USBGUARD_DEVICES_PATH "'";
+static const char *OWNER_MATCH_FMT =
+    "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+    "member='NameOwnerChanged',arg0='%s'";
+
+/* ---------- device table ---------- */
+
+static DevEntry **table_slot(UsbGuardMonitor *m, uint32_t id) {
+    DevEntry **pp = &m->buckets[(id * 2654435761u) & (m->nbuckets - 1)];
+    while (*pp && (*pp)->id != id) pp = &(*pp)->next;
+    return pp;
+}
+
+static void table_grow(UsbGuardMonitor *m) {
+    size_t n = m->nbuckets * 2;
+    DevEntry **nb = calloc(n, sizeof(DevEntry *));
+    if (!nb) return;            // keep the longer chains
+    for (size_t i = 0; i < m->nbuckets; i++) {
+        DevEntry *e = m->buckets[i];
+        while (e) {
+            DevEntry *next = e->next;
+            size_t b = (e->id * 2654435761u) & (n - 1);
+            e->next = nb[b];
+            nb[b] = e;
+            e = next;
+        }
+    }
+    free(m->buckets);
+    m->buckets = nb;
+    m->nbuckets = n;
+}
+
+static int target_from_rule(const char *rule) {
+    if (!rule) return -1;
+    if (strncmp(rule, "allow", 5) == 0) return USBGUARD_TARGET_ALLOW;
+    if (strncmp(rule, "block", 5) == 0) return USBGUARD_TARGET_BLOCK;
+    if (strncmp(rule, "reject", 6) == 0) return USBGUARD_TARGET_REJECT;
+    return -1;
+}
+
+static UsbDeviceInfo *device_build(uint32_t id, const char *rule, int target) {
+    UsbDeviceInfo *info = usbguard_device_from_rule(id, rule);
+    if (info && target >= 0) {
+        const char *t = usbguard_target_name(target);
+        usb_info_add_atom(info, USB_PROP_TARGET, t, strlen(t));
+    }
+    return info;
+}
+
+/* Insert or replace; returns the entry (NULL on allocation failure). Monitor thread only. */
+static DevEntry *table_upsert(UsbGuardMonitor *m, uint32_t id, const char *rule, int target) {
+    UsbDeviceInfo *info = device_build(id, rule, target);
+    if (!info) return NULL;
+
+    pthread_mutex_lock(&m->lock);
+    DevEntry **pp = table_slot(m, id);
+    DevEntry *e = *pp;
+    UsbDeviceInfo *old = NULL;
+    if (e) {
+        old = e->info;
+    } else if ((e = calloc(1, sizeof(DevEntry))) != NULL) {
+        e->id = id;
+        *pp = e;
+        if (++m->count > m->nbuckets * 2) table_grow(m);
+    }
+    if (e) {
+        e->info = info;
+        e->target = target;
+        e->seen = 1;
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    // the replaced object is not visible to readers any more (snapshots copy under the lock)
+    usb_info_free(old);
+    if (!e) usb_info_free(info);
+    return e;
+}
+
+/* Unlink and return the entry (caller frees after the callback). */
+static DevEntry *table_remove(UsbGuardMonitor *m, uint32_t id) {
+    pthread_mutex_lock(&m->lock);
+    DevEntry **pp = table_slot(m, id);
+    DevEntry *e = *pp;
+    if (e) {
+        *pp = e->next;
+        m->count--;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return e;
+}
+
+static void entry_free(DevEntry *e) {
+    if (!e) return;
+    usb_info_free(e->info);
+    free(e);
+}
+
+static void fire(UsbGuardMonitor *m, UsbGuardEventType type, uint32_t id, int target,
+                 int old_target, const UsbDeviceInfo *info) {
+    if (!m->callback) return;
+    UsbGuardEvent ev = { type, id, target, old_target, info };
+    m->callback(&ev, m->user);
+}
+
+/* ---------- seeding ---------- */
+
+/* NameHasOwner on the bus daemon, as the client resolves the service */
+static int name_has_owner(UsbGuardMonitor *m, const char *name) {
+    DBusMessage *msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                                    DBUS_INTERFACE_DBUS, "NameHasOwner");
+    if (!msg) return 0;
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &name, DBUS_TYPE_INVALID);
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(m->conn, msg, MONITOR_SEED_TIMEOUT_MS, NULL);
+    dbus_message_unref(msg);
+    dbus_bool_t has = FALSE;
+    if (reply) {
+        dbus_message_get_args(reply, NULL, DBUS_TYPE_BOOLEAN, &has, DBUS_TYPE_INVALID);
+        dbus_message_unref(reply);
+    }
+    return has ? 1 : 0;
+}
+
+/* The usbguard_bus_names entry equal to name, or NULL */
+static const char *known_bus_name(const char *name) {
+    for (const char *const *cand = usbguard_bus_names; *cand; cand++) {
+        if (strcmp(name, *cand) == 0) return *cand;
+    }
+    return NULL;
+}
+
+/* listDevices("match") and reconcile the table with it. */
+static void monitor_seed(UsbGuardMonitor *m) {
+    for (const char *const *cand = usbguard_bus_names; *cand && !m->service; cand++) {
+        if (name_has_owner(m, *cand)) m->service = *cand;
+    }
+    // daemon not running yet: NameOwnerChanged triggers the seed later
+    if (!m->service) return;
+
+    DBusError err;
+    dbus_error_init(&err);
+    DBusMessage *msg = dbus_message_new_method_call(m->service, USBGUARD_DEVICES_PATH,
+                                                    USBGUARD_DEVICES_IFACE, "listDevices");
+    const char *q = "match";
+    if (!msg || !dbus_message_append_args(msg, DBUS_TYPE_STRING, &q, DBUS_TYPE_INVALID)) {
+        if (msg) dbus_message_unref(msg);
+        return;
+    }
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(m->conn, msg, MONITOR_SEED_TIMEOUT_MS, &err);
+    dbus_message_unref(msg);
+    if (!reply) {
+        // gone again: resolved afresh on the next NameOwnerChanged
+        m->service = NULL;
+        dbus_error_free(&err);
+        return;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    for (size_t i = 0; i < m->nbuckets; i++)
+        for (DevEntry *e = m->buckets[i]; e; e = e->next) e->seen = 0;
+    pthread_mutex_unlock(&m->lock);
+
+    DBusMessageIter args, array, st;
+    if (dbus_message_iter_init(reply, &args) && dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_ARRAY) {
+        dbus_message_iter_recurse(&args, &array);
+        while (dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT) {
+            dbus_uint32_t id = 0;
+            const char *rule = NULL;
+            dbus_message_iter_recurse(&array, &st);
+            if (dbus_message_iter_get_arg_type(&st) == DBUS_TYPE_UINT32) dbus_message_iter_get_basic(&st, &id);
+            dbus_message_iter_next(&st);
+            if (dbus_message_iter_get_arg_type(&st) == DBUS_TYPE_STRING) dbus_message_iter_get_basic(&st, &rule);
+
+            int target = target_from_rule(rule);
+            DevEntry *e = table_upsert(m, id, rule, target);
+            if (e) fire(m, USBGUARD_EVENT_PRESENT, id, target, -1, e->info);
+            dbus_message_iter_next(&array);
+        }
+    }
+    dbus_message_unref(reply);
+
+    // devices that disappeared while the daemon was away
+    for (;;) {
+        uint32_t gone = 0;
+        int found = 0;
+        pthread_mutex_lock(&m->lock);
+        for (size_t i = 0; i < m->nbuckets && !found; i++)
+            for (DevEntry *e = m->buckets[i]; e && !found; e = e->next)
+                if (!e->seen) { gone = e->id; found = 1; }
+        pthread_mutex_unlock(&m->lock);
+        if (!found) break;
+        DevEntry *e = table_remove(m, gone);
+        if (e) fire(m, USBGUARD_EVENT_REMOVE, e->id, e->target, -1, e->info);
+        entry_free(e);
+    }
+}
+
+/* ---------- signal handling ---------- */
+
+static void on_presence(UsbGuardMonitor *m, DBusMessage *msg) {
+    dbus_uint32_t id, event, target;
+    const char *rule = NULL;
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &id, DBUS_TYPE_UINT32, &event,
+                               DBUS_TYPE_UINT32, &target, DBUS_TYPE_STRING, &rule, DBUS_TYPE_INVALID))
+        return;
+
+    if (event == USBGUARD_EVENT_REMOVE) {
+        DevEntry *e = table_remove(m, id);
+        fire(m, USBGUARD_EVENT_REMOVE, id, (int)target, -1, e ? e->info : NULL);
+        entry_free(e);
+        return;
+    }
+    if (event > USBGUARD_EVENT_UPDATE) return;
+    DevEntry *e = table_upsert(m, id, rule, (int)target);
+    if (e) fire(m, (UsbGuardEventType)event, id, (int)target, -1, e->info);
+}
+
+static void on_policy(UsbGuardMonitor *m, DBusMessage *msg) {
+    dbus_uint32_t id, old_target, new_target;
+    const char *rule = NULL;
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &id, DBUS_TYPE_UINT32, &old_target,
+                               DBUS_TYPE_UINT32, &new_target, DBUS_TYPE_STRING, &rule, DBUS_TYPE_INVALID))
+        return;
+    DevEntry *e = table_upsert(m, id, rule, (int)new_target);
+    if (e) fire(m, USBGUARD_EVENT_POLICY, id, (int)new_target, (int)old_target, e->info);
+}
+
+static DBusHandlerResult monitor_filter(DBusConnection *conn, DBusMessage *msg, void *data) {
+    (void)conn;
+    UsbGuardMonitor *m = data;
+    if (dbus_message_is_signal(msg, USBGUARD_DEVICES_IFACE, "DevicePresenceChanged")) {
+        on_presence(m, msg);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+    if (dbus_message_is_signal(msg, USBGUARD_DEVICES_IFACE, "DevicePolicyChanged")) {
+        on_policy(m, msg);
+        return DBUS_HANDLER_RESULT_HANDLED;
+    }
+    if (dbus_message_is_signal(msg, "org.freedesktop.DBus", "NameOwnerChanged")) {
+        const char *name = NULL, *old_owner = NULL, *new_owner = NULL;
+        const char *known;
+        if (dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &name, DBUS_TYPE_STRING, &old_owner,
+                                  DBUS_TYPE_STRING, &new_owner, DBUS_TYPE_INVALID) &&
+            (known = known_bus_name(name)) != NULL) {
+            if (new_owner[0] && (!m->service || m->service == known)) {
+                m->service = known;
+                monitor_seed(m);
+            } else if (!new_owner[0] && m->service == known) {
+                m->service = NULL;
+            }
+        }
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static void *monitor_thread(void *arg) {
+    UsbGuardMonitor *m = arg;
+    while (!__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE)) {
+        // wakes as soon as a message arrives; FALSE means the connection is gone
+        if (!dbus_connection_read_write_dispatch(m->conn, MONITOR_POLL_MS)) {
+            fprintf(stderr, "usbguard_monitor: bus connection lost\n");
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* ---------- public API ---------- */
+
+UsbGuardMonitor *usbguard_monitor_start(UsbGuardEventFn callback, void *user) {
+    UsbGuardMonitor *m = calloc(1, sizeof(UsbGuardMonitor));
+    if (!m) return NULL;
+    m->callback = callback;
+    m->user = user;
+    pthread_mutex_init(&m->lock, NULL);
+    m->nbuckets = MONITOR_INITIAL_BUCKETS;
+    m->buckets = calloc(m->nbuckets, sizeof(DevEntry *));
+    if (!m->buckets) goto fail;
+
+    // a private connection: the dispatch loop must not steal replies from other users
+    DBusError err;
+    dbus_error_init(&err);
+    const char *addr = usbguard_bus_address();
+    m->conn = addr ? dbus_connection_open_private(addr, &err) : dbus_bus_get_private(DBUS_BUS_SYSTEM, &err);
+    if (m->conn && addr && !dbus_bus_register(m->conn, &err)) {
+        dbus_connection_close(m->conn);
+        dbus_connection_unref(m->conn);
+        m->conn = NULL;
+    }
+    if (!m->conn) {
+        fprintf(stderr, "usbguard_monitor: cannot connect to %s: %s\n", addr ? addr : "system bus",
+                dbus_error_is_set(&err) ? err.message : "unknown error");
+        dbus_error_free(&err);
+        goto fail;
+    }
+    dbus_connection_set_exit_on_disconnect(m->conn, FALSE);
+
+    // subscribe before seeding so no insertion falls between the two
+    dbus_bus_add_match(m->conn, PRESENCE_MATCH, &err);
+    for (const char *const *cand = usbguard_bus_names; *cand && !dbus_error_is_set(&err); cand++) {
+        char match[256];
+        snprintf(match, sizeof(match), OWNER_MATCH_FMT, *cand);
+        dbus_bus_add_match(m->conn, match, &err);
+    }
+    if (dbus_error_is_set(&err)) {
+        fprintf(stderr, "usbguard_monitor: AddMatch failed: %s\n", err.message);
+        dbus_error_free(&err);
+        goto fail;
+    }
+    if (!dbus_connection_add_filter(m->conn, monitor_filter, m, NULL)) goto fail;
+
+    monitor_seed(m);
+
+    if (pthread_create(&m->thread, NULL, monitor_thread, m) != 0) {
+        dbus_connection_remove_filter(m->conn, monitor_filter, m);
+        goto fail;
+    }
+    return m;
+
+fail:
+    if (m->conn) {
+        dbus_connection_close(m->conn);
+        dbus_connection_unref(m->conn);
+        m->conn = NULL;
+    }
+    m->thread = 0;
+    usbguard_monitor_stop(m);
+    return NULL;
+}
+
+void usbguard_monitor_stop(UsbGuardMonitor *m) {
+    if (!m) return;
+    if (m->thread) {
+        __atomic_store_n(&m->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(m->thread, NULL);
+    }
+    if (m->conn) {
+        dbus_connection_remove_filter(m->conn, monitor_filter, m);
+        dbus_connection_close(m->conn);
+        dbus_connection_unref(m->conn);
+    }
+    for (size_t i = 0; m->buckets && i < m->nbuckets; i++) {
+        DevEntry *e = m->buckets[i];
+        while (e) {
+            DevEntry *next = e->next;
+            entry_free(e);
+            e = next;
+        }
+    }
+    free(m->buckets);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+}
+
+UsbDeviceList *usbguard_monitor_snapshot(UsbGuardMonitor *m) {
+    if (!m) return NULL;
+    UsbDeviceList *list = usbguard_device_list_create(1);
+    if (!list) return NULL;
+
+    pthread_mutex_lock(&m->lock);
+    for (size_t i = 0; i < m->nbuckets; i++) {
+        for (DevEntry *e = m->buckets[i]; e; e = e->next) {
+            UsbDeviceInfo *d = usb_info_clone(list->arena, e->info);
+            if (d) usbguard_device_list_append(list, d);
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+    return list;
+}
+
+size_t usbguard_monitor_count(UsbGuardMonitor *m) {
+    if (!m) return 0;
+    pthread_mutex_lock(&m->lock);
+    size_t n = m->count;
+    pthread_mutex_unlock(&m->lock);
+    return n;
+}
+
+const char *usbguard_event_name(UsbGuardEventType type) {
+    switch (type) {
+    case USBGUARD_EVENT_PRESENT: return "present";
+    case USBGUARD_EVENT_INSERT:  return "insert";
+    case USBGUARD_EVENT_UPDATE:  return "update";
+    case USBGUARD_EVENT_REMOVE:  return "remove";
+    case USBGUARD_EVENT_POLICY:  return "policy";
+    }
+    return "unknown";
+}
+
+const char *usbguard_target_name(int target) {
+    switch (target) {
+    case USBGUARD_TARGET_ALLOW:  return "allow";
+    case USBGUARD_TARGET_BLOCK:  return "block";
+    case USBGUARD_TARGET_REJECT: return "reject";
+    }
+    return "unknown";
+}
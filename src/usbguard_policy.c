@@ -0,0 +1,232 @@
+#include "../inc/usbguard_policy.h"
+#include "../inc/usbguard_rule.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RULE_KEY_MAX 512
+
+struct UsbGuardRuleCache {
+    pthread_mutex_t lock;
+    char **keys;                    /* open addressing, NULL = empty */
+    uint64_t *hashes;
+    size_t cap;                     /* power of two, 0 = nothing allocated yet */
+    size_t count;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t key_hash(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    for (; *s; s++) { h ^= (unsigned char)*s; h *= 1099511628211ULL; }
+    return h;
+}
+
+/* "<target> h <hash>" or "<target> i <vid:pid> s <serial>" (values as written in the rule,
+ * still escaped). Rules that do not name one device (no hash, no id + serial) get no key. */
+static int rule_key(int target, const char *rule, char *out, size_t outsz) {
+    if (!rule || target < USBGUARD_TARGET_ALLOW || target > USBGUARD_TARGET_REJECT) return -1;
+    UsbGuardRule r;
+    usbguard_rule_parse(rule, (size_t)-1, &r);      /* attributes before a syntax error count */
+    const UsbGuardRuleValue *hash = &r.attrs[RULE_ATTR_HASH];
+    const UsbGuardRuleValue *id = &r.attrs[RULE_ATTR_ID], *serial = &r.attrs[RULE_ATTR_SERIAL];
+    int n;
+    if (hash->present && !hash->is_set && hash->raw.len) {
+        n = snprintf(out, outsz, "%d h %.*s", target, (int)hash->raw.len, hash->raw.ptr);
+    } else if (id->present && !id->is_set && serial->present && !serial->is_set && serial->raw.len) {
+        n = snprintf(out, outsz, "%d i %.*s s %.*s", target, (int)id->raw.len, id->raw.ptr,
+                     (int)serial->raw.len, serial->raw.ptr);
+    } else {
+        return -1;
+    }
+    return n > 0 && (size_t)n < outsz ? 0 : -1;
+}
+
+UsbGuardRuleCache *usbguard_rule_cache_create(void) {
+    UsbGuardRuleCache *c = calloc(1, sizeof(*c));
+    if (c) pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+static void cache_clear(UsbGuardRuleCache *c) {
+    for (size_t i = 0; i < c->cap; i++) free(c->keys[i]);
+    free(c->keys);
+    free(c->hashes);
+    c->keys = NULL;
+    c->hashes = NULL;
+    c->cap = c->count = 0;
+}
+
+void usbguard_rule_cache_free(UsbGuardRuleCache *c) {
+    if (!c) return;
+    cache_clear(c);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+/* Slot holding key, or the empty slot where it would go. Called with the lock held. */
+static size_t cache_slot(const UsbGuardRuleCache *c, const char *key, uint64_t h) {
+    size_t i = (size_t)h & (c->cap - 1);
+    while (c->keys[i] && (c->hashes[i] != h || strcmp(c->keys[i], key) != 0)) i = (i + 1) & (c->cap - 1);
+    return i;
+}
+
+static int cache_grow(UsbGuardRuleCache *c) {
+    size_t cap = c->cap ? c->cap * 2 : 64;
+    char **keys = calloc(cap, sizeof(*keys));
+    uint64_t *hashes = calloc(cap, sizeof(*hashes));
+    if (!keys || !hashes) {
+        free(keys);
+        free(hashes);
+        return -ENOMEM;
+    }
+    UsbGuardRuleCache grown = { .keys = keys, .hashes = hashes, .cap = cap, .count = c->count };
+    for (size_t i = 0; i < c->cap; i++) {
+        if (!c->keys[i]) continue;
+        size_t j = cache_slot(&grown, c->keys[i], c->hashes[i]);
+        keys[j] = c->keys[i];
+        hashes[j] = c->hashes[i];
+    }
+    free(c->keys);
+    free(c->hashes);
+    c->keys = keys;
+    c->hashes = hashes;
+    c->cap = cap;
+    return 0;
+}
+
+/* Called with the lock held */
+static int cache_insert(UsbGuardRuleCache *c, const char *key) {
+    if ((c->count + 1) * 10 > c->cap * 7 && cache_grow(c) != 0) return -ENOMEM;
+    uint64_t h = key_hash(key);
+    size_t i = cache_slot(c, key, h);
+    if (c->keys[i]) return 0;
+    if (!(c->keys[i] = strdup(key))) return -ENOMEM;
+    c->hashes[i] = h;
+    c->count++;
+    return 0;
+}
+
+static void cache_add(UsbGuardRuleCache *c, int target, const char *rule) {
+    char key[RULE_KEY_MAX];
+    if (!c || rule_key(target, rule, key, sizeof(key)) != 0) return;
+    pthread_mutex_lock(&c->lock);
+    cache_insert(c, key);
+    pthread_mutex_unlock(&c->lock);
+}
+
+int usbguard_rule_cache_contains(UsbGuardRuleCache *c, UsbGuardTarget target, const char *rule) {
+    char key[RULE_KEY_MAX];
+    if (!c || rule_key((int)target, rule, key, sizeof(key)) != 0) return 0;
+    pthread_mutex_lock(&c->lock);
+    int found = c->cap && c->keys[cache_slot(c, key, key_hash(key))] != NULL;
+    pthread_mutex_unlock(&c->lock);
+    return found;
+}
+
+size_t usbguard_rule_cache_size(UsbGuardRuleCache *c) {
+    if (!c) return 0;
+    pthread_mutex_lock(&c->lock);
+    size_t n = c->count;
+    pthread_mutex_unlock(&c->lock);
+    return n;
+}
+
+int usbguard_rule_cache_load(UsbGuardRuleCache *c, UsbGuardClient *client) {
+    if (!c || !client) return -EINVAL;
+    UsbDeviceList *rules = NULL;
+    int rc = usbguard_call_wait_devices(usbguard_client_list_rules_async(client, ""), &rules);
+    if (rc != 0) return rc;
+    pthread_mutex_lock(&c->lock);
+    cache_clear(c);
+    for (size_t i = 0; i < rules->count && rc == 0; i++) {
+        const char *text = usb_info_raw_info(rules->devices[i]);
+        UsbGuardRule r;
+        char key[RULE_KEY_MAX];
+        if (!text || usbguard_rule_parse(text, (size_t)-1, &r) != 0) continue;
+        if (rule_key(r.target_id, text, key, sizeof(key)) == 0) rc = cache_insert(c, key);
+    }
+    pthread_mutex_unlock(&c->lock);
+    usbguard_free_device_list(rules);
+    return rc;
+}
+
+/* ---------- batch ---------- */
+
+typedef struct {
+    UsbGuardCall *call;
+    size_t index;
+} InFlight;
+
+static void batch_complete(UsbGuardRuleCache *cache, const UsbGuardDecision *d, InFlight *f,
+                           UsbGuardDecisionResult *results, UsbGuardBatchStats *st) {
+    UsbGuardDecisionResult *r = &results[f->index];
+    const UsbGuardDecision *dec = &d[f->index];
+    uint32_t rule_id = 0;
+    r->rc = usbguard_call_wait_u32(f->call, &rule_id);
+    f->call = NULL;
+    if (r->rc != 0) {
+        st->failed++;
+        return;
+    }
+    r->rule_id = rule_id;
+    if (dec->permanent && !r->cached) cache_add(cache, (int)dec->target, dec->rule ? dec->rule : dec->device_rule);
+}
+
+int usbguard_apply_batch(UsbGuardClient *client, UsbGuardRuleCache *cache, const UsbGuardDecision *decisions,
+                         size_t count, UsbGuardDecisionResult *results, UsbGuardBatchStats *stats) {
+    UsbGuardBatchStats local;
+    if (!stats) stats = &local;
+    memset(stats, 0, sizeof(*stats));
+    if (!client || (count && (!decisions || !results))) return -EINVAL;
+    double t0 = now_seconds();
+
+    InFlight ring[USBGUARD_BATCH_WINDOW];
+    size_t head = 0, in_flight = 0;
+    for (size_t i = 0; i < count; i++) {
+        const UsbGuardDecision *d = &decisions[i];
+        UsbGuardDecisionResult *r = &results[i];
+        memset(r, 0, sizeof(*r));
+        UsbGuardCall *call;
+        if (d->rule) {
+            if (d->permanent && usbguard_rule_cache_contains(cache, d->target, d->rule)) {
+                r->cached = 1;
+                stats->skipped++;
+                continue;
+            }
+            call = usbguard_client_append_rule_async(client, d->rule, USBGUARD_RULE_LAST_ID, !d->permanent);
+        } else {
+            r->cached = d->permanent && usbguard_rule_cache_contains(cache, d->target, d->device_rule);
+            stats->cached += r->cached != 0;
+            call = usbguard_client_apply_policy_async(client, d->device_id, d->target, d->permanent && !r->cached);
+        }
+        if (!call) {
+            r->rc = -ENOMEM;
+            stats->failed++;
+            continue;
+        }
+        stats->calls++;
+        /* window full: the oldest request has had the longest to complete */
+        if (in_flight == USBGUARD_BATCH_WINDOW) {
+            batch_complete(cache, decisions, &ring[head], results, stats);
+            head = (head + 1) % USBGUARD_BATCH_WINDOW;
+            in_flight--;
+        }
+        ring[(head + in_flight) % USBGUARD_BATCH_WINDOW] = (InFlight){ call, i };
+        if (++in_flight > stats->max_in_flight) stats->max_in_flight = in_flight;
+    }
+    for (; in_flight > 0; in_flight--) {
+        batch_complete(cache, decisions, &ring[head], results, stats);
+        head = (head + 1) % USBGUARD_BATCH_WINDOW;
+    }
+    stats->seconds = now_seconds() - t0;
+    return (int)stats->failed;
+}
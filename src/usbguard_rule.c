@@ -0,0 +1,301 @@
+#include "../inc/usbguard_rule.h"
+#include "../inc/usbguard_interface.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *ATTR_NAMES[RULE_ATTR_COUNT] = {
+    "id", "hash", "parent-hash", "name", "serial", "via-port",
+    "with-interface", "with-connect-type", "label", "if",
+};
+
+static const char *SET_OPERATORS[] = {
+    "all-of", "one-of", "none-of", "equals", "equals-ordered", "match-all", NULL,
+};
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+int strview_eq(StrView v, const char *s) {
+    size_t n = strlen(s);
+    return v.len == n && memcmp(v.ptr, s, n) == 0;
+}
+
+static size_t skip_space(const char *s, size_t i, size_t n) {
+    while (i < n && is_space(s[i])) i++;
+    return i;
+}
+
+/* s[i] == '"'. On success returns the index after the closing quote. */
+static int scan_quoted(const char *s, size_t i, size_t n, StrView *out, int *escaped, size_t *next) {
+    size_t start = ++i;
+    /* values are short: a byte loop beats memchr calls here */
+    while (i < n && s[i] != '"') {
+        if (s[i] == '\\') {
+            if (escaped) *escaped = 1;
+            if (++i >= n) break;
+        }
+        i++;
+    }
+    if (i >= n) return -EINVAL;
+    out->ptr = s + start;
+    out->len = i - start;
+    *next = i + 1;
+    return 0;
+}
+
+/* Character classes for bare tokens */
+enum { CH_WORD = 0, CH_STOP = 1, CH_PAREN = 2 };
+static const unsigned char CHAR_CLASS[256] = {
+    [' '] = CH_STOP, ['\t'] = CH_STOP, ['\n'] = CH_STOP, ['\r'] = CH_STOP,
+    ['{'] = CH_STOP, ['}'] = CH_STOP, ['"'] = CH_STOP, ['('] = CH_PAREN,
+};
+
+/* Bare token: up to whitespace, a brace or a quote; a parenthesised part (conditions)
+ * may contain all of them. */
+static size_t scan_bare(const char *s, size_t i, size_t n) {
+    while (i < n) {
+        unsigned char cls = CHAR_CLASS[(unsigned char)s[i]];
+        if (cls == CH_WORD) { i++; continue; }
+        if (cls == CH_STOP) break;
+        /* '(' ... matching ')' */
+        int depth = 0;
+        while (i < n) {
+            char c = s[i];
+            if (c == '(') depth++;
+            else if (c == ')' && --depth == 0) { i++; break; }
+            else if (c == '"') {
+                StrView tmp;
+                size_t next;
+                if (scan_quoted(s, i, n, &tmp, NULL, &next) != 0) return n;
+                i = next;
+                continue;
+            }
+            i++;
+        }
+    }
+    return i;
+}
+
+static int lookup_attr(StrView w) {
+    /* candidates by keyword length (attribute + 1, 0 = none); at most two share a length */
+    static const unsigned char BY_LEN[18][2] = {
+        [2] = { RULE_ATTR_ID + 1, RULE_ATTR_IF + 1 },
+        [4] = { RULE_ATTR_HASH + 1, RULE_ATTR_NAME + 1 },
+        [5] = { RULE_ATTR_LABEL + 1 },
+        [6] = { RULE_ATTR_SERIAL + 1 },
+        [8] = { RULE_ATTR_VIA_PORT + 1 },
+        [11] = { RULE_ATTR_PARENT_HASH + 1 },
+        [14] = { RULE_ATTR_WITH_INTERFACE + 1 },
+        [17] = { RULE_ATTR_WITH_CONNECT_TYPE + 1 },
+    };
+    if (w.len >= sizeof(BY_LEN) / sizeof(BY_LEN[0])) return -1;
+    for (int k = 0; k < 2 && BY_LEN[w.len][k]; k++) {
+        int a = BY_LEN[w.len][k] - 1;
+        if (memcmp(w.ptr, ATTR_NAMES[a], w.len) == 0) return a;
+    }
+    return -1;
+}
+
+static int is_set_operator(StrView w) {
+    for (const char **op = SET_OPERATORS; *op; op++)
+        if (strview_eq(w, *op)) return 1;
+    return 0;
+}
+
+static int target_of(StrView w) {
+    if (strview_eq(w, "allow")) return USBGUARD_TARGET_ALLOW;
+    if (strview_eq(w, "block")) return USBGUARD_TARGET_BLOCK;
+    if (strview_eq(w, "reject")) return USBGUARD_TARGET_REJECT;
+    if (strview_eq(w, "match") || strview_eq(w, "device")) return -1;
+    return -2;
+}
+
+/* One attribute value starting at s[*i]: word, "string" or [operator] { ... }. */
+static int parse_value(const char *s, size_t *i, size_t n, UsbGuardRuleValue *v) {
+    memset(v, 0, sizeof(*v));
+    size_t p = skip_space(s, *i, n);
+    if (p >= n) return -EINVAL;
+
+    if (s[p] != '{' && s[p] != '"') {
+        size_t end = scan_bare(s, p, n);
+        StrView w = { s + p, end - p };
+        size_t q = skip_space(s, end, n);
+        if (q < n && s[q] == '{' && is_set_operator(w)) {
+            v->op = w;
+            p = q;
+        } else {
+            if (end == p) return -EINVAL;
+            v->raw = w;
+            v->count = 1;
+            v->present = 1;
+            *i = end;
+            return 0;
+        }
+    }
+
+    if (s[p] == '"') {
+        int esc = 0;
+        if (scan_quoted(s, p, n, &v->raw, &esc, i) != 0) return -EINVAL;
+        v->quoted = 1;
+        v->escaped = (uint8_t)esc;
+        v->count = 1;
+        v->present = 1;
+        return 0;
+    }
+
+    /* set: count values up to the closing brace */
+    size_t start = p + 1;
+    p = start;
+    uint16_t count = 0;
+    int esc = 0;
+    for (;;) {
+        p = skip_space(s, p, n);
+        if (p >= n) return -EINVAL;
+        if (s[p] == '}') break;
+        if (s[p] == '{') return -EINVAL;
+        if (s[p] == '"') {
+            StrView tmp;
+            if (scan_quoted(s, p, n, &tmp, &esc, &p) != 0) return -EINVAL;
+        } else {
+            p = scan_bare(s, p, n);
+        }
+        if (count < UINT16_MAX) count++;
+    }
+    v->raw.ptr = s + start;
+    v->raw.len = p - start;
+    v->count = count;
+    v->is_set = 1;
+    v->escaped = (uint8_t)esc;
+    v->present = 1;
+    *i = p + 1;
+    return 0;
+}
+
+int usbguard_rule_parse(const char *rule, size_t len, UsbGuardRule *out) {
+    if (!rule || !out) return -EINVAL;
+    if (len == (size_t)-1) len = strlen(rule);
+    memset(out, 0, sizeof(*out));
+    out->target_id = -1;
+
+    const char *s = rule;
+    size_t n = len, i = skip_space(s, 0, n);
+
+    /* optional target, then an optional bare VID:PID */
+    size_t end = scan_bare(s, i, n);
+    StrView w = { s + i, end - i };
+    int t = target_of(w);
+    if (w.len && t != -2) {
+        out->target = w;
+        out->target_id = t;
+        i = skip_space(s, end, n);
+        end = scan_bare(s, i, n);
+        w.ptr = s + i;
+        w.len = end - i;
+    }
+    if (w.len && lookup_attr(w) < 0 && memchr(w.ptr, ':', w.len)) {
+        UsbGuardRuleValue *v = &out->attrs[RULE_ATTR_ID];
+        v->raw = w;
+        v->count = 1;
+        v->present = 1;
+        i = end;
+    }
+
+    for (;;) {
+        i = skip_space(s, i, n);
+        if (i >= n) return 0;
+        end = scan_bare(s, i, n);
+        w.ptr = s + i;
+        w.len = end - i;
+        int a = lookup_attr(w);
+        if (a < 0) {
+            out->error_pos = i;
+            return -EINVAL;
+        }
+        size_t at = end;
+        if (parse_value(s, &at, n, &out->attrs[a]) != 0) {
+            out->error_pos = i;
+            return -EINVAL;
+        }
+        i = at;
+    }
+}
+
+int usbguard_rule_next_value(const UsbGuardRuleValue *v, size_t *pos, StrView *item) {
+    if (!v || !pos || !item || !v->present) return 0;
+    if (!v->is_set) {
+        if (*pos) return 0;
+        *item = v->raw;
+        *pos = v->raw.len + 1;
+        return 1;
+    }
+    const char *s = v->raw.ptr;
+    size_t n = v->raw.len;
+    size_t p = skip_space(s, *pos, n);
+    if (p >= n) {
+        *pos = n;
+        return 0;
+    }
+    if (s[p] == '"') {
+        if (scan_quoted(s, p, n, item, NULL, pos) != 0) return 0;
+    } else {
+        size_t end = scan_bare(s, p, n);
+        item->ptr = s + p;
+        item->len = end - p;
+        *pos = end;
+    }
+    return 1;
+}
+
+const char *usbguard_rule_attr_name(UsbGuardRuleAttr attr) {
+    return attr < RULE_ATTR_COUNT ? ATTR_NAMES[attr] : "unknown";
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+size_t strview_unescape(StrView v, char *out, size_t outsz) {
+    size_t o = 0;
+    for (size_t i = 0; i < v.len; i++) {
+        char c = v.ptr[i];
+        if (c == '\\' && i + 1 < v.len) {
+            char e = v.ptr[++i];
+            switch (e) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'a': c = '\a'; break;
+            case 'x':
+                if (i + 2 < v.len && hex_digit(v.ptr[i + 1]) >= 0 && hex_digit(v.ptr[i + 2]) >= 0) {
+                    c = (char)(hex_digit(v.ptr[i + 1]) * 16 + hex_digit(v.ptr[i + 2]));
+                    i += 2;
+                } else {
+                    c = 'x';
+                }
+                break;
+            default: c = e; break;      /* \" \\ and anything unknown */
+            }
+        }
+        if (out && o + 1 < outsz) out[o] = c;
+        o++;
+    }
+    if (out && outsz) out[o < outsz ? o : outsz - 1] = '\0';
+    return o;
+}
+
+char *strview_dup(StrView v, int unescape) {
+    char *s = malloc(v.len + 1);
+    if (!s) return NULL;
+    if (unescape) {
+        strview_unescape(v, s, v.len + 1);
+    } else {
+        memcpy(s, v.ptr, v.len);
+        s[v.len] = '\0';
+    }
+    return s;
+}
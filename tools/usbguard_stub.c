@@ -0,0 +1,302 @@
+// Stand-in for the USBGuard daemon, for running the D-Bus code paths without root or
+// real devices. Serves org.usbguard.Devices1 (listDevices, applyDevicePolicy) and
+// org.usbguard.Policy1 (listRules, appendRule, removeRule) under org.usbguard1 and emits
+// DevicePresenceChanged / DevicePolicyChanged like the daemon. A permanent
+// applyDevicePolicy appends "<target> <device rule>" to the in-memory rule set.
+// Devices are plugged and unplugged through an extra interface:
+//   org.usbguard.Stub1.insert(s rule_without_target) -> u id   (target: block)
+//   org.usbguard.Stub1.remove(u id)
+//
+// Usage: usbguard_stub [--devices N] [--bus-name NAME]
+// --bus-name org.usbguard plays a daemon that only owns the fallback name.
+// Connects to $USBGUARD_DBUS_ADDRESS, or the session bus. See usbguard_stub_session.sh.
+#include "usbguard_interface.h"
+#include <dbus/dbus.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STUB_IFACE "org.usbguard.Stub1"
+
+typedef struct {
+    dbus_uint32_t id;
+    dbus_uint32_t target;
+    char *rule;             // without the leading target keyword
+} StubDevice;
+
+typedef struct {
+    dbus_uint32_t id;
+    char *rule;             // with the target keyword
+} StubRule;
+
+static StubDevice *g_devs;
+static size_t g_count, g_cap;
+static dbus_uint32_t g_next_id = 1;
+
+static StubRule *g_rules;
+static size_t g_rule_count, g_rule_cap;
+static dbus_uint32_t g_next_rule_id = 1;
+
+static const char *target_word(dbus_uint32_t t) {
+    return t == USBGUARD_TARGET_ALLOW ? "allow" : t == USBGUARD_TARGET_REJECT ? "reject" : "block";
+}
+
+static StubDevice *find_dev(dbus_uint32_t id) {
+    for (size_t i = 0; i < g_count; i++)
+        if (g_devs[i].id == id) return &g_devs[i];
+    return NULL;
+}
+
+static char *full_rule(const StubDevice *d) {
+    size_t n = strlen(d->rule) + 16;
+    char *s = malloc(n);
+    if (s) snprintf(s, n, "%s %s", target_word(d->target), d->rule);
+    return s;
+}
+
+static StubDevice *add_dev(const char *rule) {
+    if (g_count == g_cap) {
+        size_t cap = g_cap ? g_cap * 2 : 64;
+        StubDevice *n = realloc(g_devs, cap * sizeof(StubDevice));
+        if (!n) return NULL;
+        g_devs = n;
+        g_cap = cap;
+    }
+    StubDevice *d = &g_devs[g_count++];
+    d->id = g_next_id++;
+    d->target = USBGUARD_TARGET_BLOCK;
+    d->rule = strdup(rule);
+    return d;
+}
+
+// Takes ownership of rule. Returns the new rule id, 0 on failure.
+static dbus_uint32_t add_rule(char *rule) {
+    if (!rule) return 0;
+    if (g_rule_count == g_rule_cap) {
+        size_t cap = g_rule_cap ? g_rule_cap * 2 : 64;
+        StubRule *n = realloc(g_rules, cap * sizeof(StubRule));
+        if (!n) {
+            free(rule);
+            return 0;
+        }
+        g_rules = n;
+        g_rule_cap = cap;
+    }
+    StubRule *r = &g_rules[g_rule_count++];
+    r->id = g_next_rule_id++;
+    r->rule = rule;
+    return r->id;
+}
+
+static void append_empty_attrs(DBusMessageIter *it) {
+    DBusMessageIter dict;
+    dbus_message_iter_open_container(it, DBUS_TYPE_ARRAY, "{ss}", &dict);
+    dbus_message_iter_close_container(it, &dict);
+}
+
+static void emit_presence(DBusConnection *conn, const StubDevice *d, dbus_uint32_t event) {
+    DBusMessage *sig = dbus_message_new_signal(USBGUARD_DEVICES_PATH, USBGUARD_DEVICES_IFACE,
+                                               "DevicePresenceChanged");
+    char *rule = full_rule(d);
+    if (!sig || !rule) goto out;
+    DBusMessageIter it;
+    dbus_message_iter_init_append(sig, &it);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &d->id);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &event);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &d->target);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_STRING, &rule);
+    append_empty_attrs(&it);
+    dbus_connection_send(conn, sig, NULL);
+out:
+    free(rule);
+    if (sig) dbus_message_unref(sig);
+}
+
+static void emit_policy(DBusConnection *conn, const StubDevice *d, dbus_uint32_t old_target) {
+    DBusMessage *sig = dbus_message_new_signal(USBGUARD_DEVICES_PATH, USBGUARD_DEVICES_IFACE,
+                                               "DevicePolicyChanged");
+    char *rule = full_rule(d);
+    dbus_uint32_t rule_id = 0;
+    if (!sig || !rule) goto out;
+    DBusMessageIter it;
+    dbus_message_iter_init_append(sig, &it);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &d->id);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &old_target);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &d->target);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_STRING, &rule);
+    dbus_message_iter_append_basic(&it, DBUS_TYPE_UINT32, &rule_id);
+    append_empty_attrs(&it);
+    dbus_connection_send(conn, sig, NULL);
+out:
+    free(rule);
+    if (sig) dbus_message_unref(sig);
+}
+
+static DBusMessage *list_devices(DBusMessage *msg) {
+    const char *query = "";
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &query, DBUS_TYPE_INVALID))
+        return dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, "listDevices(s)");
+    int only = -1;
+    if (strcmp(query, "allow") == 0) only = USBGUARD_TARGET_ALLOW;
+    else if (strcmp(query, "block") == 0) only = USBGUARD_TARGET_BLOCK;
+    else if (strcmp(query, "reject") == 0) only = USBGUARD_TARGET_REJECT;
+
+    DBusMessage *reply = dbus_message_new_method_return(msg);
+    DBusMessageIter it, arr, st;
+    dbus_message_iter_init_append(reply, &it);
+    dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "(us)", &arr);
+    for (size_t i = 0; i < g_count; i++) {
+        if (only >= 0 && g_devs[i].target != (dbus_uint32_t)only) continue;
+        char *rule = full_rule(&g_devs[i]);
+        if (!rule) continue;
+        dbus_message_iter_open_container(&arr, DBUS_TYPE_STRUCT, NULL, &st);
+        dbus_message_iter_append_basic(&st, DBUS_TYPE_UINT32, &g_devs[i].id);
+        dbus_message_iter_append_basic(&st, DBUS_TYPE_STRING, &rule);
+        dbus_message_iter_close_container(&arr, &st);
+        free(rule);
+    }
+    dbus_message_iter_close_container(&it, &arr);
+    return reply;
+}
+
+static DBusMessage *list_rules(DBusMessage *msg) {
+    const char *label = "";
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &label, DBUS_TYPE_INVALID))
+        return dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, "listRules(s)");
+    DBusMessage *reply = dbus_message_new_method_return(msg);
+    DBusMessageIter it, arr, st;
+    dbus_message_iter_init_append(reply, &it);
+    dbus_message_iter_open_container(&it, DBUS_TYPE_ARRAY, "(us)", &arr);
+    for (size_t i = 0; i < g_rule_count; i++) {
+        dbus_message_iter_open_container(&arr, DBUS_TYPE_STRUCT, NULL, &st);
+        dbus_message_iter_append_basic(&st, DBUS_TYPE_UINT32, &g_rules[i].id);
+        dbus_message_iter_append_basic(&st, DBUS_TYPE_STRING, &g_rules[i].rule);
+        dbus_message_iter_close_container(&arr, &st);
+    }
+    dbus_message_iter_close_container(&it, &arr);
+    return reply;
+}
+
+static DBusHandlerResult handle(DBusConnection *conn, DBusMessage *msg, void *data) {
+    (void)data;
+    DBusMessage *reply = NULL;
+    dbus_uint32_t id = 0, target = 0;
+    dbus_bool_t permanent = FALSE;
+    const char *rule = NULL;
+
+    if (dbus_message_is_method_call(msg, USBGUARD_DEVICES_IFACE, "listDevices")) {
+        reply = list_devices(msg);
+    } else if (dbus_message_is_method_call(msg, USBGUARD_DEVICES_IFACE, "applyDevicePolicy")) {
+        StubDevice *d = NULL;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &id, DBUS_TYPE_UINT32, &target,
+                                   DBUS_TYPE_BOOLEAN, &permanent, DBUS_TYPE_INVALID) || target > 2) {
+            reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, "applyDevicePolicy(uub)");
+        } else if (!(d = find_dev(id))) {
+            reply = dbus_message_new_error(msg, "org.usbguard.Exception", "unknown device id");
+        } else {
+            dbus_uint32_t old = d->target;
+            d->target = target;
+            if (old != target) emit_policy(conn, d, old);
+            dbus_uint32_t rule_id = permanent ? add_rule(full_rule(d)) : 0;
+            reply = dbus_message_new_method_return(msg);
+            dbus_message_append_args(reply, DBUS_TYPE_UINT32, &rule_id, DBUS_TYPE_INVALID);
+        }
+    } else if (dbus_message_is_method_call(msg, USBGUARD_POLICY_IFACE, "listRules")) {
+        reply = list_rules(msg);
+    } else if (dbus_message_is_method_call(msg, USBGUARD_POLICY_IFACE, "appendRule")) {
+        dbus_uint32_t parent = 0, rule_id = 0;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &rule, DBUS_TYPE_UINT32, &parent,
+                                   DBUS_TYPE_BOOLEAN, &permanent, DBUS_TYPE_INVALID) || !*rule ||
+            !(rule_id = add_rule(strdup(rule)))) {
+            reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, "appendRule(sub)");
+        } else {
+            reply = dbus_message_new_method_return(msg);
+            dbus_message_append_args(reply, DBUS_TYPE_UINT32, &rule_id, DBUS_TYPE_INVALID);
+        }
+    } else if (dbus_message_is_method_call(msg, USBGUARD_POLICY_IFACE, "removeRule")) {
+        size_t i = 0;
+        if (dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &id, DBUS_TYPE_INVALID))
+            while (i < g_rule_count && g_rules[i].id != id) i++;
+        if (i == g_rule_count) {
+            reply = dbus_message_new_error(msg, "org.usbguard.Exception", "unknown rule id");
+        } else {
+            free(g_rules[i].rule);
+            memmove(&g_rules[i], &g_rules[i + 1], (g_rule_count - i - 1) * sizeof(StubRule));
+            g_rule_count--;
+            reply = dbus_message_new_method_return(msg);
+        }
+    } else if (dbus_message_is_method_call(msg, STUB_IFACE, "insert")) {
+        StubDevice *d;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &rule, DBUS_TYPE_INVALID) || !(d = add_dev(rule))) {
+            reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, "insert(s)");
+        } else {
+            emit_presence(conn, d, 1);
+            reply = dbus_message_new_method_return(msg);
+            dbus_message_append_args(reply, DBUS_TYPE_UINT32, &d->id, DBUS_TYPE_INVALID);
+        }
+    } else if (dbus_message_is_method_call(msg, STUB_IFACE, "remove")) {
+        StubDevice *d = NULL;
+        if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_UINT32, &id, DBUS_TYPE_INVALID) || !(d = find_dev(id))) {
+            reply = dbus_message_new_error(msg, "org.usbguard.Exception", "unknown device id");
+        } else {
+            emit_presence(conn, d, 3);
+            free(d->rule);
+            *d = g_devs[--g_count];
+            reply = dbus_message_new_method_return(msg);
+        }
+    } else {
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
+
+    if (reply) {
+        dbus_connection_send(conn, reply, NULL);
+        dbus_message_unref(reply);
+    }
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+int main(int argc, char *argv[]) {
+    size_t seed = 0;
+    const char *bus_name = USBGUARD_BUS_NAME;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--devices") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--bus-name") == 0 && i + 1 < argc) {
+            bus_name = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--devices N] [--bus-name NAME]\n", argv[0]);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < seed; i++) {
+        char rule[192];
+        snprintf(rule, sizeof(rule),
+                 "id 0781:5567 serial \"STUB%06zu\" name \"Stub Flash\" hash \"stub%06zu\" "
+                 "parent-hash \"stub-hub\" via-port \"1-%zu\" with-interface 08:06:50", i, i, i % 8 + 1);
+        add_dev(rule);
+    }
+
+    DBusError err;
+    dbus_error_init(&err);
+    const char *addr = usbguard_bus_address();
+    DBusConnection *conn = addr ? dbus_connection_open_private(addr, &err) : dbus_bus_get(DBUS_BUS_SESSION, &err);
+    if (conn && addr && !dbus_bus_register(conn, &err)) conn = NULL;
+    if (!conn) {
+        fprintf(stderr, "usbguard_stub: cannot connect: %s\n", dbus_error_is_set(&err) ? err.message : "?");
+        return 1;
+    }
+    if (dbus_bus_request_name(conn, bus_name, DBUS_NAME_FLAG_DO_NOT_QUEUE, &err) !=
+        DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+        fprintf(stderr, "usbguard_stub: cannot own %s\n", bus_name);
+        return 1;
+    }
+    DBusObjectPathVTable vt = { .message_function = handle };
+    if (!dbus_connection_register_object_path(conn, USBGUARD_DEVICES_PATH, &vt, NULL) ||
+        !dbus_connection_register_object_path(conn, USBGUARD_POLICY_PATH, &vt, NULL))
+        return 1;
+
+    fprintf(stderr, "usbguard_stub: serving %zu device(s) as %s\n", g_count, bus_name);
+    while (dbus_connection_read_write_dispatch(conn, -1))
+        ;
+    return 0;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Run a command against the USBGuard stand-in on a private session bus.
+#   tools/usbguard_stub_session.sh [--devices N] [--bus-name NAME] -- <command> [args...]
+# The command sees USBGUARD_DBUS_ADDRESS pointing at that bus. Build the stub with `make tools`.
+set -e
+
+STUB_ARGS=""
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    STUB_ARGS="$STUB_ARGS $1"
+    shift
+done
+[ "$1" = "--" ] && shift
+if [ $# -eq 0 ]; then
+    echo "Usage: $0 [--devices N] [--bus-name NAME] -- <command> [args...]" >&2
+    exit 1
+fi
+
+STUB="$(dirname "$0")/../build/tools/usbguard_stub"
+if [ ! -x "$STUB" ]; then
+    echo "Missing $STUB (run: make tools)" >&2
+    exit 1
+fi
+
+export STUB STUB_ARGS
+exec dbus-run-session -- sh -c '
+    export USBGUARD_DBUS_ADDRESS="$DBUS_SESSION_BUS_ADDRESS"
+    "$STUB" $STUB_ARGS &
+    stub_pid=$!
+    trap "kill $stub_pid 2>/dev/null" EXIT
+    # wait until the stub owns its bus name
+    i=0
+    owned() {
+        dbus-send --session --print-reply --dest=org.freedesktop.DBus / \
+            org.freedesktop.DBus.NameHasOwner "string:$1" 2>/dev/null | grep -q "boolean true"
+    }
+    until owned org.usbguard1 || owned org.usbguard; do
+        i=$((i + 1))
+        [ $i -gt 100 ] && { echo "usbguard_stub did not start" >&2; exit 1; }
+        sleep 0.05
+    done
+    "$@"
+' sh "$@"
@@ -5,18 +5,29 @@
 # HỖ TRỢ NVMe/mmcblk naming.
 #
 # Usage:
-#   sudo ./usb_write_raw_sig.sh /dev/sdX /path/to/signature.pem [--format-data]
+#   sudo ./usb_write_raw_sig.sh /dev/sdX /path/to/signature.pem [--format-data] [--yes]
+#
+#   --yes  skip the interactive confirmation (used by station mode, which runs
+#          several instances in parallel and cannot share stdin)
 #
 set -euo pipefail
 
-if [[ $# -lt 2 || $# -gt 3 ]]; then
-  echo "Usage: sudo $0 <device> <signature_pem> [--format-data]"
+if [[ $# -lt 2 || $# -gt 4 ]]; then
+  echo "Usage: sudo $0 <device> <signature_pem> [--format-data] [--yes]"
   exit 1
 fi
 
 DEV="$1"
 SIG="$2"
-FORMAT_DATA="${3:-}"
+FORMAT_DATA=""
+ASSUME_YES=""
+for opt in "${@:3}"; do
+  case "$opt" in
+    --format-data) FORMAT_DATA="--format-data" ;;
+    --yes) ASSUME_YES="--yes" ;;
+    *) echo "Unknown option: $opt"; exit 1 ;;
+  esac
+done
 
 # Check root
 if [[ "$EUID" -ne 0 ]]; then
@@ -37,10 +48,12 @@ fi
 # Confirm device
 echo "About to wipe and partition device: $DEV"
 lsblk "$DEV"
-read -p "Type the device path to CONFIRM (e.g. $DEV): " CONF
-if [[ "$CONF" != "$DEV" ]]; then
-  echo "Confirmation mismatch. Abort."
-  exit 5
+if [[ "$ASSUME_YES" != "--yes" ]]; then
+  read -p "Type the device path to CONFIRM (e.g. $DEV): " CONF
+  if [[ "$CONF" != "$DEV" ]]; then
+    echo "Confirmation mismatch. Abort."
+    exit 5
+  fi
 fi
 
 # ==== NEW: Unmount all existing partitions of the device ====
@@ -50,9 +63,9 @@ for p in $(lsblk -ln -o NAME "$DEV" | tail -n +2); do
 done
 sync
 
-# Resolve partition names depending on device type (nvme/mmcblk need 'p' before number)
+# Resolve partition names depending on device type (nvme/mmcblk/loop need 'p' before number)
 base=$(basename "$DEV")
-if [[ "$base" == nvme* || "$base" == mmcblk* ]]; then
+if [[ "$base" == nvme* || "$base" == mmcblk* || "$base" == loop* ]]; then
   P1="${DEV}p1"
   P2="${DEV}p2"
 else